@@ -1,5 +1,48 @@
 #include "database.hpp"
+#include "profiler.hpp"
+#include "schema_catalog.hpp"
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <strings.h>
+
+namespace {
+
+// замер фаз одного запроса; без профилировщика ничего не делает
+class QueryTimer {
+    public:
+        QueryTimer(Profiler *profiler, const char *sql)
+            : profiler(profiler) {
+            if (!profiler)
+                return;
+            profile.sql = sql ? sql : "";
+            profile.start = last = profiler->now();
+        }
+
+        // время с предыдущей отметки относится к фазе phase
+        void lap(uint64_t QueryProfile::*phase) {
+            if (!profiler)
+                return;
+            uint64_t now = profiler->now();
+            profile.*phase += now - last;
+            last = now;
+        }
+
+        void finish(uint64_t rows, uint64_t bytes) {
+            if (!profiler)
+                return;
+            profile.rows = rows;
+            profile.bytes = bytes;
+            profiler->query(std::move(profile));
+        }
+
+    private:
+        Profiler *profiler;
+        QueryProfile profile;
+        uint64_t last = 0;
+};
+
+} // namespace
 
 Database::Database()
     : db(nullptr),
@@ -7,21 +50,84 @@ Database::Database()
 
 Database::~Database() { close(); }
 
-bool Database::open(const std::string &path) {
+bool Database::open(const std::string &path, OpenProfile openProfile) {
     if (is_open)
         close();
 
-    int rc = sqlite3_open(path.c_str(), &db);
+    std::string name = path;
+    int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    if (openProfile == OpenProfile::ReadOnly ||
+        openProfile == OpenProfile::Snapshot) {
+        // immutable: SQLite не берёт блокировки и не проверяет изменения
+        // файла, поэтому открытие не зависит от размера базы
+        name = fileUri(path) + "?immutable=1";
+        flags = SQLITE_OPEN_READONLY | SQLITE_OPEN_URI;
+    } else if (openProfile == OpenProfile::Reader) {
+        flags = SQLITE_OPEN_READONLY;
+    }
+
+    std::lock_guard<std::mutex> lock(handle_mutex);
+    int rc = sqlite3_open_v2(name.c_str(), &db, flags, nullptr);
     if (rc != SQLITE_OK) {
         std::cerr << "Can't open database: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close(db);
+        db = nullptr;
         return false;
     }
 
+    if (progress_handler)
+        sqlite3_progress_handler(db, progress_period, progressCallback, this);
+    if (profiler)
+        sqlite3_trace_v2(db, SQLITE_TRACE_PROFILE, traceCallback, this);
+
     is_open = true;
+    profile = openProfile;
+
+    // mmap_size ограничен SQLITE_MAX_MMAP_SIZE сборки, лишнее отбрасывается
+    const char *pragmas = "";
+    switch (profile) {
+    case OpenProfile::ReadOnly:
+    case OpenProfile::Snapshot:
+        pragmas = "PRAGMA query_only = ON;"
+                  "PRAGMA mmap_size = 274877906944;"
+                  "PRAGMA cache_size = -65536;"
+                  "PRAGMA temp_store = MEMORY;";
+        break;
+    case OpenProfile::Editing:
+        pragmas = "PRAGMA journal_mode = WAL;"
+                  "PRAGMA synchronous = NORMAL;"
+                  "PRAGMA mmap_size = 268435456;"
+                  "PRAGMA cache_size = -65536;"
+                  "PRAGMA temp_store = MEMORY;"
+                  "PRAGMA busy_timeout = 5000;";
+        break;
+    case OpenProfile::BulkLoad:
+        pragmas = "PRAGMA journal_mode = MEMORY;"
+                  "PRAGMA synchronous = OFF;"
+                  "PRAGMA locking_mode = EXCLUSIVE;"
+                  "PRAGMA cache_size = -262144;"
+                  "PRAGMA temp_store = MEMORY;";
+        break;
+    case OpenProfile::Reader:
+        pragmas = "PRAGMA query_only = ON;"
+                  "PRAGMA mmap_size = 274877906944;"
+                  "PRAGMA cache_size = -16384;"
+                  "PRAGMA temp_store = MEMORY;";
+        break;
+    case OpenProfile::Default:
+        break;
+    }
+    sqlite3_exec(db, pragmas, nullptr, nullptr, nullptr);
     return true;
 }
 
 void Database::close() {
+    clearStatementCache();
+    schema_catalog.reset();
+    sqlite3_finalize(schema_version_stmt);
+    schema_version_stmt = nullptr;
+
+    std::lock_guard<std::mutex> lock(handle_mutex);
     if (db) {
         sqlite3_close(db);
         db = nullptr;
@@ -31,6 +137,102 @@ void Database::close() {
 
 bool Database::isOpen() const { return is_open; }
 
+bool Database::isReadOnly() const {
+    return is_open && sqlite3_db_readonly(db, "main") == 1;
+}
+
+OpenProfile Database::openProfile() const { return profile; }
+
+const char *Database::profileName(OpenProfile profile) {
+    switch (profile) {
+    case OpenProfile::ReadOnly:
+        return "readonly";
+    case OpenProfile::Editing:
+        return "editing";
+    case OpenProfile::BulkLoad:
+        return "bulkload";
+    case OpenProfile::Snapshot:
+        return "snapshot";
+    case OpenProfile::Reader:
+        return "reader";
+    default:
+        return "default";
+    }
+}
+
+bool Database::parseProfile(const std::string &name, OpenProfile &profile) {
+    if (name.empty())
+        return false;
+
+    for (auto candidate : {OpenProfile::Default, OpenProfile::ReadOnly,
+                           OpenProfile::Editing, OpenProfile::BulkLoad,
+                           OpenProfile::Snapshot}) {
+        const char *full = profileName(candidate);
+        if (name.size() <= strlen(full) &&
+            strncasecmp(name.c_str(), full, name.size()) == 0) {
+            profile = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// путь в виде file: URI; %, ? и # иначе были бы разобраны как часть URI
+std::string Database::fileUri(const std::string &path) {
+    std::string uri = "file:";
+    for (char c : path) {
+        if (c == '%' || c == '?' || c == '#') {
+            char escape[4];
+            snprintf(escape, sizeof(escape), "%%%02X", (unsigned char)c);
+            uri += escape;
+        } else {
+            uri += c;
+        }
+    }
+    return uri;
+}
+
+void Database::interrupt() {
+    std::lock_guard<std::mutex> lock(handle_mutex);
+    if (db)
+        sqlite3_interrupt(db);
+}
+
+void Database::setProgressHandler(int period, std::function<bool()> handler) {
+    progress_period = period;
+    progress_handler = std::move(handler);
+    if (db)
+        sqlite3_progress_handler(db, period,
+                                 progress_handler ? progressCallback : nullptr,
+                                 this);
+}
+
+int Database::progressCallback(void *context) {
+    auto *self = static_cast<Database *>(context);
+    return self->progress_handler() ? 1 : 0;
+}
+
+void Database::setProfiler(Profiler *profiler) {
+    this->profiler = profiler;
+    if (db)
+        sqlite3_trace_v2(db, profiler ? SQLITE_TRACE_PROFILE : 0,
+                         profiler ? traceCallback : nullptr, this);
+}
+
+int Database::traceCallback(unsigned type, void *context, void *p, void *x) {
+    auto *self = static_cast<Database *>(context);
+    if (type == SQLITE_TRACE_PROFILE && self->activeProfiler())
+        self->profiler->statement(sqlite3_sql((sqlite3_stmt *)p),
+                                  *(sqlite3_int64 *)x);
+    return 0;
+}
+
+Profiler *Database::activeProfiler() const {
+    return profiler && profiler->enabled.load(std::memory_order_relaxed)
+               ? profiler
+               : nullptr;
+}
+
 bool Database::execute(const std::string &sql) {
     if (!is_open)
         return false;
@@ -47,155 +249,528 @@ bool Database::execute(const std::string &sql) {
     return true;
 }
 
+sqlite3_stmt *Database::prepareCached(const std::string &sql) {
+    if (!is_open)
+        return nullptr;
+
+    CachedStatement *cached = cachedStatement(sql, "", {});
+    return cached ? cached->stmt : nullptr;
+}
+
+bool Database::prepare(const char *sql, sqlite3_stmt **stmt,
+                       const char **tail) {
+    *stmt = nullptr;
+    if (!is_open)
+        return false;
+    return sqlite3_prepare_v2(db, sql, -1, stmt, tail) == SQLITE_OK;
+}
+
+std::string Database::errorMessage() const {
+    return db ? sqlite3_errmsg(db) : "database is not open";
+}
+
+bool Database::inTransaction() const {
+    return is_open && !sqlite3_get_autocommit(db);
+}
+
 bool Database::beginTransaction() { return execute("BEGIN TRANSACTION;"); }
 
 bool Database::commitTransaction() { return execute("COMMIT;"); }
 
-bool Database::rollbackTransaction() { return execute("ROLLBACK;"); }
+// после отката schema_version возвращается к прежнему значению и может
+// совпасть с номером уже другой схемы, поэтому кэши сбрасываются
+bool Database::rollbackTransaction() {
+    clearStatementCache();
+    schema_catalog.reset();
+    return execute("ROLLBACK;");
+}
 
-std::vector<std::map<std::string, std::string>>
-Database::query(const std::string &sql) {
-    std::vector<std::map<std::string, std::string>> result;
+ResultSet Database::query(const std::string &sql) { return query(sql, {}); }
 
+ResultSet Database::query(const std::string &sql,
+                          const std::vector<Value> &params,
+                          size_t largeCells,
+                          const std::vector<int> &sizeColumns) {
     if (!is_open)
-        return result;
+        return ResultSet();
 
+    QueryTimer timer(activeProfiler(), sql.c_str());
     sqlite3_stmt *stmt;
     if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
-        return result;
+        std::cerr << "SQL error: " << sqlite3_errmsg(db) << std::endl;
+        return ResultSet();
     }
 
-    int cols = sqlite3_column_count(stmt);
-
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        std::map<std::string, std::string> row;
-        for (int i = 0; i < cols; ++i) {
-            const char *colName = sqlite3_column_name(stmt, i);
-            const char *colValue = (const char *)sqlite3_column_text(stmt, i);
+    for (size_t i = 0; i < params.size(); ++i) {
+        params[i].bind(stmt, (int)i + 1);
+    }
+    timer.lap(&QueryProfile::prepareUs);
+
+    ResultSet result(stmt, sizeColumns);
+    result.setLargeCellLimit(largeCells);
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        timer.lap(&QueryProfile::stepUs);
+        result.appendRow(stmt);
+        timer.lap(&QueryProfile::materializeUs);
+    }
+    timer.lap(&QueryProfile::stepUs);
 
-            if (colName && colValue) {
-                row[colName] = colValue;
-            } else if (colName) {
-                row[colName] = "";
-            }
-        }
-        result.push_back(row);
+    if (rc != SQLITE_DONE) {
+        std::cerr << "SQL error: " << sqlite3_errmsg(db) << std::endl;
+        result = ResultSet();
     }
 
     sqlite3_finalize(stmt);
+    timer.finish(result.rowCount(), result.memoryUsage());
     return result;
 }
 
-std::vector<ColumnInfo> Database::getTableInfo(const std::string &tableName) {
-    std::vector<ColumnInfo> columns;
-
+bool Database::stream(const std::string &sql, const std::vector<Value> &params,
+                      const std::function<bool(sqlite3_stmt *)> &onRow) {
     if (!is_open)
-        return columns;
+        return false;
 
-    std::string sql = "PRAGMA table_info(" + tableName + ");";
-    auto rows = query(sql);
+    QueryTimer timer(activeProfiler(), sql.c_str());
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL error: " << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
 
-    for (const auto &row : rows) {
-        ColumnInfo col;
-        col.name = row.at("name");
-        col.type = row.at("type");
-        col.not_null = (row.count("notnull") && row.at("notnull") == "1");
-        col.primary_key = (row.count("pk") && row.at("pk") == "1");
-        columns.push_back(col);
+    for (size_t i = 0; i < params.size(); ++i) {
+        params[i].bind(stmt, (int)i + 1);
     }
+    timer.lap(&QueryProfile::prepareUs);
+
+    // время обработчика строк считается переносом
+    int rc;
+    uint64_t rows = 0;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        timer.lap(&QueryProfile::stepUs);
+        ++rows;
+        bool more = onRow(stmt);
+        timer.lap(&QueryProfile::materializeUs);
+        if (!more) {
+            rc = SQLITE_DONE;
+            break;
+        }
+    }
+    timer.lap(&QueryProfile::stepUs);
+    timer.finish(rows, 0);
 
-    return columns;
-}
+    if (rc != SQLITE_DONE)
+        std::cerr << "SQL error: " << sqlite3_errmsg(db) << std::endl;
 
-std::vector<std::string> Database::getTables() {
-    std::vector<std::string> tables;
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE;
+}
 
+std::shared_ptr<const SchemaCatalog> Database::catalog() {
     if (!is_open)
-        return tables;
+        return std::make_shared<SchemaCatalog>();
 
-    auto rows = query("SELECT name FROM sqlite_master WHERE type='table';");
+    int version = schemaVersion();
+    if (!schema_catalog || schema_catalog->version != version)
+        schema_catalog = SchemaCatalog::load(*this, version);
+    return schema_catalog;
+}
 
-    for (const auto &row : rows) {
-        tables.push_back(row.at("name"));
-    }
+std::vector<ColumnInfo> Database::getTableInfo(const std::string &tableName) {
+    auto schema = catalog();
+    const TableSchema *table = schema->find(tableName);
+    return table ? table->columns : std::vector<ColumnInfo>();
+}
 
+std::vector<std::string> Database::getTables() {
+    std::vector<std::string> tables;
+    for (const auto &table : catalog()->tables) {
+        tables.push_back(table.name);
+    }
     return tables;
 }
 
 std::vector<std::string>
 Database::getTableColumns(const std::string &tableName) {
     std::vector<std::string> columns;
-
-    if (!is_open)
-        return columns;
-
-    auto infos = getTableInfo(tableName);
-    for (const auto &info : infos) {
+    for (const auto &info : getTableInfo(tableName)) {
         columns.push_back(info.name);
     }
-
     return columns;
 }
 
+// WITHOUT ROWID таблицы не компилируют обращение к rowid
+bool Database::hasRowid(const std::string &tableName) {
+    auto schema = catalog();
+    const TableSchema *table = schema->find(tableName);
+    return table && !table->withoutRowid;
+}
+
+std::vector<std::string> Database::rowKeyColumns(const std::string &tableName) {
+    auto schema = catalog();
+    const TableSchema *table = schema->find(tableName);
+    if (!table)
+        return {};
+    if (!table->withoutRowid)
+        return {"rowid"};
+    return table->primaryKey;
+}
+
+bool Database::rowidRange(const std::string &tableName, int64_t &first,
+                          int64_t &last) {
+    if (!hasRowid(tableName))
+        return false;
+
+    auto range = query("SELECT min(rowid), max(rowid) FROM " +
+                       quoteIdentifier(tableName) + ";");
+    if (range.empty() || range.isNull(0, 0))
+        return false;
+    first = range.getInt(0, 0);
+    last = range.getInt(0, 1);
+    return true;
+}
+
 bool Database::addRecord(const std::string &tableName,
-                         const std::map<std::string, std::string> &values) {
+                         const std::map<std::string, std::string> &values,
+                         const std::string &returning, ResultSet *changed) {
     if (!is_open || values.empty())
         return false;
 
-    std::string sql = "INSERT INTO " + tableName + " (";
-    std::string valuesPart = ") VALUES (";
+    std::vector<std::string> cols;
+    std::vector<std::string> texts;
+    for (const auto &pair : values) {
+        cols.push_back(pair.first);
+        texts.push_back(pair.second);
+    }
+
+    CachedStatement *cached =
+        cachedStatement(insertSql(tableName, cols, returning), tableName, cols);
+    return cached && runCached(*cached, texts, {}, changed);
+}
 
-    bool first = true;
+bool Database::addRecord(const std::string &tableName,
+                         const std::map<std::string, Value> &values,
+                         const std::string &returning, ResultSet *changed) {
+    if (!is_open || values.empty())
+        return false;
+
+    std::vector<std::string> cols;
+    std::vector<Value> params;
     for (const auto &pair : values) {
-        if (!first) {
-            sql += ", ";
-            valuesPart += ", ";
-        }
-        sql += pair.first;
-        valuesPart += "'" + pair.second + "'";
-        first = false;
+        cols.push_back(pair.first);
+        params.push_back(pair.second);
     }
 
-    sql += valuesPart + ");";
-    return execute(sql);
+    CachedStatement *cached =
+        cachedStatement(insertSql(tableName, cols, returning), tableName, cols);
+    return cached && runCached(*cached, {}, params, changed);
 }
 
 bool Database::updateRecord(const std::string &tableName,
                             const std::map<std::string, std::string> &values,
-                            const std::string &where) {
-    if (!is_open || values.empty())
+                            const RowKey &where,
+                            const std::string &returning,
+                            ResultSet *changed) {
+    if (!is_open || values.empty() || where.empty())
         return false;
 
-    std::string sql = "UPDATE " + tableName + " SET ";
-
-    bool first = true;
+    std::vector<std::string> cols;
+    std::vector<std::string> texts;
     for (const auto &pair : values) {
-        if (!first) {
-            sql += ", ";
-        }
-        sql += pair.first + " = '" + pair.second + "'";
-        first = false;
+        cols.push_back(pair.first);
+        texts.push_back(pair.second);
     }
 
-    if (!where.empty()) {
-        sql += " WHERE " + where;
+    std::vector<Value> keyValues;
+    for (const auto &pair : where) {
+        keyValues.push_back(pair.second);
     }
 
-    sql += ";";
-    return execute(sql);
+    CachedStatement *cached = cachedStatement(
+        updateSql(tableName, cols, where, returning), tableName, cols);
+    return cached && runCached(*cached, texts, keyValues, changed);
+}
+
+bool Database::updateRecord(const std::string &tableName,
+                            const std::map<std::string, Value> &values,
+                            const RowKey &where,
+                            const std::string &returning,
+                            ResultSet *changed) {
+    if (!is_open || values.empty() || where.empty())
+        return false;
+
+    std::vector<std::string> cols;
+    std::vector<Value> params;
+    for (const auto &pair : values) {
+        cols.push_back(pair.first);
+        params.push_back(pair.second);
+    }
+    for (const auto &pair : where) {
+        params.push_back(pair.second);
+    }
+
+    CachedStatement *cached = cachedStatement(
+        updateSql(tableName, cols, where, returning), tableName, cols);
+    return cached && runCached(*cached, {}, params, changed);
 }
 
 bool Database::deleteRecord(const std::string &tableName,
-                            const std::string &where) {
-    if (!is_open)
+                            const RowKey &where) {
+    if (!is_open || where.empty())
+        return false;
+
+    std::string sql =
+        "DELETE FROM " + quoteIdentifier(tableName) + whereKey(where) + ";";
+
+    std::vector<Value> keyValues;
+    for (const auto &pair : where) {
+        keyValues.push_back(pair.second);
+    }
+
+    CachedStatement *cached = cachedStatement(sql, tableName, {});
+    return cached && runCached(*cached, {}, keyValues);
+}
+
+bool Database::readCell(const std::string &tableName,
+                        const std::string &column, const RowKey &where,
+                        uint64_t offset, size_t size, std::string &out,
+                        uint64_t *total) {
+    out.clear();
+    if (!is_open || where.empty())
         return false;
 
-    std::string sql = "DELETE FROM " + tableName;
+    auto rowid = where.find("rowid");
+    if (where.size() == 1 && rowid != where.end() &&
+        rowid->second.type == Value::Type::Integer) {
+        sqlite3_blob *blob = nullptr;
+        if (sqlite3_blob_open(db, "main", tableName.c_str(), column.c_str(),
+                              rowid->second.integer, 0,
+                              &blob) == SQLITE_OK) {
+            uint64_t bytes = (uint64_t)sqlite3_blob_bytes(blob);
+            offset = std::min(offset, bytes);
+            size = (size_t)std::min<uint64_t>(size, bytes - offset);
+            out.resize(size);
+            int rc = size ? sqlite3_blob_read(blob, &out[0], (int)size,
+                                              (int)offset)
+                          : SQLITE_OK;
+            sqlite3_blob_close(blob);
+            if (total)
+                *total = bytes;
+            return rc == SQLITE_OK;
+        }
+        // столбец-псевдоним rowid и т.п. sqlite3_blob не открывает
+        sqlite3_blob_close(blob);
+    }
+
+    // substr() над BLOB считает байты, над TEXT - символы
+    std::string value = "CAST(" + quoteIdentifier(column) + " AS BLOB)";
+    std::string sql = "SELECT substr(" + value + ", ?, ?), length(" + value +
+                      ") FROM " + quoteIdentifier(tableName) +
+                      whereKey(where) + ";";
+    std::vector<Value> params = {Value::ofInteger((int64_t)offset + 1),
+                                 Value::ofInteger((int64_t)size)};
+    for (const auto &pair : where) {
+        params.push_back(pair.second);
+    }
+    bool found = false;
+    bool ok = stream(sql, params, [&](sqlite3_stmt *stmt) {
+        const char *data = (const char *)sqlite3_column_blob(stmt, 0);
+        if (data)
+            out.assign(data, sqlite3_column_bytes(stmt, 0));
+        if (total)
+            *total = (uint64_t)sqlite3_column_int64(stmt, 1);
+        found = true;
+        return false;
+    });
+    return ok && found;
+}
+
+int Database::changes() { return is_open ? sqlite3_changes(db) : 0; }
+
+int Database::schemaVersion() {
+    if (!is_open)
+        return -1;
+
+    if (!schema_version_stmt &&
+        sqlite3_prepare_v2(db, "PRAGMA schema_version;", -1,
+                           &schema_version_stmt, nullptr) != SQLITE_OK)
+        return -1;
+
+    int version = -1;
+    if (sqlite3_step(schema_version_stmt) == SQLITE_ROW)
+        version = sqlite3_column_int(schema_version_stmt, 0);
+    sqlite3_reset(schema_version_stmt);
+    return version;
+}
+
+void Database::clearStatementCache() {
+    for (auto &pair : statement_cache) {
+        sqlite3_finalize(pair.second.stmt);
+    }
+    statement_cache.clear();
+    statement_schema = -1;
+}
+
+// Кэш сбрасывается целиком при любом изменении схемы: запомненные типы
+// столбцов могли устареть, а сами запросы - ссылаться на удалённые столбцы.
+Database::CachedStatement *
+Database::cachedStatement(const std::string &sql, const std::string &tableName,
+                          const std::vector<std::string> &cols) {
+    int version = schemaVersion();
+    if (version != statement_schema) {
+        clearStatementCache();
+        statement_schema = version;
+    }
+
+    auto it = statement_cache.find(sql);
+    if (it != statement_cache.end())
+        return &it->second;
+
+    CachedStatement cached;
+    if (sqlite3_prepare_v3(db, sql.c_str(), -1, SQLITE_PREPARE_PERSISTENT,
+                           &cached.stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL error: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_finalize(cached.stmt);
+        return nullptr;
+    }
 
-    if (!where.empty()) {
-        sql += " WHERE " + where;
+    if (!cols.empty()) {
+        auto info = getTableInfo(tableName);
+        for (const auto &col : cols) {
+            std::string type;
+            for (const auto &column : info) {
+                if (column.name == col)
+                    type = column.type;
+            }
+            cached.types.push_back(type);
+        }
     }
 
-    sql += ";";
-    return execute(sql);
+    return &statement_cache.emplace(sql, cached).first->second;
+}
+
+bool Database::runCached(CachedStatement &cached,
+                         const std::vector<std::string> &texts,
+                         const std::vector<Value> &values,
+                         ResultSet *changed) {
+    QueryTimer timer(activeProfiler(), sqlite3_sql(cached.stmt));
+    int index = 1;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        Value::fromText(texts[i], cached.types[i]).bind(cached.stmt, index++);
+    }
+    for (const auto &value : values) {
+        value.bind(cached.stmt, index++);
+    }
+    timer.lap(&QueryProfile::prepareUs);
+
+    if (changed)
+        *changed = ResultSet(cached.stmt);
+
+    // строки RETURNING дочитываются до конца, иначе изменение не завершено
+    int rc;
+    while ((rc = sqlite3_step(cached.stmt)) == SQLITE_ROW) {
+        timer.lap(&QueryProfile::stepUs);
+        if (changed)
+            changed->appendRow(cached.stmt);
+        timer.lap(&QueryProfile::materializeUs);
+    }
+    timer.lap(&QueryProfile::stepUs);
+    if (rc != SQLITE_DONE)
+        std::cerr << "SQL error: " << sqlite3_errmsg(db) << std::endl;
+    timer.finish(changed ? changed->rowCount() : (uint64_t)sqlite3_changes(db),
+                 changed ? changed->memoryUsage() : 0);
+
+    sqlite3_reset(cached.stmt);
+    sqlite3_clear_bindings(cached.stmt);
+    return rc == SQLITE_DONE;
+}
+
+std::string Database::insertSql(const std::string &tableName,
+                                const std::vector<std::string> &cols,
+                                const std::string &returning) {
+    std::string sql = "INSERT INTO " + quoteIdentifier(tableName) + " (";
+    std::string valuesPart = ") VALUES (";
+    for (size_t i = 0; i < cols.size(); ++i) {
+        if (i) {
+            sql += ", ";
+            valuesPart += ", ";
+        }
+        sql += quoteIdentifier(cols[i]);
+        valuesPart += "?";
+    }
+    return sql + valuesPart + ")" + returningClause(returning) + ";";
+}
+
+std::string Database::updateSql(const std::string &tableName,
+                                const std::vector<std::string> &cols,
+                                const RowKey &where,
+                                const std::string &returning) {
+    std::string sql = "UPDATE " + quoteIdentifier(tableName) + " SET ";
+    for (size_t i = 0; i < cols.size(); ++i) {
+        if (i)
+            sql += ", ";
+        sql += quoteIdentifier(cols[i]) + " = ?";
+    }
+    return sql + whereKey(where) + returningClause(returning) + ";";
+}
+
+std::string Database::returningClause(const std::string &returning) {
+    return returning.empty() ? "" : " RETURNING " + returning;
+}
+
+std::string Database::whereKey(const RowKey &where) {
+    std::string sql;
+    for (const auto &pair : where) {
+        sql += sql.empty() ? " WHERE " : " AND ";
+        sql += (pair.first == "rowid" ? pair.first
+                                      : quoteIdentifier(pair.first)) +
+               " IS ?";
+    }
+    return sql;
+}
+
+std::string Database::quoteIdentifier(const std::string &name) {
+    std::string quoted = "\"";
+    for (char c : name) {
+        if (c == '"')
+            quoted += '"';
+        quoted += c;
+    }
+    quoted += '"';
+    return quoted;
+}
+
+std::string Database::keyExpression(const std::string &name) {
+    return name == "rowid" ? name : quoteIdentifier(name);
+}
+
+std::string Database::quoteLiteral(const Value &value) {
+    char buffer[32];
+    switch (value.type) {
+    case Value::Type::Integer:
+        return std::to_string(value.integer);
+    case Value::Type::Real:
+        snprintf(buffer, sizeof(buffer), "%.17g", value.real);
+        return buffer;
+    case Value::Type::Text: {
+        std::string quoted = "'";
+        for (char c : value.text) {
+            if (c == '\'')
+                quoted += '\'';
+            quoted += c;
+        }
+        return quoted + "'";
+    }
+    case Value::Type::Blob: {
+        static const char digits[] = "0123456789ABCDEF";
+        std::string hex = "X'";
+        for (char c : value.text) {
+            hex += digits[(unsigned char)c >> 4];
+            hex += digits[(unsigned char)c & 15];
+        }
+        return hex + "'";
+    }
+    default:
+        return "NULL";
+    }
 }
@@ -1,9 +1,13 @@
 #pragma once
 
+#include "result_set.hpp"
 #include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <sqlite3.h>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 struct ColumnInfo {
@@ -13,36 +17,176 @@ struct ColumnInfo {
         bool primary_key;
 };
 
+class Profiler;
+class SchemaCatalog;
+
+// Настройки соединения при открытии:
+// ReadOnly - только чтение неизменяемого снимка (immutable URI, без
+//   блокировок, большой mmap); правки и импорт недоступны;
+// Editing - WAL, synchronous=NORMAL и увеличенный кэш страниц;
+// BulkLoad - журнал в памяти, synchronous=OFF, монопольная блокировка;
+// Snapshot - копия базы от Snapshot, путь - Snapshot::replica(); её
+//   никто не пишет, поэтому она открывается как ReadOnly;
+// Reader - соединение ReadPool: только чтение без immutable, чтобы видеть
+//   изменения, зафиксированные основным соединением в WAL.
+enum class OpenProfile {
+    Default,
+    ReadOnly,
+    Editing,
+    BulkLoad,
+    Snapshot,
+    Reader
+};
+
+// значения, по которым находится строка: столбец (или rowid) -> значение
+using RowKey = std::map<std::string, Value>;
+
 class Database {
     public:
         Database();
         ~Database();
 
-        bool open(const std::string &path);
+        bool open(const std::string &path,
+                  OpenProfile profile = OpenProfile::Default);
         void close();
         bool isOpen() const;
+        bool isReadOnly() const;
+        OpenProfile openProfile() const;
+
+        static const char *profileName(OpenProfile profile);
+        // имя из profileName или его начало без учёта регистра
+        static bool parseProfile(const std::string &name, OpenProfile &profile);
+
+        // безопасно вызывать из другого потока
+        void interrupt();
+        void setProgressHandler(int period, std::function<bool()> handler);
+        // время подготовки, шагов и переноса строк каждого запроса плюс
+        // sqlite3_trace_v2; замер идёт, только пока profiler->enabled
+        void setProfiler(Profiler *profiler);
 
         bool execute(const std::string &sql);
+        // подготовленный запрос из кэша; после шага нужен sqlite3_reset
+        sqlite3_stmt *prepareCached(const std::string &sql);
+        // Готовит первый оператор скрипта sql, tail - начало следующего.
+        // stmt == nullptr при успехе - остались пробелы и комментарии.
+        // Оператор закрывает вызывающий (sqlite3_finalize).
+        bool prepare(const char *sql, sqlite3_stmt **stmt, const char **tail);
+        std::string errorMessage() const;
+        bool inTransaction() const;
         bool beginTransaction();
         bool commitTransaction();
         bool rollbackTransaction();
 
-        std::vector<std::map<std::string, std::string>>
-        query(const std::string &sql);
+        ResultSet query(const std::string &sql);
+        // largeCells - предел размера ячейки, сверх которого результат
+        // хранит только ссылку (ResultSet::LargeCell); sizeColumns - см.
+        // ResultSet(stmt, sizeColumns)
+        ResultSet query(const std::string &sql,
+                        const std::vector<Value> &params,
+                        size_t largeCells = 0,
+                        const std::vector<int> &sizeColumns = {});
+        // построчный обход результата без накопления; onRow возвращает
+        // false, чтобы остановиться
+        bool stream(const std::string &sql, const std::vector<Value> &params,
+                    const std::function<bool(sqlite3_stmt *)> &onRow);
+        // снимок схемы; перечитывается, только если изменился
+        // schema_version, остальные запросы к схеме идут через него
+        std::shared_ptr<const SchemaCatalog> catalog();
         std::vector<ColumnInfo> getTableInfo(const std::string &tableName);
 
         std::vector<std::string> getTables();
         std::vector<std::string> getTableColumns(const std::string &tableName);
+        bool hasRowid(const std::string &tableName);
+        // ключ строки: rowid или первичный ключ WITHOUT ROWID таблицы
+        std::vector<std::string> rowKeyColumns(const std::string &tableName);
+        // min(rowid) и max(rowid) по индексу таблицы; false для пустой
+        // таблицы или WITHOUT ROWID
+        bool rowidRange(const std::string &tableName, int64_t &first,
+                        int64_t &last);
 
+        // returning - список выражений для RETURNING: изменённая строка
+        // попадает в changed, и перечитывать таблицу не нужно
         bool addRecord(const std::string &tableName,
-                       const std::map<std::string, std::string> &values);
+                       const std::map<std::string, std::string> &values,
+                       const std::string &returning = "",
+                       ResultSet *changed = nullptr);
         bool updateRecord(const std::string &tableName,
                           const std::map<std::string, std::string> &values,
-                          const std::string &where);
-        bool deleteRecord(const std::string &tableName,
-                          const std::string &where);
+                          const RowKey &where,
+                          const std::string &returning = "",
+                          ResultSet *changed = nullptr);
+        // то же с готовыми значениями вместо текста редактора: NULL и тип
+        // каждой ячейки сохраняются как есть
+        bool addRecord(const std::string &tableName,
+                       const std::map<std::string, Value> &values,
+                       const std::string &returning = "",
+                       ResultSet *changed = nullptr);
+        bool updateRecord(const std::string &tableName,
+                          const std::map<std::string, Value> &values,
+                          const RowKey &where,
+                          const std::string &returning = "",
+                          ResultSet *changed = nullptr);
+        bool deleteRecord(const std::string &tableName, const RowKey &where);
+        // Кусок [offset, offset + size) значения ячейки без чтения её
+        // целиком: sqlite3_blob_read по rowid, для WITHOUT ROWID - substr()
+        // по ключу. total - полный размер в байтах.
+        bool readCell(const std::string &tableName, const std::string &column,
+                      const RowKey &where, uint64_t offset, size_t size,
+                      std::string &out, uint64_t *total = nullptr);
+        // число строк, затронутых последним INSERT/UPDATE/DELETE
+        int changes();
+
+        int schemaVersion();
+        void clearStatementCache();
+
+        static std::string quoteIdentifier(const std::string &name);
+        // столбец ключа в запросе: rowid без кавычек, чтобы не совпасть
+        // со столбцом "rowid" таблицы
+        static std::string keyExpression(const std::string &name);
+        // литерал SQL для значения: текст в кавычках, числа как есть
+        static std::string quoteLiteral(const Value &value);
 
     private:
+        // подготовленный запрос и объявленные типы его параметров
+        struct CachedStatement {
+                sqlite3_stmt *stmt = nullptr;
+                std::vector<std::string> types;
+        };
+
+        static std::string fileUri(const std::string &path);
+        static int progressCallback(void *context);
+        static int traceCallback(unsigned type, void *context, void *p,
+                                 void *x);
+        Profiler *activeProfiler() const;
+
+        CachedStatement *cachedStatement(const std::string &sql,
+                                         const std::string &tableName,
+                                         const std::vector<std::string> &cols);
+        bool runCached(CachedStatement &cached,
+                       const std::vector<std::string> &texts,
+                       const std::vector<Value> &values,
+                       ResultSet *changed = nullptr);
+        static std::string insertSql(const std::string &tableName,
+                                     const std::vector<std::string> &cols,
+                                     const std::string &returning);
+        static std::string updateSql(const std::string &tableName,
+                                     const std::vector<std::string> &cols,
+                                     const RowKey &where,
+                                     const std::string &returning);
+        static std::string returningClause(const std::string &returning);
+        static std::string whereKey(const RowKey &where);
+
         sqlite3 *db;
         bool is_open;
+        OpenProfile profile = OpenProfile::Default;
+        std::mutex handle_mutex;
+        int progress_period = 0;
+        std::function<bool()> progress_handler;
+        Profiler *profiler = nullptr;
+
+        // ключ - текст SQL, который однозначно задаёт таблицу и набор столбцов
+        std::unordered_map<std::string, CachedStatement> statement_cache;
+        sqlite3_stmt *schema_version_stmt = nullptr;
+        int statement_schema = -1;
+        std::shared_ptr<const SchemaCatalog> schema_catalog;
 };
@@ -0,0 +1,634 @@
+// Консольный бенчмарк слоя базы данных: без GLFW/OpenGL, результат в JSON.
+//
+//   db_bench [--rows N] [--columns N] [--tables N] [--ops N]
+//            [--db путь] [--output файл.json]
+
+#include "database.hpp"
+#include "directory_lister.hpp"
+#include "edit_journal.hpp"
+#include "exporter.hpp"
+#include "global_search.hpp"
+#include "pending_changes.hpp"
+#include "paged_table.hpp"
+#include "query_worker.hpp"
+#include "read_pool.hpp"
+#include "related_rows.hpp"
+#include "schema_catalog.hpp"
+#include "snapshot.hpp"
+#include "sql_console.hpp"
+#include "table_diff.hpp"
+#include "table_stats.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Config {
+        size_t rows = 100000;
+        size_t columns = 8;
+        size_t tables = 200;
+        size_t ops = 2000;
+        std::string path = "/tmp/db_bench.db";
+        std::string output;
+};
+
+struct Result {
+        std::string name;
+        size_t ops = 0;
+        uint64_t rows = 0;
+        uint64_t bytes = 0;
+        double seconds = 0;
+        std::vector<double> latencies;
+        long peakRssKb = 0;
+};
+
+long peakRssKb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty())
+        return 0;
+    size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+// ops вызовов body, время каждого - отдельная задержка
+Result measure(const std::string &name, size_t ops,
+               const std::function<uint64_t(size_t)> &body) {
+    Result result;
+    result.name = name;
+    result.ops = ops;
+    result.latencies.reserve(ops);
+    auto begin = Clock::now();
+    for (size_t i = 0; i < ops; ++i) {
+        auto start = Clock::now();
+        result.rows += body(i);
+        result.latencies.push_back(
+            std::chrono::duration<double, std::micro>(Clock::now() - start)
+                .count());
+    }
+    result.seconds =
+        std::chrono::duration<double>(Clock::now() - begin).count();
+    result.peakRssKb = peakRssKb();
+    fprintf(stderr, "%-24s %8zu ops %10.3f s\n", name.c_str(), ops,
+            result.seconds);
+    return result;
+}
+
+std::string columnName(size_t col) { return "c" + std::to_string(col); }
+
+// столбцы по кругу INTEGER, REAL, TEXT
+const char *columnType(size_t col) {
+    static const char *types[] = {"INTEGER", "REAL", "TEXT"};
+    return types[col % 3];
+}
+
+std::string randomText(std::mt19937_64 &random, size_t size) {
+    static const char letters[] = "abcdefghijklmnopqrstuvwxyz";
+    std::string text(size, ' ');
+    for (auto &c : text)
+        c = letters[random() % 26];
+    return text;
+}
+
+std::map<std::string, std::string> randomValues(std::mt19937_64 &random,
+                                                const Config &config) {
+    std::map<std::string, std::string> values;
+    for (size_t col = 0; col < config.columns; ++col) {
+        switch (col % 3) {
+        case 0:
+            values[columnName(col)] = std::to_string(random() % 1000000);
+            break;
+        case 1:
+            values[columnName(col)] =
+                std::to_string((random() % 1000000) / 100.0);
+            break;
+        default:
+            values[columnName(col)] = randomText(random, 8 + random() % 24);
+            break;
+        }
+    }
+    return values;
+}
+
+bool generate(Database &db, const Config &config) {
+    remove(config.path.c_str());
+    if (!db.open(config.path))
+        return false;
+
+    db.execute("PRAGMA journal_mode = MEMORY; PRAGMA synchronous = OFF;");
+    std::string sql = "CREATE TABLE bench (id INTEGER PRIMARY KEY";
+    std::string insert = "INSERT INTO bench (";
+    std::string params;
+    for (size_t col = 0; col < config.columns; ++col) {
+        sql += ", " + columnName(col) + " " + columnType(col);
+        insert += (col ? ", " : "") + columnName(col);
+        params += col ? ", ?" : "?";
+    }
+    if (!db.execute(sql + ");"))
+        return false;
+
+    // таблицы разной ширины для чтения схемы
+    for (size_t t = 0; t < config.tables; ++t) {
+        std::string table = "CREATE TABLE extra" + std::to_string(t) +
+                            " (id INTEGER PRIMARY KEY, parent INTEGER "
+                            "REFERENCES bench(id)";
+        for (size_t col = 0; col < 2 + t % 10; ++col)
+            table += ", " + columnName(col) + " " + columnType(col);
+        db.execute(table + ");");
+        std::string name = "extra" + std::to_string(t);
+        db.execute("CREATE INDEX " + name + "_parent ON " + name +
+                   " (parent);");
+    }
+
+    std::mt19937_64 random(42);
+    sqlite3_stmt *stmt =
+        db.prepareCached(insert + ") VALUES (" + params + ");");
+    if (!stmt)
+        return false;
+
+    auto start = Clock::now();
+    db.beginTransaction();
+    for (size_t row = 0; row < config.rows; ++row) {
+        for (size_t col = 0; col < config.columns; ++col) {
+            int index = (int)col + 1;
+            switch (col % 3) {
+            case 0:
+                sqlite3_bind_int64(stmt, index, random() % 1000000);
+                break;
+            case 1:
+                sqlite3_bind_double(stmt, index,
+                                    (random() % 1000000) / 100.0);
+                break;
+            default: {
+                std::string text = randomText(random, 8 + random() % 24);
+                sqlite3_bind_text(stmt, index, text.data(), (int)text.size(),
+                                  SQLITE_TRANSIENT);
+                break;
+            }
+            }
+        }
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+    db.commitTransaction();
+    fprintf(stderr, "generated %zu rows x %zu columns in %.3f s\n",
+            config.rows, config.columns,
+            std::chrono::duration<double>(Clock::now() - start).count());
+    return true;
+}
+
+// случайные строки через PagedTable: prefetch и ожидание блока
+Result benchPagedTable(const Config &config) {
+    QueryWorker worker;
+    worker.submit([path = config.path](Database &db) { return db.open(path); },
+                  [](bool) {});
+    PagedTable table;
+    table.open(worker, "bench");
+    while (table.loading()) {
+        worker.poll();
+    }
+
+    std::mt19937_64 random(7);
+    size_t rows = std::max<size_t>(table.rowCount(), 1);
+    auto result = measure("paged_table_random", config.ops / 4, [&](size_t) {
+        size_t row = random() % rows;
+        size_t local;
+        table.prefetch((long)row, (long)row + 1);
+        while (!table.rowBlock(row, local)) {
+            worker.poll();
+        }
+        return (uint64_t)1;
+    });
+    worker.stop();
+    return result;
+}
+
+// Таблица с BLOB по 256 КБ: блок строк целиком и блок PagedTable, где
+// большие ячейки остаются ссылками, затем чтение ячейки страницами.
+std::vector<Result> benchBlobs(Database &db, const Config &config) {
+    const int64_t blobRows = 256;
+    const int64_t blobBytes = 256 << 10;
+    db.execute("CREATE TABLE bench_blob (id INTEGER PRIMARY KEY, name TEXT, "
+               "data BLOB);");
+    db.execute("WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 "
+               "FROM n WHERE i < " +
+               std::to_string(blobRows) +
+               ") INSERT INTO bench_blob (name, data) SELECT 'row' || i, "
+               "randomblob(" +
+               std::to_string(blobBytes) + ") FROM n;");
+
+    std::vector<Result> results;
+    uint64_t bytes = 0;
+    auto full = measure("blob_block_full", 3, [&](size_t) {
+        auto rows = db.query("SELECT rowid, * FROM bench_blob "
+                             "ORDER BY rowid LIMIT 256;");
+        bytes = rows.memoryUsage();
+        return (uint64_t)rows.rowCount();
+    });
+    full.bytes = bytes;
+    results.push_back(std::move(full));
+
+    QueryWorker worker;
+    worker.submit([path = config.path](Database &db) { return db.open(path); },
+                  [](bool) {});
+    results.push_back(measure("blob_block_lazy", 3, [&](size_t) {
+        PagedTable table;
+        table.open(worker, "bench_blob");
+        size_t local;
+        table.prefetch(0, 1);
+        while (table.loading() || !table.rowBlock(0, local)) {
+            worker.poll();
+            table.prefetch(0, 1);
+        }
+        return (uint64_t)table.rowCount();
+    }));
+    worker.stop();
+
+    std::mt19937_64 random(5);
+    results.push_back(measure("blob_read_cell", config.ops, [&](size_t) {
+        std::string chunk;
+        RowKey key = {{"rowid", Value::ofInteger(1 + random() % blobRows)}};
+        db.readCell("bench_blob", "data", key,
+                    random() % (blobBytes / 65536) * 65536, 65536, chunk);
+        return (uint64_t)chunk.size();
+    }));
+
+    // удаление строк с BLOB и отмена по журналу: тип хранения сохраняется
+    const int64_t undoRows = 16;
+    results.push_back(measure("journal_undo_blob", 1, [&](size_t) {
+        PendingChanges pending;
+        for (int64_t id = 1; id <= undoRows; ++id) {
+            RowKey key = {{"rowid", Value::ofInteger(id)}};
+            pending.remove("bench_blob", {key["rowid"]}, key, {});
+        }
+        size_t failed = 0;
+        std::string error;
+        std::vector<RowDelta> deltas;
+        EditJournal journal;
+        std::vector<ResultSet> rows;
+        if (!PendingChanges::apply(db, pending.changes(), failed, error,
+                                   &deltas))
+            return (uint64_t)0;
+        journal.push(deltas);
+        EditJournal::replay(db, journal.undoStep(), "", "", rows, error);
+        auto blobs = db.query("SELECT count(*) FROM bench_blob "
+                              "WHERE typeof(data) = 'blob';");
+        uint64_t restored = (uint64_t)blobs.getInt(0, 0);
+        if (restored != (uint64_t)blobRows)
+            fprintf(stderr, "journal_undo_blob: %llu of %lld rows are BLOB\n",
+                    (unsigned long long)restored, (long long)blobRows);
+        return restored;
+    }));
+    db.execute("DROP TABLE bench_blob;");
+    return results;
+}
+
+// Папка с ops * 10 файлами: первое чтение DirectoryLister, повторное
+// из кэша со сверкой времени изменения и отбор по маске
+std::vector<Result> benchDirectory(const Config &config) {
+    std::string dir = config.path + ".dir";
+    size_t count = config.ops * 10;
+    std::filesystem::create_directories(dir);
+    for (size_t i = 0; i < count; ++i) {
+        std::string name = dir + "/file" + std::to_string(i) +
+                           (i % 4 ? ".txt" : ".db");
+        FILE *file = fopen(name.c_str(), "wb");
+        if (file)
+            fclose(file);
+    }
+
+    std::vector<Result> results;
+    DirectoryLister lister;
+    std::vector<DirEntry> entries;
+    auto list = [&](size_t) {
+        lister.open(dir);
+        while (lister.loading()) {
+            std::this_thread::yield();
+        }
+        lister.take(entries);
+        return (uint64_t)entries.size();
+    };
+    results.push_back(measure("dir_list_cold", 1, list));
+    results.push_back(measure("dir_list_cached", 100, list));
+
+    FileFilter filter("*.db;*.sqlite;*.sqlite3");
+    results.push_back(measure("dir_filter", 100, [&](size_t) {
+        uint64_t matched = 0;
+        for (const auto &entry : entries) {
+            matched += filter.matches(entry.name);
+        }
+        return matched;
+    }));
+    std::filesystem::remove_all(dir);
+    return results;
+}
+
+// pool != nullptr - параллельная выгрузка по диапазонам rowid
+Result benchExport(Database &db, const Config &config, ExportFormat format,
+                   ReadPool *pool = nullptr) {
+    ExportOptions options;
+    options.table = "bench";
+    options.path = config.path + Exporter::extension(format);
+    options.format = format;
+
+    std::string name = std::string("export") + Exporter::extension(format);
+    auto result = measure(pool ? name + "_pool" : name, 1, [&](size_t) {
+        TaskProgress progress;
+        Exporter exporter(options, progress);
+        if (pool)
+            exporter.run(*pool);
+        else
+            exporter.run(db);
+        return (uint64_t)progress.rows.load();
+    });
+
+    FILE *file = fopen(options.path.c_str(), "rb");
+    if (file) {
+        fseek(file, 0, SEEK_END);
+        result.bytes = (uint64_t)ftell(file);
+        fclose(file);
+    }
+    remove(options.path.c_str());
+    return result;
+}
+
+void writeJson(FILE *out, const Config &config,
+               const std::vector<Result> &results) {
+    fprintf(out, "{\n  \"sqlite_version\": \"%s\",\n", sqlite3_libversion());
+    fprintf(out,
+            "  \"config\": {\"rows\": %zu, \"columns\": %zu, \"tables\": %zu, "
+            "\"ops\": %zu},\n",
+            config.rows, config.columns, config.tables, config.ops);
+    fprintf(out, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto &r = results[i];
+        double seconds = r.seconds > 0 ? r.seconds : 1e-9;
+        fprintf(out,
+                "    {\"name\": \"%s\", \"ops\": %zu, \"seconds\": %.6f, "
+                "\"ops_per_sec\": %.1f, \"rows\": %llu, "
+                "\"rows_per_sec\": %.1f, \"bytes\": %llu, "
+                "\"latency_us\": {\"p50\": %.2f, \"p90\": %.2f, "
+                "\"p99\": %.2f, \"max\": %.2f}, \"peak_rss_kb\": %ld}%s\n",
+                r.name.c_str(), r.ops, r.seconds, r.ops / seconds,
+                (unsigned long long)r.rows, r.rows / seconds,
+                (unsigned long long)r.bytes, percentile(r.latencies, 0.5),
+                percentile(r.latencies, 0.9), percentile(r.latencies, 0.99),
+                percentile(r.latencies, 1.0), r.peakRssKb,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+bool parseArgs(int argc, char **argv, Config &config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+            return false;
+        const char *value = argv[++i];
+        if (arg == "--rows")
+            config.rows = strtoull(value, nullptr, 10);
+        else if (arg == "--columns")
+            config.columns = std::max<size_t>(1, strtoull(value, nullptr, 10));
+        else if (arg == "--tables")
+            config.tables = strtoull(value, nullptr, 10);
+        else if (arg == "--ops")
+            config.ops = std::max<size_t>(4, strtoull(value, nullptr, 10));
+        else if (arg == "--db")
+            config.path = value;
+        else if (arg == "--output")
+            config.output = value;
+        else
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Config config;
+    if (!parseArgs(argc, argv, config)) {
+        fprintf(stderr,
+                "usage: %s [--rows N] [--columns N] [--tables N] [--ops N] "
+                "[--db path] [--output file.json]\n",
+                argv[0]);
+        return 2;
+    }
+
+    Database db;
+    if (!generate(db, config)) {
+        fprintf(stderr, "cannot create %s\n", config.path.c_str());
+        return 1;
+    }
+
+    std::vector<Result> results;
+    std::mt19937_64 random(1);
+    int64_t maxId = (int64_t)config.rows;
+
+    // полная загрузка таблицы в ResultSet
+    {
+        uint64_t bytes = 0;
+        auto result = measure("load_full_table", 3, [&](size_t) {
+            auto rows = db.query("SELECT rowid, * FROM bench;");
+            bytes = rows.memoryUsage();
+            return (uint64_t)rows.rowCount();
+        });
+        result.bytes = bytes;
+        results.push_back(std::move(result));
+    }
+
+    // блок из 256 строк от случайного ключа, как у PagedTable
+    results.push_back(measure("page_keyset", config.ops, [&](size_t) {
+        auto rows = db.query("SELECT rowid, * FROM bench WHERE rowid > ? "
+                             "ORDER BY rowid LIMIT 256;",
+                             {Value::ofInteger(random() % (maxId + 1))});
+        return (uint64_t)rows.rowCount();
+    }));
+
+    results.push_back(benchPagedTable(config));
+
+    // строка родителя по ссылке, как при наведении на ячейку-ссылку
+    results.push_back(measure("fk_parent_lookup", config.ops, [&](size_t) {
+        auto link = RelatedRows::findParent(
+            db, "bench", {"rowid"}, {"rowid"},
+            {Value::ofInteger(1 + random() % maxId)});
+        return (uint64_t)!link.key.empty();
+    }));
+
+    // вся таблица через SQL-консоль: план, счётчики и поток строк
+    results.push_back(measure("console_select", 3, [&](size_t) {
+        TaskProgress progress;
+        SqlConsole console("SELECT * FROM bench;", false, progress);
+        console.run(db);
+        ResultSet rows;
+        console.take(rows);
+        return (uint64_t)rows.rowCount();
+    }));
+    for (auto &result : benchBlobs(db, config)) {
+        results.push_back(std::move(result));
+    }
+    // копия базы для просмотра: шаги backup с паузами между ними
+    results.push_back(measure("snapshot_copy", 1, [&](size_t) {
+        Snapshot snapshot(config.path, Snapshot::Target::Memory);
+        TaskProgress progress;
+        snapshot.copy(progress);
+        return (uint64_t)progress.done.load();
+    }));
+    for (auto &result : benchDirectory(config)) {
+        results.push_back(std::move(result));
+    }
+
+    // копия до правок - правая сторона table_diff
+    Snapshot before(config.path, Snapshot::Target::TempFile);
+    TaskProgress copied;
+    before.copy(copied);
+
+    // изменения в одной транзакции: меряются запросы, а не fsync
+    db.beginTransaction();
+    results.push_back(measure("insert", config.ops, [&](size_t) {
+        return (uint64_t)db.addRecord("bench", randomValues(random, config));
+    }));
+    results.push_back(measure("update", config.ops, [&](size_t) {
+        RowKey key;
+        key["rowid"] = Value::ofInteger(1 + random() % maxId);
+        return (uint64_t)db.updateRecord("bench", randomValues(random, config),
+                                         key);
+    }));
+    results.push_back(measure("delete", config.ops, [&](size_t) {
+        RowKey key;
+        key["rowid"] = Value::ofInteger(1 + random() % maxId);
+        return (uint64_t)(db.deleteRecord("bench", key) && db.changes() == 1);
+    }));
+    db.commitTransaction();
+
+    // те же правки с фиксацией каждой и буфером правок одной транзакцией
+    results.push_back(measure("update_autocommit", config.ops, [&](size_t) {
+        RowKey key;
+        key["rowid"] = Value::ofInteger(1 + random() % maxId);
+        return (uint64_t)db.updateRecord("bench", randomValues(random, config),
+                                         key);
+    }));
+    std::vector<RowDelta> deltas;
+    results.push_back(measure("pending_apply", 1, [&](size_t) {
+        // строки, уцелевшие после delete: иначе пачка откатится
+        auto rowids = db.query("SELECT rowid FROM bench ORDER BY random() "
+                               "LIMIT ?;",
+                               {Value::ofInteger((int64_t)config.ops)});
+        PendingChanges pending;
+        for (size_t i = 0; i < rowids.rowCount(); ++i) {
+            RowKey key;
+            key["rowid"] = rowids.getValue(i, 0);
+            pending.update("bench", {key["rowid"]}, key, {},
+                           randomValues(random, config));
+        }
+        size_t failed = 0;
+        std::string error;
+        return (uint64_t)PendingChanges::apply(db, pending.changes(), failed,
+                                               error, &deltas);
+    }));
+
+    // отмена той же пачки по журналу; bytes - размер журнала
+    EditJournal journal;
+    journal.push(deltas);
+    auto undo = measure("journal_undo", 1, [&](size_t) {
+        std::vector<ResultSet> rows;
+        std::string error;
+        return (uint64_t)EditJournal::replay(db, journal.undoStep(), "", "",
+                                             rows, error);
+    });
+    undo.bytes = journal.memoryUsage();
+    results.push_back(std::move(undo));
+
+    // сравнение таблицы с копией до правок слиянием по rowid
+    results.push_back(measure("table_diff", 1, [&](size_t) {
+        TaskProgress progress;
+        TableDiff diff({config.path, OpenProfile::Reader, before.replica(),
+                        "bench"},
+                       progress);
+        diff.run();
+        DiffSummary summary = diff.summary();
+        return summary.changed + summary.added + summary.removed;
+    }));
+
+    // чтение схемы: из снимка и полная перезагрузка снимка
+    std::vector<std::string> tables = db.getTables();
+    results.push_back(measure("get_table_info", config.ops, [&](size_t) {
+        return (uint64_t)db.getTableInfo(tables[random() % tables.size()])
+            .size();
+    }));
+    results.push_back(measure("schema_catalog_load", 20, [&](size_t) {
+        return (uint64_t)SchemaCatalog::load(db, db.schemaVersion())
+            ->tables.size();
+    }));
+
+    // выгрузка на том же соединении
+    for (auto format : {ExportFormat::Csv, ExportFormat::JsonLines}) {
+        results.push_back(benchExport(db, config, format));
+    }
+
+    // статистика столбцов одним соединением и пулом читателей в WAL
+    db.execute("PRAGMA journal_mode = WAL;");
+    ReadPool pool;
+    pool.open(config.path, OpenProfile::Reader);
+    for (ReadPool *readers : {(ReadPool *)nullptr, &pool}) {
+        results.push_back(measure(readers ? "table_stats_pool"
+                                          : "table_stats_single",
+                                  1, [&](size_t) {
+                                      TaskProgress progress;
+                                      TableStatsCollector stats("bench",
+                                                                progress);
+                                      return stats.run(db, readers).rows;
+                                  }));
+    }
+    results.push_back(benchExport(db, config, ExportFormat::Csv, &pool));
+
+    // поиск подстроки по всем таблицам: сканом в пуле и по FTS5-индексу
+    std::vector<std::string> all = db.getTables();
+    auto search = [&](ReadPool *readers) {
+        TaskProgress progress;
+        GlobalSearch global("qwer", progress);
+        global.run(db, readers, all);
+        return (uint64_t)global.take().size();
+    };
+    results.push_back(
+        measure("search_scan", 3, [&](size_t) { return search(&pool); }));
+    results.push_back(measure("search_index_build", 1, [&](size_t) {
+        TaskProgress progress;
+        return (uint64_t)SearchIndex::build(db, config.path, progress);
+    }));
+    results.push_back(measure("search_index", config.ops / 10,
+                              [&](size_t) { return search(&pool); }));
+    SearchIndex::remove(db, config.path);
+    pool.close();
+
+    FILE *out = stdout;
+    if (!config.output.empty()) {
+        out = fopen(config.output.c_str(), "w");
+        if (!out) {
+            fprintf(stderr, "cannot write %s\n", config.output.c_str());
+            return 1;
+        }
+    }
+    writeJson(out, config, results);
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,215 @@
+#include "directory_lister.hpp"
+#include <algorithm>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+FileFilter::FileFilter(const std::string &masks) {
+    size_t start = 0;
+    while (start <= masks.size()) {
+        size_t end = masks.find(';', start);
+        if (end == std::string::npos)
+            end = masks.size();
+        std::string mask = masks.substr(start, end - start);
+        start = end + 1;
+
+        if (mask.empty())
+            continue;
+        if (mask == "*")
+            all = true;
+        else if (mask.compare(0, 2, "*.") == 0)
+            suffixes.push_back(mask.substr(1));
+        else
+            parts.push_back(mask);
+    }
+}
+
+bool FileFilter::matches(std::string_view name) const {
+    if (all)
+        return true;
+    for (const auto &suffix : suffixes) {
+        if (name.size() >= suffix.size() &&
+            name.compare(name.size() - suffix.size(), suffix.size(),
+                         suffix) == 0)
+            return true;
+    }
+    for (const auto &part : parts) {
+        if (name.find(part) != std::string_view::npos)
+            return true;
+    }
+    return false;
+}
+
+DirectoryLister::DirectoryLister() {
+    thread = std::thread(&DirectoryLister::run, this);
+}
+
+DirectoryLister::~DirectoryLister() { stop(); }
+
+void DirectoryLister::open(const std::string &path) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        wanted = path;
+        ++requested;
+        busy = true;
+        failure.clear();
+        reset = true;
+        fresh.clear();
+        auto found = cache.find(path);
+        if (found != cache.end()) {
+            found->second.used = ++clock;
+            fresh = found->second.entries;
+        }
+    }
+    wake.notify_one();
+}
+
+bool DirectoryLister::take(std::vector<DirEntry> &entries) {
+    std::lock_guard<std::mutex> lock(mutex);
+    bool replaced = reset;
+    if (reset)
+        entries.clear();
+    reset = false;
+    if (entries.empty()) {
+        entries.swap(fresh);
+    } else {
+        std::move(fresh.begin(), fresh.end(), std::back_inserter(entries));
+        fresh.clear();
+    }
+    return replaced;
+}
+
+bool DirectoryLister::loading() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return busy;
+}
+
+std::string DirectoryLister::error() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failure;
+}
+
+void DirectoryLister::setNotify(std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(mutex);
+    notify = std::move(callback);
+}
+
+void DirectoryLister::stop() {
+    if (!thread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        ++requested;
+    }
+    wake.notify_one();
+    thread.join();
+}
+
+void DirectoryLister::run() {
+    while (true) {
+        std::string path;
+        uint64_t request;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock,
+                      [this]() { return stopping || served != requested; });
+            if (stopping)
+                break;
+            path = wanted;
+            request = served = requested;
+        }
+        list(path, request);
+    }
+}
+
+void DirectoryLister::list(const std::string &path, uint64_t request) {
+    std::error_code ec;
+    fs::file_time_type modified = fs::last_write_time(path, ec);
+    bool cached;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = cache.find(path);
+        cached = found != cache.end();
+        // каталог не менялся - кэш уже отдан в open()
+        if (cached && !ec && found->second.modified == modified) {
+            if (request == requested)
+                busy = false;
+            return;
+        }
+    }
+
+    std::vector<DirEntry> all;
+    std::vector<DirEntry> batch;
+    // первая пачка заменяет отданное из кэша
+    bool replace = cached;
+    fs::directory_iterator it(
+        path, fs::directory_options::skip_permission_denied, ec);
+    for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+        DirEntry entry;
+        entry.name = it->path().filename().string();
+        // тип берётся из readdir, без stat на каждый файл
+        std::error_code typeError;
+        entry.directory = it->is_directory(typeError);
+        all.push_back(entry);
+        batch.push_back(std::move(entry));
+        if (batch.size() == BatchEntries) {
+            if (!publish(request, std::move(batch), replace))
+                return;
+            batch.clear();
+            replace = false;
+        }
+    }
+
+    // готовый список - по имени, им же заменяется показанное
+    std::sort(all.begin(), all.end(),
+              [](const DirEntry &a, const DirEntry &b) {
+                  return a.name < b.name;
+              });
+    std::function<void()> wakeUp;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (request != requested)
+            return;
+        busy = false;
+        if (ec)
+            failure = ec.message();
+        fresh = all;
+        reset = true;
+        wakeUp = notify;
+        if (!ec) {
+            Listing &listing = cache[path];
+            listing.entries = std::move(all);
+            listing.modified = modified;
+            listing.used = ++clock;
+        }
+        if (cache.size() > CacheDirectories) {
+            auto oldest = std::min_element(
+                cache.begin(), cache.end(), [](const auto &a, const auto &b) {
+                    return a.second.used < b.second.used;
+                });
+            cache.erase(oldest);
+        }
+    }
+    if (wakeUp)
+        wakeUp();
+}
+
+bool DirectoryLister::publish(uint64_t request, std::vector<DirEntry> batch,
+                              bool replace) {
+    std::function<void()> wakeUp;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (request != requested)
+            return false;
+        if (replace) {
+            fresh.clear();
+            reset = true;
+        }
+        std::move(batch.begin(), batch.end(), std::back_inserter(fresh));
+        wakeUp = notify;
+    }
+    if (wakeUp)
+        wakeUp();
+    return true;
+}
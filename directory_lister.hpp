@@ -0,0 +1,91 @@
+#pragma once
+
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+struct DirEntry {
+        std::string name;
+        bool directory = false;
+};
+
+// Маска вида "*.db;*.csv" или подстрока имени, разобранная один раз
+class FileFilter {
+    public:
+        explicit FileFilter(const std::string &masks = "*");
+        bool matches(std::string_view name) const;
+
+    private:
+        bool all = false;
+        // "*.db" - окончание ".db", иначе - подстрока
+        std::vector<std::string> suffixes;
+        std::vector<std::string> parts;
+};
+
+// Содержимое каталогов читается в фоновом потоке и кэшируется. Записи
+// приходят пачками по BatchEntries, интерфейс забирает их take() каждый
+// кадр. Кэш сверяется со временем изменения каталога: добавление,
+// удаление и переименование файла его меняют, в том числе на сетевых
+// дисках, где inotify не видит чужих изменений.
+class DirectoryLister {
+    public:
+        static constexpr size_t BatchEntries = 256;
+        static constexpr size_t CacheDirectories = 32;
+
+        DirectoryLister();
+        ~DirectoryLister();
+
+        DirectoryLister(const DirectoryLister &) = delete;
+        DirectoryLister &operator=(const DirectoryLister &) = delete;
+
+        // Начинает показ каталога: записи из кэша сразу, затем сверка
+        // времени изменения и, если нужно, чтение заново
+        void open(const std::string &path);
+        // Дописывает записи, пришедшие после прошлого вызова. true -
+        // список прочитан заново и entries сначала очищен.
+        bool take(std::vector<DirEntry> &entries);
+        bool loading() const;
+        std::string error() const;
+        // вызывается в фоновом потоке после каждой пачки
+        void setNotify(std::function<void()> notify);
+        void stop();
+
+    private:
+        struct Listing {
+                std::vector<DirEntry> entries;
+                std::filesystem::file_time_type modified;
+                uint64_t used = 0;
+        };
+
+        void run();
+        void list(const std::string &path, uint64_t request);
+        // false - запрос устарел
+        bool publish(uint64_t request, std::vector<DirEntry> batch,
+                     bool replace);
+
+        std::thread thread;
+        mutable std::mutex mutex;
+        std::condition_variable wake;
+        bool stopping = false;
+        std::function<void()> notify;
+
+        // последний запрос open() и его номер
+        std::string wanted;
+        uint64_t requested = 0;
+        uint64_t served = 0;
+        bool busy = false;
+        std::string failure;
+
+        // записи для take()
+        std::vector<DirEntry> fresh;
+        bool reset = false;
+
+        std::map<std::string, Listing> cache;
+        uint64_t clock = 0;
+};
@@ -0,0 +1,376 @@
+#include "edit_journal.hpp"
+#include <algorithm>
+#include <cstring>
+
+RowDelta RowDelta::inverse() const {
+    RowDelta result = *this;
+    std::swap(result.before, result.after);
+    std::swap(result.oldValues, result.newValues);
+    if (kind == Kind::Insert)
+        result.kind = Kind::Delete;
+    else if (kind == Kind::Delete)
+        result.kind = Kind::Insert;
+    return result;
+}
+
+RowKey RowDelta::where() const {
+    RowKey key;
+    for (size_t i = 0; i < keyColumns.size() && i < before.size(); ++i) {
+        key[keyColumns[i]] = before[i];
+    }
+    return key;
+}
+
+void EditJournal::push(const std::vector<RowDelta> &step) {
+    // сохранение без изменений не становится шагом
+    auto empty = [](const RowDelta &delta) {
+        return delta.kind == RowDelta::Kind::Update && delta.columns.empty();
+    };
+    size_t count =
+        step.size() - std::count_if(step.begin(), step.end(), empty);
+    if (count == 0)
+        return;
+
+    // новая правка отменяет возможность повтора
+    if (position < steps.size()) {
+        arena.resize(steps[position].offset);
+        steps.resize(position);
+    }
+
+    Step added;
+    added.offset = arena.size();
+    added.count = (uint32_t)count;
+    for (const auto &delta : step) {
+        if (!empty(delta))
+            putDelta(delta);
+    }
+    added.size = arena.size() - added.offset;
+    steps.push_back(added);
+    position = steps.size();
+    trim();
+}
+
+bool EditJournal::canUndo() const { return position > 0; }
+
+bool EditJournal::canRedo() const { return position < steps.size(); }
+
+size_t EditJournal::undoCount() const { return position; }
+
+size_t EditJournal::redoCount() const { return steps.size() - position; }
+
+size_t EditJournal::memoryUsage() const {
+    size_t bytes = arena.capacity() + steps.capacity() * sizeof(Step);
+    for (const auto &name : names) {
+        bytes += name.capacity() + sizeof(name);
+    }
+    return bytes;
+}
+
+std::vector<RowDelta> EditJournal::undoStep() const {
+    std::vector<RowDelta> result;
+    if (!canUndo())
+        return result;
+    std::vector<RowDelta> step = decode(steps[position - 1]);
+    for (auto it = step.rbegin(); it != step.rend(); ++it) {
+        result.push_back(it->inverse());
+    }
+    return result;
+}
+
+std::vector<RowDelta> EditJournal::redoStep() const {
+    return canRedo() ? decode(steps[position]) : std::vector<RowDelta>();
+}
+
+void EditJournal::undone() {
+    if (canUndo())
+        --position;
+}
+
+void EditJournal::redone() {
+    if (canRedo())
+        ++position;
+}
+
+void EditJournal::clear() {
+    arena.clear();
+    arena.shrink_to_fit();
+    steps.clear();
+    position = 0;
+    names.clear();
+    nameIds.clear();
+}
+
+// старые шаги срезаются одним сдвигом буфера; последний остаётся всегда
+void EditJournal::trim() {
+    if (arena.size() <= MaxBytes)
+        return;
+
+    size_t dropped = 0;
+    size_t cut = 0;
+    while (dropped + 1 < steps.size() && arena.size() - cut > MaxBytes) {
+        cut += steps[dropped].size;
+        ++dropped;
+    }
+    arena.erase(0, cut);
+    steps.erase(steps.begin(), steps.begin() + dropped);
+    for (auto &step : steps) {
+        step.offset -= cut;
+    }
+    position -= std::min(position, dropped);
+}
+
+uint32_t EditJournal::nameId(const std::string &name) {
+    auto found = nameIds.find(name);
+    if (found != nameIds.end())
+        return found->second;
+    uint32_t id = (uint32_t)names.size();
+    names.push_back(name);
+    nameIds.emplace(name, id);
+    return id;
+}
+
+void EditJournal::putVarint(uint64_t value) {
+    while (value >= 0x80) {
+        arena += (char)(value | 0x80);
+        value >>= 7;
+    }
+    arena += (char)value;
+}
+
+uint64_t EditJournal::getVarint(size_t &offset) const {
+    uint64_t value = 0;
+    for (int shift = 0; offset < arena.size(); shift += 7) {
+        uint8_t byte = (uint8_t)arena[offset++];
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            break;
+    }
+    return value;
+}
+
+// тип, затем целое zigzag-varint, 8 байт double или длина и байты
+// текста или BLOB: тип хранения возвращается при отмене без изменений
+void EditJournal::putValue(const Value &value) {
+    arena += (char)value.type;
+    switch (value.type) {
+    case Value::Type::Null:
+        break;
+    case Value::Type::Integer:
+        putVarint(((uint64_t)value.integer << 1) ^
+                  (uint64_t)(value.integer >> 63));
+        break;
+    case Value::Type::Real: {
+        char bytes[sizeof(double)];
+        memcpy(bytes, &value.real, sizeof(bytes));
+        arena.append(bytes, sizeof(bytes));
+        break;
+    }
+    case Value::Type::Text:
+    case Value::Type::Blob:
+        putVarint(value.text.size());
+        arena += value.text;
+        break;
+    }
+}
+
+Value EditJournal::getValue(size_t &offset) const {
+    Value value;
+    value.type = (Value::Type)arena[offset++];
+    switch (value.type) {
+    case Value::Type::Null:
+        break;
+    case Value::Type::Integer: {
+        uint64_t raw = getVarint(offset);
+        value.integer = (int64_t)(raw >> 1) ^ -(int64_t)(raw & 1);
+        break;
+    }
+    case Value::Type::Real:
+        memcpy(&value.real, arena.data() + offset, sizeof(double));
+        offset += sizeof(double);
+        break;
+    case Value::Type::Text:
+    case Value::Type::Blob: {
+        size_t size = (size_t)getVarint(offset);
+        value.text.assign(arena, offset, size);
+        offset += size;
+        break;
+    }
+    }
+    return value;
+}
+
+void EditJournal::putDelta(const RowDelta &delta) {
+    bool hasOld = delta.kind != RowDelta::Kind::Insert;
+    bool hasNew = delta.kind != RowDelta::Kind::Delete;
+
+    arena += (char)delta.kind;
+    putVarint(nameId(delta.table));
+    putVarint(delta.keyColumns.size());
+    for (size_t i = 0; i < delta.keyColumns.size(); ++i) {
+        putVarint(nameId(delta.keyColumns[i]));
+        if (hasOld)
+            putValue(delta.before[i]);
+        if (hasNew)
+            putValue(delta.after[i]);
+    }
+    putVarint(delta.columns.size());
+    for (size_t i = 0; i < delta.columns.size(); ++i) {
+        putVarint(nameId(delta.columns[i]));
+        if (hasOld)
+            putValue(delta.oldValues[i]);
+        if (hasNew)
+            putValue(delta.newValues[i]);
+    }
+}
+
+RowDelta EditJournal::getDelta(size_t &offset) const {
+    RowDelta delta;
+    delta.kind = (RowDelta::Kind)arena[offset++];
+    bool hasOld = delta.kind != RowDelta::Kind::Insert;
+    bool hasNew = delta.kind != RowDelta::Kind::Delete;
+
+    delta.table = names[getVarint(offset)];
+    size_t keys = (size_t)getVarint(offset);
+    for (size_t i = 0; i < keys; ++i) {
+        delta.keyColumns.push_back(names[getVarint(offset)]);
+        if (hasOld)
+            delta.before.push_back(getValue(offset));
+        if (hasNew)
+            delta.after.push_back(getValue(offset));
+    }
+    size_t columns = (size_t)getVarint(offset);
+    for (size_t i = 0; i < columns; ++i) {
+        delta.columns.push_back(names[getVarint(offset)]);
+        if (hasOld)
+            delta.oldValues.push_back(getValue(offset));
+        if (hasNew)
+            delta.newValues.push_back(getValue(offset));
+    }
+    return delta;
+}
+
+std::vector<RowDelta> EditJournal::decode(const Step &step) const {
+    std::vector<RowDelta> deltas;
+    size_t offset = step.offset;
+    for (uint32_t i = 0; i < step.count; ++i) {
+        deltas.push_back(getDelta(offset));
+    }
+    return deltas;
+}
+
+std::string EditJournal::rowColumns(const std::vector<std::string> &keys) {
+    std::string list;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        list += Database::keyExpression(keys[i]) + " AS \"__key" +
+                std::to_string(i) + "\", ";
+    }
+    return list + "*";
+}
+
+ResultSet EditJournal::readRow(Database &db, const std::string &table,
+                               const std::vector<std::string> &keys,
+                               const std::vector<Value> &key) {
+    std::string sql = "SELECT " + rowColumns(keys) + " FROM " +
+                      Database::quoteIdentifier(table);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        sql += (i ? " AND " : " WHERE ") + Database::keyExpression(keys[i]) +
+               " IS ?";
+    }
+    return db.query(sql + ";", key);
+}
+
+RowDelta EditJournal::diff(const std::string &table,
+                           const std::vector<std::string> &keys,
+                           const ResultSet &before, const ResultSet &after) {
+    RowDelta delta;
+    delta.table = table;
+    delta.keyColumns = keys;
+    bool hasOld = before.rowCount() == 1;
+    bool hasNew = after.rowCount() == 1;
+    delta.kind = !hasOld ? RowDelta::Kind::Insert
+                 : !hasNew ? RowDelta::Kind::Delete
+                           : RowDelta::Kind::Update;
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (hasOld)
+            delta.before.push_back(before.getValue(0, i));
+        if (hasNew)
+            delta.after.push_back(after.getValue(0, i));
+    }
+
+    const ResultSet &row = hasNew ? after : before;
+    for (size_t col = keys.size(); col < row.columnCount(); ++col) {
+        Value oldValue = hasOld ? before.getValue(0, col) : Value();
+        Value newValue = hasNew ? after.getValue(0, col) : Value();
+        if (delta.kind == RowDelta::Kind::Update && oldValue == newValue)
+            continue;
+        delta.columns.push_back(row.columnName(col));
+        if (hasOld)
+            delta.oldValues.push_back(std::move(oldValue));
+        if (hasNew)
+            delta.newValues.push_back(std::move(newValue));
+    }
+    return delta;
+}
+
+bool EditJournal::replay(Database &db, const std::vector<RowDelta> &step,
+                         const std::string &table,
+                         const std::string &returning,
+                         std::vector<ResultSet> &rows, std::string &error) {
+    rows.assign(step.size(), ResultSet());
+    if (!db.execute("SAVEPOINT edit_journal;")) {
+        error = db.errorMessage();
+        return false;
+    }
+
+    bool ok = true;
+    for (size_t i = 0; ok && i < step.size(); ++i) {
+        const RowDelta &delta = step[i];
+        bool current = delta.table == table;
+        std::map<std::string, Value> values;
+        for (size_t col = 0; col < delta.columns.size(); ++col) {
+            if (!delta.newValues.empty())
+                values[delta.columns[col]] = delta.newValues[col];
+        }
+
+        switch (delta.kind) {
+        case RowDelta::Kind::Insert:
+            // прежний ключ: строка возвращается на своё место
+            for (size_t key = 0; key < delta.keyColumns.size(); ++key) {
+                values.emplace(delta.keyColumns[key], delta.after[key]);
+            }
+            ok = db.addRecord(delta.table, values,
+                              current ? returning : "",
+                              current ? &rows[i] : nullptr);
+            break;
+        case RowDelta::Kind::Update:
+            ok = values.empty() ||
+                 db.updateRecord(delta.table, values, delta.where(),
+                                 current ? returning : "",
+                                 current ? &rows[i] : nullptr);
+            break;
+        case RowDelta::Kind::Delete:
+            ok = db.deleteRecord(delta.table, delta.where());
+            break;
+        }
+        if (!ok) {
+            error = db.errorMessage();
+        } else if (!values.empty() || delta.kind == RowDelta::Kind::Delete) {
+            // строку изменили или удалили в обход журнала
+            if (db.changes() != 1) {
+                ok = false;
+                error = "строка изменена в обход журнала";
+            }
+        }
+    }
+
+    if (ok && !db.execute("RELEASE edit_journal;")) {
+        ok = false;
+        error = db.errorMessage();
+    }
+    if (!ok) {
+        db.execute("ROLLBACK TO edit_journal;");
+        db.execute("RELEASE edit_journal;");
+    }
+    return ok;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "database.hpp"
+#include "result_set.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Изменение одной строки: ключ до и после и значения только тех
+// столбцов, что изменились (у вставки и удаления - всех)
+struct RowDelta {
+        enum class Kind { Insert, Update, Delete };
+
+        Kind kind = Kind::Update;
+        std::string table;
+        // rowid или первичный ключ, как у PagedTable
+        std::vector<std::string> keyColumns;
+        // пуст у вставки
+        std::vector<Value> before;
+        // пуст у удаления
+        std::vector<Value> after;
+        std::vector<std::string> columns;
+        // пусто у вставки
+        std::vector<Value> oldValues;
+        // пусто у удаления
+        std::vector<Value> newValues;
+
+        // изменение, которое возвращает строку к прежнему виду
+        RowDelta inverse() const;
+        RowKey where() const;
+};
+
+// Журнал отмены: шаги из дельт строк, закодированные подряд в одном
+// буфере. Имена таблиц и столбцов хранятся один раз, в дельте - их
+// номера; целые - varint. Когда журнал превышает MaxBytes, старые шаги
+// забываются. Сам журнал живёт в потоке интерфейса, дельты снимаются и
+// применяются статическими функциями в потоке базы.
+class EditJournal {
+    public:
+        static constexpr size_t MaxBytes = 16 << 20;
+
+        // шаг - все дельты одной правки или одной записи буфера
+        void push(const std::vector<RowDelta> &step);
+        bool canUndo() const;
+        bool canRedo() const;
+        size_t undoCount() const;
+        size_t redoCount() const;
+        size_t memoryUsage() const;
+        // дельты для отмены последнего шага: обратные, в обратном порядке
+        std::vector<RowDelta> undoStep() const;
+        std::vector<RowDelta> redoStep() const;
+        // шаг применён к базе - позиция сдвигается
+        void undone();
+        void redone();
+        void clear();
+
+        // список для SELECT/RETURNING: ключи, затем все столбцы
+        static std::string rowColumns(const std::vector<std::string> &keys);
+        static ResultSet readRow(Database &db, const std::string &table,
+                                 const std::vector<std::string> &keys,
+                                 const std::vector<Value> &key);
+        // дельта по строке до и после правки в формате rowColumns; пустой
+        // before - вставка, пустой after - удаление
+        static RowDelta diff(const std::string &table,
+                             const std::vector<std::string> &keys,
+                             const ResultSet &before, const ResultSet &after);
+        // Применяет шаг в одной транзакции (SAVEPOINT). rows[i] - строка
+        // после дельты i в формате returning, если её таблица - table.
+        static bool replay(Database &db, const std::vector<RowDelta> &step,
+                           const std::string &table,
+                           const std::string &returning,
+                           std::vector<ResultSet> &rows, std::string &error);
+
+    private:
+        struct Step {
+                size_t offset;
+                size_t size;
+                uint32_t count;
+        };
+
+        uint32_t nameId(const std::string &name);
+        void putVarint(uint64_t value);
+        void putValue(const Value &value);
+        void putDelta(const RowDelta &delta);
+        RowDelta getDelta(size_t &offset) const;
+        uint64_t getVarint(size_t &offset) const;
+        Value getValue(size_t &offset) const;
+        std::vector<RowDelta> decode(const Step &step) const;
+        void trim();
+
+        std::string arena;
+        std::vector<Step> steps;
+        // шаги перед позицией можно отменить, после неё - повторить
+        size_t position = 0;
+        std::vector<std::string> names;
+        std::unordered_map<std::string, uint32_t> nameIds;
+};
@@ -0,0 +1,513 @@
+#include "exporter.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+namespace {
+
+const char hexDigits[] = "0123456789abcdef";
+
+void writeHex(const unsigned char *data, int size, BufferedWriter &out) {
+    for (int i = 0; i < size; ++i) {
+        out.put(hexDigits[data[i] >> 4]);
+        out.put(hexDigits[data[i] & 15]);
+    }
+}
+
+void writeInteger(sqlite3_stmt *stmt, int col, BufferedWriter &out) {
+    char buffer[32];
+    int n = snprintf(buffer, sizeof(buffer), "%lld",
+                     (long long)sqlite3_column_int64(stmt, col));
+    out.write(buffer, n);
+}
+
+// кратчайшая запись, которая читается обратно в то же double; целое
+// получает ".0", чтобы при загрузке дампа осталось REAL, а не INTEGER
+void writeReal(sqlite3_stmt *stmt, int col, BufferedWriter &out) {
+    char buffer[32];
+    double value = sqlite3_column_double(stmt, col);
+    int n = snprintf(buffer, sizeof(buffer), "%.15g", value);
+    if (strtod(buffer, nullptr) != value)
+        n = snprintf(buffer, sizeof(buffer), "%.17g", value);
+    out.write(buffer, n);
+    if (!strpbrk(buffer, ".en"))
+        out.write(".0", 2);
+}
+
+// текст как поле CSV: в кавычках, только если есть , " или перевод строки
+void writeCsvText(const char *text, int size, BufferedWriter &out) {
+    if (!memchr(text, ',', size) && !memchr(text, '"', size) &&
+        !memchr(text, '\n', size) && !memchr(text, '\r', size)) {
+        out.write(text, size);
+        return;
+    }
+
+    out.put('"');
+    for (int i = 0; i < size; ++i) {
+        if (text[i] == '"')
+            out.put('"');
+        out.put(text[i]);
+    }
+    out.put('"');
+}
+
+// текст как строка JSON в кавычках
+void writeJsonText(const char *text, int size, BufferedWriter &out) {
+    out.put('"');
+    for (int i = 0; i < size; ++i) {
+        unsigned char c = (unsigned char)text[i];
+        switch (c) {
+        case '"':
+            out.write("\\\"", 2);
+            break;
+        case '\\':
+            out.write("\\\\", 2);
+            break;
+        case '\n':
+            out.write("\\n", 2);
+            break;
+        case '\r':
+            out.write("\\r", 2);
+            break;
+        case '\t':
+            out.write("\\t", 2);
+            break;
+        default:
+            if (c < 0x20) {
+                char escape[8];
+                snprintf(escape, sizeof(escape), "\\u%04x", c);
+                out.write(escape, 6);
+            } else {
+                out.put((char)c);
+            }
+            break;
+        }
+    }
+    out.put('"');
+}
+
+} // namespace
+
+BufferedWriter::BufferedWriter(size_t capacity)
+    : buffer(capacity) {}
+
+BufferedWriter::~BufferedWriter() { close(); }
+
+bool BufferedWriter::open(const std::string &path) {
+    close();
+    file = fopen(path.c_str(), "wb");
+    failed = file == nullptr;
+    used = 0;
+    written = 0;
+    return !failed;
+}
+
+bool BufferedWriter::close() {
+    if (!file)
+        return !failed;
+
+    flush();
+    if (fclose(file) != 0)
+        failed = true;
+    file = nullptr;
+    return !failed;
+}
+
+void BufferedWriter::write(const char *data, size_t size) {
+    if (size >= buffer.size()) {
+        flush();
+        if (file && fwrite(data, 1, size, file) != size)
+            failed = true;
+        written += size;
+        return;
+    }
+
+    if (used + size > buffer.size())
+        flush();
+    memcpy(buffer.data() + used, data, size);
+    used += size;
+}
+
+void BufferedWriter::flush() {
+    if (used && file && fwrite(buffer.data(), 1, used, file) != used)
+        failed = true;
+    written += used;
+    used = 0;
+}
+
+Exporter::Exporter(ExportOptions options, TaskProgress &progress)
+    : options(std::move(options)),
+      progress(progress) {}
+
+const char *Exporter::extension(ExportFormat format) {
+    switch (format) {
+    case ExportFormat::JsonLines:
+        return ".jsonl";
+    case ExportFormat::SqlInserts:
+        return ".sql";
+    default:
+        return ".csv";
+    }
+}
+
+bool Exporter::run() {
+    progress.start(0);
+    Database db;
+    if (!db.open(options.databasePath)) {
+        progress.setError("Не удалось открыть базу");
+        progress.finish();
+        return false;
+    }
+    return run(db);
+}
+
+bool Exporter::run(Database &db) {
+    if (!progress.running)
+        progress.start(0);
+
+    BufferedWriter out;
+    if (!out.open(options.path)) {
+        progress.setError("Не удалось создать " + options.path);
+        progress.finish();
+        return false;
+    }
+
+    std::string sql = options.sql;
+    if (sql.empty()) {
+        std::string table = Database::quoteIdentifier(options.table);
+        sql = "SELECT * FROM " + table + ";";
+        // оценка числа строк по max(rowid) не требует полного прохода
+        if (db.hasRowid(options.table)) {
+            auto max = db.query("SELECT max(rowid) FROM " + table + ";");
+            if (!max.empty())
+                progress.total =
+                    (uint64_t)std::max<int64_t>(0, max.getInt(0, 0));
+        }
+    }
+
+    writePrelude(db, out);
+    columns.clear();
+    uint64_t rows = 0;
+    bool ok = db.stream(sql, {}, [&](sqlite3_stmt *stmt) {
+        if (columns.empty()) {
+            std::vector<std::string> names;
+            int count = sqlite3_column_count(stmt);
+            for (int i = 0; i < count; ++i) {
+                const char *name = sqlite3_column_name(stmt, i);
+                names.push_back(name ? name : "");
+            }
+            startColumns(std::move(names), out);
+        }
+
+        writeRow(stmt, out);
+
+        if (++rows % 4096 == 0) {
+            progress.rows = rows;
+            progress.done = rows;
+            if (progress.cancelled || !out.ok())
+                return false;
+        }
+        return true;
+    });
+
+    progress.rows = rows;
+    progress.done = rows;
+    return finish(out, ok, ok ? "" : db.errorMessage());
+}
+
+// Таблица с rowid делится на диапазоны: каждый пишется своим соединением
+// пула во временный файл, затем части дописываются в итоговый по порядку.
+// Запрос или таблица без rowid выгружаются одним соединением пула.
+bool Exporter::run(ReadPool &pool) {
+    progress.start(0);
+
+    BufferedWriter out;
+    bool split = false;
+    int64_t first = 0, last = -1;
+    bool ran = pool.parallelFor(1, [&](Database &reader, size_t) {
+        if (!options.sql.empty() ||
+            !reader.rowidRange(options.table, first, last)) {
+            run(reader);
+            return;
+        }
+        split = true;
+        if (!out.open(options.path))
+            return;
+        auto header = reader.query(
+            "SELECT * FROM " + Database::quoteIdentifier(options.table) +
+            " LIMIT 0;");
+        std::vector<std::string> names;
+        for (size_t col = 0; col < header.columnCount(); ++col) {
+            names.push_back(header.columnName(col));
+        }
+        writePrelude(reader, out);
+        startColumns(std::move(names), out);
+    });
+    if (!split) {
+        if (!ran) {
+            progress.setError("Экспорт отменён");
+            progress.finish();
+        }
+        return progress.getError().empty();
+    }
+    if (!out.ok()) {
+        progress.setError("Не удалось создать " + options.path);
+        progress.finish();
+        return false;
+    }
+
+    auto ranges = ReadPool::splitRange(first, last, pool.size() * 4);
+    progress.total = (uint64_t)(last - first + 1);
+    std::vector<char> written(ranges.size(), 0);
+    std::mutex errorMutex;
+    std::string error;
+    std::string select = "SELECT * FROM " +
+                         Database::quoteIdentifier(options.table) +
+                         " WHERE rowid BETWEEN ? AND ?;";
+    bool ok = pool.parallelFor(ranges.size(), [&](Database &reader,
+                                                  size_t part) {
+        auto fail = [&](const std::string &message) {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (error.empty())
+                error = message;
+        };
+        BufferedWriter partOut(1 << 20);
+        if (!partOut.open(partPath(part))) {
+            fail("Не удалось создать " + partPath(part));
+            return;
+        }
+        uint64_t rows = 0;
+        bool streamed = reader.stream(
+            select,
+            {Value::ofInteger(ranges[part].first),
+             Value::ofInteger(ranges[part].second)},
+            [&](sqlite3_stmt *stmt) {
+                writeRow(stmt, partOut);
+                if (++rows % 4096 == 0) {
+                    progress.rows += 4096;
+                    progress.done += 4096;
+                    if (progress.cancelled || !partOut.ok())
+                        return false;
+                }
+                return true;
+            });
+        progress.rows += rows % 4096;
+        progress.done += rows % 4096;
+        if (!streamed)
+            fail(reader.errorMessage());
+        written[part] = partOut.close() && streamed;
+        if (streamed && !written[part])
+            fail("Не удалось записать " + partPath(part));
+    });
+
+    // части дописываются по порядку диапазонов и сразу удаляются
+    std::vector<char> buffer(4 << 20);
+    for (size_t part = 0; part < ranges.size(); ++part) {
+        ok = ok && written[part];
+        FILE *file = fopen(partPath(part).c_str(), "rb");
+        if (ok && !file) {
+            ok = false;
+            error = "Не удалось прочитать " + partPath(part);
+        }
+        size_t size;
+        while (ok && file &&
+               (size = fread(buffer.data(), 1, buffer.size(), file)) > 0) {
+            out.write(buffer.data(), size);
+        }
+        if (file)
+            fclose(file);
+        remove(partPath(part).c_str());
+    }
+    return finish(out, ok, error);
+}
+
+std::string Exporter::partPath(size_t part) const {
+    return options.path + ".part" + std::to_string(part);
+}
+
+void Exporter::writePrelude(Database &db, BufferedWriter &out) {
+    if (options.format != ExportFormat::SqlInserts)
+        return;
+
+    out.write("BEGIN TRANSACTION;\n");
+    if (options.sql.empty()) {
+        auto schema =
+            db.query("SELECT sql FROM sqlite_master WHERE type = 'table' "
+                     "AND name = ?;",
+                     {Value::ofText(options.table)});
+        if (!schema.empty())
+            out.write(schema.getString(0, 0) + ";\n");
+    }
+}
+
+void Exporter::startColumns(std::vector<std::string> names,
+                            BufferedWriter &out) {
+    columns = std::move(names);
+    std::string target =
+        options.table.empty() ? "query_result" : options.table;
+
+    if (options.format == ExportFormat::Csv) {
+        for (size_t i = 0; i < columns.size(); ++i) {
+            if (i)
+                out.put(',');
+            writeCsvText(columns[i].data(), (int)columns[i].size(), out);
+        }
+        out.put('\n');
+    } else if (options.format == ExportFormat::SqlInserts) {
+        insertPrefix =
+            "INSERT INTO " + Database::quoteIdentifier(target) + " (";
+        for (size_t i = 0; i < columns.size(); ++i) {
+            if (i)
+                insertPrefix += ", ";
+            insertPrefix += Database::quoteIdentifier(columns[i]);
+        }
+        insertPrefix += ") VALUES (";
+    }
+}
+
+bool Exporter::finish(BufferedWriter &out, bool ok,
+                      const std::string &error) {
+    if (options.format == ExportFormat::SqlInserts)
+        out.write("COMMIT;\n");
+
+    if (!out.close())
+        progress.setError("Ошибка записи в " + options.path);
+    else if (progress.cancelled)
+        progress.setError("Экспорт отменён");
+    else if (!ok)
+        progress.setError(error.empty() ? "Ошибка экспорта в " + options.path
+                                        : error);
+
+    progress.finish();
+    return progress.getError().empty();
+}
+
+void Exporter::writeRow(sqlite3_stmt *stmt, BufferedWriter &out) const {
+    int count = (int)columns.size();
+    switch (options.format) {
+    case ExportFormat::Csv:
+        for (int i = 0; i < count; ++i) {
+            if (i)
+                out.put(',');
+            writeCsvValue(stmt, i, out);
+        }
+        out.put('\n');
+        break;
+    case ExportFormat::JsonLines:
+        out.put('{');
+        for (int i = 0; i < count; ++i) {
+            if (i)
+                out.put(',');
+            writeJsonText(columns[i].data(), (int)columns[i].size(), out);
+            out.put(':');
+            writeJsonValue(stmt, i, out);
+        }
+        out.write("}\n", 2);
+        break;
+    case ExportFormat::SqlInserts:
+        out.write(insertPrefix);
+        for (int i = 0; i < count; ++i) {
+            if (i)
+                out.write(", ", 2);
+            writeSqlValue(stmt, i, out);
+        }
+        out.write(");\n", 3);
+        break;
+    }
+}
+
+void Exporter::writeCsvValue(sqlite3_stmt *stmt, int col,
+                             BufferedWriter &out) const {
+    switch (sqlite3_column_type(stmt, col)) {
+    case SQLITE_NULL:
+        return;
+    case SQLITE_INTEGER:
+        writeInteger(stmt, col, out);
+        return;
+    case SQLITE_FLOAT:
+        writeReal(stmt, col, out);
+        return;
+    case SQLITE_BLOB:
+        writeHex((const unsigned char *)sqlite3_column_blob(stmt, col),
+                 sqlite3_column_bytes(stmt, col), out);
+        return;
+    default:
+        break;
+    }
+
+    writeCsvText((const char *)sqlite3_column_text(stmt, col),
+                 sqlite3_column_bytes(stmt, col), out);
+}
+
+void Exporter::writeJsonValue(sqlite3_stmt *stmt, int col,
+                              BufferedWriter &out) const {
+    switch (sqlite3_column_type(stmt, col)) {
+    case SQLITE_NULL:
+        out.write("null", 4);
+        return;
+    case SQLITE_INTEGER:
+        writeInteger(stmt, col, out);
+        return;
+    case SQLITE_FLOAT:
+        if (std::isfinite(sqlite3_column_double(stmt, col)))
+            writeReal(stmt, col, out);
+        else
+            out.write("null", 4);
+        return;
+    case SQLITE_BLOB:
+        out.put('"');
+        writeHex((const unsigned char *)sqlite3_column_blob(stmt, col),
+                 sqlite3_column_bytes(stmt, col), out);
+        out.put('"');
+        return;
+    default:
+        break;
+    }
+
+    writeJsonText((const char *)sqlite3_column_text(stmt, col),
+                  sqlite3_column_bytes(stmt, col), out);
+}
+
+void Exporter::writeSqlValue(sqlite3_stmt *stmt, int col,
+                             BufferedWriter &out) const {
+    switch (sqlite3_column_type(stmt, col)) {
+    case SQLITE_NULL:
+        out.write("NULL", 4);
+        return;
+    case SQLITE_INTEGER:
+        writeInteger(stmt, col, out);
+        return;
+    case SQLITE_FLOAT: {
+        // inf и nan SQLite не читает: бесконечность - как 9e999 в
+        // самом SQLite, NaN он хранит как NULL
+        double value = sqlite3_column_double(stmt, col);
+        if (std::isnan(value))
+            out.write("NULL", 4);
+        else if (std::isinf(value))
+            out.write(value > 0 ? "9e999" : "-9e999");
+        else
+            writeReal(stmt, col, out);
+        return;
+    }
+    case SQLITE_BLOB:
+        out.write("X'", 2);
+        writeHex((const unsigned char *)sqlite3_column_blob(stmt, col),
+                 sqlite3_column_bytes(stmt, col), out);
+        out.put('\'');
+        return;
+    default:
+        break;
+    }
+
+    const char *text = (const char *)sqlite3_column_text(stmt, col);
+    int size = sqlite3_column_bytes(stmt, col);
+    out.put('\'');
+    for (int i = 0; i < size; ++i) {
+        if (text[i] == '\'')
+            out.put('\'');
+        out.put(text[i]);
+    }
+    out.put('\'');
+}
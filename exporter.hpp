@@ -0,0 +1,84 @@
+#pragma once
+
+#include "database.hpp"
+#include "read_pool.hpp"
+#include "task_progress.hpp"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+enum class ExportFormat { Csv, JsonLines, SqlInserts };
+
+struct ExportOptions {
+        // база открывается отдельным соединением в потоке экспорта
+        std::string databasePath;
+        // таблица целиком или произвольный запрос, если sql не пуст
+        std::string table;
+        std::string sql;
+        std::string path;
+        ExportFormat format = ExportFormat::Csv;
+};
+
+// Файл с большим буфером: данные уходят на диск кусками по несколько МБ
+class BufferedWriter {
+    public:
+        explicit BufferedWriter(size_t capacity = 4 << 20);
+        ~BufferedWriter();
+
+        bool open(const std::string &path);
+        bool close();
+
+        void write(const char *data, size_t size);
+        void write(const std::string &text) { write(text.data(), text.size()); }
+        void put(char c) {
+            if (used == buffer.size())
+                flush();
+            buffer[used++] = c;
+        }
+
+        bool ok() const { return !failed; }
+        uint64_t bytesWritten() const { return written + used; }
+
+    private:
+        void flush();
+
+        FILE *file = nullptr;
+        std::vector<char> buffer;
+        size_t used = 0;
+        uint64_t written = 0;
+        bool failed = false;
+};
+
+// Потоковая выгрузка: строки читаются шагами sqlite3_step и сразу пишутся
+// в файл, поэтому расход памяти не зависит от размера таблицы.
+class Exporter {
+    public:
+        Exporter(ExportOptions options, TaskProgress &progress);
+
+        bool run();
+        bool run(Database &db);
+        // параллельно по диапазонам rowid на соединениях пула
+        bool run(ReadPool &pool);
+
+        static const char *extension(ExportFormat format);
+
+    private:
+        std::string partPath(size_t part) const;
+        void writePrelude(Database &db, BufferedWriter &out);
+        void startColumns(std::vector<std::string> names, BufferedWriter &out);
+        bool finish(BufferedWriter &out, bool ok, const std::string &error);
+
+        // только читают состояние и вызываются из нескольких потоков
+        void writeRow(sqlite3_stmt *stmt, BufferedWriter &out) const;
+        void writeCsvValue(sqlite3_stmt *stmt, int col,
+                           BufferedWriter &out) const;
+        void writeJsonValue(sqlite3_stmt *stmt, int col,
+                            BufferedWriter &out) const;
+        void writeSqlValue(sqlite3_stmt *stmt, int col,
+                           BufferedWriter &out) const;
+
+        ExportOptions options;
+        TaskProgress &progress;
+        std::vector<std::string> columns;
+        std::string insertPrefix;
+};
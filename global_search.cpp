@@ -0,0 +1,398 @@
+#include "global_search.hpp"
+#include "schema_catalog.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+
+namespace {
+
+// число символов UTF-8: trigram ищет по индексу от трёх символов
+size_t utf8Length(const std::string &text) {
+    size_t length = 0;
+    for (unsigned char c : text) {
+        length += (c & 0xC0) != 0x80;
+    }
+    return length;
+}
+
+// позиция needle в data без учёта регистра ASCII, как у LIKE
+size_t findNoCase(const char *data, size_t size, const std::string &needle) {
+    if (needle.empty() || needle.size() > size)
+        return std::string::npos;
+    for (size_t at = 0; at + needle.size() <= size; ++at) {
+        size_t i = 0;
+        while (i < needle.size() &&
+               tolower((unsigned char)data[at + i]) ==
+                   tolower((unsigned char)needle[i])) {
+            ++i;
+        }
+        if (i == needle.size())
+            return at;
+    }
+    return std::string::npos;
+}
+
+// фрагмент вокруг совпадения с выделением в [ ], по границам символов UTF-8
+std::string makeSnippet(const char *data, size_t size, size_t at,
+                        size_t length) {
+    const size_t context = 40;
+    size_t from = at > context ? at - context : 0;
+    size_t to = std::min(size, at + length + context);
+    while (from > 0 && ((unsigned char)data[from] & 0xC0) == 0x80) {
+        --from;
+    }
+    while (to < size && ((unsigned char)data[to] & 0xC0) == 0x80) {
+        ++to;
+    }
+
+    std::string snippet = from ? "..." : "";
+    for (size_t i = from; i < to; ++i) {
+        if (i == at)
+            snippet += '[';
+        if (i == at + length)
+            snippet += ']';
+        snippet += (unsigned char)data[i] < ' ' ? ' ' : data[i];
+    }
+    if (at + length == to)
+        snippet += ']';
+    return to < size ? snippet + "..." : snippet;
+}
+
+// фраза FTS5: кавычки внутри удваиваются
+std::string ftsPhrase(const std::string &text) {
+    std::string phrase = "\"";
+    for (char c : text) {
+        if (c == '"')
+            phrase += '"';
+        phrase += c;
+    }
+    return phrase + "\"";
+}
+
+} // namespace
+
+std::string SearchIndex::sidecarPath(const std::string &dbPath) {
+    return dbPath + ".fts";
+}
+
+bool SearchIndex::exists(const std::string &dbPath) {
+    FILE *file = fopen(sidecarPath(dbPath).c_str(), "rb");
+    if (file)
+        fclose(file);
+    return file != nullptr;
+}
+
+bool SearchIndex::attach(Database &db, const std::string &dbPath) {
+    if (isAttached(db))
+        return true;
+    if (!exists(dbPath))
+        return false;
+    if (!attachFile(db, dbPath))
+        return false;
+
+    auto meta = db.query("SELECT name FROM search_index.sqlite_master "
+                         "WHERE name = '_search_tables';");
+    if (meta.empty()) {
+        db.execute("DETACH search_index;");
+        return false;
+    }
+    if (!db.isReadOnly())
+        installTriggers(db);
+    return true;
+}
+
+bool SearchIndex::attachFile(Database &db, const std::string &dbPath) {
+    return db.execute(
+        "ATTACH " +
+        Database::quoteLiteral(Value::ofText(sidecarPath(dbPath))) +
+        " AS search_index;");
+}
+
+bool SearchIndex::isAttached(Database &db) {
+    auto list = db.query("SELECT 1 FROM pragma_database_list "
+                         "WHERE name = 'search_index';");
+    return !list.empty();
+}
+
+std::string SearchIndex::contentExpression(Database &db,
+                                           const std::string &table,
+                                           const std::string &row) {
+    std::string expression;
+    for (const auto &name : db.getTableColumns(table)) {
+        std::string column = (row.empty() ? "" : row + ".") +
+                             Database::quoteIdentifier(name);
+        if (!expression.empty())
+            expression += " || char(10) || ";
+        expression += "coalesce(CASE WHEN typeof(" + column +
+                      ") = 'blob' THEN NULL ELSE " + column + " END, '')";
+    }
+    return expression.empty() ? "''" : expression;
+}
+
+bool SearchIndex::build(Database &db, const std::string &dbPath,
+                        TaskProgress &progress) {
+    remove(db, dbPath);
+    if (!attachFile(db, dbPath)) {
+        progress.setError(db.errorMessage());
+        progress.finish();
+        return false;
+    }
+
+    auto catalog = db.catalog();
+    std::vector<const TableSchema *> tables;
+    for (const auto &table : catalog->tables) {
+        if (!table.withoutRowid)
+            tables.push_back(&table);
+    }
+    progress.total = tables.size();
+
+    bool ok = db.execute("CREATE TABLE search_index._search_tables ("
+                         "source TEXT PRIMARY KEY, fts TEXT NOT NULL, "
+                         "max_rowid INTEGER);") &&
+              db.beginTransaction();
+    for (size_t i = 0; ok && i < tables.size(); ++i) {
+        const std::string &source = tables[i]->name;
+        std::string fts = "_search_fts_" + std::to_string(i);
+        std::string from = " FROM main." + Database::quoteIdentifier(source);
+        ok = db.execute("CREATE VIRTUAL TABLE search_index." + fts +
+                        " USING fts5(value, tokenize = 'trigram');") &&
+             db.execute("INSERT INTO search_index." + fts +
+                        " (rowid, value) SELECT rowid, " +
+                        contentExpression(db, source, "") + from + ";") &&
+             db.execute("INSERT INTO search_index._search_tables VALUES (" +
+                        Database::quoteLiteral(Value::ofText(source)) +
+                        ", '" + fts + "', (SELECT max(rowid)" + from +
+                        "));") &&
+             !progress.cancelled;
+        progress.done = i + 1;
+    }
+
+    if (ok)
+        ok = db.commitTransaction();
+    else if (db.inTransaction())
+        db.rollbackTransaction();
+
+    if (!ok) {
+        progress.setError(progress.cancelled ? "Построение отменено"
+                                             : db.errorMessage());
+        remove(db, dbPath);
+    } else {
+        installTriggers(db);
+    }
+    progress.finish();
+    return ok;
+}
+
+void SearchIndex::remove(Database &db, const std::string &dbPath) {
+    auto triggers = db.query("SELECT name FROM temp.sqlite_master WHERE "
+                             "type = 'trigger' AND name LIKE 'search\\_%' "
+                             "ESCAPE '\\';");
+    for (size_t i = 0; i < triggers.rowCount(); ++i) {
+        db.execute("DROP TRIGGER IF EXISTS temp." +
+                   Database::quoteIdentifier(triggers.getString(i, 0)) + ";");
+    }
+    if (isAttached(db))
+        db.execute("DETACH search_index;");
+
+    std::string path = sidecarPath(dbPath);
+    std::remove(path.c_str());
+    std::remove((path + "-journal").c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+// Триггеры TEMP живут только в этом соединении и могут писать в
+// подключённую базу; изменения индекса идут в той же транзакции, что и
+// правка, поэтому откат правки откатывает и индекс.
+void SearchIndex::installTriggers(Database &db) {
+    auto catalog = db.catalog();
+    auto indexed =
+        db.query("SELECT source, fts FROM search_index._search_tables;");
+    for (size_t i = 0; i < indexed.rowCount(); ++i) {
+        std::string source = indexed.getString(i, 0);
+        std::string fts = indexed.getString(i, 1);
+        if (!catalog->find(source))
+            continue;
+
+        // в теле триггера таблицы не квалифицируются: имена с префиксом
+        // _search находятся в подключённой базе
+        std::string table = "main." + Database::quoteIdentifier(source);
+        std::string insert = "INSERT INTO " + fts +
+                             " (rowid, value) VALUES (new.rowid, " +
+                             contentExpression(db, source, "new") + "); ";
+        std::string erase = "DELETE FROM " + fts + " WHERE rowid = old.rowid; ";
+        std::string grow = "UPDATE _search_tables SET max_rowid = "
+                           "max(coalesce(max_rowid, new.rowid), new.rowid) "
+                           "WHERE source = " +
+                           Database::quoteLiteral(Value::ofText(source)) +
+                           "; ";
+
+        db.execute("DROP TRIGGER IF EXISTS temp.search_ai" + fts +
+                   "; DROP TRIGGER IF EXISTS temp.search_ad" + fts +
+                   "; DROP TRIGGER IF EXISTS temp.search_au" + fts + ";");
+        db.execute("CREATE TEMP TRIGGER search_ai" + fts +
+                   " AFTER INSERT ON " + table + " BEGIN " + insert + grow +
+                   "END;");
+        db.execute("CREATE TEMP TRIGGER search_ad" + fts +
+                   " AFTER DELETE ON " + table + " BEGIN " + erase + "END;");
+        db.execute("CREATE TEMP TRIGGER search_au" + fts +
+                   " AFTER UPDATE ON " + table + " BEGIN " + erase + insert +
+                   grow + "END;");
+    }
+}
+
+std::vector<std::string> SearchIndex::freshTables(Database &db) {
+    std::vector<std::string> fresh;
+    if (!isAttached(db))
+        return fresh;
+
+    auto catalog = db.catalog();
+    auto indexed =
+        db.query("SELECT source, max_rowid FROM search_index._search_tables;");
+    for (size_t i = 0; i < indexed.rowCount(); ++i) {
+        std::string source = indexed.getString(i, 0);
+        if (!catalog->find(source))
+            continue;
+        auto current = db.query("SELECT max(rowid) FROM main." +
+                                Database::quoteIdentifier(source) + ";");
+        if (!current.empty() &&
+            current.getValue(0, 0) == indexed.getValue(i, 1))
+            fresh.push_back(source);
+    }
+    return fresh;
+}
+
+std::vector<SearchHit> SearchIndex::search(Database &db,
+                                           const std::string &text,
+                                           const std::string &table,
+                                           size_t limit) {
+    std::vector<SearchHit> hits;
+    auto meta = db.query("SELECT fts FROM search_index._search_tables "
+                         "WHERE source = ?;",
+                         {Value::ofText(table)});
+    if (meta.empty())
+        return hits;
+
+    std::string fts = meta.getString(0, 0);
+    auto found = db.query(
+        "SELECT rowid, snippet(" + fts +
+            ", 0, '[', ']', '...', 12) FROM search_index." + fts + " WHERE " +
+            fts + " MATCH ? LIMIT ?;",
+        {Value::ofText(ftsPhrase(text)), Value::ofInteger((int64_t)limit)});
+    for (size_t row = 0; row < found.rowCount(); ++row) {
+        SearchHit hit;
+        hit.table = table;
+        hit.key.push_back(found.getValue(row, 0));
+        hit.snippet = found.getString(row, 1);
+        std::replace(hit.snippet.begin(), hit.snippet.end(), '\n', ' ');
+        hits.push_back(std::move(hit));
+    }
+    return hits;
+}
+
+GlobalSearch::GlobalSearch(std::string text, TaskProgress &progress)
+    : text(std::move(text)),
+      progress(progress) {}
+
+void GlobalSearch::run(Database &db, ReadPool *pool,
+                       const std::vector<std::string> &tables) {
+    progress.total = tables.size();
+
+    std::vector<std::string> fresh;
+    if (utf8Length(text) >= 3)
+        fresh = SearchIndex::freshTables(db);
+
+    std::vector<std::string> scanned;
+    for (const auto &table : tables) {
+        if (std::find(fresh.begin(), fresh.end(), table) == fresh.end()) {
+            scanned.push_back(table);
+            continue;
+        }
+        for (auto &hit :
+             SearchIndex::search(db, text, table, MaxHits - hits)) {
+            addHit(std::move(hit));
+        }
+        ++indexed;
+        ++progress.done;
+    }
+
+    if (pool && pool->isOpen()) {
+        pool->parallelFor(scanned.size(), [&](Database &reader, size_t i) {
+            scanTable(reader, scanned[i]);
+        });
+    } else {
+        for (const auto &table : scanned) {
+            scanTable(db, table);
+        }
+    }
+}
+
+std::vector<SearchHit> GlobalSearch::take() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<SearchHit> taken;
+    taken.swap(fresh);
+    return taken;
+}
+
+size_t GlobalSearch::indexedTables() const { return indexed.load(); }
+
+void GlobalSearch::scanTable(Database &db, const std::string &table) {
+    if (progress.cancelled || hits >= MaxHits) {
+        ++progress.done;
+        return;
+    }
+
+    std::vector<std::string> keys = db.rowKeyColumns(table);
+    std::vector<std::string> names = db.getTableColumns(table);
+    std::string sql = "SELECT ";
+    for (const auto &key : keys) {
+        sql += (key == "rowid" ? key : Database::quoteIdentifier(key)) + ", ";
+    }
+    std::string where;
+    for (size_t i = 0; i < names.size(); ++i) {
+        std::string column = Database::quoteIdentifier(names[i]);
+        sql += (i ? ", " : "") + column;
+        where += (i ? " OR " : "") + column + " LIKE ?1 ESCAPE '\\'";
+    }
+    sql += " FROM " + Database::quoteIdentifier(table) + " WHERE " + where +
+           ";";
+
+    std::string pattern = "%";
+    for (char c : text) {
+        if (c == '%' || c == '_' || c == '\\')
+            pattern += '\\';
+        pattern += c;
+    }
+    pattern += '%';
+
+    db.stream(sql, {Value::ofText(pattern)}, [&](sqlite3_stmt *stmt) {
+        SearchHit hit;
+        hit.table = table;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            hit.key.push_back(Value::fromColumn(stmt, (int)i));
+        }
+        for (size_t i = 0; i < names.size(); ++i) {
+            int col = (int)(keys.size() + i);
+            const char *data = (const char *)sqlite3_column_text(stmt, col);
+            size_t size = (size_t)sqlite3_column_bytes(stmt, col);
+            size_t at = data ? findNoCase(data, size, text)
+                             : std::string::npos;
+            if (at != std::string::npos) {
+                hit.column = names[i];
+                hit.snippet = makeSnippet(data, size, at, text.size());
+                break;
+            }
+        }
+
+        return addHit(std::move(hit)) && !progress.cancelled;
+    });
+    ++progress.done;
+}
+
+bool GlobalSearch::addHit(SearchHit hit) {
+    if (hits >= MaxHits)
+        return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    fresh.push_back(std::move(hit));
+    return ++hits < MaxHits;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "read_pool.hpp"
+#include "result_set.hpp"
+#include "task_progress.hpp"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct SearchHit {
+        std::string table;
+        // rowid или первичный ключ, как у PagedTable
+        std::vector<Value> key;
+        // пусто, если совпадение найдено индексом по строке целиком
+        std::string column;
+        std::string snippet;
+};
+
+// FTS5-индекс в файле рядом с базой (<база>.fts), подключается к
+// соединению worker как search_index. На каждую таблицу с rowid -
+// FTS5-таблица с токенизатором trigram и тем же rowid, поэтому поиск
+// подстроки от трёх символов идёт по индексу. Индекс поддерживают
+// TEMP-триггеры этого соединения; правки из других программ замечаются
+// по max(rowid) (удаления - нет), такие таблицы считаются устаревшими.
+class SearchIndex {
+    public:
+        static constexpr const char *Schema = "search_index";
+
+        static std::string sidecarPath(const std::string &dbPath);
+        static bool exists(const std::string &dbPath);
+        // подключает существующий индекс и ставит триггеры
+        static bool attach(Database &db, const std::string &dbPath);
+        static bool isAttached(Database &db);
+        // строит индекс заново по всем таблицам с rowid
+        static bool build(Database &db, const std::string &dbPath,
+                          TaskProgress &progress);
+        static void remove(Database &db, const std::string &dbPath);
+
+        // таблицы в индексе, совпадающие с базой
+        static std::vector<std::string> freshTables(Database &db);
+        static std::vector<SearchHit> search(Database &db,
+                                             const std::string &text,
+                                             const std::string &table,
+                                             size_t limit);
+
+    private:
+        static bool attachFile(Database &db, const std::string &dbPath);
+        static std::string contentExpression(Database &db,
+                                             const std::string &table,
+                                             const std::string &row);
+        static void installTriggers(Database &db);
+};
+
+// Поиск подстроки по всем таблицам. Таблицы из свежего индекса ищутся
+// FTS5 на db, остальные сканируются LIKE по всем столбцам, каждая своим
+// заданием пула. Совпадения копятся в буфере, интерфейс забирает их
+// take() каждый кадр, не дожидаясь конца поиска.
+class GlobalSearch {
+    public:
+        static constexpr size_t MaxHits = 1000;
+
+        GlobalSearch(std::string text, TaskProgress &progress);
+
+        // db - соединение с подключённым индексом (если он есть)
+        void run(Database &db, ReadPool *pool,
+                 const std::vector<std::string> &tables);
+        // совпадения, найденные после прошлого вызова
+        std::vector<SearchHit> take();
+        // сколько таблиц найдено по индексу
+        size_t indexedTables() const;
+
+    private:
+        void scanTable(Database &db, const std::string &table);
+        // false, когда набрано MaxHits
+        bool addHit(SearchHit hit);
+
+        std::string text;
+        TaskProgress &progress;
+        std::mutex mutex;
+        std::vector<SearchHit> fresh;
+        std::atomic<size_t> hits{0};
+        std::atomic<size_t> indexed{0};
+};
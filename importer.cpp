@@ -0,0 +1,721 @@
+#include "importer.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <strings.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr size_t ChunkSize = 1 << 20;
+constexpr size_t RowsPerBatch = 8192;
+constexpr size_t QueueDepth = 8;
+
+// Разобранные строки: поля всех строк подряд, rowEnds[i] - конец строки i.
+// В первом пакете передаются также имена столбцов.
+struct RowBatch {
+        std::vector<std::string> columns;
+        std::vector<std::string> fields;
+        std::vector<bool> nulls;
+        std::vector<size_t> rowEnds;
+
+        size_t rowCount() const { return rowEnds.size(); }
+        size_t rowBegin(size_t row) const { return row ? rowEnds[row - 1] : 0; }
+
+        void addField(std::string value, bool isNull) {
+            fields.push_back(std::move(value));
+            nulls.push_back(isNull);
+        }
+
+        void endRow() { rowEnds.push_back(fields.size()); }
+
+        void dropFirstRow() {
+            size_t count = rowEnds.front();
+            fields.erase(fields.begin(), fields.begin() + count);
+            nulls.erase(nulls.begin(), nulls.begin() + count);
+            rowEnds.erase(rowEnds.begin());
+            for (auto &end : rowEnds) {
+                end -= count;
+            }
+        }
+};
+
+// Ограниченная очередь между потоком разбора и потоком вставки
+class BatchQueue {
+    public:
+        bool push(RowBatch batch) {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this]() {
+                return aborted || batches.size() < QueueDepth;
+            });
+            if (aborted)
+                return false;
+            batches.push_back(std::move(batch));
+            changed.notify_all();
+            return true;
+        }
+
+        bool pop(RowBatch &batch) {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this]() {
+                return aborted || closed || !batches.empty();
+            });
+            if (aborted || batches.empty())
+                return false;
+            batch = std::move(batches.front());
+            batches.pop_front();
+            changed.notify_all();
+            return true;
+        }
+
+        void close() {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            changed.notify_all();
+        }
+
+        void abort() {
+            std::lock_guard<std::mutex> lock(mutex);
+            aborted = true;
+            changed.notify_all();
+        }
+
+    private:
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<RowBatch> batches;
+        bool closed = false;
+        bool aborted = false;
+};
+
+// CSV по RFC 4180 (кавычки, "" внутри поля, переводы строк в кавычках);
+// для TSV кавычки не используются. Состояние сохраняется между кусками.
+class CsvParser {
+    public:
+        CsvParser(char separator, bool quoting)
+            : separator(separator),
+              quoting(quoting) {}
+
+        void feed(const char *data, size_t size, RowBatch &batch) {
+            for (size_t i = 0; i < size; ++i) {
+                char c = data[i];
+                switch (state) {
+                case State::FieldStart:
+                    if (quoting && c == '"') {
+                        state = State::Quoted;
+                    } else if (c == separator) {
+                        endField();
+                    } else if (c == '\n') {
+                        endField();
+                        endRecord(batch);
+                    } else if (c != '\r') {
+                        field += c;
+                        state = State::Unquoted;
+                    }
+                    break;
+                case State::Unquoted:
+                case State::QuoteInQuoted:
+                    if (state == State::QuoteInQuoted && c == '"') {
+                        field += '"';
+                        state = State::Quoted;
+                    } else if (c == separator) {
+                        endField();
+                    } else if (c == '\n') {
+                        endField();
+                        endRecord(batch);
+                    } else if (c != '\r') {
+                        field += c;
+                        state = State::Unquoted;
+                    }
+                    break;
+                case State::Quoted:
+                    if (c == '"')
+                        state = State::QuoteInQuoted;
+                    else
+                        field += c;
+                    break;
+                }
+            }
+        }
+
+        void finish(RowBatch &batch) {
+            if (state != State::FieldStart || !field.empty() ||
+                !record.empty()) {
+                endField();
+                endRecord(batch);
+            }
+        }
+
+    private:
+        enum class State { FieldStart, Unquoted, Quoted, QuoteInQuoted };
+
+        void endField() {
+            record.push_back(std::move(field));
+            field.clear();
+            state = State::FieldStart;
+        }
+
+        void endRecord(RowBatch &batch) {
+            // пустые строки пропускаются
+            if (!(record.size() == 1 && record[0].empty())) {
+                for (auto &value : record) {
+                    batch.addField(std::move(value), false);
+                }
+                batch.endRow();
+            }
+            record.clear();
+        }
+
+        char separator;
+        bool quoting;
+        State state = State::FieldStart;
+        std::string field;
+        std::vector<std::string> record;
+};
+
+// JSON Lines: по одному плоскому объекту в строке. Столбцы задаются
+// ключами первого объекта; вложенные объекты и массивы сохраняются текстом.
+class JsonLinesParser {
+    public:
+        void feed(const char *data, size_t size, RowBatch &batch) {
+            const char *end = data + size;
+            while (data < end) {
+                const char *newline =
+                    (const char *)memchr(data, '\n', end - data);
+                if (!newline) {
+                    pending.append(data, end);
+                    return;
+                }
+                if (pending.empty()) {
+                    parseLine(data, newline, batch);
+                } else {
+                    pending.append(data, newline);
+                    parseLine(pending.data(), pending.data() + pending.size(),
+                              batch);
+                    pending.clear();
+                }
+                data = newline + 1;
+            }
+        }
+
+        void finish(RowBatch &batch) {
+            if (!pending.empty())
+                parseLine(pending.data(), pending.data() + pending.size(),
+                          batch);
+            pending.clear();
+        }
+
+        const std::vector<std::string> &columns() const { return names; }
+
+    private:
+        void parseLine(const char *p, const char *end, RowBatch &batch) {
+            skipSpace(p, end);
+            if (p == end || *p != '{')
+                return;
+            ++p;
+
+            values.assign(names.size(), std::string());
+            present.assign(names.size(), false);
+
+            skipSpace(p, end);
+            while (p < end && *p != '}') {
+                std::string key;
+                if (!parseString(p, end, key))
+                    return;
+                skipSpace(p, end);
+                if (p == end || *p != ':')
+                    return;
+                ++p;
+                skipSpace(p, end);
+
+                std::string value;
+                bool isNull = false;
+                if (!parseValue(p, end, value, isNull))
+                    return;
+
+                auto it = index.find(key);
+                if (it == index.end() && firstObject) {
+                    index[key] = names.size();
+                    names.push_back(key);
+                    values.push_back(std::string());
+                    present.push_back(false);
+                    it = index.find(key);
+                }
+                if (it != index.end() && !isNull) {
+                    values[it->second] = std::move(value);
+                    present[it->second] = true;
+                }
+
+                skipSpace(p, end);
+                if (p < end && *p == ',') {
+                    ++p;
+                    skipSpace(p, end);
+                }
+            }
+
+            firstObject = false;
+            for (size_t i = 0; i < names.size(); ++i) {
+                batch.addField(std::move(values[i]), !present[i]);
+            }
+            batch.endRow();
+        }
+
+        static void skipSpace(const char *&p, const char *end) {
+            while (p < end && isspace((unsigned char)*p)) {
+                ++p;
+            }
+        }
+
+        static void appendUtf8(std::string &out, unsigned code) {
+            if (code < 0x80) {
+                out += (char)code;
+            } else if (code < 0x800) {
+                out += (char)(0xC0 | (code >> 6));
+                out += (char)(0x80 | (code & 0x3F));
+            } else if (code < 0x10000) {
+                out += (char)(0xE0 | (code >> 12));
+                out += (char)(0x80 | ((code >> 6) & 0x3F));
+                out += (char)(0x80 | (code & 0x3F));
+            } else {
+                out += (char)(0xF0 | (code >> 18));
+                out += (char)(0x80 | ((code >> 12) & 0x3F));
+                out += (char)(0x80 | ((code >> 6) & 0x3F));
+                out += (char)(0x80 | (code & 0x3F));
+            }
+        }
+
+        static bool parseHex4(const char *&p, const char *end,
+                              unsigned &code) {
+            if (end - p < 4)
+                return false;
+            code = (unsigned)strtoul(std::string(p, 4).c_str(), nullptr, 16);
+            p += 4;
+            return true;
+        }
+
+        static bool parseString(const char *&p, const char *end,
+                                std::string &out) {
+            if (p == end || *p != '"')
+                return false;
+            ++p;
+            while (p < end && *p != '"') {
+                if (*p != '\\') {
+                    out += *p++;
+                    continue;
+                }
+                if (++p == end)
+                    return false;
+                char c = *p++;
+                switch (c) {
+                case 'n':
+                    out += '\n';
+                    break;
+                case 't':
+                    out += '\t';
+                    break;
+                case 'r':
+                    out += '\r';
+                    break;
+                case 'b':
+                    out += '\b';
+                    break;
+                case 'f':
+                    out += '\f';
+                    break;
+                case 'u': {
+                    unsigned code;
+                    if (!parseHex4(p, end, code))
+                        return false;
+                    // суррогатная пара
+                    if (code >= 0xD800 && code < 0xDC00 && end - p >= 6 &&
+                        p[0] == '\\' && p[1] == 'u') {
+                        p += 2;
+                        unsigned low;
+                        if (!parseHex4(p, end, low))
+                            return false;
+                        code = 0x10000 + ((code - 0xD800) << 10) +
+                               (low - 0xDC00);
+                    }
+                    appendUtf8(out, code);
+                    break;
+                }
+                default:
+                    out += c;
+                    break;
+                }
+            }
+            if (p == end)
+                return false;
+            ++p;
+            return true;
+        }
+
+        static bool parseValue(const char *&p, const char *end,
+                               std::string &out, bool &isNull) {
+            if (p == end)
+                return false;
+
+            if (*p == '"')
+                return parseString(p, end, out);
+
+            if (*p == '{' || *p == '[') {
+                const char *start = p;
+                int depth = 0;
+                bool inString = false;
+                for (; p < end; ++p) {
+                    if (inString) {
+                        if (*p == '\\')
+                            ++p;
+                        else if (*p == '"')
+                            inString = false;
+                    } else if (*p == '"') {
+                        inString = true;
+                    } else if (*p == '{' || *p == '[') {
+                        ++depth;
+                    } else if ((*p == '}' || *p == ']') && --depth == 0) {
+                        ++p;
+                        out.assign(start, p);
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            const char *start = p;
+            while (p < end && *p != ',' && *p != '}' &&
+                   !isspace((unsigned char)*p)) {
+                ++p;
+            }
+            out.assign(start, p);
+            if (out == "null") {
+                isNull = true;
+                out.clear();
+            } else if (out == "true") {
+                out = "1";
+            } else if (out == "false") {
+                out = "0";
+            }
+            return !out.empty() || isNull;
+        }
+
+        std::string pending;
+        std::vector<std::string> names;
+        std::unordered_map<std::string, size_t> index;
+        std::vector<std::string> values;
+        std::vector<bool> present;
+        bool firstObject = true;
+};
+
+void takeColumns(RowBatch &batch, const ImportOptions &options,
+                 const JsonLinesParser &json) {
+    if (options.format == ImportFormat::JsonLines) {
+        batch.columns = json.columns();
+        return;
+    }
+
+    size_t count = batch.rowEnds.front();
+    if (options.header) {
+        batch.columns.assign(batch.fields.begin(),
+                             batch.fields.begin() + count);
+        batch.dropFirstRow();
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            batch.columns.push_back("c" + std::to_string(i + 1));
+        }
+    }
+}
+
+void parseFile(const ImportOptions &options, TaskProgress &progress,
+               BatchQueue &queue) {
+    FILE *file = fopen(options.path.c_str(), "rb");
+    if (!file) {
+        progress.setError("Не удалось открыть " + options.path);
+        queue.close();
+        return;
+    }
+
+    CsvParser csv(options.format == ImportFormat::Tsv ? '\t' : ',',
+                  options.format == ImportFormat::Csv);
+    JsonLinesParser json;
+    RowBatch batch;
+    bool haveColumns = false;
+    std::vector<char> chunk(ChunkSize);
+
+    auto flush = [&](bool last) {
+        if (!haveColumns && batch.rowCount() > 0) {
+            takeColumns(batch, options, json);
+            haveColumns = true;
+        }
+        if (haveColumns && (batch.rowCount() >= RowsPerBatch ||
+                            (last && batch.rowCount() > 0) ||
+                            !batch.columns.empty())) {
+            bool pushed = queue.push(std::move(batch));
+            batch = RowBatch();
+            return pushed;
+        }
+        return true;
+    };
+
+    size_t n;
+    while ((n = fread(chunk.data(), 1, chunk.size(), file)) > 0) {
+        if (progress.cancelled)
+            break;
+
+        if (options.format == ImportFormat::JsonLines)
+            json.feed(chunk.data(), n, batch);
+        else
+            csv.feed(chunk.data(), n, batch);
+        progress.done += n;
+
+        if (!flush(false))
+            break;
+    }
+
+    if (options.format == ImportFormat::JsonLines)
+        json.finish(batch);
+    else
+        csv.finish(batch);
+    flush(true);
+
+    fclose(file);
+    queue.close();
+}
+
+bool parseInteger(const std::string &text, int64_t &value) {
+    if (text.empty() || isspace((unsigned char)text[0]))
+        return false;
+    char *end;
+    errno = 0;
+    value = strtoll(text.c_str(), &end, 10);
+    return *end == '\0' && errno == 0;
+}
+
+bool parseReal(const std::string &text, double &value) {
+    if (text.empty() || isspace((unsigned char)text[0]))
+        return false;
+    char *end;
+    value = strtod(text.c_str(), &end);
+    return *end == '\0';
+}
+
+// тип нового столбца по первому пакету: INTEGER, REAL или TEXT
+std::string inferType(const RowBatch &batch, size_t col) {
+    bool integer = true, real = true, any = false;
+    for (size_t row = 0; row < batch.rowCount(); ++row) {
+        size_t index = batch.rowBegin(row) + col;
+        if (index >= batch.rowEnds[row] || batch.nulls[index] ||
+            batch.fields[index].empty())
+            continue;
+
+        any = true;
+        int64_t i;
+        double d;
+        if (!parseInteger(batch.fields[index], i))
+            integer = false;
+        if (!integer && !parseReal(batch.fields[index], d))
+            real = false;
+        if (!real)
+            break;
+    }
+    if (!any)
+        return "TEXT";
+    return integer ? "INTEGER" : real ? "REAL" : "TEXT";
+}
+
+bool isNumericAffinity(const std::string &declaredType) {
+    std::string type;
+    for (char c : declaredType) {
+        type += (char)toupper((unsigned char)c);
+    }
+    if (type.find("INT") != std::string::npos)
+        return true;
+    if (type.empty() || type.find("CHAR") != std::string::npos ||
+        type.find("CLOB") != std::string::npos ||
+        type.find("TEXT") != std::string::npos ||
+        type.find("BLOB") != std::string::npos)
+        return false;
+    return true;
+}
+
+const char *checkedPragma(const std::string &value,
+                          std::initializer_list<const char *> allowed,
+                          const char *fallback) {
+    for (const char *option : allowed) {
+        if (strcasecmp(value.c_str(), option) == 0)
+            return option;
+    }
+    return fallback;
+}
+
+} // namespace
+
+Importer::Importer(ImportOptions options, TaskProgress &progress)
+    : options(std::move(options)),
+      progress(progress) {}
+
+ImportFormat Importer::detectFormat(const std::string &path) {
+    std::string ext = fs::path(path).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (ext == ".tsv" || ext == ".tab")
+        return ImportFormat::Tsv;
+    if (ext == ".jsonl" || ext == ".ndjson" || ext == ".json")
+        return ImportFormat::JsonLines;
+    return ImportFormat::Csv;
+}
+
+bool Importer::run(Database &db) {
+    std::error_code ec;
+    uint64_t size = fs::file_size(options.path, ec);
+    progress.start(ec ? 0 : size);
+
+    BatchQueue queue;
+    std::thread parser(parseFile, std::cref(options), std::ref(progress),
+                       std::ref(queue));
+
+    RowBatch batch;
+    bool ok = queue.pop(batch) && !batch.columns.empty();
+    if (!ok && progress.getError().empty())
+        progress.setError("В файле нет данных");
+
+    std::vector<std::string> columns = batch.columns;
+    std::string table = Database::quoteIdentifier(options.table);
+
+    // создаём таблицу, если её нет
+    auto existing = db.getTables();
+    if (ok && std::find(existing.begin(), existing.end(), options.table) ==
+                  existing.end()) {
+        std::string sql = "CREATE TABLE " + table + " (";
+        for (size_t i = 0; i < columns.size(); ++i) {
+            if (i)
+                sql += ", ";
+            sql += Database::quoteIdentifier(columns[i]) + " " +
+                   inferType(batch, i);
+        }
+        ok = db.execute(sql + ");");
+    }
+
+    std::vector<bool> numeric(columns.size(), false);
+    if (ok) {
+        auto info = db.getTableInfo(options.table);
+        for (size_t i = 0; i < columns.size(); ++i) {
+            auto it = std::find_if(info.begin(), info.end(),
+                                   [&](const ColumnInfo &col) {
+                                       return col.name == columns[i];
+                                   });
+            if (it == info.end()) {
+                progress.setError("Нет столбца " + columns[i]);
+                ok = false;
+                break;
+            }
+            numeric[i] = isNumericAffinity(it->type);
+        }
+    }
+
+    // внутри транзакции пользователя режимы журнала менять нельзя
+    bool ownTransaction = !db.inTransaction();
+    std::string savedJournal, savedSync;
+    if (ok && ownTransaction) {
+        savedJournal = db.query("PRAGMA journal_mode;").getString(0, 0);
+        savedSync = db.query("PRAGMA synchronous;").getString(0, 0);
+        db.execute(std::string("PRAGMA journal_mode = ") +
+                   checkedPragma(options.journalMode,
+                                 {"DELETE", "TRUNCATE", "PERSIST", "MEMORY",
+                                  "WAL", "OFF"},
+                                 "MEMORY") +
+                   ";");
+        db.execute(std::string("PRAGMA synchronous = ") +
+                   checkedPragma(options.synchronous,
+                                 {"OFF", "NORMAL", "FULL", "EXTRA"}, "OFF") +
+                   ";");
+        ok = db.beginTransaction();
+    }
+
+    sqlite3_stmt *stmt = nullptr;
+    if (ok) {
+        std::string sql = "INSERT INTO " + table + " (";
+        std::string params;
+        for (size_t i = 0; i < columns.size(); ++i) {
+            sql += (i ? ", " : "") + Database::quoteIdentifier(columns[i]);
+            params += i ? ", ?" : "?";
+        }
+        stmt = db.prepareCached(sql + ") VALUES (" + params + ");");
+        ok = stmt != nullptr;
+    }
+
+    size_t sinceCommit = 0;
+    while (ok) {
+        for (size_t row = 0; ok && row < batch.rowCount(); ++row) {
+            size_t begin = batch.rowBegin(row);
+            size_t width = batch.rowEnds[row] - begin;
+            for (size_t i = 0; i < columns.size(); ++i) {
+                int index = (int)i + 1;
+                if (i >= width || batch.nulls[begin + i]) {
+                    sqlite3_bind_null(stmt, index);
+                    continue;
+                }
+
+                const std::string &text = batch.fields[begin + i];
+                int64_t integer;
+                double real;
+                if (numeric[i] && text.empty())
+                    sqlite3_bind_null(stmt, index);
+                else if (numeric[i] && parseInteger(text, integer))
+                    sqlite3_bind_int64(stmt, index, integer);
+                else if (numeric[i] && parseReal(text, real))
+                    sqlite3_bind_double(stmt, index, real);
+                else
+                    sqlite3_bind_text(stmt, index, text.data(),
+                                      (int)text.size(), SQLITE_STATIC);
+            }
+
+            int rc = sqlite3_step(stmt);
+            if (rc != SQLITE_DONE) {
+                progress.setError(db.errorMessage());
+                ok = false;
+            }
+            sqlite3_reset(stmt);
+
+            if (ok && ownTransaction && ++sinceCommit >= options.batchRows) {
+                ok = db.commitTransaction() && db.beginTransaction();
+                sinceCommit = 0;
+            }
+        }
+        progress.rows += batch.rowCount();
+
+        if (progress.cancelled) {
+            progress.setError("Импорт отменён");
+            ok = false;
+        }
+        if (!ok || !queue.pop(batch))
+            break;
+    }
+
+    if (stmt)
+        sqlite3_clear_bindings(stmt);
+
+    if (ownTransaction && db.inTransaction()) {
+        if (ok)
+            ok = db.commitTransaction();
+        else
+            db.rollbackTransaction();
+    }
+    if (!savedJournal.empty()) {
+        db.execute("PRAGMA journal_mode = " + savedJournal + ";");
+        db.execute("PRAGMA synchronous = " + savedSync + ";");
+    }
+
+    queue.abort();
+    parser.join();
+    progress.finish();
+    return ok && progress.getError().empty();
+}
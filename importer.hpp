@@ -0,0 +1,35 @@
+#pragma once
+
+#include "database.hpp"
+#include "task_progress.hpp"
+#include <string>
+
+enum class ImportFormat { Csv, Tsv, JsonLines };
+
+struct ImportOptions {
+        std::string path;
+        std::string table;
+        ImportFormat format = ImportFormat::Csv;
+        bool header = true;
+        // строк в одной транзакции
+        size_t batchRows = 100000;
+        // режимы журнала на время загрузки, затем восстанавливаются
+        std::string journalMode = "MEMORY";
+        std::string synchronous = "OFF";
+};
+
+// Потоковая загрузка CSV/TSV/JSON Lines. Файл читается блоками и
+// разбирается в отдельном потоке, вставка идёт одним подготовленным
+// запросом крупными транзакциями на соединении вызывающего потока.
+class Importer {
+    public:
+        Importer(ImportOptions options, TaskProgress &progress);
+
+        bool run(Database &db);
+
+        static ImportFormat detectFormat(const std::string &path);
+
+    private:
+        ImportOptions options;
+        TaskProgress &progress;
+};
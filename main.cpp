@@ -1,15 +1,38 @@
 #include "database.hpp"
+#include "directory_lister.hpp"
+#include "edit_journal.hpp"
+#include "exporter.hpp"
+#include "global_search.hpp"
+#include "importer.hpp"
+#include "paged_table.hpp"
+#include "pending_changes.hpp"
+#include "profiler.hpp"
+#include "query_worker.hpp"
+#include "read_pool.hpp"
+#include "record_editor.hpp"
+#include "related_rows.hpp"
+#include "schema_catalog.hpp"
+#include "snapshot.hpp"
+#include "sql_console.hpp"
+#include "table_diff.hpp"
+#include "table_stats.hpp"
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <ctime>
 #include <filesystem>
+#include <fstream>
 #include <functional>
 #include <iostream>
 #include <map>
 // #include <nfd.h>
 // #include <regex>
+#include <set>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 static void glfw_error_callback(int error, const char *description) {
@@ -29,130 +52,2602 @@ namespace fs = std::filesystem;
 const char *filterPresets[] = {"Все файлы (*.*)", "Текстовые файлы (*.txt)",
                                "Изображения (*.png;*.jpg;*.jpeg;*.bmp)",
                                "Документы (*.pdf;*.doc;*.docx)",
-                               "Базы данных (*.db)"};
+                               "Базы данных (*.db)",
+                               "Данные (*.csv;*.tsv;*.jsonl)"};
 
 const char *filterPatterns[] = {"*", "*.txt", "*.png;*.jpg;*.jpeg;*.bmp",
-                                "*.pdf;*.doc;*.docx", "*.db"};
+                                "*.pdf;*.doc;*.docx", "*.db",
+                                "*.csv;*.tsv;*.jsonl"};
 
 class FileBrowser {
     public:
         std::string currentPath = fs::current_path().string();
         std::string selectedFile;
-        std::vector<std::string> directories;
-        std::vector<std::string> files;
         std::string filter = "*.db";    // Маска по умолчанию - все файлы
         char filterInput[128] = "*.db"; // Буфер для ввода маски
+        DirectoryLister lister;
 
+        // Список читается в фоне, Draw() дописывает пришедшие записи
         void Refresh() {
+            entries.clear();
+            ResetView();
+            lister.open(currentPath);
+        }
+
+        // маска разбирается один раз, каталог заново не читается
+        void SetFilter(const std::string &masks) {
+            filter = masks;
+            strcpy(filterInput, filter.c_str());
+            mask = FileFilter(filter);
+            ResetView();
+        }
+
+        bool Draw() {
+            bool fileSelected = false;
+            if (lister.take(entries))
+                ResetView();
+            // новые записи раскладываются по спискам один раз
+            for (; sorted < entries.size(); ++sorted) {
+                const DirEntry &entry = entries[sorted];
+                if (entry.directory)
+                    directories.push_back(sorted);
+                else if (mask.matches(entry.name))
+                    files.push_back(sorted);
+            }
+
+            // Панель управления с фильтром
+            if (ImGui::Button("Наверх") && currentPath != "/") {
+                currentPath = fs::path(currentPath).parent_path().string();
+                Refresh();
+            }
+
+            ImGui::SameLine();
+            ImGui::Text("Текущая папка: %s", currentPath.c_str());
+
+            if (ImGui::BeginCombo("Предустановки", filter.c_str())) {
+                for (int i = 0; i < IM_ARRAYSIZE(filterPresets); i++) {
+                    if (ImGui::Selectable(filterPresets[i],
+                                          filter == filterPatterns[i]))
+                        SetFilter(filterPatterns[i]);
+                }
+                ImGui::EndCombo();
+            }
+            std::string error = lister.error();
+            if (!error.empty())
+                ImGui::TextColored(ImVec4(1, 0.4f, 0.4f, 1), "%s",
+                                   error.c_str());
+            else if (lister.loading())
+                ImGui::Text("Чтение папки... %zu", entries.size());
+            ImGui::BeginChild("##browser", ImVec2(0, 300), true);
+
+            // папки, затем файлы; в ImGui уходят только видимые строки
+            std::string open;
+            ImGuiListClipper clipper;
+            clipper.Begin((int)(directories.size() + files.size()));
+            while (clipper.Step()) {
+                for (int row = clipper.DisplayStart; row < clipper.DisplayEnd;
+                     ++row) {
+                    ImGui::PushID(row);
+                    if ((size_t)row < directories.size()) {
+                        const std::string &dir =
+                            entries[directories[row]].name;
+                        if (ImGui::Selectable(
+                                ("[D] " + dir).c_str(), false,
+                                ImGuiSelectableFlags_AllowDoubleClick) &&
+                            ImGui::IsMouseDoubleClicked(0))
+                            open = dir;
+                    } else {
+                        const std::string &file =
+                            entries[files[row - directories.size()]].name;
+                        if (ImGui::Selectable(file.c_str(),
+                                              selectedFile == file)) {
+                            selectedFile = file;
+                            if (ImGui::IsMouseDoubleClicked(0))
+                                fileSelected = true;
+                        }
+                    }
+                    ImGui::PopID();
+                }
+            }
+            clipper.End();
+
+            ImGui::EndChild();
+
+            // переход после цикла: Refresh() очищает entries
+            if (!open.empty()) {
+                currentPath = (fs::path(currentPath) / open).string();
+                Refresh();
+            }
+            return fileSelected;
+        }
+
+    private:
+        void ResetView() {
             directories.clear();
             files.clear();
+            sorted = 0;
+        }
 
-            for (const auto &entry : fs::directory_iterator(currentPath)) {
-                try {
-                    if (entry.is_directory()) {
-                        directories.push_back(entry.path().filename().string());
-                    } else if (MatchesFilter(
-                                   entry.path().filename().string())) {
-                        files.push_back(entry.path().filename().string());
-                    }
-                } catch (...) {
-                    // Пропустить файлы с проблемами доступа
+        std::vector<DirEntry> entries;
+        FileFilter mask{filter};
+        // номера записей в entries: папки и подходящие под маску файлы
+        std::vector<size_t> directories;
+        std::vector<size_t> files;
+        // сколько записей entries уже разложено
+        size_t sorted = 0;
+};
+
+// Глобальные переменные для управления окном
+bool showFileBrowser = false;
+FileBrowser browser; // Наш класс файлового браузера
+// для чего выбирается файл
+enum class BrowserTarget { OpenDatabase, ImportFile };
+BrowserTarget browserTarget = BrowserTarget::OpenDatabase;
+
+// Импорт данных
+bool showImport = false;
+char importPath[1024] = "";
+char importTable[256] = "";
+int importFormat = 0;
+bool importHeader = true;
+int importJournal = 0;
+int importSync = 0;
+int importBatch = 100000;
+auto importProgress = std::make_shared<TaskProgress>();
+
+// Экспорт идёт в своём потоке на отдельном соединении, не занимая worker
+bool showExport = false;
+int exportSource = 0;
+char exportSql[4096] = "";
+char exportPath[1024] = "";
+int exportFormat = 0;
+TaskProgress exportProgress;
+std::thread exportThread;
+
+// окно профилировщика; объявлен до worker, чтобы пережить его поток
+bool showProfiler = false;
+// Кадры по событиям: в простое поток интерфейса спит, а не рисует
+// кадр за кадром с частотой экрана
+bool idleWait = true;
+const int SettleFrames = 3;
+// период кадров, пока идёт фоновая работа
+const double BusyWaitSeconds = 0.1;
+const double InputWaitSeconds = 0.5;
+Profiler profiler;
+char tracePath[1024] = "trace.json";
+std::string traceStatus;
+
+// Наша база данных: все запросы выполняются в фоновом потоке
+QueryWorker worker;
+std::string dbPath;
+bool dbOpen = false;
+// база открыта только для чтения: правки и импорт выключены
+bool dbReadOnly = false;
+// профиль соединения, выбранный в окне открытия файла
+int openProfile = (int)OpenProfile::Default;
+// параллельные читатели; открыт для баз в WAL или только для чтения
+ReadPool pool;
+// Снимок: редактор читает копию базы, снятую Snapshot в своём потоке.
+// Обновление копируется рядом и подменяет прежнюю, когда готово.
+std::shared_ptr<Snapshot> snapshot;
+std::shared_ptr<Snapshot> nextSnapshot;
+TaskProgress snapshotProgress;
+std::thread snapshotThread;
+// копия во временном файле, а не в памяти
+bool snapshotInFile = false;
+// период автообновления в секундах; 0 - только вручную
+int snapshotInterval = 0;
+double snapshotTakenAt = 0;
+std::string snapshotClock;
+
+// профиль столбцов текущей таблицы на вкладке рядом с редактированием
+TaskProgress statsProgress;
+std::shared_ptr<TableStatsCollector> statsCollector;
+TableStats tableStats;
+// версия снимка, уже показанного интерфейсом
+uint64_t statsVersion = 0;
+
+// поиск по всем таблицам и FTS5-индекс рядом с базой
+bool showSearch = false;
+char searchText[256] = "";
+TaskProgress searchProgress;
+std::shared_ptr<GlobalSearch> globalSearch;
+std::vector<SearchHit> searchHits;
+bool searchIndex = false;
+TaskProgress indexProgress;
+
+// SQL-консоль: произвольные запросы через worker, строки приходят
+// по мере выполнения
+bool showConsole = false;
+std::string consoleSql;
+TaskProgress consoleProgress;
+std::shared_ptr<SqlConsole> sqlConsole;
+ResultSet consoleRows;
+std::vector<StatementStats> consoleStats;
+SqlHistory sqlHistory;
+// сравнение таблицы с другим файлом базы; идёт в своём потоке на
+// соединениях TableDiff, не занимая worker и пул
+bool showDiff = false;
+char diffPath[1024] = "";
+std::string diffTable;
+TaskProgress diffProgress;
+std::thread diffThread;
+std::shared_ptr<TableDiff> tableDiff;
+ResultSet diffRows;
+int diffSelected = -1;
+// выбранная строка в текущей и другой базе
+std::pair<ResultSet, ResultSet> diffDetail;
+// переход к строке: ключ ищется, когда таблица загрузила раскладку
+std::string jumpTable;
+std::vector<Value> jumpKey;
+long scrollToRecord = -1;
+// значения выбранной строки читаются, когда придёт её блок
+bool loadSelected = false;
+
+// Состояние интерфейса
+// снимок схемы из потока базы; интерфейс читает только его
+std::shared_ptr<const SchemaCatalog> catalog;
+std::string currentTable;
+PagedTable records;
+std::vector<ColumnInfo> tableInfo;
+int selectedRecord = -1;
+RecordEditor editor;
+std::vector<Value> selectedKey;
+// фильтры столбцов текущей таблицы по порядку tableInfo, применяются
+// по Enter; строки живут между кадрами и растут по мере ввода
+std::vector<std::string> columnFilters;
+// Фильтры перехода к дочерним строкам по номеру столбца: значение ключа
+// передаётся в PagedTable как есть, text - его вид в строке фильтра.
+// Правка этой строки превращает фильтр в обычный текстовый.
+struct LinkFilter {
+        std::string text;
+        Value value;
+};
+std::map<size_t, LinkFilter> linkFilters;
+bool inTransaction = false;
+// несохранённые правки, пишутся в базу одной транзакцией
+PendingChanges pendingChanges;
+bool bufferEdits = true;
+// идёт запись буфера, отмена или повтор: правки недоступны
+bool applyingChanges = false;
+bool showChanges = false;
+std::string changesError;
+// выбранная вставка из буфера (номер в pendingChanges) или -1
+int selectedInsert = -1;
+// выбранная строка, как она есть в базе, без правок из буфера
+std::map<std::string, std::string> selectedOriginal;
+// журнал отмены записанных в базу правок
+EditJournal journal;
+std::string journalError;
+// строки, связанные внешними ключами: родители и число дочерних
+RelatedRows related;
+// номер внешнего ключа для каждого столбца tableInfo или -1
+std::vector<int> linkColumns;
+// переход по ссылке, ждущий ответа related
+struct LinkJump {
+        std::string table;
+        size_t key = 0;
+        std::vector<Value> values;
+};
+LinkJump linkJump;
+
+// Просмотр большой ячейки. Содержимое читается в потоке базы страницами
+// по CellPageBytes через Database::readCell, в памяти держится не больше
+// CellPages страниц - дальние от просматриваемой вытесняются.
+struct CellView {
+        bool open = false;
+        std::string table;
+        std::string column;
+        RowKey where;
+        ResultSet::LargeCell cell;
+        std::map<uint64_t, std::string> pages;
+        std::set<uint64_t> loading;
+        std::string error;
+        // 0 - hex, 1 - текст
+        int mode = 0;
+        uint64_t textPage = 0;
+        // меняется при открытии другой ячейки; старые ответы отбрасываются
+        uint64_t generation = 0;
+        char savePath[1024] = "";
+        bool saving = false;
+        std::string status;
+};
+CellView cellView;
+const size_t CellPageBytes = 64 << 10;
+const size_t CellPages = 32;
+
+struct CellPage {
+        bool ok = false;
+        std::string data;
+        std::string error;
+};
+
+void CloseCellView() {
+    cellView.open = false;
+    cellView.pages.clear();
+    cellView.loading.clear();
+    ++cellView.generation;
+}
+
+void JumpToRecord(const std::string &table, const std::vector<Value> &key);
+void SelectTable(const std::string &table);
+
+// Ссылки по внешним ключам. Родительская строка запрашивается при
+// наведении на ячейку-ссылку и при выборе строки, поэтому переход
+// обычно берёт готовый ключ из кэша related.
+const ImVec4 LinkColor(0.45f, 0.7f, 1.0f, 1.0f);
+
+const TableSchema *CurrentSchema() {
+    return catalog ? catalog->find(currentTable) : nullptr;
+}
+
+void UpdateLinkColumns() {
+    const TableSchema *schema = CurrentSchema();
+    linkColumns = schema ? RelatedRows::columnKeys(*schema, tableInfo)
+                         : std::vector<int>();
+}
+
+// значение столбца строки row текущей таблицы, в том числе rowid
+Value RecordValue(size_t row, const std::string &column) {
+    for (size_t col = 0; col < tableInfo.size(); ++col) {
+        if (tableInfo[col].name == column)
+            return records.value(row, col);
+    }
+    const auto &keys = records.keyColumns();
+    if (column == "rowid" && !keys.empty() && keys[0] == "rowid") {
+        std::vector<Value> key = records.rowKey(row);
+        return key.empty() ? Value() : key[0];
+    }
+    return Value();
+}
+
+std::vector<Value> RecordValues(size_t row,
+                                const std::vector<std::string> &columns) {
+    std::vector<Value> values;
+    for (const auto &column : columns) {
+        values.push_back(RecordValue(row, column));
+    }
+    return values;
+}
+
+const RelatedRows::Link *ParentLink(size_t row, size_t key) {
+    const TableSchema *schema = CurrentSchema();
+    if (!schema || key >= schema->foreignKeys.size())
+        return nullptr;
+    return related.parent(*catalog, currentTable, key,
+                          RecordValues(row, schema->foreignKeys[key].from));
+}
+
+void UpdateLinkJump() {
+    if (linkJump.table.empty() || !catalog)
+        return;
+    const TableSchema *schema = catalog->find(linkJump.table);
+    if (!schema || linkJump.key >= schema->foreignKeys.size()) {
+        linkJump.table.clear();
+        return;
+    }
+    const RelatedRows::Link *link = related.parent(
+        *catalog, linkJump.table, linkJump.key, linkJump.values);
+    if (!link)
+        return;
+    linkJump.table.clear();
+    if (!link->key.empty())
+        JumpToRecord(schema->foreignKeys[linkJump.key].table, link->key);
+}
+
+// переход к родительской строке; без ответа в кэше - когда он придёт
+void FollowLink(size_t row, size_t key) {
+    const TableSchema *schema = CurrentSchema();
+    if (!schema || key >= schema->foreignKeys.size())
+        return;
+    linkJump.table = currentTable;
+    linkJump.key = key;
+    linkJump.values = RecordValues(row, schema->foreignKeys[key].from);
+    UpdateLinkJump();
+}
+
+// подсказка со строкой родителя; заодно запрашивает её
+void LinkTooltip(size_t row, size_t key) {
+    const RelatedRows::Link *link = ParentLink(row, key);
+    ImGui::BeginTooltip();
+    if (!link)
+        ImGui::TextDisabled("...");
+    else if (link->key.empty())
+        ImGui::TextUnformatted("Строка не найдена");
+    else
+        ImGui::TextUnformatted(link->summary.c_str());
+    ImGui::EndTooltip();
+}
+
+// вид фильтра связи со значением value в строке фильтра
+std::string FilterValue(const Value &value) {
+    char buffer[32];
+    switch (value.type) {
+    case Value::Type::Null:
+        return "NULL";
+    case Value::Type::Integer:
+        return "=" + std::to_string(value.integer);
+    case Value::Type::Real:
+        snprintf(buffer, sizeof(buffer), "=%.17g", value.real);
+        return buffer;
+    case Value::Type::Blob: {
+        std::string text = "=X'";
+        for (unsigned char c : value.text) {
+            snprintf(buffer, sizeof(buffer), "%02X", c);
+            text += buffer;
+        }
+        return text + "'";
+    }
+    case Value::Type::Text:
+        break;
+    }
+    return "=" + value.text;
+}
+
+// непустые фильтры по именам столбцов - в PagedTable
+void ApplyFilters() {
+    std::map<std::string, std::string> filters;
+    std::map<std::string, Value> values;
+    for (size_t col = 0; col < columnFilters.size() && col < tableInfo.size();
+         ++col) {
+        auto link = linkFilters.find(col);
+        if (link != linkFilters.end() &&
+            link->second.text == columnFilters[col]) {
+            values[tableInfo[col].name] = link->second.value;
+            continue;
+        }
+        if (link != linkFilters.end())
+            linkFilters.erase(link);
+        if (!columnFilters[col].empty())
+            filters[tableInfo[col].name] = columnFilters[col];
+    }
+    records.setFilters(filters, values);
+}
+
+// дочерние строки - таблица reference с фильтром по ссылке
+void OpenChildren(const RelatedRows::Reference &reference,
+                  const std::vector<Value> &values) {
+    const TableSchema *child = catalog->find(reference.table);
+    if (!child)
+        return;
+    const ForeignKeyInfo &key = child->foreignKeys[reference.key];
+    SelectTable(reference.table);
+    for (size_t i = 0; i < key.from.size() && i < values.size(); ++i) {
+        for (size_t col = 0; col < tableInfo.size(); ++col) {
+            if (tableInfo[col].name != key.from[i])
+                continue;
+            columnFilters[col] = FilterValue(values[i]);
+            linkFilters[col] = {columnFilters[col], values[i]};
+        }
+    }
+    ApplyFilters();
+}
+
+std::string JoinColumns(const std::vector<std::string> &columns) {
+    std::string text;
+    for (const auto &column : columns) {
+        text += (text.empty() ? "" : ", ") + column;
+    }
+    return text;
+}
+
+// Связи выбранной строки: родители по её внешним ключам и таблицы,
+// которые на неё ссылаются. Дочерние строки считаются, только пока
+// список раскрыт.
+void RenderLinks() {
+    const TableSchema *schema = CurrentSchema();
+    if (!schema || selectedRecord < 0 || selectedInsert >= 0)
+        return;
+    size_t row = (size_t)selectedRecord;
+    std::vector<RelatedRows::Reference> references =
+        RelatedRows::references(*catalog, currentTable);
+    if (schema->foreignKeys.empty() && references.empty())
+        return;
+
+    ImGui::Separator();
+    int followed = -1;
+    for (size_t key = 0; key < schema->foreignKeys.size(); ++key) {
+        const ForeignKeyInfo &foreign = schema->foreignKeys[key];
+        const RelatedRows::Link *link = ParentLink(row, key);
+        ImGui::PushID((int)key);
+        ImGui::BeginDisabled(link && link->key.empty());
+        if (ImGui::SmallButton("Перейти"))
+            followed = (int)key;
+        ImGui::EndDisabled();
+        ImGui::SameLine();
+        ImGui::Text("%s -> %s:", JoinColumns(foreign.from).c_str(),
+                    foreign.table.c_str());
+        ImGui::SameLine();
+        if (!link)
+            ImGui::TextDisabled("...");
+        else if (link->key.empty())
+            ImGui::TextDisabled("нет строки");
+        else
+            ImGui::TextColored(LinkColor, "%s", link->summary.c_str());
+        ImGui::PopID();
+    }
+    if (followed >= 0)
+        FollowLink(row, (size_t)followed);
+
+    if (references.empty() || !ImGui::TreeNode("Ссылаются на строку"))
+        return;
+    int opened = -1;
+    std::vector<Value> openValues;
+    for (size_t i = 0; i < references.size(); ++i) {
+        const TableSchema *child = catalog->find(references[i].table);
+        const ForeignKeyInfo &key = child->foreignKeys[references[i].key];
+        std::vector<Value> values =
+            RecordValues(row, RelatedRows::targetColumns(*schema, key));
+        const RelatedRows::Link *link = related.children(
+            *catalog, references[i].table, references[i].key, values);
+
+        ImGui::PushID((int)i);
+        if (ImGui::SmallButton("Открыть")) {
+            opened = (int)i;
+            openValues = values;
+        }
+        ImGui::SameLine();
+        ImGui::Text("%s (%s):", child->name.c_str(),
+                    JoinColumns(key.from).c_str());
+        ImGui::SameLine();
+        if (!link)
+            ImGui::TextDisabled("...");
+        else if (link->count < 0)
+            ImGui::TextDisabled("?");
+        else
+            ImGui::Text("%lld", (long long)link->count);
+        if (!RelatedRows::indexed(*child, key.from)) {
+            ImGui::SameLine();
+            ImGui::TextColored(ImVec4(1, 0.6f, 0.2f, 1), "без индекса");
+        }
+        ImGui::PopID();
+    }
+    ImGui::TreePop();
+    if (opened >= 0)
+        OpenChildren(references[opened], openValues);
+}
+
+void SelectTable(const std::string &table) {
+    currentTable = table;
+    tableInfo.clear();
+    selectedRecord = -1;
+    selectedInsert = -1;
+    editor.clear();
+    CloseCellView();
+
+    if (const TableSchema *schema = catalog ? catalog->find(table) : nullptr)
+        tableInfo = schema->columns;
+    columnFilters.assign(tableInfo.size(), std::string());
+    linkFilters.clear();
+    UpdateLinkColumns();
+    records.open(worker, table);
+}
+
+// перечитывает снимок схемы, если она изменилась (в потоке базы это
+// один PRAGMA schema_version)
+void ReloadCatalog() {
+    worker.submit([](Database &db) { return db.catalog(); },
+                  [](std::shared_ptr<const SchemaCatalog> schema) {
+                      if (!dbOpen || !schema || schema == catalog)
+                          return;
+                      catalog = std::move(schema);
+                      related.clear();
+                      if (const TableSchema *table =
+                              catalog->find(currentTable))
+                          tableInfo = table->columns;
+                      UpdateLinkColumns();
+                  });
+}
+
+// закрывает пул; выгрузка и статистика на его соединениях прерываются
+void ClosePool() {
+    if (exportThread.joinable()) {
+        exportProgress.cancelled = true;
+        exportThread.join();
+    }
+    statsProgress.cancelled = true;
+    pool.close();
+    statsProgress.finish();
+    statsCollector.reset();
+    tableStats = TableStats();
+}
+
+// сравнение шло по закрываемой базе
+void ResetDiff() {
+    if (diffThread.joinable()) {
+        diffProgress.cancelled = true;
+        diffThread.join();
+    }
+    tableDiff.reset();
+    diffRows = ResultSet();
+    diffSelected = -1;
+    diffDetail = {};
+}
+
+// результаты поиска принадлежат закрываемой базе
+void ResetSearch() {
+    searchProgress.cancelled = true;
+    indexProgress.cancelled = true;
+    globalSearch.reset();
+    searchHits.clear();
+    searchIndex = false;
+    jumpTable.clear();
+}
+
+// результаты консоли принадлежат закрываемой базе
+void ResetConsole() {
+    consoleProgress.cancelled = true;
+    sqlConsole.reset();
+    consoleRows = ResultSet();
+    consoleStats.clear();
+}
+
+// фон строк и ячеек с несохранёнными правками
+const ImU32 InsertedColor = IM_COL32(40, 120, 40, 160);
+const ImU32 UpdatedColor = IM_COL32(140, 110, 30, 160);
+const ImU32 DeletedColor = IM_COL32(140, 40, 40, 160);
+
+// значения выбранной строки с правками из буфера поверх
+void LoadSelectedValues(size_t row) {
+    selectedOriginal = records.rowValues(row);
+    std::map<std::string, std::string> values = selectedOriginal;
+    if (const PendingChange *change =
+            pendingChanges.find(currentTable, selectedKey)) {
+        for (const auto &pair : change->values) {
+            values[pair.first] = pair.second;
+        }
+    }
+    editor.load(tableInfo, values);
+}
+
+void SelectInsert(size_t index) {
+    selectedRecord = -1;
+    selectedInsert = (int)index;
+    editor.load(tableInfo, pendingChanges.changes()[index].values);
+}
+
+// вставка из буфера строкой таблицы: row - номер строки в клиппере
+void RenderInsertRow(size_t index, int row) {
+    const auto &values = pendingChanges.changes()[index].values;
+    ImGui::TableSetBgColor(ImGuiTableBgTarget_RowBg1, InsertedColor);
+    ImGui::PushID(row);
+    for (size_t j = 0; j < tableInfo.size(); j++) {
+        ImGui::TableSetColumnIndex(j);
+        auto found = values.find(tableInfo[j].name);
+        const char *text = found != values.end() ? found->second.c_str() : "";
+        if (j == 0) {
+            if (ImGui::Selectable(text, selectedInsert == (int)index,
+                                  ImGuiSelectableFlags_SpanAllColumns))
+                SelectInsert(index);
+        } else {
+            ImGui::TextUnformatted(text);
+        }
+    }
+    ImGui::PopID();
+}
+
+// номера вставок сдвигаются, правки выбранной строки пропадают
+void DiscardChange(size_t index) {
+    const PendingChange &change = pendingChanges.changes()[index];
+    bool selected = selectedRecord >= 0 && change.table == currentTable &&
+                    change.key == selectedKey;
+    pendingChanges.discard(index);
+    if (selectedInsert >= 0) {
+        selectedInsert = -1;
+        editor.clear();
+    } else if (selected) {
+        editor.load(tableInfo, selectedOriginal);
+    }
+}
+
+void DiscardChanges() {
+    pendingChanges.clear();
+    changesError.clear();
+    if (selectedInsert >= 0) {
+        selectedInsert = -1;
+        editor.clear();
+    } else if (selectedRecord >= 0) {
+        editor.load(tableInfo, selectedOriginal);
+    }
+}
+
+struct OpenResult {
+        std::shared_ptr<const SchemaCatalog> catalog;
+        bool readOnly = false;
+        bool wal = false;
+        bool searchIndex = false;
+};
+
+// секунд до автообновления снимка: < 0 - пора, 0 - не запланировано
+double SnapshotDueIn() {
+    if (!snapshot || !dbOpen || snapshotInterval <= 0 || nextSnapshot)
+        return 0;
+    double due = snapshotTakenAt + snapshotInterval - glfwGetTime();
+    return due > 0 ? due : -1;
+}
+
+// открыта новая копия: время для строки состояния и автообновления
+void SetSnapshot(std::shared_ptr<Snapshot> replica) {
+    snapshot = std::move(replica);
+    snapshotTakenAt = glfwGetTime();
+    char text[16];
+    time_t now = time(nullptr);
+    strftime(text, sizeof(text), "%H:%M:%S", localtime(&now));
+    snapshotClock = text;
+}
+
+void CancelSnapshot() {
+    if (snapshotThread.joinable()) {
+        snapshotProgress.cancelled = true;
+        snapshotThread.join();
+    }
+    nextSnapshot.reset();
+}
+
+// копия снимается в своём потоке, по готовности её подхватывает
+// UpdateSnapshot()
+void StartSnapshot(const std::string &source) {
+    CancelSnapshot();
+    auto next = std::make_shared<Snapshot>(
+        source, snapshotInFile ? Snapshot::Target::TempFile
+                               : Snapshot::Target::Memory);
+    nextSnapshot = next;
+    snapshotProgress.start(0);
+    snapshotThread = std::thread([next] {
+        next->copy(snapshotProgress);
+        snapshotProgress.finish();
+        glfwPostEmptyEvent();
+    });
+}
+
+// replica - готовый снимок path, который открывается вместо него
+void OpenDatabase(const std::string &path, OpenProfile profile,
+                  std::shared_ptr<Snapshot> replica = nullptr) {
+    if (profile == OpenProfile::Snapshot && !replica) {
+        // база откроется, когда копия будет готова
+        StartSnapshot(path);
+        return;
+    }
+    if (!replica)
+        CancelSnapshot();
+    worker.cancel();
+    ClosePool();
+    ResetSearch();
+    ResetConsole();
+    ResetDiff();
+    DiscardChanges();
+    journal.clear();
+    CloseCellView();
+    worker.submit(
+        [path, profile, name = replica ? replica->replica() : path](
+            Database &db) {
+            OpenResult result;
+            if (!db.open(name, profile))
+                return result;
+            result.catalog = db.catalog();
+            result.readOnly = db.isReadOnly();
+            auto mode = db.query("PRAGMA journal_mode;");
+            result.wal = !mode.empty() && mode.getString(0, 0) == "wal";
+            // индекс поиска лежит рядом с базой, а не с копией
+            if (profile != OpenProfile::Snapshot)
+                result.searchIndex = SearchIndex::attach(db, path);
+            return result;
+        },
+        [path, replica](OpenResult result) {
+            dbOpen = result.catalog != nullptr;
+            if (!dbOpen)
+                return;
+
+            dbPath = path;
+            SetSnapshot(replica);
+            dbReadOnly = result.readOnly;
+            searchIndex = result.searchIndex;
+            inTransaction = false;
+            catalog = std::move(result.catalog);
+            // без WAL читатели ждали бы блокировки писателя
+            if (replica)
+                pool.open(replica->replica(), OpenProfile::Snapshot);
+            else if (result.readOnly)
+                pool.open(path, OpenProfile::ReadOnly);
+            else if (result.wal)
+                pool.open(path, OpenProfile::Reader);
+            if (!catalog->tables.empty()) {
+                SelectTable(catalog->tables[0].name);
+            } else {
+                currentTable.clear();
+                tableInfo.clear();
+                records.reset();
+                selectedRecord = -1;
+                editor.clear();
+            }
+        });
+}
+
+// Новая копия подменяет прежнюю на worker и в пуле. Таблица и фильтры
+// остаются, строки перечитываются.
+void SwitchSnapshot(std::shared_ptr<Snapshot> next) {
+    ClosePool();
+    CloseCellView();
+    worker.submit(
+        [name = next->replica()](Database &db) {
+            OpenResult result;
+            if (db.open(name, OpenProfile::Snapshot))
+                result.catalog = db.catalog();
+            return result;
+        },
+        [next](OpenResult result) {
+            selectedRecord = -1;
+            selectedInsert = -1;
+            editor.clear();
+            related.clear();
+            if (!result.catalog) {
+                snapshotProgress.setError("Не удалось открыть снимок");
+                dbOpen = false;
+                catalog.reset();
+                currentTable.clear();
+                tableInfo.clear();
+                records.reset();
+                return;
+            }
+            SetSnapshot(next);
+            catalog = std::move(result.catalog);
+            pool.open(next->replica(), OpenProfile::Snapshot);
+            if (const TableSchema *table = catalog->find(currentTable)) {
+                tableInfo = table->columns;
+                UpdateLinkColumns();
+                records.refresh();
+            } else if (!catalog->tables.empty()) {
+                SelectTable(catalog->tables[0].name);
+            }
+        });
+}
+
+// готовая копия открывается или подменяет прежнюю; по таймеру
+// снимается следующая
+void UpdateSnapshot() {
+    if (nextSnapshot && !snapshotProgress.running) {
+        snapshotThread.join();
+        std::shared_ptr<Snapshot> next = std::move(nextSnapshot);
+        nextSnapshot.reset();
+        if (snapshotProgress.cancelled ||
+            !snapshotProgress.getError().empty())
+            return;
+        if (snapshot && dbOpen && snapshot->source() == next->source())
+            SwitchSnapshot(next);
+        else
+            OpenDatabase(next->source(), OpenProfile::Snapshot, next);
+        return;
+    }
+    // выгрузку и профиль на соединениях пула обновление прервало бы
+    if (SnapshotDueIn() < 0 && !exportProgress.running &&
+        !statsProgress.running)
+        StartSnapshot(snapshot->source());
+}
+
+// условие WHERE по значениям ключа записи: rowid или первичный ключ
+RowKey RecordKey(const std::vector<Value> &values) {
+    RowKey key;
+    const auto &columns = records.keyColumns();
+    for (size_t i = 0; i < columns.size() && i < values.size(); ++i) {
+        key[columns[i]] = values[i];
+    }
+    return key;
+}
+
+RowKey SelectedRecordKey() { return RecordKey(selectedKey); }
+
+std::string FormatSize(uint64_t bytes) {
+    char text[32];
+    if (bytes < 1024)
+        snprintf(text, sizeof(text), "%llu Б", (unsigned long long)bytes);
+    else if (bytes < (1 << 20))
+        snprintf(text, sizeof(text), "%.1f КБ", bytes / 1024.0);
+    else
+        snprintf(text, sizeof(text), "%.1f МБ", bytes / 1048576.0);
+    return text;
+}
+
+// подпись большой ячейки в таблице вместо её содержимого
+std::string LargeCellLabel(const ResultSet::LargeCell &cell,
+                           std::string_view preview) {
+    std::string label = std::string("[") + (cell.blob ? "BLOB " : "TEXT ") +
+                        FormatSize(cell.bytes) + "]";
+    if (!cell.blob) {
+        // только первая строка начала текста
+        label += ' ';
+        label += preview.substr(0, std::min<size_t>(preview.find('\n'), 64));
+    }
+    return label;
+}
+
+// Подготовленный текст видимых строк таблицы записей: числа и подписи
+// больших ячеек форматируются один раз, а не в каждом кадре. Кэш
+// сбрасывается, когда меняется PagedTable::version().
+struct CachedRow {
+        // тексты ячеек подряд, каждый с завершающим '\0'
+        std::string text;
+        std::vector<uint32_t> starts;
+        std::vector<bool> large;
+};
+std::unordered_map<int, CachedRow> rowCache;
+uint64_t rowCacheVersion = 0;
+size_t rowCacheColumns = 0;
+// при большем размере кэш (строки вне экрана) очищается
+const size_t RowCacheLimit = 1024;
+
+// nullptr, пока блок строки не загружен
+const CachedRow *CachedRecordRow(int row, size_t columns) {
+    if (rowCacheVersion != records.version() || rowCacheColumns != columns) {
+        rowCache.clear();
+        rowCacheVersion = records.version();
+        rowCacheColumns = columns;
+    }
+    auto found = rowCache.find(row);
+    if (found != rowCache.end())
+        return &found->second;
+
+    size_t local;
+    if (!records.rowBlock(row, local))
+        return nullptr;
+    if (rowCache.size() >= RowCacheLimit)
+        rowCache.clear();
+
+    CachedRow &cached = rowCache[row];
+    ResultSet::NumberBuffer buffer;
+    for (size_t col = 0; col < columns; ++col) {
+        std::string_view value = records.getText(row, col, buffer);
+        const ResultSet::LargeCell *large = records.largeCell(row, col);
+        cached.starts.push_back((uint32_t)cached.text.size());
+        cached.large.push_back(large != nullptr);
+        if (large)
+            cached.text += LargeCellLabel(*large, value);
+        else
+            cached.text += value;
+        cached.text += '\0';
+    }
+    return &cached;
+}
+
+void OpenCellView(size_t row, size_t col) {
+    const ResultSet::LargeCell *cell = records.largeCell(row, col);
+    if (!cell || col >= tableInfo.size())
+        return;
+    CloseCellView();
+    cellView.open = true;
+    cellView.table = currentTable;
+    cellView.column = tableInfo[col].name;
+    cellView.where = RecordKey(records.rowKey(row));
+    cellView.cell = *cell;
+    cellView.error.clear();
+    cellView.status.clear();
+    cellView.mode = cell->blob ? 0 : 1;
+    cellView.textPage = 0;
+    snprintf(cellView.savePath, sizeof(cellView.savePath), "%s.%s",
+             cellView.column.c_str(), cell->blob ? "bin" : "txt");
+}
+
+// nullptr, пока страница не загружена; загрузка ставится в очередь
+const std::string *CellViewPage(uint64_t page) {
+    auto found = cellView.pages.find(page);
+    if (found != cellView.pages.end())
+        return &found->second;
+    if (!cellView.error.empty() || !cellView.loading.insert(page).second)
+        return nullptr;
+
+    worker.submit(
+        [table = cellView.table, column = cellView.column,
+         where = cellView.where, page](Database &db) {
+            CellPage result;
+            result.ok = db.readCell(table, column, where,
+                                    page * CellPageBytes, CellPageBytes,
+                                    result.data);
+            if (!result.ok)
+                result.error = db.errorMessage();
+            return result;
+        },
+        [page, generation = cellView.generation](CellPage result) {
+            if (generation != cellView.generation)
+                return;
+            cellView.loading.erase(page);
+            if (!result.ok) {
+                // отменённое задание повторится на следующем кадре
+                if (!result.error.empty())
+                    cellView.error = result.error;
+                return;
+            }
+            cellView.pages[page] = std::move(result.data);
+            while (cellView.pages.size() > CellPages) {
+                auto first = cellView.pages.begin();
+                auto last = std::prev(cellView.pages.end());
+                cellView.pages.erase(page - first->first >
+                                             last->first - page
+                                         ? first
+                                         : last);
+            }
+        });
+    return nullptr;
+}
+
+uint32_t ReadBigEndian(const std::string &data, size_t offset) {
+    const auto *bytes = (const unsigned char *)data.data() + offset;
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 |
+           (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+uint32_t ReadLittleEndian(const std::string &data, size_t offset,
+                          size_t size) {
+    const auto *bytes = (const unsigned char *)data.data() + offset;
+    uint32_t value = 0;
+    for (size_t i = size; i-- > 0;) {
+        value = value << 8 | bytes[i];
+    }
+    return value;
+}
+
+// Формат изображения по заголовку. Декодера картинок в программе нет,
+// поэтому только формат и, где он в заголовке, размер.
+std::string ImageInfo(const std::string &head) {
+    char text[64];
+    if (head.size() >= 24 && head.compare(0, 8, "\x89PNG\r\n\x1a\n") == 0) {
+        snprintf(text, sizeof(text), "PNG %ux%u", ReadBigEndian(head, 16),
+                 ReadBigEndian(head, 20));
+        return text;
+    }
+    if (head.size() >= 10 && head.compare(0, 4, "GIF8") == 0) {
+        snprintf(text, sizeof(text), "GIF %ux%u",
+                 ReadLittleEndian(head, 6, 2), ReadLittleEndian(head, 8, 2));
+        return text;
+    }
+    if (head.size() >= 26 && head.compare(0, 2, "BM") == 0) {
+        snprintf(text, sizeof(text), "BMP %ux%d",
+                 ReadLittleEndian(head, 18, 4),
+                 std::abs((int32_t)ReadLittleEndian(head, 22, 4)));
+        return text;
+    }
+    if (head.size() >= 3 && head.compare(0, 3, "\xff\xd8\xff") == 0)
+        return "JPEG";
+    if (head.size() >= 12 && head.compare(0, 4, "RIFF") == 0 &&
+        head.compare(8, 4, "WEBP") == 0)
+        return "WebP";
+    return "";
+}
+
+// строка hex-дампа: 16 байт с offset, если страница уже загружена
+void RenderHexLine(uint64_t offset) {
+    const std::string *page = CellViewPage(offset / CellPageBytes);
+    if (!page) {
+        ImGui::TextDisabled("%08llx  ...", (unsigned long long)offset);
+        return;
+    }
+    size_t start = std::min<size_t>(offset % CellPageBytes, page->size());
+    size_t count = std::min<size_t>(16, page->size() - start);
+    char line[96];
+    int length = snprintf(line, sizeof(line), "%08llx ",
+                          (unsigned long long)offset);
+    for (size_t i = 0; i < 16; ++i) {
+        if (i < count)
+            length += snprintf(line + length, sizeof(line) - length, " %02x",
+                               (unsigned char)(*page)[start + i]);
+        else
+            length += snprintf(line + length, sizeof(line) - length, "   ");
+    }
+    length += snprintf(line + length, sizeof(line) - length, "  ");
+    for (size_t i = 0; i < count; ++i) {
+        char c = (*page)[start + i];
+        line[length++] = c >= 0x20 && c < 0x7f ? c : '.';
+    }
+    ImGui::TextUnformatted(line, line + length);
+}
+
+void SaveCellView() {
+    cellView.saving = true;
+    cellView.status.clear();
+    worker.submit(
+        [table = cellView.table, column = cellView.column,
+         where = cellView.where,
+         path = std::string(cellView.savePath)](Database &db) {
+            std::ofstream file(path, std::ios::binary);
+            if (!file)
+                return std::string("не удалось открыть ") + path;
+            // кусками по мегабайту: ячейка целиком в память не читается
+            std::string chunk;
+            uint64_t total = 0;
+            for (uint64_t offset = 0;; offset += chunk.size()) {
+                if (!db.readCell(table, column, where, offset, 1 << 20,
+                                 chunk, &total))
+                    return db.errorMessage();
+                file.write(chunk.data(), chunk.size());
+                if (chunk.empty() || offset + chunk.size() >= total)
+                    break;
+            }
+            return file ? std::string() : "ошибка записи в " + path;
+        },
+        [generation = cellView.generation](std::string error) {
+            if (generation != cellView.generation)
+                return;
+            cellView.saving = false;
+            cellView.status = error.empty() ? "Сохранено" : error;
+        });
+}
+
+void RenderCellWindow() {
+    if (!cellView.open)
+        return;
+
+    ImGui::SetNextWindowSize(ImVec2(720, 480), ImGuiCond_FirstUseEver);
+    bool open = true;
+    if (ImGui::Begin("Содержимое ячейки", &open)) {
+        const ResultSet::LargeCell &cell = cellView.cell;
+        ImGui::Text("%s.%s: %s, %s", cellView.table.c_str(),
+                    cellView.column.c_str(), cell.blob ? "BLOB" : "TEXT",
+                    FormatSize(cell.bytes).c_str());
+        if (const std::string *first = CellViewPage(0)) {
+            std::string image = ImageInfo(*first);
+            if (!image.empty()) {
+                ImGui::SameLine();
+                ImGui::TextDisabled("(изображение %s)", image.c_str());
+            }
+        }
+
+        ImGui::RadioButton("Hex", &cellView.mode, 0);
+        ImGui::SameLine();
+        ImGui::RadioButton("Текст", &cellView.mode, 1);
+
+        uint64_t pageCount = (cell.bytes + CellPageBytes - 1) / CellPageBytes;
+        if (cellView.mode == 1 && pageCount > 1) {
+            ImGui::SameLine();
+            ImGui::BeginDisabled(cellView.textPage == 0);
+            if (ImGui::SmallButton("<"))
+                --cellView.textPage;
+            ImGui::EndDisabled();
+            ImGui::SameLine();
+            ImGui::Text("%llu / %llu",
+                        (unsigned long long)cellView.textPage + 1,
+                        (unsigned long long)pageCount);
+            ImGui::SameLine();
+            ImGui::BeginDisabled(cellView.textPage + 1 >= pageCount);
+            if (ImGui::SmallButton(">"))
+                ++cellView.textPage;
+            ImGui::EndDisabled();
+        }
+
+        ImGui::InputText("Файл", cellView.savePath,
+                         sizeof(cellView.savePath));
+        ImGui::SameLine();
+        ImGui::BeginDisabled(cellView.saving || !cellView.savePath[0]);
+        if (ImGui::Button("Сохранить в файл"))
+            SaveCellView();
+        ImGui::EndDisabled();
+        if (!cellView.status.empty())
+            ImGui::TextUnformatted(cellView.status.c_str());
+        if (!cellView.error.empty())
+            ImGui::TextColored(ImVec4(1, 0.4f, 0.4f, 1), "%s",
+                               cellView.error.c_str());
+
+        ImGui::BeginChild("CellContent", ImVec2(0, 0), true,
+                          ImGuiWindowFlags_HorizontalScrollbar);
+        if (cellView.mode == 0) {
+            // страницы запрашиваются только для видимых строк
+            ImGuiListClipper clipper;
+            clipper.Begin((int)((cell.bytes + 15) / 16));
+            while (clipper.Step()) {
+                for (int line = clipper.DisplayStart;
+                     line < clipper.DisplayEnd; ++line) {
+                    RenderHexLine((uint64_t)line * 16);
+                }
+            }
+        } else if (const std::string *page =
+                       CellViewPage(cellView.textPage)) {
+            // страница может оборвать многобайтовый символ UTF-8
+            ImGui::TextUnformatted(page->data(), page->data() + page->size());
+        } else {
+            ImGui::TextDisabled("Загрузка...");
+        }
+        ImGui::EndChild();
+    }
+    ImGui::End();
+    if (!open)
+        CloseCellView();
+}
+
+// InputText пишет прямо в std::string: при каждом изменении длины
+// строка подгоняется, при нехватке места - растёт
+int ResizeString(ImGuiInputTextCallbackData *data) {
+    if (data->EventFlag == ImGuiInputTextFlags_CallbackResize) {
+        auto *value = (std::string *)data->UserData;
+        value->resize(data->BufTextLen);
+        data->Buf = value->data();
+    }
+    return 0;
+}
+
+bool InputString(const char *id, std::string &value,
+                 ImGuiInputTextFlags flags = 0, const char *hint = nullptr) {
+    flags |= ImGuiInputTextFlags_CallbackResize;
+    if (hint)
+        return ImGui::InputTextWithHint(id, hint, value.data(),
+                                        value.capacity() + 1, flags,
+                                        ResizeString, &value);
+    return ImGui::InputText(id, value.data(), value.capacity() + 1, flags,
+                            ResizeString, &value);
+}
+
+bool InputStringMultiline(const char *id, std::string &value,
+                          const ImVec2 &size) {
+    return ImGui::InputTextMultiline(
+        id, value.data(), value.capacity() + 1, size,
+        ImGuiInputTextFlags_CallbackResize, ResizeString, &value);
+}
+
+std::string CurrentDateTime() {
+    char text[32];
+    time_t now = time(nullptr);
+    strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    return text;
+}
+
+// поля выбранной записи; редактор - по типу столбца
+void RenderEditFields() {
+    for (auto &field : editor.fields()) {
+        if (!field.present) {
+            // большая ячейка не редактируется, только открывается
+            const ResultSet::LargeCell *large =
+                selectedRecord >= 0 && selectedInsert < 0
+                    ? records.largeCell(selectedRecord, field.column)
+                    : nullptr;
+            if (!large)
+                continue;
+            ImGui::TextUnformatted(field.label.c_str());
+            ImGui::PushID(field.id.c_str());
+            if (ImGui::Button("Открыть"))
+                OpenCellView(selectedRecord, field.column);
+            ImGui::PopID();
+            ImGui::SameLine();
+            ImGui::TextDisabled("%s, %llu байт", large->blob ? "BLOB" : "TEXT",
+                                (unsigned long long)large->bytes);
+            continue;
+        }
+
+        ImGui::TextUnformatted(field.label.c_str());
+        switch (field.kind) {
+        case EditField::Kind::Integer:
+            InputString(field.id.c_str(), field.value,
+                        ImGuiInputTextFlags_CharsDecimal);
+            break;
+        case EditField::Kind::Real:
+            InputString(field.id.c_str(), field.value,
+                        ImGuiInputTextFlags_CharsScientific);
+            break;
+        case EditField::Kind::Date:
+            InputString(field.id.c_str(), field.value, 0,
+                        "ГГГГ-ММ-ДД ЧЧ:ММ:СС");
+            ImGui::SameLine();
+            ImGui::PushID(field.id.c_str());
+            if (ImGui::SmallButton("Сейчас"))
+                field.value = CurrentDateTime();
+            ImGui::PopID();
+            if (!RecordEditor::validDate(field.value))
+                ImGui::TextColored(ImVec4(1, 0.6f, 0.2f, 1),
+                                   "Не похоже на дату SQLite");
+            break;
+        case EditField::Kind::Multiline:
+            InputStringMultiline(
+                field.id.c_str(), field.value,
+                ImVec2(-1, ImGui::GetTextLineHeight() * 6));
+            break;
+        case EditField::Kind::Text:
+            InputString(field.id.c_str(), field.value);
+            break;
+        }
+    }
+}
+
+void SetImportFile(const std::string &path) {
+    snprintf(importPath, sizeof(importPath), "%s", path.c_str());
+    snprintf(importTable, sizeof(importTable), "%s",
+             fs::path(path).stem().string().c_str());
+    importFormat = (int)Importer::detectFormat(path);
+}
+
+// окно импорта CSV/TSV/JSON Lines
+void RenderImportWindow() {
+    if (!showImport)
+        return;
+
+    static const char *formats[] = {"CSV", "TSV", "JSON Lines"};
+    static const char *journalModes[] = {"MEMORY", "OFF", "WAL", "DELETE"};
+    static const char *syncModes[] = {"OFF", "NORMAL", "FULL"};
+
+    ImGui::SetNextWindowSize(ImVec2(600, 320), ImGuiCond_FirstUseEver);
+    if (ImGui::Begin("Импорт", &showImport)) {
+        bool running = importProgress->running;
+
+        ImGui::InputText("Файл", importPath, sizeof(importPath));
+        ImGui::SameLine();
+        if (ImGui::Button("Обзор...")) {
+            browserTarget = BrowserTarget::ImportFile;
+            browser.SetFilter("*.csv;*.tsv;*.jsonl");
+            browser.Refresh();
+            showFileBrowser = true;
+        }
+        ImGui::InputText("Таблица", importTable, sizeof(importTable));
+        ImGui::Combo("Формат", &importFormat, formats, IM_ARRAYSIZE(formats));
+        ImGui::Checkbox("Первая строка - заголовок", &importHeader);
+        ImGui::Combo("journal_mode", &importJournal, journalModes,
+                     IM_ARRAYSIZE(journalModes));
+        ImGui::Combo("synchronous", &importSync, syncModes,
+                     IM_ARRAYSIZE(syncModes));
+        ImGui::InputInt("Строк в транзакции", &importBatch, 10000, 100000);
+
+        if (running) {
+            char overlay[128];
+            snprintf(overlay, sizeof(overlay), "%llu строк, %.0f строк/с",
+                     (unsigned long long)importProgress->rows.load(),
+                     importProgress->rowsPerSecond());
+            ImGui::ProgressBar(importProgress->fraction(), ImVec2(-1, 0),
+                               overlay);
+            if (ImGui::Button("Остановить")) {
+                importProgress->cancelled = true;
+            }
+        } else {
+            if (ImGui::Button("Импортировать") && dbOpen &&
+                importPath[0] && importTable[0]) {
+                ImportOptions options;
+                options.path = importPath;
+                options.table = importTable;
+                options.format = (ImportFormat)importFormat;
+                options.header = importHeader;
+                options.batchRows = (size_t)std::max(importBatch, 1);
+                options.journalMode = journalModes[importJournal];
+                options.synchronous = syncModes[importSync];
+
+                // счётчики обнуляются сразу, чтобы кнопка не нажалась дважды
+                importProgress->start(0);
+                auto progress = importProgress;
+                worker.submit(
+                    [options, progress](Database &db) {
+                        Importer importer(options, *progress);
+                        return std::make_pair(importer.run(db),
+                                              db.catalog());
+                    },
+                    [table = options.table](
+                        std::pair<bool, std::shared_ptr<const SchemaCatalog>>
+                            result) {
+                        importProgress->finish();
+                        // нет снимка - задание отменено до запуска
+                        if (!dbOpen || !result.second)
+                            return;
+                        catalog = std::move(result.second);
+                        related.clear();
+                        if (currentTable == table)
+                            records.refresh();
+                        else if (currentTable.empty())
+                            SelectTable(table);
+                    });
+            }
+
+            std::string error = importProgress->getError();
+            if (!error.empty()) {
+                ImGui::TextColored(ImVec4(1, 0, 0, 1), "%s", error.c_str());
+            } else if (importProgress->rows > 0) {
+                ImGui::Text("Загружено %llu строк за %.1f с",
+                            (unsigned long long)importProgress->rows.load(),
+                            importProgress->seconds());
+            }
+        }
+    }
+    ImGui::End();
+}
+
+// окно экспорта таблицы или запроса
+void RenderExportWindow() {
+    if (!showExport)
+        return;
+
+    static const char *sources[] = {"Текущая таблица", "Запрос SQL"};
+    static const char *formats[] = {"CSV", "JSON Lines", "SQL INSERT"};
+
+    ImGui::SetNextWindowSize(ImVec2(600, 360), ImGuiCond_FirstUseEver);
+    if (ImGui::Begin("Экспорт", &showExport)) {
+        bool running = exportProgress.running;
+
+        ImGui::Combo("Источник", &exportSource, sources, IM_ARRAYSIZE(sources));
+        if (exportSource == 0) {
+            ImGui::Text("Таблица: %s", currentTable.c_str());
+        } else {
+            ImGui::InputTextMultiline("##sql", exportSql, sizeof(exportSql),
+                                      ImVec2(-1, 100));
+        }
+        if (ImGui::Combo("Формат", &exportFormat, formats,
+                         IM_ARRAYSIZE(formats)) ||
+            !exportPath[0]) {
+            std::string name = exportSource == 0 && !currentTable.empty()
+                                   ? currentTable
+                                   : "query_result";
+            snprintf(exportPath, sizeof(exportPath), "%s%s", name.c_str(),
+                     Exporter::extension((ExportFormat)exportFormat));
+        }
+        ImGui::InputText("Файл", exportPath, sizeof(exportPath));
+
+        if (running) {
+            char overlay[128];
+            snprintf(overlay, sizeof(overlay), "%llu строк, %.0f строк/с",
+                     (unsigned long long)exportProgress.rows.load(),
+                     exportProgress.rowsPerSecond());
+            ImGui::ProgressBar(exportProgress.fraction(), ImVec2(-1, 0),
+                               overlay);
+            if (ImGui::Button("Остановить")) {
+                exportProgress.cancelled = true;
+            }
+        } else {
+            bool ready = dbOpen && exportPath[0] &&
+                         (exportSource == 0 ? !currentTable.empty()
+                                            : exportSql[0] != 0);
+            if (ImGui::Button("Экспортировать") && ready) {
+                ExportOptions options;
+                options.databasePath = dbPath;
+                if (exportSource == 0)
+                    options.table = currentTable;
+                else
+                    options.sql = exportSql;
+                options.path = exportPath;
+                options.format = (ExportFormat)exportFormat;
+
+                if (exportThread.joinable())
+                    exportThread.join();
+                exportProgress.start(0);
+                bool parallel = pool.isOpen();
+                exportThread = std::thread([options, parallel] {
+                    Exporter exporter(options, exportProgress);
+                    if (parallel)
+                        exporter.run(pool);
+                    else
+                        exporter.run();
+                });
+            }
+
+            std::string error = exportProgress.getError();
+            if (!error.empty()) {
+                ImGui::TextColored(ImVec4(1, 0, 0, 1), "%s", error.c_str());
+            } else if (exportProgress.rows > 0) {
+                ImGui::Text("Выгружено %llu строк за %.1f с",
+                            (unsigned long long)exportProgress.rows.load(),
+                            exportProgress.seconds());
+            }
+            if (inTransaction) {
+                ImGui::TextDisabled("Незафиксированные изменения транзакции "
+                                    "в выгрузку не попадут");
+            }
+        }
+    }
+    ImGui::End();
+}
+
+// текст значения для таблиц профиля и поиска
+std::string ValueText(const Value &value) {
+    switch (value.type) {
+    case Value::Type::Null:
+        return "";
+    case Value::Type::Integer:
+        return std::to_string(value.integer);
+    case Value::Type::Real: {
+        // все знаки: разные числа не должны выглядеть одинаково
+        char text[32];
+        snprintf(text, sizeof(text), "%.17g", value.real);
+        return text;
+    }
+    case Value::Type::Text:
+        break;
+    case Value::Type::Blob:
+        return "[BLOB " + FormatSize(value.text.size()) + "]";
+    }
+    return value.text.size() > 64 ? value.text.substr(0, 64) + "..."
+                                  : value.text;
+}
+
+// Профиль собирается пулом по диапазонам rowid или, без пула и внутри
+// транзакции, на соединении worker. Снимок обновляется по ходу прохода.
+void StartProfile() {
+    statsProgress.start(0);
+    auto collector =
+        std::make_shared<TableStatsCollector>(currentTable, statsProgress);
+    statsCollector = collector;
+    statsVersion = 0;
+    tableStats = TableStats();
+    tableStats.table = currentTable;
+
+    ReadPool *readers = pool.isOpen() && !inTransaction ? &pool : nullptr;
+    auto work = [collector, readers](Database &db) {
+        return collector->run(db, readers);
+    };
+    auto done = [collector](TableStats stats) {
+        statsProgress.finish();
+        if (collector == statsCollector && !stats.table.empty())
+            tableStats = std::move(stats);
+    };
+    if (readers)
+        pool.submit(work, done);
+    else
+        worker.submit(work, done);
+}
+
+// первые частые значения в строку, полный список - в подсказке
+void RenderTopValues(const ColumnStats &column) {
+    std::string line;
+    for (size_t i = 0; i < column.top.size() && i < 3; ++i) {
+        line += (i ? ", " : "") + ValueText(column.top[i].first) + " (" +
+                std::to_string(column.top[i].second) + ")";
+    }
+    ImGui::TextUnformatted(line.c_str());
+    if (!column.top.empty() && ImGui::IsItemHovered()) {
+        ImGui::BeginTooltip();
+        for (const auto &entry : column.top) {
+            ImGui::Text("%llu  %s", (unsigned long long)entry.second,
+                        ValueText(entry.first).c_str());
+        }
+        ImGui::EndTooltip();
+    }
+}
+
+void RenderProfilePanel() {
+    // смена таблицы прерывает проход, новый начнётся после его окончания
+    if (statsProgress.running && statsCollector &&
+        tableStats.table != currentTable)
+        statsProgress.cancelled = true;
+    if (!statsProgress.running && tableStats.table != currentTable)
+        StartProfile();
+    if (statsProgress.running && statsCollector &&
+        statsCollector->version() != statsVersion) {
+        statsVersion = statsCollector->version();
+        tableStats = statsCollector->snapshot();
+    }
+
+    if (statsProgress.running) {
+        char overlay[128];
+        snprintf(overlay, sizeof(overlay), "%llu строк, %.0f строк/с",
+                 (unsigned long long)statsProgress.rows.load(),
+                 statsProgress.rowsPerSecond());
+        ImGui::ProgressBar(statsProgress.fraction(), ImVec2(-1, 0), overlay);
+        if (ImGui::Button("Остановить"))
+            statsProgress.cancelled = true;
+    } else if (ImGui::Button("Обновить")) {
+        StartProfile();
+    }
+    ImGui::SameLine();
+    ImGui::Text("%llu строк за %.2f с, диапазонов %zu из %zu%s",
+                (unsigned long long)tableStats.rows, tableStats.seconds,
+                tableStats.partsDone, tableStats.parts,
+                tableStats.complete || statsProgress.running ? ""
+                                                             : " (прервано)");
+
+    if (ImGui::BeginTable("Profile", 7,
+                          ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
+                              ImGuiTableFlags_ScrollY |
+                              ImGuiTableFlags_Resizable)) {
+        ImGui::TableSetupColumn("Столбец");
+        ImGui::TableSetupColumn("NULL");
+        ImGui::TableSetupColumn("Различных ~");
+        ImGui::TableSetupColumn("Минимум");
+        ImGui::TableSetupColumn("Максимум");
+        ImGui::TableSetupColumn("Гистограмма");
+        ImGui::TableSetupColumn("Частые");
+        ImGui::TableSetupScrollFreeze(1, 1);
+        ImGui::TableHeadersRow();
+
+        for (const auto &column : tableStats.columns) {
+            ImGui::PushID(column.name.c_str());
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::TextUnformatted(column.name.c_str());
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%llu", (unsigned long long)column.nulls);
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%llu", (unsigned long long)column.distinct);
+            ImGui::TableSetColumnIndex(3);
+            ImGui::TextUnformatted(ValueText(column.min).c_str());
+            ImGui::TableSetColumnIndex(4);
+            ImGui::TextUnformatted(ValueText(column.max).c_str());
+            ImGui::TableSetColumnIndex(5);
+            if (!column.histogram.empty()) {
+                ImGui::PlotHistogram("##histogram", column.histogram.data(),
+                                     (int)column.histogram.size(), 0,
+                                     nullptr, 0.0f, FLT_MAX,
+                                     ImVec2(-1, 32));
+                if (ImGui::IsItemHovered())
+                    ImGui::SetTooltip("%g .. %g", column.histogramMin,
+                                      column.histogramMax);
+            }
+            ImGui::TableSetColumnIndex(6);
+            RenderTopValues(column);
+            ImGui::PopID();
+        }
+        ImGui::EndTable();
+    }
+}
+
+struct ApplyResult {
+        bool ok = false;
+        size_t failed = 0;
+        std::string error;
+        std::vector<RowDelta> deltas;
+        std::vector<PendingChange> changes;
+        // строки после изменений в формате PagedTable и признак, что
+        // строка была в виде до записи
+        std::vector<ResultSet> rows;
+        std::vector<bool> visible;
+};
+
+// Весь буфер - одна транзакция и один fsync вместо отдельного на правку.
+// Строки текущей таблицы из RETURNING заменяются в кэше PagedTable без
+// перечитывания, как при отмене.
+void ApplyChanges() {
+    if (pendingChanges.empty() || applyingChanges)
+        return;
+    applyingChanges = true;
+    changesError.clear();
+    worker.submit(
+        [changes = pendingChanges.changes(), table = currentTable,
+         format = records.rowFormat()](Database &db) {
+            ApplyResult result;
+            for (const auto &change : changes) {
+                result.visible.push_back(
+                    change.table == table &&
+                    change.kind != PendingChange::Kind::Insert &&
+                    PagedTable::inView(db, format, change.key));
+            }
+            result.ok =
+                PendingChanges::apply(db, changes, result.failed, result.error,
+                                      &result.deltas, &result.rows);
+            for (size_t i = 0; result.ok && i < changes.size(); ++i) {
+                if (changes[i].table == table)
+                    result.rows[i] = PagedTable::matchRow(
+                        db, format, std::move(result.rows[i]));
+            }
+            result.changes = changes;
+            return result;
+        },
+        [table = currentTable](ApplyResult result) {
+            applyingChanges = false;
+            if (!result.ok) {
+                changesError = result.error.empty()
+                                   ? "Запись прервана"
+                                   : "Изменение " +
+                                         std::to_string(result.failed + 1) +
+                                         ": " + result.error;
+                showChanges = true;
+                return;
+            }
+            pendingChanges.clear();
+            // вся запись буфера отменяется одним шагом
+            journal.push(result.deltas);
+            related.clear();
+            selectedRecord = -1;
+            selectedInsert = -1;
+            editor.clear();
+            if (table != records.tableName())
+                return;
+
+            for (size_t i = 0; i < result.changes.size(); ++i) {
+                const PendingChange &change = result.changes[i];
+                if (change.table != table)
+                    continue;
+                switch (change.kind) {
+                case PendingChange::Kind::Insert:
+                    records.applyInsert(result.rows[i]);
+                    break;
+                case PendingChange::Kind::Update:
+                    records.applyUpdate(change.key, result.rows[i],
+                                        result.visible[i]);
+                    break;
+                case PendingChange::Kind::Delete:
+                    records.applyDelete(change.key, result.visible[i]);
+                    break;
+                }
+            }
+        });
+}
+
+// итог правки строки в потоке базы: строка после неё для кэша
+// PagedTable и дельта для журнала отмены (table пуст - дельты нет)
+struct RecordEdit {
+        bool ok = false;
+        ResultSet row;
+        RowDelta delta;
+};
+
+struct ReplayResult {
+        bool ok = false;
+        std::vector<RowDelta> step;
+        std::vector<ResultSet> rows;
+        // строка дельты была в виде с фильтром до шага
+        std::vector<bool> visible;
+        std::string error;
+};
+
+// Отмена и повтор применяют дельты шага на соединении worker; строки
+// текущей таблицы заменяются в кэше PagedTable без перечитывания.
+void ReplayJournal(bool undo) {
+    if (applyingChanges || (undo ? !journal.canUndo() : !journal.canRedo()))
+        return;
+    applyingChanges = true;
+    journalError.clear();
+    worker.submit(
+        [step = undo ? journal.undoStep() : journal.redoStep(),
+         table = currentTable, format = records.rowFormat()](Database &db) {
+            ReplayResult result;
+            for (const auto &delta : step) {
+                result.visible.push_back(
+                    delta.table == table &&
+                    delta.kind != RowDelta::Kind::Insert &&
+                    PagedTable::inView(db, format, delta.before));
+            }
+            result.ok = EditJournal::replay(db, step, table, format.columns,
+                                            result.rows, result.error);
+            for (auto &row : result.rows) {
+                row = PagedTable::matchRow(db, format, std::move(row));
+            }
+            result.step = step;
+            return result;
+        },
+        [undo, table = currentTable](ReplayResult result) {
+            applyingChanges = false;
+            if (!result.ok) {
+                journalError =
+                    result.error.empty() ? "Отмена прервана" : result.error;
+                return;
+            }
+            if (undo)
+                journal.undone();
+            else
+                journal.redone();
+            related.clear();
+            selectedRecord = -1;
+            selectedInsert = -1;
+            editor.clear();
+            if (table != records.tableName())
+                return;
+
+            for (size_t i = 0; i < result.step.size(); ++i) {
+                const RowDelta &delta = result.step[i];
+                if (delta.table != table)
+                    continue;
+                switch (delta.kind) {
+                case RowDelta::Kind::Insert:
+                    records.applyInsert(result.rows[i]);
+                    break;
+                case RowDelta::Kind::Update:
+                    records.applyUpdate(delta.before, result.rows[i],
+                                        result.visible[i]);
+                    break;
+                case RowDelta::Kind::Delete:
+                    records.applyDelete(delta.before, result.visible[i]);
+                    break;
                 }
             }
+        });
+}
+
+// значения правки по столбцам: было -> стало
+void RenderChangeValues(const PendingChange &change) {
+    switch (change.kind) {
+    case PendingChange::Kind::Insert:
+        for (const auto &pair : change.values) {
+            ImGui::Text("%s = %s", pair.first.c_str(), pair.second.c_str());
+        }
+        break;
+    case PendingChange::Kind::Update:
+        for (const auto &pair : change.values) {
+            auto old = change.original.find(pair.first);
+            ImGui::Text("%s: %s -> %s", pair.first.c_str(),
+                        old != change.original.end() ? old->second.c_str()
+                                                     : "",
+                        pair.second.c_str());
         }
-        bool MatchesFilter(const std::string &filename) {
-            std::vector<std::string> masks;
-            std::istringstream iss(filter);
-            std::string mask;
+        break;
+    case PendingChange::Kind::Delete:
+        for (const auto &pair : change.original) {
+            ImGui::TextDisabled("%s = %s", pair.first.c_str(),
+                                pair.second.c_str());
+        }
+        break;
+    }
+}
 
-            while (std::getline(iss, mask, ';')) {
-                if (mask == "*")
-                    return true;
+// список несохранённых правок перед записью в базу
+void RenderChangesWindow() {
+    if (!showChanges)
+        return;
 
-                if (mask.find("*.") == 0) {
-                    std::string ext = mask.substr(1);
-                    if (filename.size() >= ext.size() &&
-                        filename.compare(filename.size() - ext.size(),
-                                         ext.size(), ext) == 0) {
-                        return true;
-                    }
-                } else if (filename.find(mask) != std::string::npos) {
-                    return true;
-                }
+    ImGui::SetNextWindowSize(ImVec2(640, 400), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Несохранённые изменения", &showChanges)) {
+        ImGui::End();
+        return;
+    }
+
+    ImGui::BeginDisabled(pendingChanges.empty() || applyingChanges);
+    if (ImGui::Button("Применить"))
+        ApplyChanges();
+    ImGui::SameLine();
+    if (ImGui::Button("Отменить все"))
+        DiscardChanges();
+    ImGui::EndDisabled();
+    ImGui::SameLine();
+    ImGui::Text("Изменений: %zu", pendingChanges.size());
+    if (applyingChanges) {
+        ImGui::SameLine();
+        ImGui::TextDisabled("запись...");
+    }
+    if (!changesError.empty())
+        ImGui::TextColored(ImVec4(1, 0.3f, 0.3f, 1), "%s",
+                           changesError.c_str());
+
+    static const char *kinds[] = {"Вставка", "Правка", "Удаление"};
+    static const ImVec4 colors[] = {ImVec4(0.4f, 1, 0.4f, 1),
+                                    ImVec4(1, 0.8f, 0.3f, 1),
+                                    ImVec4(1, 0.4f, 0.4f, 1)};
+    int discard = -1;
+    if (ImGui::BeginTable("Changes", 4,
+                          ImGuiTableFlags_Resizable |
+                              ImGuiTableFlags_Borders |
+                              ImGuiTableFlags_RowBg |
+                              ImGuiTableFlags_ScrollY)) {
+        ImGui::TableSetupColumn("Действие");
+        ImGui::TableSetupColumn("Таблица");
+        ImGui::TableSetupColumn("Строка");
+        ImGui::TableSetupColumn("Значения");
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableHeadersRow();
+
+        const auto &changes = pendingChanges.changes();
+        for (size_t i = 0; i < changes.size(); ++i) {
+            const PendingChange &change = changes[i];
+            ImGui::TableNextRow();
+            ImGui::PushID((int)i);
+            ImGui::TableSetColumnIndex(0);
+            ImGui::TextColored(colors[(int)change.kind], "%s",
+                               kinds[(int)change.kind]);
+            ImGui::BeginDisabled(applyingChanges);
+            if (ImGui::SmallButton("Отменить"))
+                discard = (int)i;
+            ImGui::EndDisabled();
+            ImGui::TableSetColumnIndex(1);
+            ImGui::TextUnformatted(change.table.c_str());
+            ImGui::TableSetColumnIndex(2);
+            std::string key;
+            for (const auto &pair : change.where) {
+                key += (key.empty() ? "" : ", ") + pair.first + " = " +
+                       ValueText(pair.second);
             }
+            ImGui::TextUnformatted(key.empty() ? "новая" : key.c_str());
+            ImGui::TableSetColumnIndex(3);
+            RenderChangeValues(change);
+            ImGui::PopID();
+        }
+        ImGui::EndTable();
+    }
+    if (discard >= 0)
+        DiscardChange(discard);
+
+    ImGui::End();
+}
+
+// Выбирает таблицу и строку с ключом key. Фильтры могли бы скрыть
+// строку, поэтому при активных фильтрах вид таблицы сбрасывается.
+void JumpToRecord(const std::string &table, const std::vector<Value> &key) {
+    bool filtered = false;
+    for (const auto &filter : columnFilters) {
+        filtered = filtered || !filter.empty();
+    }
+    if (table != currentTable || filtered)
+        SelectTable(table);
+    jumpTable = table;
+    jumpKey = key;
+}
+
+void UpdateJump() {
+    if (jumpTable.empty() || records.tableName() != jumpTable ||
+        records.loading())
+        return;
+
+    records.locate(jumpKey, [key = jumpKey](long row) {
+        if (row < 0)
+            return;
+        selectedRecord = (int)row;
+        selectedInsert = -1;
+        selectedKey = key;
+        editor.clear();
+        scrollToRecord = row;
+        loadSelected = true;
+    });
+    jumpTable.clear();
+}
 
-            return false;
+void StartSearch() {
+    searchHits.clear();
+    searchProgress.start(0);
+    auto search = std::make_shared<GlobalSearch>(searchText, searchProgress);
+    globalSearch = search;
+
+    std::vector<std::string> tables;
+    for (const auto &table : catalog->tables) {
+        tables.push_back(table.name);
+    }
+    // индекс подключён к соединению worker, сканы таблиц идут в пуле
+    ReadPool *readers = pool.isOpen() && !inTransaction ? &pool : nullptr;
+    worker.submit(
+        [search, readers, tables](Database &db) {
+            search->run(db, readers, tables);
+            return true;
+        },
+        [](bool) { searchProgress.finish(); });
+}
+
+// поиск подстроки по всем таблицам, построение и удаление индекса
+void RenderSearchWindow() {
+    if (!showSearch || !dbOpen)
+        return;
+
+    if (globalSearch) {
+        for (auto &hit : globalSearch->take()) {
+            searchHits.push_back(std::move(hit));
         }
+    }
 
-        bool Draw() {
-            bool fileSelected = false;
+    ImGui::SetNextWindowSize(ImVec2(800, 450), ImGuiCond_FirstUseEver);
+    if (ImGui::Begin("Поиск по базе", &showSearch)) {
+        bool running = searchProgress.running;
+        bool enter = ImGui::InputTextWithHint(
+            "##search", "текст", searchText, sizeof(searchText),
+            ImGuiInputTextFlags_EnterReturnsTrue);
+        ImGui::SameLine();
+        if (running) {
+            if (ImGui::Button("Остановить"))
+                searchProgress.cancelled = true;
+        } else if ((ImGui::Button("Искать") || enter) && searchText[0] &&
+                   catalog) {
+            StartSearch();
+        }
 
-            // Панель управления с фильтром
-            if (ImGui::Button("Наверх") && currentPath != "/") {
-                currentPath = fs::path(currentPath).parent_path().string();
-                Refresh();
-            }
+        if (running) {
+            char overlay[64];
+            snprintf(overlay, sizeof(overlay), "таблиц %llu из %llu",
+                     (unsigned long long)searchProgress.done.load(),
+                     (unsigned long long)searchProgress.total.load());
+            ImGui::ProgressBar(searchProgress.fraction(), ImVec2(-1, 0),
+                               overlay);
+        } else if (globalSearch) {
+            ImGui::Text("Найдено %zu%s за %.2f с, по индексу таблиц: %zu",
+                        searchHits.size(),
+                        searchHits.size() >= GlobalSearch::MaxHits
+                            ? " (предел)"
+                            : "",
+                        searchProgress.seconds(),
+                        globalSearch->indexedTables());
+        }
 
+        // индекс FTS5 в файле рядом с базой
+        if (indexProgress.running) {
+            ImGui::ProgressBar(indexProgress.fraction(), ImVec2(-1, 0),
+                               "Построение индекса");
+            // прерывается только построение, очередь worker остаётся
+            if (ImGui::Button("Отменить построение"))
+                indexProgress.cancelled = true;
+        } else {
+            ImGui::Text("Индекс: %s",
+                        searchIndex
+                            ? SearchIndex::sidecarPath(dbPath).c_str()
+                            : "нет");
             ImGui::SameLine();
-            ImGui::Text("Текущая папка: %s", currentPath.c_str());
-
-            if (ImGui::BeginCombo("Предустановки", filter.c_str())) {
-                for (int i = 0; i < IM_ARRAYSIZE(filterPresets); i++) {
-                    if (ImGui::Selectable(filterPresets[i],
-                                          filter == filterPatterns[i])) {
-                        filter = filterPatterns[i];
-                        strcpy(filterInput, filter.c_str());
-                        Refresh();
-                    }
+            ImGui::BeginDisabled(dbReadOnly || inTransaction);
+            if (ImGui::SmallButton(searchIndex ? "Перестроить"
+                                               : "Построить")) {
+                indexProgress.start(0);
+                worker.submit(
+                    [path = dbPath](Database &db) {
+                        return SearchIndex::build(db, path, indexProgress);
+                    },
+                    [path = dbPath](bool ok) {
+                        indexProgress.finish();
+                        if (path == dbPath)
+                            searchIndex = ok;
+                    },
+                    &indexProgress.cancelled);
+            }
+            if (searchIndex) {
+                ImGui::SameLine();
+                if (ImGui::SmallButton("Удалить")) {
+                    worker.submit(
+                        [path = dbPath](Database &db) {
+                            SearchIndex::remove(db, path);
+                            return true;
+                        },
+                        [](bool) { searchIndex = false; });
                 }
-                ImGui::EndCombo();
             }
-            ImGui::BeginChild("##browser", ImVec2(0, 300), true);
+            ImGui::EndDisabled();
+            std::string error = indexProgress.getError();
+            if (!error.empty())
+                ImGui::TextColored(ImVec4(1, 0, 0, 1), "%s", error.c_str());
+        }
 
-            // Показываем папки
-            for (const auto &dir : directories) {
-                if (ImGui::Selectable(("[D] " + dir).c_str(), false,
-                                      ImGuiSelectableFlags_AllowDoubleClick)) {
-                    if (ImGui::IsMouseDoubleClicked(0)) {
-                        currentPath = (fs::path(currentPath) / dir).string();
-                        Refresh();
+        if (ImGui::BeginTable("SearchHits", 4,
+                              ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
+                                  ImGuiTableFlags_ScrollY |
+                                  ImGuiTableFlags_Resizable)) {
+            ImGui::TableSetupColumn("Таблица");
+            ImGui::TableSetupColumn("Ключ");
+            ImGui::TableSetupColumn("Столбец");
+            ImGui::TableSetupColumn("Фрагмент");
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableHeadersRow();
+
+            ImGuiListClipper clipper;
+            clipper.Begin((int)searchHits.size());
+            while (clipper.Step()) {
+                for (int i = clipper.DisplayStart; i < clipper.DisplayEnd;
+                     i++) {
+                    const SearchHit &hit = searchHits[i];
+                    std::string key;
+                    for (const auto &value : hit.key) {
+                        key += (key.empty() ? "" : ", ") + ValueText(value);
                     }
+
+                    ImGui::TableNextRow();
+                    ImGui::PushID(i);
+                    ImGui::TableSetColumnIndex(0);
+                    if (ImGui::Selectable(hit.table.c_str(), false,
+                                          ImGuiSelectableFlags_SpanAllColumns))
+                        JumpToRecord(hit.table, hit.key);
+                    ImGui::TableSetColumnIndex(1);
+                    ImGui::TextUnformatted(key.c_str());
+                    ImGui::TableSetColumnIndex(2);
+                    ImGui::TextUnformatted(hit.column.c_str());
+                    ImGui::TableSetColumnIndex(3);
+                    ImGui::TextUnformatted(hit.snippet.c_str());
+                    ImGui::PopID();
                 }
             }
+            ImGui::EndTable();
+        }
+    }
+    ImGui::End();
+}
+
+// Левая сторона - открытая база или её снимок, правая - diffPath. Поток
+// живёт до конца сравнения, строки забираются каждый кадр.
+void StartDiff() {
+    ResetDiff();
+    DiffOptions options;
+    options.leftPath = snapshot ? snapshot->replica() : dbPath;
+    options.leftProfile =
+        snapshot ? OpenProfile::Snapshot : OpenProfile::Reader;
+    options.rightPath = diffPath;
+    options.table = diffTable;
+    diffProgress.start(0);
+    auto diff = std::make_shared<TableDiff>(options, diffProgress);
+    tableDiff = diff;
+    // снимок держится, пока идёт проход по его файлу
+    diffThread = std::thread([diff, replica = snapshot] {
+        diff->run();
+        diffProgress.finish();
+        glfwPostEmptyEvent();
+    });
+}
+
+// Строки по ключу читаются после прохода на соединениях TableDiff, но в
+// потоке worker: медленный второй файл не задерживает кадр
+void SelectDiffRow(int row) {
+    std::vector<Value> values;
+    for (size_t col = 1; col < diffRows.columnCount(); ++col) {
+        values.push_back(diffRows.getValue(row, col));
+    }
+    diffSelected = row;
+    diffDetail = {};
+    worker.submit(
+        [diff = tableDiff, values](Database &) { return diff->rows(values); },
+        [diff = tableDiff, row](std::pair<ResultSet, ResultSet> detail) {
+            if (diff == tableDiff && row == diffSelected)
+                diffDetail = std::move(detail);
+        });
+}
+
+const ImVec4 DiffColors[] = {ImVec4(1.0f, 0.8f, 0.3f, 1.0f),
+                             ImVec4(0.4f, 0.9f, 0.4f, 1.0f),
+                             ImVec4(1.0f, 0.45f, 0.45f, 1.0f)};
+const char *DiffNames[] = {"изменена", "добавлена", "удалена"};
+
+// столбцы выбранной строки в обеих базах, различия выделены
+void RenderDiffDetail() {
+    const ResultSet &left = diffDetail.first;
+    const ResultSet &right = diffDetail.second;
+    std::vector<std::string> names;
+    for (const ResultSet *rows : {&left, &right}) {
+        for (size_t col = 0; col < rows->columnCount(); ++col) {
+            if (std::find(names.begin(), names.end(),
+                          rows->columnName(col)) == names.end())
+                names.push_back(rows->columnName(col));
+        }
+    }
+    if (names.empty()) {
+        ImGui::TextDisabled("Чтение строки...");
+        return;
+    }
+    if (!ImGui::BeginTable("DiffDetail", 3,
+                           ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
+                               ImGuiTableFlags_ScrollY |
+                               ImGuiTableFlags_Resizable))
+        return;
+    ImGui::TableSetupColumn("Столбец");
+    ImGui::TableSetupColumn("Текущая база");
+    ImGui::TableSetupColumn("Другая база");
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableHeadersRow();
+    for (const auto &name : names) {
+        int a = left.rowCount() ? left.columnIndex(name) : -1;
+        int b = right.rowCount() ? right.columnIndex(name) : -1;
+        Value oldValue = a >= 0 ? left.getValue(0, a) : Value();
+        Value newValue = b >= 0 ? right.getValue(0, b) : Value();
+        bool changed = a < 0 || b < 0 || oldValue != newValue;
+
+        ImGui::TableNextRow();
+        ImGui::TableSetColumnIndex(0);
+        if (changed)
+            ImGui::TextColored(DiffColors[0], "%s", name.c_str());
+        else
+            ImGui::TextUnformatted(name.c_str());
+        ImGui::TableSetColumnIndex(1);
+        ImGui::TextUnformatted(a >= 0 ? ValueText(oldValue).c_str() : "-");
+        ImGui::TableSetColumnIndex(2);
+        ImGui::TextUnformatted(b >= 0 ? ValueText(newValue).c_str() : "-");
+    }
+    ImGui::EndTable();
+}
+
+// сравнение таблицы текущей базы с той же таблицей в другом файле
+void RenderDiffWindow() {
+    if (!showDiff || !dbOpen)
+        return;
+
+    if (tableDiff)
+        tableDiff->take(diffRows);
+    if (diffTable.empty())
+        diffTable = currentTable;
+
+    ImGui::SetNextWindowSize(ImVec2(800, 500), ImGuiCond_FirstUseEver);
+    if (ImGui::Begin("Сравнение таблиц", &showDiff)) {
+        bool running = diffProgress.running;
+        ImGui::InputTextWithHint("##diffPath", "файл другой базы", diffPath,
+                                 sizeof(diffPath));
+        if (catalog && ImGui::BeginCombo("Таблица##diff", diffTable.c_str())) {
+            for (const auto &table : catalog->tables) {
+                if (ImGui::Selectable(table.name.c_str(),
+                                      table.name == diffTable))
+                    diffTable = table.name;
+            }
+            ImGui::EndCombo();
+        }
+        if (running) {
+            if (ImGui::Button("Остановить"))
+                diffProgress.cancelled = true;
+        } else if (ImGui::Button("Сравнить") && diffPath[0] &&
+                   !diffTable.empty()) {
+            StartDiff();
+        }
+        if (inTransaction) {
+            ImGui::SameLine();
+            ImGui::TextDisabled("незафиксированные изменения не видны");
+        }
+
+        DiffSummary summary =
+            tableDiff ? tableDiff->summary() : DiffSummary();
+        std::string error = diffProgress.getError();
+        if (running) {
+            char overlay[64];
+            snprintf(overlay, sizeof(overlay), "%llu строк, %.0f в с",
+                     (unsigned long long)diffProgress.rows.load(),
+                     diffProgress.rowsPerSecond());
+            ImGui::ProgressBar(diffProgress.fraction(), ImVec2(-1, 0),
+                               overlay);
+        }
+        if (!error.empty()) {
+            ImGui::TextColored(ImVec4(1, 0, 0, 1), "%s", error.c_str());
+        } else if (tableDiff) {
+            ImGui::Text("Совпадают %llu, изменены %llu, добавлены %llu, "
+                        "удалены %llu%s",
+                        (unsigned long long)summary.same,
+                        (unsigned long long)summary.changed,
+                        (unsigned long long)summary.added,
+                        (unsigned long long)summary.removed,
+                        summary.truncated ? " (список обрезан)" : "");
+            std::string only;
+            for (const auto &name : summary.leftOnly) {
+                only += (only.empty() ? "" : ", ") + name;
+            }
+            for (const auto &name : summary.rightOnly) {
+                only += (only.empty() ? "" : ", ") + name + " (другая)";
+            }
+            if (!only.empty())
+                ImGui::TextDisabled("Не сравниваются: %s", only.c_str());
+        }
 
-            // Показываем файлы
-            for (const auto &file : files) {
-                if (ImGui::Selectable(file.c_str(), selectedFile == file)) {
-                    selectedFile = file;
-                    if (ImGui::IsMouseDoubleClicked(0)) {
-                        fileSelected = true;
+        float detail = diffSelected >= 0 ? 180.0f : 0.0f;
+        if (ImGui::BeginTable("DiffRows", 2,
+                              ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
+                                  ImGuiTableFlags_ScrollY,
+                              ImVec2(0, -detail))) {
+            ImGui::TableSetupColumn("Строка",
+                                    ImGuiTableColumnFlags_WidthFixed, 90.0f);
+            ImGui::TableSetupColumn("Ключ");
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableHeadersRow();
+
+            ImGuiListClipper clipper;
+            clipper.Begin((int)diffRows.rowCount());
+            while (clipper.Step()) {
+                for (int i = clipper.DisplayStart; i < clipper.DisplayEnd;
+                     i++) {
+                    int kind = (int)diffRows.getInt(i, 0);
+                    std::string key;
+                    for (size_t col = 1; col < diffRows.columnCount(); ++col) {
+                        key += (key.empty() ? "" : ", ") +
+                               ValueText(diffRows.getValue(i, col));
                     }
+
+                    ImGui::TableNextRow();
+                    ImGui::PushID(i);
+                    ImGui::TableSetColumnIndex(0);
+                    ImGui::PushStyleColor(ImGuiCol_Text, DiffColors[kind]);
+                    bool clicked = ImGui::Selectable(
+                        DiffNames[kind], i == diffSelected,
+                        ImGuiSelectableFlags_SpanAllColumns);
+                    ImGui::PopStyleColor();
+                    if (clicked && !running)
+                        SelectDiffRow(i);
+                    ImGui::TableSetColumnIndex(1);
+                    ImGui::TextUnformatted(key.c_str());
+                    ImGui::PopID();
                 }
             }
+            ImGui::EndTable();
+        }
+        if (diffSelected >= 0)
+            RenderDiffDetail();
+    }
+    ImGui::End();
+}
 
-            ImGui::EndChild();
+struct ConsoleResult {
+        bool ran = false;
+        bool inTransaction = false;
+};
 
-            return fileSelected;
+// planOnly - только EXPLAIN QUERY PLAN каждого оператора
+void StartConsole(bool planOnly) {
+    sqlHistory.add(consoleSql);
+    consoleRows = ResultSet();
+    consoleStats.clear();
+    consoleProgress.start(0);
+    auto console =
+        std::make_shared<SqlConsole>(consoleSql, planOnly, consoleProgress);
+    sqlConsole = console;
+    worker.submit(
+        [console](Database &db) {
+            ConsoleResult result;
+            console->run(db);
+            result.ran = true;
+            result.inTransaction = db.inTransaction();
+            return result;
+        },
+        [console](ConsoleResult result) {
+            consoleProgress.finish();
+            if (console != sqlConsole)
+                return;
+            consoleStats = console->statements();
+            console->take(consoleRows);
+            if (!result.ran)
+                return;
+            // BEGIN и COMMIT из консоли меняют состояние транзакции
+            inTransaction = result.inTransaction;
+            if (console->wrote()) {
+                ReloadCatalog();
+                related.clear();
+                records.refresh();
+            }
+        },
+        &consoleProgress.cancelled);
+}
+
+// SCAN без индекса, временное B-дерево и автоиндекс - признаки
+// медленного запроса
+bool SlowPlanStep(const std::string &detail) {
+    return (detail.compare(0, 5, "SCAN ") == 0 &&
+            detail.find(" USING ") == std::string::npos &&
+            detail.find("CONSTANT ROW") == std::string::npos) ||
+           detail.find("TEMP B-TREE") != std::string::npos ||
+           detail.find("AUTOMATIC") != std::string::npos;
+}
+
+void RenderPlan(const std::vector<PlanNode> &plan, int parent) {
+    for (const auto &node : plan) {
+        if (node.parent != parent)
+            continue;
+        bool children =
+            std::any_of(plan.begin(), plan.end(), [&](const PlanNode &child) {
+                return child.parent == node.id;
+            });
+        bool slow = SlowPlanStep(node.detail);
+        if (slow)
+            ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1, 0.6f, 0.2f, 1));
+        ImGuiTreeNodeFlags flags =
+            children ? ImGuiTreeNodeFlags_DefaultOpen
+                     : ImGuiTreeNodeFlags_Leaf |
+                           ImGuiTreeNodeFlags_NoTreePushOnOpen;
+        bool open = ImGui::TreeNodeEx((void *)(intptr_t)node.id, flags, "%s",
+                                      node.detail.c_str());
+        if (slow)
+            ImGui::PopStyleColor();
+        if (children && open) {
+            RenderPlan(plan, node.id);
+            ImGui::TreePop();
         }
-};
+    }
+}
 
-// Глобальные переменные для управления окном
-bool showFileBrowser = false;
-FileBrowser browser; // Наш класс файлового браузера
+// первая строка текста, не длиннее limit байт
+std::string FirstLine(const std::string &text, size_t limit) {
+    size_t start = text.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos)
+        return "";
+    size_t end = std::min(text.find('\n', start), start + limit);
+    return text.substr(start, end - start);
+}
 
-// Наша база данных
-Database db;
-std::string dbPath;
-bool dbOpen = false;
+void RenderConsoleStats() {
+    if (!ImGui::BeginTable("Statements", 8,
+                           ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
+                               ImGuiTableFlags_Resizable))
+        return;
+    ImGui::TableSetupColumn("Оператор и план");
+    ImGui::TableSetupColumn("мс");
+    ImGui::TableSetupColumn("Строк");
+    ImGui::TableSetupColumn("Изменено");
+    ImGui::TableSetupColumn("Полный просмотр");
+    ImGui::TableSetupColumn("Сортировки");
+    ImGui::TableSetupColumn("Автоиндексы");
+    ImGui::TableSetupColumn("Шаги VM");
+    ImGui::TableHeadersRow();
+
+    for (size_t i = 0; i < consoleStats.size(); ++i) {
+        const StatementStats &stats = consoleStats[i];
+        ImGui::TableNextRow();
+        ImGui::PushID((int)i);
+        ImGui::TableSetColumnIndex(0);
+        std::string title = FirstLine(stats.sql, 80);
+        if (stats.plan.empty()) {
+            ImGui::TextUnformatted(title.c_str());
+        } else if (ImGui::TreeNode(title.c_str())) {
+            RenderPlan(stats.plan, 0);
+            ImGui::TreePop();
+        }
+        if (!stats.error.empty())
+            ImGui::TextColored(ImVec4(1, 0.4f, 0.4f, 1), "%s",
+                               stats.error.c_str());
+        if (!stats.finished) {
+            ImGui::TableSetColumnIndex(1);
+            ImGui::TextDisabled("...");
+            ImGui::PopID();
+            continue;
+        }
 
-// Состояние интерфейса
-std::vector<std::string> tables;
-std::string currentTable;
-std::vector<std::map<std::string, std::string>> records;
-std::vector<ColumnInfo> tableInfo;
-int selectedRecord = -1;
-std::map<std::string, std::string> editValues;
-bool inTransaction = false;
+        ImGui::TableSetColumnIndex(1);
+        ImGui::Text("%.2f", stats.seconds * 1000);
+        ImGui::TableSetColumnIndex(2);
+        ImGui::Text("%llu", (unsigned long long)stats.rows);
+        ImGui::TableSetColumnIndex(3);
+        ImGui::Text("%d", stats.changes);
+        // шаги полного просмотра и автоиндексы - повод для индекса
+        ImGui::TableSetColumnIndex(4);
+        if (stats.fullscanSteps > 0)
+            ImGui::TableSetBgColor(ImGuiTableBgTarget_CellBg, UpdatedColor);
+        ImGui::Text("%d", stats.fullscanSteps);
+        ImGui::TableSetColumnIndex(5);
+        ImGui::Text("%d", stats.sorts);
+        ImGui::TableSetColumnIndex(6);
+        if (stats.autoindexes > 0)
+            ImGui::TableSetBgColor(ImGuiTableBgTarget_CellBg, UpdatedColor);
+        ImGui::Text("%d", stats.autoindexes);
+        ImGui::TableSetColumnIndex(7);
+        ImGui::Text("%d", stats.vmSteps);
+        ImGui::PopID();
+    }
+    ImGui::EndTable();
+}
+
+void RenderConsoleRows() {
+    // ImGui ограничивает число столбцов таблицы
+    size_t columns = std::min<size_t>(consoleRows.columnCount(), 512);
+    if (columns == 0 ||
+        !ImGui::BeginTable("ConsoleRows", (int)columns,
+                           ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
+                               ImGuiTableFlags_ScrollX |
+                               ImGuiTableFlags_ScrollY |
+                               ImGuiTableFlags_Resizable))
+        return;
+    for (size_t col = 0; col < columns; ++col) {
+        ImGui::TableSetupColumn(consoleRows.columnName(col).c_str());
+    }
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableHeadersRow();
+
+    ResultSet::NumberBuffer buffer;
+    ImGuiListClipper clipper;
+    clipper.Begin((int)consoleRows.rowCount());
+    while (clipper.Step()) {
+        for (int row = clipper.DisplayStart; row < clipper.DisplayEnd;
+             ++row) {
+            ImGui::TableNextRow();
+            for (size_t col = 0; col < columns; ++col) {
+                ImGui::TableSetColumnIndex((int)col);
+                std::string_view value =
+                    consoleRows.getText(row, col, buffer);
+                if (const ResultSet::LargeCell *large =
+                        consoleRows.largeCell(row, col))
+                    ImGui::TextDisabled(
+                        "%s", LargeCellLabel(*large, value).c_str());
+                else
+                    ImGui::TextUnformatted(value.data(),
+                                           value.data() + value.size());
+            }
+        }
+    }
+    ImGui::EndTable();
+}
+
+// произвольный SQL: план, счётчики операторов и строки результата
+void RenderConsoleWindow() {
+    if (!showConsole || !dbOpen)
+        return;
+
+    bool running = consoleProgress.running;
+    if (running && sqlConsole) {
+        consoleStats = sqlConsole->statements();
+        sqlConsole->take(consoleRows);
+    }
+
+    ImGui::SetNextWindowSize(ImVec2(900, 600), ImGuiCond_FirstUseEver);
+    if (ImGui::Begin("SQL-консоль", &showConsole)) {
+        InputStringMultiline("##sql", consoleSql,
+                             ImVec2(-1, ImGui::GetTextLineHeight() * 8));
+        bool ready = !running && consoleSql.find_first_not_of(" \t\r\n") !=
+                                     std::string::npos;
+        // поле ввода - дочернее окно консоли
+        bool shortcut =
+            ImGui::IsWindowFocused(ImGuiFocusedFlags_RootAndChildWindows) &&
+            ImGui::GetIO().KeyCtrl &&
+            ImGui::IsKeyPressed(ImGuiKey_Enter, false);
+
+        if (running) {
+            // правки и блоки в очереди за запросом не отменяются
+            if (ImGui::Button("Остановить"))
+                consoleProgress.cancelled = true;
+            ImGui::SameLine();
+            ImGui::Text("%llu строк, %.1f с",
+                        (unsigned long long)consoleProgress.rows.load(),
+                        consoleProgress.seconds());
+        } else {
+            ImGui::BeginDisabled(!ready);
+            if (ImGui::Button("Выполнить (Ctrl+Enter)") ||
+                (shortcut && ready))
+                StartConsole(false);
+            ImGui::SameLine();
+            if (ImGui::Button("Только план"))
+                StartConsole(true);
+            ImGui::EndDisabled();
+        }
+
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(200);
+        if (ImGui::BeginCombo("##history", "История")) {
+            const auto &entries = sqlHistory.entries();
+            for (size_t i = entries.size(); i-- > 0;) {
+                ImGui::PushID((int)i);
+                if (ImGui::Selectable(FirstLine(entries[i], 80).c_str()))
+                    consoleSql = entries[i];
+                ImGui::PopID();
+            }
+            ImGui::EndCombo();
+        }
+
+        RenderConsoleStats();
+        if (sqlConsole && sqlConsole->truncated())
+            ImGui::TextDisabled("Показаны первые %zu строк",
+                                SqlConsole::MaxRows);
+        RenderConsoleRows();
+    }
+    ImGui::End();
+}
+
+// время кадров и запросов к базе, запись трассы Chrome
+void RenderProfilerWindow() {
+    profiler.enabled = showProfiler || profiler.tracing();
+    if (!showProfiler)
+        return;
+
+    ImGui::SetNextWindowSize(ImVec2(700, 500), ImGuiCond_FirstUseEver);
+    if (ImGui::Begin("Профилировщик", &showProfiler)) {
+        FrameProfile average = profiler.averageFrame();
+        ImGui::Text("Кадр: события %.2f мс, интерфейс %.2f мс, отрисовка "
+                    "%.2f мс, swap %.2f мс",
+                    average.pollUs / 1000.0, average.uiUs / 1000.0,
+                    average.drawUs / 1000.0, average.swapUs / 1000.0);
+
+        auto frames = profiler.frameHistory();
+        ImGui::PlotHistogram("Кадр, мс", frames.data(), (int)frames.size(),
+                             0, nullptr, 0.0f, 33.0f, ImVec2(0, 60));
+        auto queries = profiler.queryHistory();
+        ImGui::PlotHistogram("Запрос, мс", queries.data(),
+                             (int)queries.size(), 0, nullptr, 0.0f,
+                             FLT_MAX, ImVec2(0, 60));
+
+        if (profiler.tracing()) {
+            if (ImGui::Button("Остановить запись")) {
+                profiler.stopTrace();
+                traceStatus = profiler.writeChromeTrace(tracePath)
+                                  ? "Трасса сохранена в " +
+                                        std::string(tracePath)
+                                  : "Не удалось записать " +
+                                        std::string(tracePath);
+            }
+            ImGui::SameLine();
+            ImGui::Text("%zu событий", profiler.traceEvents());
+        } else {
+            ImGui::InputText("Файл трассы", tracePath, sizeof(tracePath));
+            ImGui::SameLine();
+            if (ImGui::Button("Записать трассу")) {
+                profiler.startTrace();
+                traceStatus.clear();
+            }
+        }
+        if (!traceStatus.empty())
+            ImGui::TextDisabled("%s", traceStatus.c_str());
+
+        // последние запросы, новые сверху
+        if (ImGui::BeginTable("Queries", 6,
+                              ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
+                                  ImGuiTableFlags_ScrollY |
+                                  ImGuiTableFlags_Resizable)) {
+            ImGui::TableSetupColumn("Запрос");
+            ImGui::TableSetupColumn("prepare, мс");
+            ImGui::TableSetupColumn("step, мс");
+            ImGui::TableSetupColumn("перенос, мс");
+            ImGui::TableSetupColumn("Строк");
+            ImGui::TableSetupColumn("Байт");
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableHeadersRow();
+
+            auto recent = profiler.recentQueries();
+            for (auto it = recent.rbegin(); it != recent.rend(); ++it) {
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+                ImGui::TextUnformatted(it->sql.c_str());
+                if (ImGui::IsItemHovered())
+                    ImGui::SetTooltip("%s", it->sql.c_str());
+                ImGui::TableSetColumnIndex(1);
+                ImGui::Text("%.3f", it->prepareUs / 1000.0);
+                ImGui::TableSetColumnIndex(2);
+                ImGui::Text("%.3f", it->stepUs / 1000.0);
+                ImGui::TableSetColumnIndex(3);
+                ImGui::Text("%.3f", it->materializeUs / 1000.0);
+                ImGui::TableSetColumnIndex(4);
+                ImGui::Text("%llu", (unsigned long long)it->rows);
+                ImGui::TableSetColumnIndex(5);
+                ImGui::Text("%llu", (unsigned long long)it->bytes);
+            }
+            ImGui::EndTable();
+        }
+    }
+    ImGui::End();
+}
 
 // выбор файла
 void RenderFileBrowser() {
@@ -170,6 +2665,15 @@ void RenderFileBrowser() {
                 showFileBrowser = false; // Закрываем окно после выбора
             }
 
+            if (browserTarget == BrowserTarget::OpenDatabase) {
+                static const char *profiles[] = {
+                    "Обычный", "Только чтение (снимок)",
+                    "Редактирование (WAL)", "Массовая загрузка",
+                    "Копия (без блокировок)"};
+                ImGui::Combo("Режим", &openProfile, profiles,
+                             IM_ARRAYSIZE(profiles));
+            }
+
             // Кнопка "Открыть" для подтверждения выбора
             if (ImGui::Button("Открыть") && !browser.selectedFile.empty()) {
                 std::string selectedFile =
@@ -178,25 +2682,12 @@ void RenderFileBrowser() {
 
                 std::string newPath =
                     (fs::path(browser.currentPath) / browser.selectedFile);
-                // открываем базу
-                if (!newPath.empty()) {
-                    dbPath = newPath;
-                    dbOpen = db.open(dbPath);
-                    if (dbOpen) {
-                        tables = db.getTables();
-                        if (!tables.empty()) {
-                            currentTable = tables[0];
-                            tableInfo = db.getTableInfo(currentTable);
-                            records =
-                                db.query("SELECT * FROM " + currentTable + ";");
-                        } else {
-                            currentTable.clear();
-                            tableInfo.clear();
-                            records.clear();
-                        }
-                        selectedRecord = -1;
-                        editValues.clear();
-                    }
+                if (browserTarget == BrowserTarget::ImportFile) {
+                    // файл для импорта
+                    SetImportFile(newPath);
+                } else if (!newPath.empty()) {
+                    // открываем базу
+                    OpenDatabase(newPath, (OpenProfile)openProfile);
                 }
 
                 showFileBrowser = false;
@@ -213,7 +2704,65 @@ void RenderFileBrowser() {
     }
 }
 
+// true, пока идёт фоновая работа с индикатором или счётчиком времени
+bool BackgroundBusy() {
+    return worker.busy() || records.loading() || exportProgress.running ||
+           importProgress->running || statsProgress.running ||
+           searchProgress.running || indexProgress.running ||
+           snapshotProgress.running || diffProgress.running;
+}
+
+// Кадр рисуется по событию, а не с частотой экрана: ввод, готовый
+// результат фонового запроса (glfwPostEmptyEvent из его потока) или
+// таймер, пока идёт работа с прогрессом. После события рисуется ещё
+// SettleFrames кадров: ImGui раскладывает окна по размерам прошлого.
+void WaitForEvents(int &settle) {
+    if (!idleWait || profiler.enabled || settle < SettleFrames) {
+        glfwPollEvents();
+        ++settle;
+        return;
+    }
+
+    // курсор в поле ввода мигает, подсказка появляется с задержкой
+    double timeout = BackgroundBusy() ? BusyWaitSeconds
+                     : ImGui::GetIO().WantTextInput ||
+                             ImGui::IsAnyItemHovered()
+                         ? InputWaitSeconds
+                         : 0;
+    // автообновление снимка будит по таймеру
+    double due = SnapshotDueIn();
+    if (due != 0 && (timeout == 0 || due < timeout))
+        timeout = std::max(due, 0.001);
+    double start = glfwGetTime();
+    if (timeout > 0)
+        glfwWaitEventsTimeout(timeout);
+    else
+        glfwWaitEvents();
+    // проснулись раньше таймера - пришло событие
+    if (timeout == 0 || glfwGetTime() - start < timeout)
+        settle = 0;
+}
+
 int main(int argc, char **argv) {
+    // database_editor [--profile default|readonly|editing|bulkload|snapshot]
+    //                 [файл]
+    std::string startPath;
+    OpenProfile startProfile = OpenProfile::Default;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--profile" && i + 1 < argc) {
+            if (!Database::parseProfile(argv[++i], startProfile)) {
+                fprintf(stderr, "Неизвестный профиль: %s\n", argv[i]);
+                return 2;
+            }
+        } else if (arg == "--readonly") {
+            startProfile = OpenProfile::ReadOnly;
+        } else {
+            startPath = arg;
+        }
+    }
+    openProfile = (int)startProfile;
+
     // Инициализация GLFW
     glfwSetErrorCallback(glfw_error_callback);
     if (!glfwInit()) {
@@ -259,9 +2808,40 @@ int main(int argc, char **argv) {
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init(glsl_version);
 
+    worker.submit(
+        [](Database &db) {
+            db.setProfiler(&profiler);
+            return true;
+        },
+        [](bool) {});
+    // готовый результат фонового запроса будит ожидание событий
+    worker.setNotify([] { glfwPostEmptyEvent(); });
+    pool.setNotify([] { glfwPostEmptyEvent(); });
+    related.open(worker);
+    browser.lister.setNotify([] { glfwPostEmptyEvent(); });
+    sqlHistory.load(SqlHistory::defaultPath());
+    if (!startPath.empty())
+        OpenDatabase(startPath, startProfile);
+
     // Главный цикл
+    int settleFrames = 0;
     while (!glfwWindowShouldClose(window)) {
-        glfwPollEvents();
+        WaitForEvents(settleFrames);
+        FrameProfile frame;
+        frame.start = profiler.now();
+
+        // Результаты фоновых запросов
+        worker.poll();
+        pool.poll();
+        records.setReadPool(pool.isOpen() && !inTransaction ? &pool
+                                                            : nullptr);
+        related.setReadPool(pool.isOpen() && !inTransaction ? &pool
+                                                            : nullptr);
+        UpdateSnapshot();
+        UpdateLinkJump();
+        UpdateJump();
+        uint64_t mark = profiler.now();
+        frame.pollUs = mark - frame.start;
 
         // Начало кадра IMGUI
         ImGui_ImplOpenGL3_NewFrame();
@@ -283,6 +2863,7 @@ int main(int argc, char **argv) {
             if (ImGui::BeginMenu("File")) {
                 if (ImGui::MenuItem("Open Database...")) {
                     // std::string newPath = OpenFileDialog();
+                    browserTarget = BrowserTarget::OpenDatabase;
                     showFileBrowser = true;
                     browser.Refresh(); // Обновляем список файлов при открытии
                                        // if (file.Draw()) {
@@ -292,14 +2873,64 @@ int main(int argc, char **argv) {
                     //                                .string();
                 }
 
+                if (ImGui::MenuItem("Import...", nullptr, false,
+                                    dbOpen && !dbReadOnly)) {
+                    showImport = true;
+                }
+
+                if (ImGui::MenuItem("Export...", nullptr, false, dbOpen)) {
+                    exportPath[0] = 0;
+                    showExport = true;
+                }
+
                 if (ImGui::MenuItem("Close Database", nullptr, false, dbOpen)) {
-                    db.close();
+                    CancelSnapshot();
+                    snapshot.reset();
+                    worker.cancel();
+                    ClosePool();
+                    ResetSearch();
+                    ResetConsole();
+                    ResetDiff();
+                    DiscardChanges();
+                    journal.clear();
+                    CloseCellView();
+                    worker.submit(
+                        [](Database &db) {
+                            db.close();
+                            return true;
+                        },
+                        [](bool) {});
                     dbOpen = false;
-                    tables.clear();
+                    dbReadOnly = false;
+                    inTransaction = false;
+                    catalog.reset();
+                    related.clear();
+                    linkJump.table.clear();
                     currentTable.clear();
-                    records.clear();
+                    records.reset();
                     tableInfo.clear();
                     selectedRecord = -1;
+                    selectedInsert = -1;
+                    editor.clear();
+                }
+
+                if (ImGui::BeginMenu("Снимок")) {
+                    if (ImGui::MenuItem("Обновить сейчас", nullptr, false,
+                                        snapshot && !nextSnapshot))
+                        StartSnapshot(snapshot->source());
+                    ImGui::MenuItem("Во временном файле", nullptr,
+                                    &snapshotInFile);
+                    ImGui::Separator();
+                    static const int intervals[] = {0, 30, 300, 1800};
+                    static const char *names[] = {
+                        "Не обновлять", "Каждые 30 с", "Каждые 5 мин",
+                        "Каждые 30 мин"};
+                    for (int i = 0; i < IM_ARRAYSIZE(intervals); ++i) {
+                        if (ImGui::MenuItem(names[i], nullptr,
+                                            snapshotInterval == intervals[i]))
+                            snapshotInterval = intervals[i];
+                    }
+                    ImGui::EndMenu();
                 }
 
                 ImGui::Separator();
@@ -311,50 +2942,181 @@ int main(int argc, char **argv) {
                 ImGui::EndMenu();
             }
 
+            if (ImGui::BeginMenu("Edit", dbOpen)) {
+                if (ImGui::MenuItem("Отменить", "Ctrl+Z", false,
+                                    journal.canUndo() && !applyingChanges &&
+                                        !dbReadOnly)) {
+                    ReplayJournal(true);
+                }
+                if (ImGui::MenuItem("Повторить", "Ctrl+Y", false,
+                                    journal.canRedo() && !applyingChanges &&
+                                        !dbReadOnly)) {
+                    ReplayJournal(false);
+                }
+                ImGui::Separator();
+                ImGui::TextDisabled("Шагов: %zu / %zu, %zu КБ",
+                                    journal.undoCount(), journal.redoCount(),
+                                    journal.memoryUsage() / 1024);
+                ImGui::EndMenu();
+            }
+
             if (ImGui::BeginMenu("Transaction", dbOpen)) {
                 if (ImGui::MenuItem("Begin Transaction", nullptr, false,
                                     !inTransaction)) {
-                    inTransaction = db.beginTransaction();
+                    worker.submit(
+                        [](Database &db) { return db.beginTransaction(); },
+                        [](bool ok) { inTransaction = ok; });
                 }
 
                 if (ImGui::MenuItem("Commit", nullptr, false, inTransaction)) {
-                    inTransaction = !db.commitTransaction();
+                    worker.submit(
+                        [](Database &db) { return db.commitTransaction(); },
+                        [](bool ok) { inTransaction = !ok; });
                 }
 
                 if (ImGui::MenuItem("Rollback", nullptr, false,
                                     inTransaction)) {
-                    inTransaction = !db.rollbackTransaction();
+                    worker.submit(
+                        [](Database &db) { return db.rollbackTransaction(); },
+                        [](bool ok) {
+                            inTransaction = !ok;
+                            if (ok) {
+                                // откатились и правки из журнала
+                                journal.clear();
+                                related.clear();
+                                records.refresh();
+                                ReloadCatalog();
+                            }
+                        });
+                }
+
+                ImGui::Separator();
+                ImGui::MenuItem("Копить правки", nullptr, &bufferEdits);
+                if (ImGui::MenuItem("Несохранённые изменения...", nullptr,
+                                    false, !pendingChanges.empty())) {
+                    showChanges = true;
+                }
+                if (ImGui::MenuItem("Применить изменения", nullptr, false,
+                                    !pendingChanges.empty() &&
+                                        !applyingChanges)) {
+                    ApplyChanges();
                 }
+                if (ImGui::MenuItem("Отменить изменения", nullptr, false,
+                                    !pendingChanges.empty() &&
+                                        !applyingChanges)) {
+                    DiscardChanges();
+                }
+
+                ImGui::EndMenu();
+            }
 
+            if (ImGui::BeginMenu("View")) {
+                ImGui::MenuItem("Профилировщик", nullptr, &showProfiler);
+                ImGui::MenuItem("Кадры только по событиям", nullptr,
+                                &idleWait);
+                ImGui::MenuItem("Поиск по базе", nullptr, &showSearch,
+                                dbOpen);
+                ImGui::MenuItem("SQL-консоль", nullptr, &showConsole, dbOpen);
+                ImGui::MenuItem("Сравнение таблиц", nullptr, &showDiff,
+                                dbOpen);
                 ImGui::EndMenu();
             }
 
             ImGui::EndMenuBar();
         }
 
+        // отмена и повтор, пока фокус не в поле ввода (у него своя отмена)
+        if (dbOpen && !dbReadOnly && io.KeyCtrl &&
+            !ImGui::IsAnyItemActive()) {
+            if (ImGui::IsKeyPressed(ImGuiKey_Z, false))
+                ReplayJournal(true);
+            else if (ImGui::IsKeyPressed(ImGuiKey_Y, false))
+                ReplayJournal(false);
+        }
+
         // Статус базы данных
         ImGui::Text("Database: %s", dbOpen ? dbPath.c_str() : "Not opened");
+        if (dbReadOnly) {
+            ImGui::SameLine();
+            ImGui::TextDisabled("(только чтение)");
+        }
+        if (snapshot && dbOpen) {
+            ImGui::SameLine();
+            ImGui::TextDisabled("(копия от %s)", snapshotClock.c_str());
+        }
+        if (snapshotProgress.running) {
+            ImGui::SameLine();
+            ImGui::ProgressBar(snapshotProgress.fraction(), ImVec2(160, 0),
+                               "Снимок");
+            ImGui::SameLine();
+            if (ImGui::SmallButton("Прервать снимок"))
+                snapshotProgress.cancelled = true;
+        } else if (!snapshotProgress.getError().empty()) {
+            ImGui::SameLine();
+            ImGui::TextColored(ImVec4(1, 0.4f, 0.4f, 1), "Снимок: %s",
+                               snapshotProgress.getError().c_str());
+        }
         if (inTransaction) {
             ImGui::SameLine();
             ImGui::TextColored(ImVec4(1, 0, 0, 1), " (Transaction active)");
         }
+        if (!pendingChanges.empty()) {
+            ImGui::SameLine();
+            ImGui::TextColored(ImVec4(1, 0.8f, 0.3f, 1),
+                               "  Несохранённых изменений: %zu",
+                               pendingChanges.size());
+            ImGui::SameLine();
+            if (ImGui::SmallButton("Просмотр"))
+                showChanges = true;
+            ImGui::SameLine();
+            ImGui::BeginDisabled(applyingChanges);
+            if (ImGui::SmallButton("Применить"))
+                ApplyChanges();
+            ImGui::EndDisabled();
+        }
+        if (!journalError.empty()) {
+            ImGui::SameLine();
+            ImGui::TextColored(ImVec4(1, 0.3f, 0.3f, 1), "  Отмена: %s",
+                               journalError.c_str());
+        }
+
+        // Долгий запрос в фоне: показываем ход и даём отменить
+        if (worker.busySeconds() > 0.25) {
+            ImGui::SameLine();
+            ImGui::Text("  Выполняется запрос: %.1f с, %llu тыс. шагов",
+                        worker.busySeconds(),
+                        (unsigned long long)(worker.progressSteps() / 1000));
+            ImGui::SameLine();
+            if (ImGui::SmallButton("Отмена")) {
+                worker.cancel();
+            }
+        }
 
         // диалог выбора файла
         //        if (!dbOpen) {
         RenderFileBrowser();
+        RenderImportWindow();
+        RenderExportWindow();
+        RenderProfilerWindow();
+        RenderSearchWindow();
+        RenderConsoleWindow();
+        RenderDiffWindow();
+        RenderChangesWindow();
+        RenderCellWindow();
         //        }
 
         // Выбор таблицы
-        if (dbOpen && !tables.empty()) {
+        if (dbOpen && catalog && !catalog->tables.empty()) {
             if (ImGui::BeginCombo("Table", currentTable.c_str())) {
-                for (const auto &table : tables) {
-                    bool isSelected = (currentTable == table);
-                    if (ImGui::Selectable(table.c_str(), isSelected)) {
-                        currentTable = table;
-                        tableInfo = db.getTableInfo(currentTable);
-                        records =
-                            db.query("SELECT * FROM " + currentTable + ";");
-                        selectedRecord = -1;
+                for (const auto &table : catalog->tables) {
+                    bool isSelected = (currentTable == table.name);
+                    if (ImGui::Selectable(table.name.c_str(), isSelected)) {
+                        SelectTable(table.name);
+                    }
+                    if (table.rowEstimate >= 0) {
+                        ImGui::SameLine();
+                        ImGui::TextDisabled("~%lld",
+                                            (long long)table.rowEstimate);
                     }
                     if (isSelected) {
                         ImGui::SetItemDefaultFocus();
@@ -374,38 +3136,206 @@ int main(int argc, char **argv) {
                 ImVec2(ImGui::GetContentRegionAvail().x * 0.5f, panelHeight),
                 true);
 
-            if (ImGui::BeginTable(
+            if (records.loading()) {
+                ImGui::TextDisabled("Загрузка...");
+            }
+
+            // план запроса вида: полный проход или сортировка без индекса
+            if (!records.planWarning().empty()) {
+                ImGui::TextColored(ImVec4(1, 0.6f, 0, 1), "%s",
+                                   records.planWarning().c_str());
+                if (!records.suggestedIndex().empty() && !dbReadOnly) {
+                    ImGui::SameLine();
+                    if (ImGui::SmallButton("Создать индекс")) {
+                        worker.submit(
+                            [sql = records.suggestedIndex()](Database &db) {
+                                return db.execute(sql);
+                            },
+                            [](bool ok) {
+                                if (!ok)
+                                    return;
+                                records.refresh();
+                                ReloadCatalog();
+                            });
+                    }
+                    if (ImGui::IsItemHovered())
+                        ImGui::SetTooltip("%s",
+                                          records.suggestedIndex().c_str());
+                }
+            }
+
+            if (!tableInfo.empty() &&
+                ImGui::BeginTable(
                     "RecordsTable", tableInfo.size(),
                     ImGuiTableFlags_Resizable | ImGuiTableFlags_Borders |
-                        ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY)) {
-                // Заголовки столбцов
+                        ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY |
+                        ImGuiTableFlags_Sortable |
+                        ImGuiTableFlags_SortTristate)) {
+                // Заголовки столбцов и строка фильтров
                 for (const auto &col : tableInfo) {
                     ImGui::TableSetupColumn(col.name.c_str());
                 }
+                ImGui::TableSetupScrollFreeze(0, 2);
                 ImGui::TableHeadersRow();
 
-                // Строки с данными
-                for (int i = 0; i < records.size(); i++) {
-                    ImGui::TableNextRow();
-                    bool isSelected = (selectedRecord == i);
+                // строка из поиска - примерно в середину окна
+                if (scrollToRecord >= 0) {
+                    float rowHeight = ImGui::GetTextLineHeight() +
+                                      ImGui::GetStyle().CellPadding.y * 2;
+                    ImGui::SetScrollY(std::max(
+                        0.0f, scrollToRecord * rowHeight -
+                                  ImGui::GetWindowHeight() / 2));
+                    scrollToRecord = -1;
+                }
+
+                // сортировка выполняется в SQL, а не в памяти
+                ImGuiTableSortSpecs *sortSpecs = ImGui::TableGetSortSpecs();
+                if (sortSpecs && sortSpecs->SpecsDirty) {
+                    std::string column;
+                    bool descending = false;
+                    if (sortSpecs->SpecsCount > 0 &&
+                        sortSpecs->Specs[0].ColumnIndex <
+                            (int)tableInfo.size()) {
+                        column = tableInfo[sortSpecs->Specs[0].ColumnIndex].name;
+                        descending = sortSpecs->Specs[0].SortDirection ==
+                                     ImGuiSortDirection_Descending;
+                    }
+                    records.setSort(column, descending);
+                    sortSpecs->SpecsDirty = false;
+                    selectedRecord = -1;
+                    editor.clear();
+                }
+
+                ImGui::TableNextRow();
+                ImGui::PushID("filters");
+                // схема перечитана: число столбцов могло измениться
+                columnFilters.resize(tableInfo.size());
+                for (size_t j = 0; j < tableInfo.size(); j++) {
+                    ImGui::TableSetColumnIndex(j);
+                    ImGui::PushID((int)j);
+                    ImGui::SetNextItemWidth(-FLT_MIN);
+                    InputString("##filter", columnFilters[j], 0,
+                                "текст, =, <, >, NULL");
+                    if (ImGui::IsItemDeactivatedAfterEdit()) {
+                        ApplyFilters();
+                        selectedRecord = -1;
+                        editor.clear();
+                    }
+                    ImGui::PopID();
+                }
+                ImGui::PopID();
+
+                // Строки с данными: только видимое окно, за ними вставки
+                // из буфера правок
+                size_t columnCount =
+                    std::min(tableInfo.size(), records.columnCount());
+                size_t rowCount = records.rowCount();
+                bool pendingRows = pendingChanges.hasTable(currentTable);
+                std::vector<size_t> inserts =
+                    pendingChanges.inserts(currentTable);
+                ImGuiListClipper clipper;
+                clipper.Begin((int)(rowCount + inserts.size()));
+                while (clipper.Step()) {
+                    records.prefetch(
+                        clipper.DisplayStart - (long)PagedTable::PrefetchRows,
+                        clipper.DisplayEnd + (long)PagedTable::PrefetchRows);
+
+                    for (int i = clipper.DisplayStart; i < clipper.DisplayEnd;
+                         i++) {
+                        ImGui::TableNextRow();
+                        if (i >= (int)rowCount) {
+                            RenderInsertRow(inserts[i - rowCount], i);
+                            continue;
+                        }
+                        bool isSelected = (selectedRecord == i);
+
+                        const CachedRow *cached =
+                            CachedRecordRow(i, columnCount);
+                        if (!cached) {
+                            ImGui::TableSetColumnIndex(0);
+                            ImGui::TextDisabled("...");
+                            continue;
+                        }
+
+                        if (loadSelected && isSelected) {
+                            LoadSelectedValues(i);
+                            loadSelected = false;
+                        }
 
-                    for (int j = 0; j < tableInfo.size(); j++) {
-                        ImGui::TableSetColumnIndex(j);
-                        const auto &colName = tableInfo[j].name;
-                        const auto &record = records[i];
+                        // удалённая строка - красная, изменённые ячейки
+                        // показывают новое значение на жёлтом
+                        const PendingChange *change =
+                            pendingRows ? pendingChanges.find(
+                                              currentTable, records.rowKey(i))
+                                        : nullptr;
+                        if (change &&
+                            change->kind == PendingChange::Kind::Delete)
+                            ImGui::TableSetBgColor(ImGuiTableBgTarget_RowBg1,
+                                                   DeletedColor);
+
+                        ImGui::PushID(i);
+                        for (size_t j = 0; j < columnCount; j++) {
+                            ImGui::TableSetColumnIndex(j);
+                            // большая ячейка - подпись с размером, по
+                            // щелчку открывается просмотр
+                            bool large = cached->large[j];
+                            const char *text =
+                                cached->text.data() + cached->starts[j];
+                            const char *end =
+                                j + 1 < columnCount
+                                    ? cached->text.data() +
+                                          cached->starts[j + 1] - 1
+                                    : cached->text.data() +
+                                          cached->text.size() - 1;
+                            if (change &&
+                                change->kind == PendingChange::Kind::Update) {
+                                auto edited =
+                                    change->values.find(tableInfo[j].name);
+                                if (edited != change->values.end()) {
+                                    text = edited->second.c_str();
+                                    end = text + edited->second.size();
+                                    ImGui::TableSetBgColor(
+                                        ImGuiTableBgTarget_CellBg,
+                                        UpdatedColor);
+                                }
+                            }
 
-                        if (record.find(colName) != record.end()) {
+                            // ссылка: подсказка с родителем, по щелчку
+                            // переход к нему
+                            int link = j < linkColumns.size()
+                                           ? linkColumns[j]
+                                           : -1;
                             if (j == 0) {
                                 if (ImGui::Selectable(
-                                        record.at(colName).c_str(), isSelected,
+                                        text, isSelected,
                                         ImGuiSelectableFlags_SpanAllColumns)) {
                                     selectedRecord = i;
-                                    editValues = records[i];
+                                    selectedInsert = -1;
+                                    selectedKey = records.rowKey(i);
+                                    LoadSelectedValues(i);
+                                    if (large)
+                                        OpenCellView(i, j);
                                 }
+                                if (link >= 0 && ImGui::IsItemHovered())
+                                    LinkTooltip(i, link);
+                            } else if (large) {
+                                ImGui::TextDisabled("%s", text);
+                                if (ImGui::IsItemClicked())
+                                    OpenCellView(i, j);
+                            } else if (link >= 0) {
+                                ImGui::PushStyleColor(ImGuiCol_Text,
+                                                      LinkColor);
+                                ImGui::TextUnformatted(text, end);
+                                ImGui::PopStyleColor();
+                                if (ImGui::IsItemHovered())
+                                    LinkTooltip(i, link);
+                                if (ImGui::IsItemClicked())
+                                    FollowLink(i, link);
                             } else {
-                                ImGui::Text("%s", record.at(colName).c_str());
+                                ImGui::TextUnformatted(text, end);
                             }
                         }
+                        ImGui::PopID();
                     }
                 }
 
@@ -413,120 +3343,192 @@ int main(int argc, char **argv) {
             }
 
             // Кнопки для управления записями
+            ImGui::BeginDisabled(dbReadOnly || applyingChanges);
             if (ImGui::Button("Add Record")) {
-                editValues.clear();
-                for (const auto &col : tableInfo) {
-                    editValues[col.name] = "";
-                }
+                editor.loadEmpty(tableInfo);
                 selectedRecord = -1;
+                selectedInsert = -1;
             }
 
             ImGui::SameLine();
 
             if (ImGui::Button("Delete Record")) {
-                if (selectedRecord >= 0 && selectedRecord < records.size()) {
-                    std::string where;
-                    for (const auto &col : tableInfo) {
-                        if (col.primary_key) {
-                            if (!where.empty())
-                                where += " AND ";
-                            where += col.name + " = '" +
-                                     records[selectedRecord][col.name] + "'";
-                        }
-                    }
-
-                    if (where.empty()) {
-                        // Если нет первичного ключа, используем все поля
-                        // для идентификации записи
-                        for (const auto &col : tableInfo) {
-                            if (!where.empty())
-                                where += " AND ";
-                            where += col.name + " = '" +
-                                     records[selectedRecord][col.name] + "'";
-                        }
-                    }
-
-                    if (db.deleteRecord(currentTable, where)) {
-                        records =
-                            db.query("SELECT * FROM " + currentTable + ";");
-                        selectedRecord = -1;
-                    }
+                // вставка ещё не в базе - просто убирается из буфера
+                if (selectedInsert >= 0) {
+                    DiscardChange(selectedInsert);
+                } else if (bufferEdits && selectedRecord >= 0) {
+                    pendingChanges.remove(currentTable, selectedKey,
+                                          SelectedRecordKey(),
+                                          selectedOriginal);
+                    editor.load(tableInfo, selectedOriginal);
+                } else if (selectedRecord >= 0 &&
+                    selectedRecord < (int)records.rowCount()) {
+                    worker.submit(
+                        [table = currentTable, keys = records.keyColumns(),
+                         key = selectedKey,
+                         where = SelectedRecordKey()](Database &db) {
+                            RecordEdit edit;
+                            ResultSet before =
+                                EditJournal::readRow(db, table, keys, key);
+                            edit.ok = db.deleteRecord(table, where);
+                            if (edit.ok && db.changes() == 1)
+                                edit.delta = EditJournal::diff(
+                                    table, keys, before, ResultSet());
+                            return edit;
+                        },
+                        [table = currentTable, key = selectedKey](
+                            RecordEdit edit) {
+                            if (!edit.ok)
+                                return;
+                            journal.push({edit.delta});
+                            related.clear();
+                            if (table != records.tableName())
+                                return;
+                            // строку удалили раньше нас - кэш устарел
+                            if (!edit.delta.table.empty())
+                                records.applyDelete(key);
+                            else
+                                records.refresh();
+                            selectedRecord = -1;
+                            editor.clear();
+                        });
                 }
             }
+            ImGui::EndDisabled();
 
             ImGui::EndChild();
 
             ImGui::SameLine();
 
-            // Правая панель - редактирование записи
+            // Правая панель - редактирование записи и профиль столбцов
             ImGui::BeginChild("Edit", ImVec2(0, panelHeight), true);
 
-            if (selectedRecord >= 0 || !editValues.empty()) {
+            bool editTab = true;
+            if (ImGui::BeginTabBar("EditTabs")) {
+                editTab = ImGui::BeginTabItem("Запись");
+                if (editTab)
+                    ImGui::EndTabItem();
+                if (ImGui::BeginTabItem("Профиль")) {
+                    RenderProfilePanel();
+                    ImGui::EndTabItem();
+                }
+                ImGui::EndTabBar();
+            }
+
+            if (editTab && (selectedRecord >= 0 || !editor.empty())) {
                 ImGui::Text("Edit Record");
                 ImGui::Separator();
 
-                for (const auto &col : tableInfo) {
-                    if (editValues.find(col.name) != editValues.end()) {
-                        char buffer[256] = {0};
-                        strncpy(buffer, editValues[col.name].c_str(),
-                                sizeof(buffer));
-
-                        ImGui::Text("%s (%s):", col.name.c_str(),
-                                    col.type.c_str());
-                        if (ImGui::InputText(("##" + col.name).c_str(), buffer,
-                                             sizeof(buffer))) {
-                            editValues[col.name] = buffer;
-                        }
-                    }
-                }
-
-                if (ImGui::Button("Save")) {
+                RenderEditFields();
+                RenderLinks();
+
+                // строка помечена на удаление - её можно только вернуть
+                const PendingChange *change =
+                    selectedRecord >= 0
+                        ? pendingChanges.find(currentTable, selectedKey)
+                        : nullptr;
+                bool deleted =
+                    change && change->kind == PendingChange::Kind::Delete;
+
+                ImGui::BeginDisabled(dbReadOnly || applyingChanges || deleted);
+                bool save = ImGui::Button("Save");
+                ImGui::EndDisabled();
+                if (save && selectedInsert >= 0) {
+                    pendingChanges.updateInsert(selectedInsert,
+                                                editor.values());
+                } else if (save && bufferEdits && selectedRecord >= 0) {
+                    pendingChanges.update(currentTable, selectedKey,
+                                          SelectedRecordKey(),
+                                          selectedOriginal, editor.values());
+                } else if (save && bufferEdits) {
+                    pendingChanges.insert(currentTable, editor.values());
+                    editor.clear();
+                } else if (save) {
                     if (selectedRecord >= 0) {
                         // Обновление существующей записи
-                        std::string where;
-                        for (const auto &col : tableInfo) {
-                            if (col.primary_key) {
-                                if (!where.empty())
-                                    where += " AND ";
-                                where += col.name + " = '" +
-                                         records[selectedRecord][col.name] +
-                                         "'";
-                            }
-                        }
-
-                        if (where.empty()) {
-                            // Если нет первичного ключа, используем все
-                            // поля для идентификации записи
-                            for (const auto &col : tableInfo) {
-                                if (!where.empty())
-                                    where += " AND ";
-                                where += col.name + " = '" +
-                                         records[selectedRecord][col.name] +
-                                         "'";
-                            }
-                        }
-
-                        if (db.updateRecord(currentTable, editValues, where)) {
-                            records =
-                                db.query("SELECT * FROM " + currentTable + ";");
-                        }
+                        // RETURNING возвращает строку в формате блока,
+                        // и она заменяется в кэше без перечитывания таблицы
+                        // строка до правки читается для журнала отмены
+                        worker.submit(
+                            [table = currentTable, values = editor.values(),
+                             keys = records.keyColumns(), key = selectedKey,
+                             where = SelectedRecordKey(),
+                             format = records.rowFormat()](Database &db) {
+                                RecordEdit edit;
+                                ResultSet before =
+                                    EditJournal::readRow(db, table, keys, key);
+                                ResultSet changed;
+                                edit.ok = db.updateRecord(table, values, where,
+                                                          format.columns,
+                                                          &changed);
+                                if (edit.ok && changed.rowCount() == 1)
+                                    edit.delta = EditJournal::diff(
+                                        table, keys, before, changed);
+                                edit.row = PagedTable::matchRow(
+                                    db, format, std::move(changed));
+                                return edit;
+                            },
+                            [table = currentTable,
+                             key = selectedKey](RecordEdit edit) {
+                                if (!edit.ok)
+                                    return;
+                                journal.push({edit.delta});
+                                related.clear();
+                                if (table != records.tableName())
+                                    return;
+                                records.applyUpdate(key, edit.row);
+                                // ключ мог измениться - строка переехала
+                                if (records.keyOf(edit.row) != key)
+                                    selectedRecord = -1;
+                            });
                     } else {
                         // Добавление новой записи
-                        if (db.addRecord(currentTable, editValues)) {
-                            records =
-                                db.query("SELECT * FROM " + currentTable + ";");
-                            editValues.clear();
-                        }
+                        worker.submit(
+                            [table = currentTable, values = editor.values(),
+                             keys = records.keyColumns(),
+                             format = records.rowFormat()](Database &db) {
+                                RecordEdit edit;
+                                ResultSet changed;
+                                edit.ok = db.addRecord(table, values,
+                                                       format.columns,
+                                                       &changed);
+                                if (edit.ok && changed.rowCount() == 1)
+                                    edit.delta = EditJournal::diff(
+                                        table, keys, ResultSet(), changed);
+                                edit.row = PagedTable::matchRow(
+                                    db, format, std::move(changed));
+                                return edit;
+                            },
+                            [table = currentTable](RecordEdit edit) {
+                                if (!edit.ok)
+                                    return;
+                                journal.push({edit.delta});
+                                related.clear();
+                                if (table != records.tableName())
+                                    return;
+                                records.applyInsert(edit.row);
+                                editor.clear();
+                            });
                     }
                 }
 
                 ImGui::SameLine();
 
                 if (ImGui::Button("Cancel")) {
-                    editValues.clear();
+                    editor.clear();
                     selectedRecord = -1;
+                    selectedInsert = -1;
                 }
-            } else {
+
+                if (deleted) {
+                    ImGui::SameLine();
+                    if (ImGui::Button("Восстановить"))
+                        DiscardChange(change -
+                                      pendingChanges.changes().data());
+                    ImGui::TextColored(ImVec4(1, 0.4f, 0.4f, 1),
+                                       "Строка помечена на удаление");
+                }
+            } else if (editTab) {
                 ImGui::Text("Select a record to edit or click 'Add Record'");
             }
 
@@ -541,17 +3543,29 @@ int main(int argc, char **argv) {
 
         // Рендеринг
         ImGui::Render();
+        frame.uiUs = profiler.now() - mark;
+        mark = profiler.now();
         int display_w, display_h;
         glfwGetFramebufferSize(window, &display_w, &display_h);
         glViewport(0, 0, display_w, display_h);
         glClearColor(0.45f, 0.55f, 0.60f, 1.00f);
         glClear(GL_COLOR_BUFFER_BIT);
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        frame.drawUs = profiler.now() - mark;
+        mark = profiler.now();
 
         glfwSwapBuffers(window);
+        frame.swapUs = profiler.now() - mark;
+        if (profiler.enabled)
+            profiler.frame(frame);
     }
 
     // Очистка
+    CancelSnapshot();
+    ResetDiff();
+    ClosePool();
+    worker.stop();
+    browser.lister.stop();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -0,0 +1,1082 @@
+#include "paged_table.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace {
+
+int compareKeys(const std::vector<Value> &a, const std::vector<Value> &b) {
+    for (size_t i = 0; i < a.size() && i < b.size(); ++i) {
+        int order = a[i].compare(b[i]);
+        if (order)
+            return order;
+    }
+    return 0;
+}
+
+// копия блока, где с позиции at удалено erase строк и вставлена строка
+// insert; лишние строки сверх limit отбрасываются
+ResultSet spliceRows(const ResultSet &rows, size_t at, size_t erase,
+                     const ResultSet *insert, size_t limit) {
+    std::vector<std::string> names;
+    for (size_t col = 0; col < rows.columnCount(); ++col) {
+        names.push_back(rows.columnName(col));
+    }
+
+    ResultSet result(std::move(names));
+    result.setLargeCellLimit(rows.largeCellLimit());
+    for (size_t row = 0; row < at; ++row) {
+        result.appendRow(rows, row);
+    }
+    if (insert)
+        result.appendRow(*insert, 0);
+    for (size_t row = at + erase;
+         row < rows.rowCount() && result.rowCount() < limit; ++row) {
+        result.appendRow(rows, row);
+    }
+    return result;
+}
+
+// Условие WHERE для одного фильтра. kind: '=' - равенство, '<' - диапазон,
+// '~' - условие, которое обычный индекс не ускоряет. Значение не
+// подставляется в текст, а добавляется в params как :fN: оно разбирается
+// по объявленному типу столбца, и '007' в TEXT остаётся текстом.
+std::string filterCondition(const std::string &column, const std::string &text,
+                            const std::string &type, char &kind,
+                            std::vector<Value> &params) {
+    size_t first = text.find_first_not_of(" \t");
+    if (first == std::string::npos)
+        return "";
+    std::string value =
+        text.substr(first, text.find_last_not_of(" \t") - first + 1);
+    std::string name = Database::quoteIdentifier(column);
+
+    std::string upper;
+    for (char c : value) {
+        upper += (char)toupper((unsigned char)c);
+    }
+    if (upper == "NULL") {
+        kind = '=';
+        return name + " IS NULL";
+    }
+    if (upper == "!NULL") {
+        kind = '~';
+        return name + " IS NOT NULL";
+    }
+
+    static const char *operators[] = {">=", "<=", "!=", "<>", "=", "<", ">"};
+    for (const char *op : operators) {
+        size_t size = strlen(op);
+        if (value.compare(0, size, op) != 0)
+            continue;
+
+        std::string operand = value.substr(size);
+        operand.erase(0, operand.find_first_not_of(" \t"));
+        if (op[0] == '=')
+            kind = '=';
+        else if (op[0] == '!' || (op[0] == '<' && op[1] == '>'))
+            kind = '~';
+        else
+            kind = '<';
+        params.push_back(Value::fromText(operand, type));
+        return name + " " + op + " :f" + std::to_string(params.size() - 1);
+    }
+
+    // подстрока: % и _ из текста экранируются
+    std::string pattern = "%";
+    for (char c : value) {
+        if (c == '%' || c == '_' || c == '\\')
+            pattern += '\\';
+        pattern += c;
+    }
+    kind = '~';
+    params.push_back(Value::ofText(pattern + "%"));
+    return name + " LIKE :f" + std::to_string(params.size() - 1) +
+           " ESCAPE '\\'";
+}
+
+// родство TEXT по правилам SQLite (datatype3, 3.1)
+bool textAffinity(const std::string &declared) {
+    std::string type;
+    for (char c : declared) {
+        type += (char)toupper((unsigned char)c);
+    }
+    return type.find("INT") == std::string::npos &&
+           (type.find("CHAR") != std::string::npos ||
+            type.find("CLOB") != std::string::npos ||
+            type.find("TEXT") != std::string::npos);
+}
+
+// Размер текста в байтах. octet_length() (SQLite 3.43+) не читает само
+// значение; length(CAST ... AS BLOB) на старых версиях читает, но текст
+// всё равно не копируется в результат целиком.
+std::string byteLength(const std::string &name) {
+    if (sqlite3_libversion_number() >= 3043000)
+        return "octet_length(" + name + ")";
+    return "length(CAST(" + name + " AS BLOB))";
+}
+
+} // namespace
+
+void PagedTable::setReadPool(ReadPool *pool) { readPool = pool; }
+
+void PagedTable::open(QueryWorker &queryWorker, const std::string &tableName) {
+    worker = &queryWorker;
+    table = tableName;
+    keys.clear();
+    sort.clear();
+    descending = false;
+    filter.clear();
+    filterParams.clear();
+    equalityColumns.clear();
+    rangeColumns.clear();
+    refresh();
+}
+
+void PagedTable::refresh() {
+    ++generation;
+    clearCache();
+    rows = 0;
+    layoutPending = false;
+    warning.clear();
+    suggestion.clear();
+
+    if (!worker || table.empty())
+        return;
+
+    layoutPending = true;
+    uint64_t gen = generation;
+    // план проверяется только для отсортированного или отфильтрованного
+    // вида, когда ключи уже известны
+    std::string explain;
+    if (!keys.empty() && (!sort.empty() || !filter.empty()))
+        explain = explainSql();
+    worker->submit(
+        [tableName = table, knownKeys = keys, where = filter,
+         params = filterParams, explain](Database &db) {
+            return readLayout(db, tableName, knownKeys, where, params,
+                              explain);
+        },
+        [this, gen](Layout layout) { applyLayout(gen, std::move(layout)); });
+}
+
+void PagedTable::reset() {
+    worker = nullptr;
+    table.clear();
+    keys.clear();
+    names.clear();
+    types.clear();
+    blobColumns.clear();
+    refresh();
+}
+
+bool PagedTable::isOpen() const { return worker && !table.empty(); }
+
+bool PagedTable::loading() const { return layoutPending; }
+
+uint64_t PagedTable::version() const { return changes; }
+
+const std::string &PagedTable::tableName() const { return table; }
+
+size_t PagedTable::rowCount() const { return rows; }
+
+size_t PagedTable::columnCount() const { return names.size(); }
+
+const std::vector<std::string> &PagedTable::keyColumns() const {
+    return keys;
+}
+
+// Смена сортировки не меняет число строк: count(*) не нужен, сбрасываются
+// только блоки и якоря.
+void PagedTable::setSort(const std::string &column, bool desc) {
+    if (column == sort && desc == descending)
+        return;
+
+    sort = column;
+    descending = desc;
+    if (layoutPending || !worker) {
+        refresh();
+        return;
+    }
+
+    ++generation;
+    clearCache();
+    warning.clear();
+    suggestion.clear();
+    if (sort.empty() && filter.empty())
+        return;
+
+    uint64_t gen = generation;
+    worker->submit(
+        [sql = explainSql()](Database &db) { return explainPlan(db, sql); },
+        [this, gen](std::vector<std::string> plan) {
+            if (gen == generation)
+                applyPlan(plan);
+        });
+}
+
+void PagedTable::setFilters(const std::map<std::string, std::string> &filters,
+                            const std::map<std::string, Value> &values) {
+    std::string where;
+    std::vector<Value> params;
+    equalityColumns.clear();
+    rangeColumns.clear();
+    for (const auto &pair : filters) {
+        char kind = 0;
+        auto it = std::find(names.begin(), names.end(), pair.first);
+        std::string type =
+            it != names.end() && (size_t)(it - names.begin()) < types.size()
+                ? types[it - names.begin()]
+                : "";
+        std::string condition =
+            filterCondition(pair.first, pair.second, type, kind, params);
+        if (condition.empty())
+            continue;
+
+        where += where.empty() ? "" : " AND ";
+        where += condition;
+        if (kind == '=')
+            equalityColumns.push_back(pair.first);
+        else if (kind == '<')
+            rangeColumns.push_back(pair.first);
+    }
+    for (const auto &pair : values) {
+        params.push_back(pair.second);
+        where += where.empty() ? "" : " AND ";
+        where += Database::quoteIdentifier(pair.first) + " IS :f" +
+                 std::to_string(params.size() - 1);
+        equalityColumns.push_back(pair.first);
+    }
+
+    if (where == filter && params == filterParams)
+        return;
+    filter = where;
+    filterParams = std::move(params);
+    refresh();
+}
+
+const std::string &PagedTable::sortColumn() const { return sort; }
+
+const std::string &PagedTable::planWarning() const { return warning; }
+
+const std::string &PagedTable::suggestedIndex() const { return suggestion; }
+
+// Строки перед искомой: по возрастанию NULL в столбце сортировки идут
+// первыми, по убыванию - последними, как в blockSql.
+void PagedTable::locate(const std::vector<Value> &key,
+                        std::function<void(long)> done) {
+    if (!worker || layoutPending || key.empty() || key.size() != keys.size()) {
+        done(-1);
+        return;
+    }
+
+    std::string from = " FROM " + Database::quoteIdentifier(table);
+    std::string match;
+    std::string placeholders;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        match += (i ? " AND " : "") + Database::keyExpression(keys[i]) +
+                 " IS ?";
+        placeholders += i ? ", ?" : "?";
+    }
+    std::string before = descending ? " > " : " < ";
+    std::string beforeKey =
+        "(" + keyList() + ")" + before + "(" + placeholders + ")";
+
+    std::string column = Database::quoteIdentifier(sort);
+    std::string find = "SELECT " + (sort.empty() ? "1" : column) + from +
+                       whereSql(match) + ";";
+    std::string count = "SELECT count(*)" + from;
+    std::string countValue, countNull;
+    if (sort.empty()) {
+        countValue = count + whereSql(beforeKey) + ";";
+    } else {
+        std::string beforeRow = "(" + column + ", " + keyList() + ")" +
+                                before + "(?, " + placeholders + ")";
+        countValue =
+            count +
+            whereSql(descending ? beforeRow
+                                : "(" + column + " IS NULL OR " + beforeRow +
+                                      ")") +
+            ";";
+        countNull = count +
+                    whereSql(descending ? "(" + column + " IS NOT NULL OR (" +
+                                              column + " IS NULL AND " +
+                                              beforeKey + "))"
+                                        : "(" + column + " IS NULL AND " +
+                                              beforeKey + ")") +
+                    ";";
+    }
+
+    uint64_t gen = generation;
+    worker->submit(
+        [find, countValue, countNull, key,
+         filterValues = filterParams](Database &db) -> long {
+            // значения фильтра (:fN) идут первыми
+            std::vector<Value> params = filterValues;
+            params.insert(params.end(), key.begin(), key.end());
+            auto row = db.query(find, params);
+            if (row.empty())
+                return -1;
+            params = filterValues;
+            const std::string *sql = &countValue;
+            if (!countNull.empty()) {
+                Value value = row.getValue(0, 0);
+                if (value.type == Value::Type::Null)
+                    sql = &countNull;
+                else
+                    params.push_back(value);
+            }
+            params.insert(params.end(), key.begin(), key.end());
+            auto result = db.query(*sql, params);
+            return result.empty() ? -1 : (long)result.getInt(0, 0);
+        },
+        [this, gen, done](long row) { done(gen == generation ? row : -1); });
+}
+
+void PagedTable::prefetch(long first, long last) {
+    first = std::max(first, 0L);
+    last = std::min(last, (long)rows);
+    if (layoutPending || first >= last)
+        return;
+
+    for (size_t index = first / BlockSize; index <= (last - 1) / BlockSize;
+         ++index) {
+        auto it = blocks.find(index);
+        if (it == blocks.end())
+            requestBlock(index);
+        else
+            touch(it->second, index);
+    }
+}
+
+const ResultSet *PagedTable::rowBlock(size_t row, size_t &local) {
+    if (row >= rows)
+        return nullptr;
+
+    size_t index = row / BlockSize;
+    local = row % BlockSize;
+
+    auto it = blocks.find(index);
+    if (it == blocks.end() || local >= it->second.rows.rowCount()) {
+        requestBlock(index);
+        return nullptr;
+    }
+    return &it->second.rows;
+}
+
+std::string_view PagedTable::getText(size_t row, size_t col,
+                                     ResultSet::NumberBuffer &buffer) {
+    size_t local;
+    const ResultSet *block = rowBlock(row, local);
+    if (!block)
+        return std::string_view("", 0);
+    return block->getText(local, col + keys.size(), buffer);
+}
+
+std::string PagedTable::getString(size_t row, size_t col) {
+    ResultSet::NumberBuffer buffer;
+    return std::string(getText(row, col, buffer));
+}
+
+std::vector<Value> PagedTable::rowKey(size_t row) {
+    size_t local;
+    const ResultSet *block = rowBlock(row, local);
+    if (!block)
+        return {};
+    return keyOf(*block, local);
+}
+
+Value PagedTable::value(size_t row, size_t col) {
+    size_t local;
+    const ResultSet *block = rowBlock(row, local);
+    if (!block || col + keys.size() >= block->columnCount())
+        return Value();
+    return block->getValue(local, col + keys.size());
+}
+
+std::map<std::string, std::string> PagedTable::rowValues(size_t row) {
+    std::map<std::string, std::string> values;
+    size_t local;
+    const ResultSet *block = rowBlock(row, local);
+    if (!block)
+        return values;
+
+    // большие ячейки не попадают в редактор: их показывает просмотрщик
+    for (size_t col = 0; col < names.size(); ++col) {
+        if (!block->largeCell(local, col + keys.size()))
+            values[names[col]] = block->getString(local, col + keys.size());
+    }
+    return values;
+}
+
+const ResultSet::LargeCell *PagedTable::largeCell(size_t row, size_t col) {
+    size_t local;
+    const ResultSet *block = rowBlock(row, local);
+    return block && col + keys.size() < block->columnCount()
+               ? block->largeCell(local, col + keys.size())
+               : nullptr;
+}
+
+PagedTable::Layout PagedTable::readLayout(Database &db,
+                                          const std::string &table,
+                                          std::vector<std::string> keys,
+                                          const std::string &where,
+                                          const std::vector<Value> &params,
+                                          const std::string &explain) {
+    Layout layout;
+    if (keys.empty())
+        keys = db.rowKeyColumns(table);
+    layout.keys = std::move(keys);
+
+    std::string from = " FROM " + Database::quoteIdentifier(table);
+    auto header = db.query("SELECT *" + from + " LIMIT 0;");
+    auto info = db.getTableInfo(table);
+    for (size_t col = 0; col < header.columnCount(); ++col) {
+        layout.names.push_back(header.columnName(col));
+        // родство BLOB: тип не указан или содержит BLOB
+        bool blob = false;
+        std::string declared;
+        for (const auto &column : info) {
+            if (column.name != header.columnName(col))
+                continue;
+            declared = column.type;
+            std::string type = column.type;
+            for (char &c : type) {
+                c = (char)toupper((unsigned char)c);
+            }
+            blob = type.empty() || type.find("BLOB") != std::string::npos;
+        }
+        layout.blobs.push_back(blob);
+        layout.types.push_back(declared);
+    }
+
+    if (!where.empty())
+        from += " WHERE " + where;
+    auto count = db.query("SELECT count(*)" + from + ";", params);
+    if (!count.empty())
+        layout.rows = (size_t)count.getInt(0, 0);
+
+    if (!explain.empty()) {
+        layout.plan = explainPlan(db, explain);
+        if (!where.empty()) {
+            auto scan = explainPlan(db, "SELECT count(*)" + from + ";");
+            layout.plan.insert(layout.plan.end(), scan.begin(), scan.end());
+        }
+    }
+    return layout;
+}
+
+std::vector<std::string> PagedTable::explainPlan(Database &db,
+                                                 const std::string &sql) {
+    std::vector<std::string> plan;
+    auto result = db.query("EXPLAIN QUERY PLAN " + sql);
+    int detail = result.columnIndex("detail");
+    for (size_t row = 0; detail >= 0 && row < result.rowCount(); ++row) {
+        plan.push_back(result.getString(row, detail));
+    }
+    return plan;
+}
+
+void PagedTable::applyLayout(uint64_t gen, Layout layout) {
+    if (gen != generation)
+        return;
+
+    keys = std::move(layout.keys);
+    names = std::move(layout.names);
+    types = std::move(layout.types);
+    blobColumns = std::move(layout.blobs);
+    rows = layout.rows;
+    layoutPending = false;
+    ++changes;
+    applyPlan(layout.plan);
+}
+
+// SCAN в плане - полный проход по таблице или индексу, TEMP B-TREE - сортировка
+// всей выборки ради каждого блока. Предлагаемый индекс: сначала столбцы
+// с равенством, затем столбец сортировки или диапазона.
+void PagedTable::applyPlan(const std::vector<std::string> &plan) {
+    warning.clear();
+    suggestion.clear();
+
+    bool tempSort = false;
+    bool fullScan = false;
+    for (const auto &detail : plan) {
+        if (detail.find("TEMP B-TREE") != std::string::npos)
+            tempSort = true;
+        if (detail.compare(0, 5, "SCAN ") == 0 && !filter.empty())
+            fullScan = true;
+    }
+    if (!tempSort && !fullScan)
+        return;
+
+    if (tempSort)
+        warning = "Сортировка по \"" + sort +
+                  "\" без индекса: каждый блок сортирует всю выборку";
+    else
+        warning = "Фильтр просматривает всю таблицу";
+
+    std::vector<std::string> columns = equalityColumns;
+    if (!sort.empty() && tempSort)
+        columns.push_back(sort);
+    else if (columns.empty() && !rangeColumns.empty())
+        columns.push_back(rangeColumns.front());
+    if (columns.empty())
+        return;
+
+    std::string name = table;
+    std::string list;
+    for (const auto &column : columns) {
+        name += "_" + column;
+        list += (list.empty() ? "" : ", ") + Database::quoteIdentifier(column);
+    }
+    suggestion = "CREATE INDEX IF NOT EXISTS " +
+            Database::quoteIdentifier(name + "_idx") + " ON " +
+            Database::quoteIdentifier(table) + " (" + list + ");";
+}
+
+// Блок читается от ближайшего известного начала (anchor): для соседнего
+// блока это чистый keyset-запрос, для дальнего прыжка - OFFSET от якоря.
+void PagedTable::requestBlock(size_t index) {
+    if (!worker || layoutPending || pending.count(index))
+        return;
+
+    auto anchor = std::prev(anchors.upper_bound(index));
+    // склейка двух запросов на границе NULL материализует все OFFSET
+    // строк, поэтому дальний прыжок от такого якоря дешевле сделать одним
+    // запросом от начала по индексу
+    bool merged = !sort.empty() && !anchor->second.empty() &&
+                  (anchor->second[0].type == Value::Type::Null) != descending;
+    if (merged && anchor->first != index)
+        anchor = anchors.begin();
+
+    std::vector<Value> params;
+    std::string sql = blockSql(anchor->second, BlockSize,
+                               (index - anchor->first) * BlockSize, params);
+    // :fN фильтра стоят в запросе раньше остальных параметров
+    params.insert(params.begin(), filterParams.begin(), filterParams.end());
+
+    pending.insert(index);
+    uint64_t gen = generation;
+    uint64_t edit = edits;
+    auto work = [sql, params, sizes = sizeColumns()](Database &db) {
+        return db.query(sql, params, LargeCellBytes, sizes);
+    };
+    auto done = [this, gen, edit, index](ResultSet result) {
+        if (gen != generation)
+            return;
+        pending.erase(index);
+        // пустой заголовок - запрос не выполнился или был отменён;
+        // после правки блок будет перечитан при следующей отрисовке
+        if (result.columnCount() == 0 || edit != edits)
+            return;
+        // неполный блок - последний: уточняем число строк без count(*)
+        if (result.rowCount() < BlockSize)
+            rows = index * BlockSize + result.rowCount();
+        storeBlock(index, std::move(result));
+    };
+    if (readPool)
+        readPool->submit(std::move(work), std::move(done));
+    else
+        worker->submit(std::move(work), std::move(done));
+}
+
+void PagedTable::storeBlock(size_t index, ResultSet result) {
+    ++changes;
+    size_t count = result.rowCount();
+    // начало большой ячейки в якорь не годится: следующий блок будет
+    // прочитан со смещением от предыдущего якоря
+    auto column = std::find(names.begin(), names.end(), sort);
+    bool partial =
+        count && column != names.end() &&
+        result.largeCell(count - 1, keys.size() + (column - names.begin()));
+    if (count == BlockSize && !partial)
+        anchors[index + 1] = orderKey(result, count - 1);
+
+    auto it = blocks.find(index);
+    if (it != blocks.end()) {
+        touch(it->second, index);
+        it->second.rows = std::move(result);
+        return;
+    }
+
+    while (blocks.size() >= CacheBlocks && !lru.empty()) {
+        blocks.erase(lru.back());
+        lru.pop_back();
+    }
+
+    lru.push_front(index);
+    Block &block = blocks[index];
+    block.rows = std::move(result);
+    block.lru = lru.begin();
+}
+
+// Запрос limit строк после якоря со смещением offset. Сравнение строк
+// (s, k) > (?, ?) не работает для NULL в столбце сортировки, поэтому на
+// границе NULL и значений склеиваются два запроса, каждый по индексу:
+// по возрастанию NULL идут первыми, по убыванию - последними.
+std::string PagedTable::blockSql(const std::vector<Value> &anchor,
+                                 size_t limit, size_t offset,
+                                 std::vector<Value> &params) const {
+    std::string select = "SELECT " + blockColumns() + " FROM " +
+                         Database::quoteIdentifier(table);
+    std::string after = descending ? " < " : " > ";
+    std::string placeholders;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        placeholders += i ? ", ?" : "?";
+    }
+
+    auto single = [&](const std::string &condition) {
+        params.push_back(Value::ofInteger(limit));
+        params.push_back(Value::ofInteger(offset));
+        return select + whereSql(condition) + orderBy() + " LIMIT ? OFFSET ?;";
+    };
+    auto merged = [&](const std::string &first, std::vector<Value> firstParams,
+                      const std::string &second) {
+        Value total = Value::ofInteger(limit + offset);
+        params = std::move(firstParams);
+        params.push_back(total);
+        params.push_back(total);
+        params.push_back(Value::ofInteger(limit));
+        params.push_back(Value::ofInteger(offset));
+        return "SELECT * FROM (" + select + whereSql(first) + orderBy() +
+               " LIMIT ?) UNION ALL SELECT * FROM (" + select +
+               whereSql(second) + orderBy() + " LIMIT ?) LIMIT ? OFFSET ?;";
+    };
+
+    if (anchor.empty())
+        return single("");
+
+    if (sort.empty()) {
+        params = anchor;
+        return single("(" + keyList() + ")" + after + "(" + placeholders +
+                      ")");
+    }
+
+    std::string column = Database::quoteIdentifier(sort);
+    std::vector<Value> keyParams(anchor.begin() + 1, anchor.end());
+    std::string afterKey =
+        "(" + keyList() + ")" + after + "(" + placeholders + ")";
+    std::string afterRow =
+        "(" + column + ", " + keyList() + ")" + after + "(?, " + placeholders +
+        ")";
+
+    if (anchor[0].type == Value::Type::Null) {
+        if (descending) {
+            params = keyParams;
+            return single(column + " IS NULL AND " + afterKey);
+        }
+        return merged(column + " IS NULL AND " + afterKey, keyParams,
+                      column + " IS NOT NULL");
+    }
+
+    if (descending)
+        return merged(afterRow, anchor, column + " IS NULL");
+    params = anchor;
+    return single(afterRow);
+}
+
+// представительный запрос для EXPLAIN: блок после непустого якоря
+std::string PagedTable::explainSql() const {
+    std::vector<Value> anchor(keys.size() + (sort.empty() ? 0 : 1),
+                              Value::ofInteger(0));
+    std::vector<Value> params;
+    return blockSql(anchor, BlockSize, 0, params);
+}
+
+std::string PagedTable::keyList() const {
+    std::string list;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (i)
+            list += ", ";
+        list += Database::keyExpression(keys[i]);
+    }
+    return list;
+}
+
+// Имена уточняются таблицей: иначе ORDER BY возьмёт одноимённый столбец
+// результата - CASE из blockColumns() вместо значения в таблице.
+std::string PagedTable::orderBy() const {
+    std::string direction = descending ? " DESC" : "";
+    std::string prefix = Database::quoteIdentifier(table) + ".";
+    std::string sql = " ORDER BY ";
+    if (!sort.empty())
+        sql += prefix + Database::quoteIdentifier(sort) + direction + ", ";
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (i)
+            sql += ", ";
+        sql += prefix + Database::keyExpression(keys[i]) + direction;
+    }
+    return sql;
+}
+
+std::string PagedTable::whereSql(std::string condition) const {
+    if (!filter.empty())
+        condition = condition.empty() ? filter
+                                      : "(" + filter + ") AND " + condition;
+    return condition.empty() ? "" : " WHERE " + condition;
+}
+
+// Столбцы с родством BLOB читаются через CASE: большое значение заменяется
+// zeroblob() той же длины. typeof() и length() над BLOB не читают само
+// значение, поэтому страницы переполнения не загружаются. Большой текст
+// (в столбцах TEXT и без типа) заменяется началом substr(), а его размер
+// в байтах приходит следом отдельным столбцом (см. sizeColumns()).
+std::string PagedTable::blockColumns() const {
+    std::vector<bool> texts = previewColumns();
+    if (std::find(texts.begin(), texts.end(), true) == texts.end())
+        return rowColumns();
+
+    std::string list;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        list += Database::keyExpression(keys[i]) + " AS \"__key" +
+                std::to_string(i) + "\", ";
+    }
+    std::string limit = std::to_string(LargeCellBytes);
+    std::string preview = std::to_string(ResultSet::PreviewBytes);
+    for (size_t col = 0; col < names.size(); ++col) {
+        std::string name = Database::quoteIdentifier(names[col]);
+        list += col ? ", " : "";
+        if (!texts[col]) {
+            list += name;
+            continue;
+        }
+        std::string bytes = byteLength(name);
+        std::string large =
+            "typeof(" + name + ") = 'text' AND " + bytes + " > " + limit;
+        list += "CASE WHEN " + large + " THEN substr(" + name + ", 1, " +
+                preview + ")";
+        if (col < blobColumns.size() && blobColumns[col])
+            list += " WHEN typeof(" + name + ") = 'blob' AND length(" + name +
+                    ") > " + limit + " THEN zeroblob(length(" + name + "))";
+        list += " ELSE " + name + " END AS " + name + ", CASE WHEN " + large +
+                " THEN " + bytes + " END AS \"__bytes" + std::to_string(col) +
+                "\"";
+    }
+    return list;
+}
+
+// столбцы, большой текст которых blockColumns() читает началом
+std::vector<bool> PagedTable::previewColumns() const {
+    std::vector<bool> texts;
+    for (size_t col = 0; col < names.size(); ++col) {
+        bool blob = col < blobColumns.size() && blobColumns[col];
+        texts.push_back(blob || (col < types.size() &&
+                                 textAffinity(types[col])));
+    }
+    return texts;
+}
+
+// номера столбцов размера в запросе blockColumns(): каждый идёт сразу
+// за своим столбцом
+std::vector<int> PagedTable::sizeColumns() const {
+    std::vector<bool> texts = previewColumns();
+    std::vector<int> sizes;
+    int index = (int)keys.size();
+    for (size_t col = 0; col < names.size(); ++col) {
+        ++index;
+        if (texts[col])
+            sizes.push_back(index++);
+    }
+    return sizes;
+}
+
+std::string PagedTable::rowColumns() const {
+    std::string list;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        list += Database::keyExpression(keys[i]) + " AS \"__key" +
+                std::to_string(i) + "\", ";
+    }
+    return list + "*";
+}
+
+// Признак фильтра читается отдельным SELECT, а не через RETURNING: в
+// RETURNING старые версии SQLite сравнивают значения без учёта родства
+// столбца (например, '' >= 5 в столбце INT).
+PagedTable::RowFormat PagedTable::rowFormat() const {
+    RowFormat format;
+    format.columns = rowColumns();
+    format.keys = keys.size();
+    if (filter.empty())
+        return format;
+
+    std::string where;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        where += (i ? " AND " : " WHERE ") +
+                 Database::keyExpression(keys[i]) + " IS ?";
+    }
+    std::string from = " FROM " + Database::quoteIdentifier(table) + where;
+    format.select = "SELECT " + format.columns + ", (" + filter +
+                    ") AS \"__match\"" + from + ";";
+    format.match = "SELECT (" + filter + ")" + from + ";";
+    format.params = filterParams;
+    return format;
+}
+
+bool PagedTable::inView(Database &db, const RowFormat &format,
+                        const std::vector<Value> &key) {
+    if (format.match.empty())
+        return true;
+    std::vector<Value> params = format.params;
+    params.insert(params.end(), key.begin(), key.end());
+    ResultSet match = db.query(format.match, params);
+    return match.rowCount() == 1 && match.getInt(0, 0) != 0;
+}
+
+ResultSet PagedTable::matchRow(Database &db, const RowFormat &format,
+                               ResultSet changed) {
+    if (format.select.empty() || changed.rowCount() != 1)
+        return changed;
+
+    std::vector<Value> params = format.params;
+    for (size_t i = 0; i < format.keys; ++i) {
+        params.push_back(changed.getValue(0, i));
+    }
+    return db.query(format.select, params);
+}
+
+std::vector<Value> PagedTable::keyOf(const ResultSet &block,
+                                     size_t row) const {
+    std::vector<Value> key;
+    for (size_t i = 0; i < keys.size() && row < block.rowCount(); ++i) {
+        key.push_back(block.getValue(row, i));
+    }
+    return key;
+}
+
+bool PagedTable::matches(const ResultSet &changed) const {
+    size_t column = keys.size() + names.size();
+    return filter.empty() || changed.getInt(0, column) != 0;
+}
+
+bool PagedTable::sameLayout(const ResultSet &changed) const {
+    size_t expected = keys.size() + names.size() + (filter.empty() ? 0 : 1);
+    return !layoutPending && !keys.empty() && changed.rowCount() == 1 &&
+           changed.columnCount() == expected;
+}
+
+// порядок строки в текущем виде: значение сортировки, затем ключ
+std::vector<Value> PagedTable::orderKey(const ResultSet &block,
+                                        size_t row) const {
+    std::vector<Value> order;
+    if (!sort.empty()) {
+        auto it = std::find(names.begin(), names.end(), sort);
+        if (it != names.end())
+            order.push_back(
+                block.getValue(row, keys.size() + (it - names.begin())));
+    }
+    std::vector<Value> key = keyOf(block, row);
+    order.insert(order.end(), key.begin(), key.end());
+    return order;
+}
+
+int PagedTable::compareOrder(const std::vector<Value> &a,
+                             const std::vector<Value> &b) const {
+    int order = compareKeys(a, b);
+    return descending ? -order : order;
+}
+
+void PagedTable::applyInsert(const ResultSet &changed) {
+    ++edits;
+    if (!sameLayout(changed)) {
+        refresh();
+        return;
+    }
+    // новая строка не проходит фильтр - в выборке её нет
+    if (!matches(changed))
+        return;
+    completeBlock(insertRow(changed));
+}
+
+void PagedTable::applyUpdate(const std::vector<Value> &key,
+                             const ResultSet &changed, bool visible) {
+    ++edits;
+    if (!sameLayout(changed)) {
+        refresh();
+        return;
+    }
+
+    // строка выходит из-под фильтра, входит в него или не видна вовсе
+    bool match = matches(changed);
+    if (!visible || !match) {
+        if (visible)
+            completeBlock(eraseKey(key));
+        else if (match)
+            completeBlock(insertRow(changed));
+        return;
+    }
+
+    size_t index, local;
+    bool cached = findRow(key, index, local);
+
+    // позиция строки не меняется, поэтому уже отправленные запросы блоков
+    // остаются верными и generation не трогаем
+    if (cached &&
+        compareKeys(orderKey(blocks.at(index).rows, local),
+                    orderKey(changed, 0)) == 0) {
+        const ResultSet &block = blocks.at(index).rows;
+        storeBlock(index, spliceRows(block, local, 1, &changed, BlockSize));
+        return;
+    }
+    if (!cached && sort.empty() && compareKeys(keyOf(changed), key) == 0)
+        return;
+
+    // строка переезжает на новое место в порядке вида
+    size_t erased = eraseKey(key);
+    size_t inserted = insertRow(changed);
+    completeBlock(erased);
+    completeBlock(inserted);
+}
+
+void PagedTable::applyDelete(const std::vector<Value> &key, bool visible) {
+    ++edits;
+    if (!visible)
+        return;
+    if (layoutPending || keys.empty() || key.size() != keys.size()) {
+        refresh();
+        return;
+    }
+    completeBlock(eraseKey(key));
+}
+
+// ожидаемое число строк в блоке при текущем rows
+size_t PagedTable::blockRows(size_t index) const {
+    size_t first = index * BlockSize;
+    return first >= rows ? 0 : std::min(BlockSize, rows - first);
+}
+
+// Первый блок, на который может повлиять строка с порядком order: последний
+// якорь меньше неё. Все блоки до него при вставке или удалении этой
+// строки не сдвигаются.
+size_t PagedTable::blockForKey(const std::vector<Value> &order) const {
+    size_t index = 0;
+    for (const auto &anchor : anchors) {
+        if (anchor.first && compareOrder(anchor.second, order) >= 0)
+            break;
+        index = anchor.first;
+    }
+    return index;
+}
+
+size_t PagedTable::lowerBound(const ResultSet &block,
+                              const std::vector<Value> &order) const {
+    size_t first = 0;
+    size_t count = block.rowCount();
+    while (count > 0) {
+        size_t step = count / 2;
+        if (compareOrder(orderKey(block, first + step), order) < 0) {
+            first += step + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+    return first;
+}
+
+// Ищет строку по ключу среди загруженных блоков. Значение сортировки
+// заранее неизвестно, поэтому просмотр линейный; блоков не больше
+// CacheBlocks.
+bool PagedTable::findRow(const std::vector<Value> &key, size_t &index,
+                         size_t &local) const {
+    for (const auto &pair : blocks) {
+        const ResultSet &block = pair.second.rows;
+        for (size_t row = 0; row < block.rowCount(); ++row) {
+            if (compareKeys(keyOf(block, row), key) == 0) {
+                index = pair.first;
+                local = row;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Удаляет строку из кэша; возвращает блок, который мог стать неполным
+size_t PagedTable::eraseKey(const std::vector<Value> &key) {
+    if (rows)
+        --rows;
+
+    size_t index, local;
+    if (!findRow(key, index, local)) {
+        // строки нет среди загруженных: без сортировки её место известно
+        // по ключу, иначе сдвинуться могло что угодно
+        index = sort.empty() ? blockForKey(key) : 0;
+        invalidateFrom(index);
+        return index;
+    }
+
+    ResultSet result =
+        spliceRows(blocks.at(index).rows, local, 1, nullptr, BlockSize);
+    invalidateFrom(index + 1);
+    anchors.erase(index + 1);
+    storeBlock(index, std::move(result));
+    return index;
+}
+
+// Вставляет строку в кэш; возвращает блок, в который она попала
+size_t PagedTable::insertRow(const ResultSet &changed) {
+    std::vector<Value> order = orderKey(changed, 0);
+    size_t index = blockForKey(order);
+
+    auto it = blocks.find(index);
+    if (it == blocks.end() || it->second.rows.rowCount() < blockRows(index)) {
+        ++rows;
+        invalidateFrom(index);
+        return index;
+    }
+
+    const ResultSet &block = it->second.rows;
+    size_t local = lowerBound(block, order);
+    ++rows;
+    if (local == BlockSize) {
+        invalidateFrom(index + 1);
+        return index + 1;
+    }
+
+    ResultSet result = spliceRows(block, local, 0, &changed, BlockSize);
+    invalidateFrom(index + 1);
+    anchors.erase(index + 1);
+    storeBlock(index, std::move(result));
+    return index;
+}
+
+// дочитывает блок, если после удаления в нём не хватает строк
+void PagedTable::completeBlock(size_t index) {
+    auto it = blocks.find(index);
+    if (it != blocks.end() && it->second.rows.rowCount() < blockRows(index))
+        requestBlock(index);
+}
+
+// Сбрасывает блоки начиная с index. Якорь index (конец предыдущего блока)
+// остаётся верным, дальние якоря сдвинулись вместе со строками.
+void PagedTable::invalidateFrom(size_t index) {
+    // уже отправленные запросы считали смещения по старым позициям
+    ++generation;
+    ++changes;
+    pending.clear();
+
+    for (auto it = blocks.begin(); it != blocks.end();) {
+        if (it->first >= index) {
+            lru.erase(it->second.lru);
+            it = blocks.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    anchors.erase(anchors.upper_bound(index), anchors.end());
+}
+
+void PagedTable::clearCache() {
+    ++changes;
+    blocks.clear();
+    pending.clear();
+    lru.clear();
+    anchors.clear();
+    anchors[0] = {};
+}
+
+void PagedTable::touch(Block &block, size_t index) {
+    lru.erase(block.lru);
+    lru.push_front(index);
+    block.lru = lru.begin();
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include "query_worker.hpp"
+#include "read_pool.hpp"
+#include "result_set.hpp"
+#include <functional>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Постраничный источник строк таблицы: загружаются только блоки,
+// попавшие в видимое окно, с keyset-пагинацией по rowid или первичному
+// ключу. Загруженные блоки хранятся в LRU-кэше, запросы к базе идут через
+// QueryWorker и не блокируют кадр.
+class PagedTable {
+    public:
+        static constexpr size_t BlockSize = 256;
+        static constexpr size_t CacheBlocks = 64;
+        static constexpr size_t PrefetchRows = 64;
+        // ячейки больше этого хранятся в блоках ссылкой
+        static constexpr size_t LargeCellBytes = 4096;
+
+        void open(QueryWorker &queryWorker, const std::string &table);
+        // блоки читаются параллельно соединениями пула; nullptr - через
+        // QueryWorker (внутри транзакции пул не видит её изменений)
+        void setReadPool(ReadPool *pool);
+        void refresh();
+        void reset();
+
+        bool isOpen() const;
+        bool loading() const;
+        // меняется при любом изменении загруженных строк или их числа;
+        // по нему интерфейс сбрасывает подготовленный текст строк
+        uint64_t version() const;
+        const std::string &tableName() const;
+        size_t rowCount() const;
+        size_t columnCount() const;
+        const std::vector<std::string> &keyColumns() const;
+
+        // Сортировка и фильтры выполняются в SQL: порядок задаёт пара
+        // (столбец, ключ), поэтому keyset-пагинация работает и здесь.
+        // Фильтр: текст (LIKE %текст%), =, !=, <, <=, >, >= или NULL/!NULL.
+        // values - равенство значению как есть, без разбора текста (ключи
+        // связей: пробелы по краям и BLOB сохраняются).
+        void setSort(const std::string &column, bool descending);
+        void setFilters(const std::map<std::string, std::string> &filters,
+                        const std::map<std::string, Value> &values = {});
+        const std::string &sortColumn() const;
+        // предупреждение по EXPLAIN QUERY PLAN и индекс, который его снимет
+        const std::string &planWarning() const;
+        const std::string &suggestedIndex() const;
+        // Номер строки с ключом key в текущем виде: число строк перед ней в
+        // порядке сортировки среди прошедших фильтры. done(-1), если
+        // строки нет или фильтр её скрывает.
+        void locate(const std::vector<Value> &key,
+                    std::function<void(long)> done);
+
+        // запрашивает блоки, покрывающие строки [first, last)
+        void prefetch(long first, long last);
+
+        // блок, содержащий строку, или nullptr, пока он не загружен;
+        // local - номер строки внутри блока
+        const ResultSet *rowBlock(size_t row, size_t &local);
+        std::string_view getText(size_t row, size_t col,
+                                 ResultSet::NumberBuffer &buffer);
+        std::string getString(size_t row, size_t col);
+        std::vector<Value> rowKey(size_t row);
+        // типизированное значение ячейки; Null, пока блок не загружен
+        Value value(size_t row, size_t col);
+        // без больших ячеек: их значение в блоке неполное
+        std::map<std::string, std::string> rowValues(size_t row);
+        // nullptr, если ячейка загружена целиком или блока ещё нет
+        const ResultSet::LargeCell *largeCell(size_t row, size_t col);
+
+        // Снимок формата строки для задания в потоке базы: columns - список
+        // для RETURNING в INSERT/UPDATE (ключи, затем *), select - запрос
+        // той же строки с признаком __match, если активен фильтр, match -
+        // только признак. Изменения применяются к кэшу на месте:
+        // перечитывается не больше одного блока, count(*) не нужен.
+        struct RowFormat {
+                std::string columns;
+                std::string select;
+                std::string match;
+                // значения :fN фильтра, первые параметры select и match
+                std::vector<Value> params;
+                size_t keys = 0;
+        };
+        RowFormat rowFormat() const;
+        static ResultSet matchRow(Database &db, const RowFormat &format,
+                                  ResultSet changed);
+        // строка с ключом key есть в виде (проходит фильтр); читается до
+        // правки или удаления
+        static bool inView(Database &db, const RowFormat &format,
+                           const std::vector<Value> &key);
+        std::vector<Value> keyOf(const ResultSet &block, size_t row = 0) const;
+        void applyInsert(const ResultSet &changed);
+        // visible - строка была в виде до правки (inView)
+        void applyUpdate(const std::vector<Value> &key,
+                         const ResultSet &changed, bool visible = true);
+        void applyDelete(const std::vector<Value> &key, bool visible = true);
+
+    private:
+        struct Block {
+                ResultSet rows;
+                std::list<size_t>::iterator lru;
+        };
+
+        struct Layout {
+                std::vector<std::string> keys;
+                std::vector<std::string> names;
+                // объявленные типы столбцов и столбцы с родством BLOB
+                std::vector<std::string> types;
+                std::vector<bool> blobs;
+                size_t rows = 0;
+                std::vector<std::string> plan;
+        };
+
+        static Layout readLayout(Database &db, const std::string &table,
+                                 std::vector<std::string> keys,
+                                 const std::string &where,
+                                 const std::vector<Value> &params,
+                                 const std::string &explain);
+        static std::vector<std::string> explainPlan(Database &db,
+                                                    const std::string &sql);
+        void applyLayout(uint64_t gen, Layout layout);
+        void applyPlan(const std::vector<std::string> &plan);
+        void requestBlock(size_t index);
+        void storeBlock(size_t index, ResultSet result);
+        std::string blockSql(const std::vector<Value> &anchor, size_t limit,
+                             size_t offset, std::vector<Value> &params) const;
+        std::string explainSql() const;
+        std::string rowColumns() const;
+        std::string blockColumns() const;
+        std::vector<bool> previewColumns() const;
+        std::vector<int> sizeColumns() const;
+        std::string keyList() const;
+        std::string orderBy() const;
+        std::string whereSql(std::string condition) const;
+        bool matches(const ResultSet &changed) const;
+        bool sameLayout(const ResultSet &changed) const;
+        std::vector<Value> orderKey(const ResultSet &block, size_t row) const;
+        int compareOrder(const std::vector<Value> &a,
+                         const std::vector<Value> &b) const;
+        size_t blockRows(size_t index) const;
+        size_t blockForKey(const std::vector<Value> &order) const;
+        size_t lowerBound(const ResultSet &block,
+                          const std::vector<Value> &order) const;
+        bool findRow(const std::vector<Value> &key, size_t &index,
+                     size_t &local) const;
+        size_t eraseKey(const std::vector<Value> &key);
+        size_t insertRow(const ResultSet &changed);
+        void completeBlock(size_t index);
+        void invalidateFrom(size_t index);
+        void clearCache();
+        void touch(Block &block, size_t index);
+
+        QueryWorker *worker = nullptr;
+        ReadPool *readPool = nullptr;
+        std::string table;
+        std::vector<std::string> keys;
+        std::vector<std::string> names;
+        std::vector<std::string> types;
+        std::vector<bool> blobColumns;
+        size_t rows = 0;
+        bool layoutPending = false;
+        // меняется при смене таблицы; ответы от старых запросов отбрасываются
+        uint64_t generation = 0;
+        // правки строк; блок, прочитанный пулом до правки, устарел
+        uint64_t edits = 0;
+        uint64_t changes = 0;
+
+        // текущий вид: сортировка и условие WHERE из фильтров
+        std::string sort;
+        bool descending = false;
+        std::string filter;
+        // значения :fN из filter, привязываются перед прочими параметрами
+        std::vector<Value> filterParams;
+        std::vector<std::string> equalityColumns;
+        std::vector<std::string> rangeColumns;
+        std::string warning;
+        std::string suggestion;
+
+        std::unordered_map<size_t, Block> blocks;
+        std::set<size_t> pending;
+        std::list<size_t> lru;
+        // ключ сортировки последней строки блока index - 1, т.е. начало
+        // блока index
+        std::map<size_t, std::vector<Value>> anchors;
+};
@@ -0,0 +1,230 @@
+#include "pending_changes.hpp"
+#include <algorithm>
+
+bool PendingChanges::KeyLess::operator()(
+    const std::pair<std::string, std::vector<Value>> &a,
+    const std::pair<std::string, std::vector<Value>> &b) const {
+    if (a.first != b.first)
+        return a.first < b.first;
+    size_t count = std::min(a.second.size(), b.second.size());
+    for (size_t i = 0; i < count; ++i) {
+        int order = a.second[i].compare(b.second[i]);
+        if (order != 0)
+            return order < 0;
+    }
+    return a.second.size() < b.second.size();
+}
+
+void PendingChanges::insert(const std::string &table,
+                            std::map<std::string, std::string> values) {
+    PendingChange change;
+    change.kind = PendingChange::Kind::Insert;
+    change.table = table;
+    change.values = std::move(values);
+    list.push_back(std::move(change));
+    ++tables[table];
+}
+
+void PendingChanges::updateInsert(size_t index,
+                                  std::map<std::string, std::string> values) {
+    if (index < list.size() &&
+        list[index].kind == PendingChange::Kind::Insert)
+        list[index].values = std::move(values);
+}
+
+void PendingChanges::update(
+    const std::string &table, const std::vector<Value> &key,
+    const RowKey &where, const std::map<std::string, std::string> &original,
+    const std::map<std::string, std::string> &values) {
+    auto found = index.find({table, key});
+    if (found != index.end() &&
+        list[found->second].kind == PendingChange::Kind::Delete)
+        return;
+
+    // в правку попадают только ячейки, отличные от строки в базе
+    std::map<std::string, std::string> changed;
+    for (const auto &pair : values) {
+        auto old = original.find(pair.first);
+        if (old == original.end() || old->second != pair.second)
+            changed.insert(pair);
+    }
+
+    if (found != index.end()) {
+        if (changed.empty()) {
+            discard(found->second);
+        } else {
+            list[found->second].values = std::move(changed);
+        }
+        return;
+    }
+    if (changed.empty())
+        return;
+
+    PendingChange change;
+    change.table = table;
+    change.key = key;
+    change.where = where;
+    change.values = std::move(changed);
+    change.original = original;
+    index[{table, key}] = list.size();
+    list.push_back(std::move(change));
+    ++tables[table];
+}
+
+void PendingChanges::remove(
+    const std::string &table, const std::vector<Value> &key,
+    const RowKey &where, const std::map<std::string, std::string> &original) {
+    auto found = index.find({table, key});
+    if (found != index.end()) {
+        // правка удаляемой строки теряет смысл
+        PendingChange &change = list[found->second];
+        change.kind = PendingChange::Kind::Delete;
+        change.values.clear();
+        return;
+    }
+
+    PendingChange change;
+    change.kind = PendingChange::Kind::Delete;
+    change.table = table;
+    change.key = key;
+    change.where = where;
+    change.original = original;
+    index[{table, key}] = list.size();
+    list.push_back(std::move(change));
+    ++tables[table];
+}
+
+void PendingChanges::discard(size_t number) {
+    if (number >= list.size())
+        return;
+    list.erase(list.begin() + number);
+    reindex();
+}
+
+void PendingChanges::clear() {
+    list.clear();
+    index.clear();
+    tables.clear();
+}
+
+bool PendingChanges::empty() const { return list.empty(); }
+
+size_t PendingChanges::size() const { return list.size(); }
+
+const std::vector<PendingChange> &PendingChanges::changes() const {
+    return list;
+}
+
+const PendingChange *
+PendingChanges::find(const std::string &table,
+                     const std::vector<Value> &key) const {
+    auto found = index.find({table, key});
+    return found == index.end() ? nullptr : &list[found->second];
+}
+
+bool PendingChanges::hasTable(const std::string &table) const {
+    return tables.count(table) != 0;
+}
+
+std::vector<size_t> PendingChanges::inserts(const std::string &table) const {
+    std::vector<size_t> result;
+    if (!hasTable(table))
+        return result;
+    for (size_t i = 0; i < list.size(); ++i) {
+        if (list[i].kind == PendingChange::Kind::Insert &&
+            list[i].table == table)
+            result.push_back(i);
+    }
+    return result;
+}
+
+void PendingChanges::reindex() {
+    index.clear();
+    tables.clear();
+    for (size_t i = 0; i < list.size(); ++i) {
+        if (list[i].kind != PendingChange::Kind::Insert)
+            index[{list[i].table, list[i].key}] = i;
+        ++tables[list[i].table];
+    }
+}
+
+bool PendingChanges::apply(Database &db,
+                           const std::vector<PendingChange> &changes,
+                           size_t &failed, std::string &error,
+                           std::vector<RowDelta> *deltas,
+                           std::vector<ResultSet> *rows) {
+    failed = 0;
+    if (!db.execute("SAVEPOINT pending_changes;")) {
+        error = db.errorMessage();
+        return false;
+    }
+
+    // запросы берутся из кэша Database: одинаковый набор столбцов
+    // готовится один раз
+    std::map<std::string, std::vector<std::string>> tableKeys;
+    bool ok = true;
+    for (; ok && failed < changes.size(); ++failed) {
+        const PendingChange &change = changes[failed];
+        std::vector<std::string> keys;
+        std::string returning;
+        ResultSet before;
+        ResultSet after;
+        bool collect = deltas || rows;
+        if (collect) {
+            auto found = tableKeys.find(change.table);
+            if (found == tableKeys.end())
+                found = tableKeys
+                            .emplace(change.table,
+                                     db.rowKeyColumns(change.table))
+                            .first;
+            keys = found->second;
+            returning = EditJournal::rowColumns(keys);
+            if (deltas && change.kind != PendingChange::Kind::Insert)
+                before = EditJournal::readRow(db, change.table, keys,
+                                              change.key);
+        }
+
+        switch (change.kind) {
+        case PendingChange::Kind::Insert:
+            ok = db.addRecord(change.table, change.values, returning,
+                              collect ? &after : nullptr);
+            break;
+        case PendingChange::Kind::Update:
+            ok = db.updateRecord(change.table, change.values, change.where,
+                                 returning, collect ? &after : nullptr);
+            break;
+        case PendingChange::Kind::Delete:
+            ok = db.deleteRecord(change.table, change.where);
+            break;
+        }
+        if (!ok) {
+            error = db.errorMessage();
+            break;
+        }
+        // строку удалили или изменили её ключ в обход буфера
+        if (change.kind != PendingChange::Kind::Insert && db.changes() != 1) {
+            ok = false;
+            error = "строка не найдена";
+            break;
+        }
+        if (deltas)
+            deltas->push_back(
+                EditJournal::diff(change.table, keys, before, after));
+        if (rows)
+            rows->push_back(std::move(after));
+    }
+
+    if (ok)
+        ok = db.execute("RELEASE pending_changes;");
+    if (!ok) {
+        if (failed == changes.size())
+            error = db.errorMessage();
+        db.execute("ROLLBACK TO pending_changes;");
+        db.execute("RELEASE pending_changes;");
+        if (deltas)
+            deltas->clear();
+        if (rows)
+            rows->clear();
+    }
+    return ok;
+}
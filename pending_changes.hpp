@@ -0,0 +1,82 @@
+#pragma once
+
+#include "database.hpp"
+#include "edit_journal.hpp"
+#include "result_set.hpp"
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct PendingChange {
+        enum class Kind { Insert, Update, Delete };
+
+        Kind kind = Kind::Update;
+        std::string table;
+        // ключ строки в порядке PagedTable::keyColumns(); пуст у вставки
+        std::vector<Value> key;
+        RowKey where;
+        // Insert - вся строка, Update - только изменённые ячейки
+        std::map<std::string, std::string> values;
+        // строка до правки (Update и Delete), для просмотра разницы
+        std::map<std::string, std::string> original;
+};
+
+// Буфер несохранённых правок: ячейки, новые и удалённые строки копятся
+// локально и записываются в базу одной транзакцией. Повторная правка
+// строки сливается с прежней, возврат к исходному значению её снимает.
+class PendingChanges {
+    public:
+        void insert(const std::string &table,
+                    std::map<std::string, std::string> values);
+        // правка вставки, ещё не записанной в базу
+        void updateInsert(size_t index,
+                          std::map<std::string, std::string> values);
+        void update(const std::string &table, const std::vector<Value> &key,
+                    const RowKey &where,
+                    const std::map<std::string, std::string> &original,
+                    const std::map<std::string, std::string> &values);
+        void remove(const std::string &table, const std::vector<Value> &key,
+                    const RowKey &where,
+                    const std::map<std::string, std::string> &original);
+        void discard(size_t index);
+        void clear();
+
+        bool empty() const;
+        size_t size() const;
+        const std::vector<PendingChange> &changes() const;
+        // правка или удаление строки; nullptr, если её нет
+        const PendingChange *find(const std::string &table,
+                                  const std::vector<Value> &key) const;
+        bool hasTable(const std::string &table) const;
+        // номера вставок в таблицу по порядку
+        std::vector<size_t> inserts(const std::string &table) const;
+
+        // Записывает изменения одной транзакцией через SAVEPOINT, поэтому
+        // и внутри транзакции, открытой вручную. При ошибке всё
+        // откатывается, failed - номер изменения, на котором она случилась.
+        // deltas - дельты строк для журнала отмены, rows - строка после
+        // каждого изменения из RETURNING (ключи, затем *; у удаления пуста)
+        // для кэша PagedTable.
+        static bool apply(Database &db,
+                          const std::vector<PendingChange> &changes,
+                          size_t &failed, std::string &error,
+                          std::vector<RowDelta> *deltas = nullptr,
+                          std::vector<ResultSet> *rows = nullptr);
+
+    private:
+        struct KeyLess {
+                bool operator()(
+                    const std::pair<std::string, std::vector<Value>> &a,
+                    const std::pair<std::string, std::vector<Value>> &b) const;
+        };
+
+        void reindex();
+
+        std::vector<PendingChange> list;
+        // (таблица, ключ) -> номер правки или удаления в list
+        std::map<std::pair<std::string, std::vector<Value>>, size_t, KeyLess>
+            index;
+        // число изменений по таблицам
+        std::map<std::string, size_t> tables;
+};
@@ -0,0 +1,196 @@
+#include "profiler.hpp"
+#include "exporter.hpp"
+
+namespace {
+
+void writeJsonString(const std::string &text, BufferedWriter &out) {
+    out.put('"');
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            out.put('\\');
+            out.put((char)c);
+        } else if (c < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out.write(escape, 6);
+        } else {
+            out.put((char)c);
+        }
+    }
+    out.put('"');
+}
+
+} // namespace
+
+Profiler::Scope::Scope(Profiler &profiler, const char *category,
+                       std::string name)
+    : profiler(profiler),
+      category(category),
+      name(std::move(name)),
+      start(profiler.now()) {}
+
+Profiler::Scope::~Scope() {
+    profiler.span(category, std::move(name), start, profiler.now() - start);
+}
+
+Profiler::Profiler()
+    : origin(std::chrono::steady_clock::now()) {}
+
+uint64_t Profiler::now() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - origin)
+        .count();
+}
+
+uint32_t Profiler::threadId() {
+    static std::atomic<uint32_t> next{1};
+    thread_local uint32_t id = next++;
+    return id;
+}
+
+void Profiler::query(QueryProfile profile) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (recording) {
+        addEvent({profile.sql, "query", threadId(), profile.start,
+                  profile.totalUs(), profile.rows, profile.bytes});
+        if (profile.prepareUs)
+            addEvent({"prepare", "query", threadId(), profile.start,
+                      profile.prepareUs, 0, 0});
+    }
+
+    queryTimes.push_back(profile.totalUs() / 1000.0f);
+    if (queryTimes.size() > History)
+        queryTimes.pop_front();
+    queries.push_back(std::move(profile));
+    if (queries.size() > RecentQueries)
+        queries.pop_front();
+}
+
+void Profiler::statement(const char *sql, uint64_t nanoseconds) {
+    uint64_t duration = nanoseconds / 1000;
+    uint64_t end = now();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (recording)
+        addEvent({sql ? sql : "", "sqlite", threadId(),
+                  end > duration ? end - duration : 0, duration, 0, 0});
+}
+
+void Profiler::frame(const FrameProfile &profile) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (recording)
+        addEvent({"frame", "frame", threadId(), profile.start,
+                  profile.totalUs(), 0, 0});
+    frames.push_back(profile);
+    if (frames.size() > History)
+        frames.pop_front();
+}
+
+void Profiler::span(const char *category, std::string name, uint64_t start,
+                    uint64_t duration) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (recording)
+        addEvent({std::move(name), category, threadId(), start, duration, 0,
+                  0});
+}
+
+// вызывается под mutex
+void Profiler::addEvent(TraceEvent event) {
+    if (events.size() < MaxTraceEvents)
+        events.push_back(std::move(event));
+}
+
+void Profiler::startTrace() {
+    std::lock_guard<std::mutex> lock(mutex);
+    events.clear();
+    recording = true;
+}
+
+void Profiler::stopTrace() {
+    std::lock_guard<std::mutex> lock(mutex);
+    recording = false;
+}
+
+bool Profiler::tracing() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return recording;
+}
+
+size_t Profiler::traceEvents() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return events.size();
+}
+
+bool Profiler::writeChromeTrace(const std::string &path) {
+    std::vector<TraceEvent> copy;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        copy = events;
+    }
+
+    BufferedWriter out;
+    if (!out.open(path))
+        return false;
+
+    out.write("{\"traceEvents\":[\n");
+    char buffer[160];
+    for (size_t i = 0; i < copy.size(); ++i) {
+        const auto &event = copy[i];
+        out.write(i ? ",\n{\"name\":" : "{\"name\":");
+        writeJsonString(event.name, out);
+        int n = snprintf(buffer, sizeof(buffer),
+                         ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                         "\"ts\":%llu,\"dur\":%llu",
+                         event.category, event.thread,
+                         (unsigned long long)event.start,
+                         (unsigned long long)event.duration);
+        out.write(buffer, n);
+        if (event.rows || event.bytes) {
+            n = snprintf(buffer, sizeof(buffer),
+                         ",\"args\":{\"rows\":%llu,\"bytes\":%llu}",
+                         (unsigned long long)event.rows,
+                         (unsigned long long)event.bytes);
+            out.write(buffer, n);
+        }
+        out.put('}');
+    }
+    out.write("\n]}\n");
+    return out.close();
+}
+
+std::vector<QueryProfile> Profiler::recentQueries() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::vector<QueryProfile>(queries.begin(), queries.end());
+}
+
+std::vector<float> Profiler::frameHistory() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<float> history;
+    for (const auto &frame : frames) {
+        history.push_back(frame.totalUs() / 1000.0f);
+    }
+    return history;
+}
+
+std::vector<float> Profiler::queryHistory() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::vector<float>(queryTimes.begin(), queryTimes.end());
+}
+
+FrameProfile Profiler::averageFrame() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    FrameProfile average;
+    if (frames.empty())
+        return average;
+
+    for (const auto &frame : frames) {
+        average.pollUs += frame.pollUs;
+        average.uiUs += frame.uiUs;
+        average.drawUs += frame.drawUs;
+        average.swapUs += frame.swapUs;
+    }
+    average.pollUs /= frames.size();
+    average.uiUs /= frames.size();
+    average.drawUs /= frames.size();
+    average.swapUs /= frames.size();
+    return average;
+}
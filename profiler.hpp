@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// время одного запроса Database: подготовка, шаги sqlite3_step и
+// перенос строк в ResultSet
+struct QueryProfile {
+        std::string sql;
+        uint64_t start = 0;
+        uint64_t prepareUs = 0;
+        uint64_t stepUs = 0;
+        uint64_t materializeUs = 0;
+        uint64_t rows = 0;
+        uint64_t bytes = 0;
+
+        uint64_t totalUs() const { return prepareUs + stepUs + materializeUs; }
+};
+
+// фазы кадра в главном цикле
+struct FrameProfile {
+        uint64_t start = 0;
+        uint64_t pollUs = 0;
+        uint64_t uiUs = 0;
+        uint64_t drawUs = 0;
+        uint64_t swapUs = 0;
+
+        uint64_t totalUs() const { return pollUs + uiUs + drawUs + swapUs; }
+};
+
+// Сбор времени запросов и кадров. Запись идёт из потока базы и потока
+// интерфейса; пока enabled сброшен, Database не снимает время вовсе.
+// Во время записи трассы все интервалы копятся и сохраняются в формате
+// Chrome trace (chrome://tracing, Perfetto).
+class Profiler {
+    public:
+        static constexpr size_t History = 240;
+        static constexpr size_t RecentQueries = 64;
+        static constexpr size_t MaxTraceEvents = 1 << 20;
+
+        // RAII-интервал для произвольного участка кода
+        class Scope {
+            public:
+                Scope(Profiler &profiler, const char *category,
+                      std::string name);
+                ~Scope();
+
+            private:
+                Profiler &profiler;
+                const char *category;
+                std::string name;
+                uint64_t start;
+        };
+
+        Profiler();
+
+        // микросекунды от создания профилировщика
+        uint64_t now() const;
+
+        void query(QueryProfile profile);
+        // время выполнения оператора по sqlite3_trace_v2 (SQLITE_TRACE_PROFILE)
+        void statement(const char *sql, uint64_t nanoseconds);
+        void frame(const FrameProfile &profile);
+        void span(const char *category, std::string name, uint64_t start,
+                  uint64_t duration);
+
+        void startTrace();
+        void stopTrace();
+        bool tracing() const;
+        size_t traceEvents() const;
+        bool writeChromeTrace(const std::string &path);
+
+        // копии для окна профилировщика
+        std::vector<QueryProfile> recentQueries() const;
+        std::vector<float> frameHistory() const;
+        std::vector<float> queryHistory() const;
+        FrameProfile averageFrame() const;
+
+        std::atomic<bool> enabled{false};
+
+    private:
+        struct TraceEvent {
+                std::string name;
+                const char *category;
+                uint32_t thread;
+                uint64_t start;
+                uint64_t duration;
+                uint64_t rows;
+                uint64_t bytes;
+        };
+
+        static uint32_t threadId();
+        void addEvent(TraceEvent event);
+
+        std::chrono::steady_clock::time_point origin;
+
+        mutable std::mutex mutex;
+        std::deque<QueryProfile> queries;
+        std::deque<FrameProfile> frames;
+        // время последних запросов, мс
+        std::deque<float> queryTimes;
+        bool recording = false;
+        std::vector<TraceEvent> events;
+};
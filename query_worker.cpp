@@ -0,0 +1,110 @@
+#include "query_worker.hpp"
+
+QueryWorker::QueryWorker() {
+    database.setProgressHandler(1000, [this]() {
+        steps.fetch_add(1000, std::memory_order_relaxed);
+        const std::atomic<bool> *cancelled = watched.load();
+        return cancelled && cancelled->load();
+    });
+    thread = std::thread(&QueryWorker::run, this);
+}
+
+QueryWorker::~QueryWorker() { stop(); }
+
+void QueryWorker::poll() {
+    std::deque<std::function<void()>> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.swap(completed);
+    }
+
+    for (auto &done : ready) {
+        done();
+    }
+}
+
+void QueryWorker::setNotify(std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(mutex);
+    notify = std::move(callback);
+}
+
+void QueryWorker::cancel() {
+    std::lock_guard<std::mutex> lock(mutex);
+    generation.fetch_add(1);
+    if (running)
+        database.interrupt();
+}
+
+void QueryWorker::stop() {
+    if (!thread.joinable())
+        return;
+
+    cancel();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+    database.close();
+}
+
+bool QueryWorker::busy() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return running || !jobs.empty();
+}
+
+size_t QueryWorker::pending() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return jobs.size() + (running ? 1 : 0);
+}
+
+uint64_t QueryWorker::progressSteps() const { return steps.load(); }
+
+double QueryWorker::busySeconds() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!running)
+        return 0.0;
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         startedAt)
+        .count();
+}
+
+void QueryWorker::enqueue(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back({generation.load(), std::move(task)});
+    }
+    wake.notify_one();
+}
+
+void QueryWorker::run() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+                break;
+
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            running = true;
+            startedAt = std::chrono::steady_clock::now();
+            steps = 0;
+        }
+
+        bool cancelled = job.generation < generation.load();
+        auto done = job.task(database, cancelled);
+
+        std::function<void()> wakeUp;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            completed.push_back(std::move(done));
+            running = false;
+            wakeUp = notify;
+        }
+        if (wakeUp)
+            wakeUp();
+    }
+}
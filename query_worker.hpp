@@ -0,0 +1,94 @@
+#pragma once
+
+#include "database.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+// Фоновый поток, единолично владеющий соединением с базой. Задания
+// выполняются по очереди, а их результаты передаются обратно в поток
+// интерфейса через poll(), который вызывается раз в кадр.
+class QueryWorker {
+    public:
+        QueryWorker();
+        ~QueryWorker();
+
+        QueryWorker(const QueryWorker &) = delete;
+        QueryWorker &operator=(const QueryWorker &) = delete;
+
+        // work(Database &) выполняется в фоновом потоке, done(result) -
+        // в потоке интерфейса. Отменённые задания получают Result{}.
+        template <class Work, class Done> void submit(Work work, Done done) {
+            using Result = std::invoke_result_t<Work &, Database &>;
+            enqueue([work = std::move(work), done = std::move(done)](
+                        Database &db,
+                        bool cancelled) mutable -> std::function<void()> {
+                auto result = std::make_shared<Result>(
+                    cancelled ? Result{} : work(db));
+                return [done, result]() mutable { done(std::move(*result)); };
+            });
+        }
+
+        // То же с флагом отмены задания: пока оно выполняется, запрос
+        // прерывается, как только *cancelled станет true. Очередь и
+        // остальные задания не затрагиваются, в отличие от cancel().
+        template <class Work, class Done>
+        void submit(Work work, Done done, const std::atomic<bool> *cancelled) {
+            auto watch = [this, work = std::move(work),
+                          cancelled](Database &db) mutable {
+                watched = cancelled;
+                auto result = work(db);
+                watched = nullptr;
+                return result;
+            };
+            submit(std::move(watch), std::move(done));
+        }
+
+        // выполняет готовые обработчики результатов
+        void poll();
+        // notify вызывается в фоновом потоке, когда готов результат, -
+        // будит поток интерфейса, который ждёт событий
+        void setNotify(std::function<void()> notify);
+        // прерывает текущий запрос и отменяет все ожидающие задания
+        void cancel();
+        void stop();
+
+        bool busy() const;
+        size_t pending() const;
+        uint64_t progressSteps() const;
+        double busySeconds() const;
+
+    private:
+        using Task = std::function<std::function<void()>(Database &, bool)>;
+
+        struct Job {
+                uint64_t generation;
+                Task task;
+        };
+
+        void enqueue(Task task);
+        void run();
+
+        Database database;
+        std::thread thread;
+
+        mutable std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<Job> jobs;
+        std::deque<std::function<void()>> completed;
+        std::function<void()> notify;
+        bool stopping = false;
+        bool running = false;
+        std::chrono::steady_clock::time_point startedAt;
+
+        std::atomic<uint64_t> generation{0};
+        std::atomic<uint64_t> steps{0};
+        // флаг отмены текущего задания, проверяется обработчиком прогресса
+        std::atomic<const std::atomic<bool> *> watched{nullptr};
+};
@@ -0,0 +1,225 @@
+#include "read_pool.hpp"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+// пул и номер потока, если код выполняется в потоке пула
+thread_local const void *currentPool = nullptr;
+thread_local size_t currentWorker = 0;
+
+} // namespace
+
+ReadPool::~ReadPool() { close(); }
+
+bool ReadPool::open(const std::string &path, OpenProfile profile,
+                    size_t threads) {
+    close();
+    if (!threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (size_t i = 0; i < threads; ++i) {
+        auto worker = std::make_unique<Worker>();
+        if (!worker->db.open(path, profile)) {
+            workers.clear();
+            return false;
+        }
+        workers.push_back(std::move(worker));
+    }
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i]->thread = std::thread(&ReadPool::run, this, i);
+    }
+    return true;
+}
+
+void ReadPool::close() {
+    if (workers.empty())
+        return;
+
+    cancel();
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers) {
+        worker->thread.join();
+    }
+    workers.clear();
+
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    stopping = false;
+    queued = 0;
+    std::lock_guard<std::mutex> completedLock(completedMutex);
+    completed.clear();
+}
+
+bool ReadPool::isOpen() const { return !workers.empty(); }
+
+size_t ReadPool::size() const { return workers.size(); }
+
+std::vector<std::pair<int64_t, int64_t>>
+ReadPool::splitRange(int64_t first, int64_t last, size_t parts) {
+    std::vector<std::pair<int64_t, int64_t>> ranges;
+    if (last < first)
+        return ranges;
+
+    uint64_t span = (uint64_t)(last - first) + 1;
+    parts = (size_t)std::min<uint64_t>(std::max<size_t>(parts, 1), span);
+    uint64_t step = span / parts;
+    uint64_t extra = span % parts;
+    int64_t from = first;
+    for (size_t i = 0; i < parts; ++i) {
+        int64_t to = from + (int64_t)(step + (i < extra ? 1 : 0)) - 1;
+        ranges.emplace_back(from, to);
+        from = to + 1;
+    }
+    return ranges;
+}
+
+void ReadPool::poll() {
+    std::deque<std::function<void()>> ready;
+    {
+        std::lock_guard<std::mutex> lock(completedMutex);
+        ready.swap(completed);
+    }
+
+    for (auto &done : ready) {
+        done();
+    }
+}
+
+void ReadPool::setNotify(std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(completedMutex);
+    notify = std::move(callback);
+}
+
+void ReadPool::complete(std::function<void()> done) {
+    std::function<void()> wakeUp;
+    {
+        std::lock_guard<std::mutex> lock(completedMutex);
+        completed.push_back(std::move(done));
+        wakeUp = notify;
+    }
+    if (wakeUp)
+        wakeUp();
+}
+
+void ReadPool::cancel() {
+    generation.fetch_add(1);
+    for (auto &worker : workers) {
+        worker->db.interrupt();
+    }
+}
+
+// задание из потока пула кладётся в его же очередь, остальные - по кругу
+void ReadPool::push(Task task) {
+    size_t index = currentPool == this ? currentWorker
+                                       : next++ % workers.size();
+    {
+        std::lock_guard<std::mutex> lock(workers[index]->mutex);
+        workers[index]->queue.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        ++queued;
+    }
+    wake.notify_one();
+}
+
+bool ReadPool::take(size_t self, Task &task) {
+    bool found = false;
+    {
+        Worker &own = *workers[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.queue.empty()) {
+            task = std::move(own.queue.front());
+            own.queue.pop_front();
+            found = true;
+        }
+    }
+    for (size_t i = 1; !found && i < workers.size(); ++i) {
+        Worker &victim = *workers[(self + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.queue.empty()) {
+            task = std::move(victim.queue.back());
+            victim.queue.pop_back();
+            found = true;
+        }
+    }
+
+    if (found) {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        --queued;
+    }
+    return found;
+}
+
+void ReadPool::run(size_t self) {
+    currentPool = this;
+    currentWorker = self;
+    Database &db = workers[self]->db;
+    while (true) {
+        Task task;
+        if (take(self, task)) {
+            task(db);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wake.wait(lock, [this]() { return stopping || queued > 0; });
+        if (stopping && queued == 0)
+            break;
+    }
+    db.close();
+}
+
+bool ReadPool::parallelFor(
+    size_t parts, const std::function<void(Database &, size_t)> &body) {
+    if (workers.empty())
+        return false;
+    if (parts == 0)
+        return true;
+
+    struct Join {
+            std::mutex mutex;
+            std::condition_variable done;
+            size_t remaining;
+    };
+    auto join = std::make_shared<Join>();
+    join->remaining = parts;
+    // после cancel() оставшиеся части пропускаются
+    uint64_t gen = generation.load();
+    for (size_t part = 0; part < parts; ++part) {
+        push([this, join, gen, &body, part](Database &db) {
+            if (gen == generation.load())
+                body(db, part);
+            std::lock_guard<std::mutex> lock(join->mutex);
+            if (--join->remaining == 0)
+                join->done.notify_all();
+        });
+    }
+
+    if (currentPool != this) {
+        std::unique_lock<std::mutex> lock(join->mutex);
+        join->done.wait(lock, [&]() { return join->remaining == 0; });
+        return gen == generation.load();
+    }
+
+    // поток пула не простаивает: выполняет свои и чужие задания
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(join->mutex);
+            if (join->remaining == 0)
+                return gen == generation.load();
+        }
+        Task task;
+        if (take(currentWorker, task)) {
+            task(workers[currentWorker]->db);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(join->mutex);
+        join->done.wait_for(lock, std::chrono::milliseconds(1),
+                            [&]() { return join->remaining == 0; });
+    }
+}
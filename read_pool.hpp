@@ -0,0 +1,92 @@
+#pragma once
+
+#include "database.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Пул соединений только для чтения, по одному на поток. У каждого потока
+// своя очередь: владелец берёт задания с начала, свободные потоки крадут
+// с конца чужих очередей. Читатели видят только зафиксированные данные,
+// поэтому пул открывается для баз в WAL или открытых только для чтения.
+class ReadPool {
+    public:
+        ReadPool() = default;
+        ~ReadPool();
+
+        ReadPool(const ReadPool &) = delete;
+        ReadPool &operator=(const ReadPool &) = delete;
+
+        // threads = 0 - по числу ядер
+        bool open(const std::string &path, OpenProfile profile,
+                  size_t threads = 0);
+        void close();
+        bool isOpen() const;
+        size_t size() const;
+
+        // как QueryWorker::submit: work(Database &) в потоке пула,
+        // done(result) - в потоке интерфейса из poll()
+        template <class Work, class Done> void submit(Work work, Done done) {
+            using Result = std::invoke_result_t<Work &, Database &>;
+            uint64_t gen = generation.load();
+            push([this, gen, work = std::move(work),
+                  done = std::move(done)](Database &db) mutable {
+                auto result = std::make_shared<Result>(
+                    gen < generation.load() ? Result{} : work(db));
+                complete(
+                    [done, result]() mutable { done(std::move(*result)); });
+            });
+        }
+
+        // Выполняет body(db, part) для part из [0, parts) и ждёт окончания.
+        // Из потока пула ожидающий сам выполняет задания, поэтому вложенные
+        // вызовы не блокируют пул. false - пул закрыт или вызван cancel(),
+        // и часть частей не выполнена.
+        bool parallelFor(size_t parts,
+                         const std::function<void(Database &, size_t)> &body);
+
+        // делит [first, last] на не больше parts равных непустых диапазонов
+        static std::vector<std::pair<int64_t, int64_t>>
+        splitRange(int64_t first, int64_t last, size_t parts);
+
+        void poll();
+        // как QueryWorker::setNotify: вызывается в потоке пула, когда
+        // готов результат submit
+        void setNotify(std::function<void()> notify);
+        // прерывает запросы и отменяет ещё не начатые задания submit
+        void cancel();
+
+    private:
+        using Task = std::function<void(Database &)>;
+
+        struct Worker {
+                Database db;
+                std::deque<Task> queue;
+                std::mutex mutex;
+                std::thread thread;
+        };
+
+        void push(Task task);
+        void complete(std::function<void()> done);
+        bool take(size_t self, Task &task);
+        void run(size_t self);
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::atomic<size_t> next{0};
+
+        std::mutex wakeMutex;
+        std::condition_variable wake;
+        size_t queued = 0;
+        bool stopping = false;
+
+        std::mutex completedMutex;
+        std::deque<std::function<void()>> completed;
+        std::function<void()> notify;
+        std::atomic<uint64_t> generation{0};
+};
@@ -0,0 +1,125 @@
+#include "record_editor.hpp"
+#include <cctype>
+#include <cstdlib>
+
+namespace {
+
+bool digits(const std::string &value, size_t &pos, size_t count) {
+    for (size_t end = pos + count; pos < end; ++pos) {
+        if (pos >= value.size() || !isdigit((unsigned char)value[pos]))
+            return false;
+    }
+    return true;
+}
+
+bool expect(const std::string &value, size_t &pos, char c) {
+    if (pos >= value.size() || value[pos] != c)
+        return false;
+    ++pos;
+    return true;
+}
+
+} // namespace
+
+void RecordEditor::load(const std::vector<ColumnInfo> &columns,
+                        const std::map<std::string, std::string> &values) {
+    list.clear();
+    if (values.empty())
+        return;
+
+    list.reserve(columns.size());
+    for (size_t i = 0; i < columns.size(); ++i) {
+        const ColumnInfo &column = columns[i];
+        EditField field;
+        field.name = column.name;
+        field.label = column.name + " (" + column.type + "):";
+        field.id = "##" + column.name;
+        field.column = i;
+        auto found = values.find(column.name);
+        if (found != values.end()) {
+            field.value = found->second;
+            field.present = true;
+        }
+        field.kind = kindOf(column, field.value);
+        list.push_back(std::move(field));
+    }
+}
+
+void RecordEditor::loadEmpty(const std::vector<ColumnInfo> &columns) {
+    std::map<std::string, std::string> values;
+    for (const auto &column : columns) {
+        values[column.name];
+    }
+    load(columns, values);
+}
+
+void RecordEditor::clear() { list.clear(); }
+
+bool RecordEditor::empty() const { return list.empty(); }
+
+std::vector<EditField> &RecordEditor::fields() { return list; }
+
+std::map<std::string, std::string> RecordEditor::values() const {
+    std::map<std::string, std::string> result;
+    for (const auto &field : list) {
+        if (field.present)
+            result[field.name] = field.value;
+    }
+    return result;
+}
+
+// по правилам родства типов SQLite; DATE и TIME - до NUMERIC
+EditField::Kind RecordEditor::kindOf(const ColumnInfo &column,
+                                     const std::string &value) {
+    if (value.size() > MultilineBytes ||
+        value.find('\n') != std::string::npos)
+        return EditField::Kind::Multiline;
+
+    std::string type = column.type;
+    for (auto &c : type)
+        c = (char)toupper((unsigned char)c);
+    auto has = [&](const char *part) {
+        return type.find(part) != std::string::npos;
+    };
+    if (has("INT"))
+        return EditField::Kind::Integer;
+    if (has("CHAR") || has("CLOB") || has("TEXT"))
+        return EditField::Kind::Text;
+    if (has("DATE") || has("TIME"))
+        return EditField::Kind::Date;
+    if (has("REAL") || has("FLOA") || has("DOUB") || has("NUM") ||
+        has("DEC"))
+        return EditField::Kind::Real;
+    return EditField::Kind::Text;
+}
+
+bool RecordEditor::validDate(const std::string &value) {
+    if (value.empty())
+        return true;
+    char *end = nullptr;
+    strtod(value.c_str(), &end);
+    if (end == value.c_str() + value.size())
+        return true;
+
+    size_t pos = 0;
+    if (!digits(value, pos, 4) || !expect(value, pos, '-') ||
+        !digits(value, pos, 2) || !expect(value, pos, '-') ||
+        !digits(value, pos, 2))
+        return false;
+    if (pos == value.size())
+        return true;
+    if (value[pos] != ' ' && value[pos] != 'T')
+        return false;
+    ++pos;
+    if (!digits(value, pos, 2) || !expect(value, pos, ':') ||
+        !digits(value, pos, 2))
+        return false;
+    if (pos < value.size() &&
+        (!expect(value, pos, ':') || !digits(value, pos, 2)))
+        return false;
+    if (pos < value.size() && !expect(value, pos, '.'))
+        return false;
+    while (pos < value.size() && isdigit((unsigned char)value[pos]))
+        ++pos;
+    return pos == value.size();
+}
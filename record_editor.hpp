@@ -0,0 +1,53 @@
+#pragma once
+
+#include "database.hpp"
+#include <map>
+#include <string>
+#include <vector>
+
+// Поле редактора записи; строки для виджетов готовятся при загрузке
+struct EditField {
+        enum class Kind { Text, Integer, Real, Date, Multiline };
+
+        std::string name;
+        // "имя (тип):" и идентификатор виджета "##имя"
+        std::string label;
+        std::string id;
+        // буфер InputText, растёт через ImGuiInputTextFlags_CallbackResize
+        std::string value;
+        Kind kind = Kind::Text;
+        // номер столбца в описании таблицы
+        size_t column = 0;
+        // значения нет в записи: большая ячейка или столбец вне вставки
+        bool present = false;
+};
+
+// Правка одной записи. Поля строятся один раз при выборе строки; в
+// кадре виджеты пишут прямо в EditField::value, поэтому без поиска по
+// map и без выделений памяти, пока значения не меняются.
+class RecordEditor {
+    public:
+        // более длинный текст правится многострочным полем
+        static constexpr size_t MultilineBytes = 120;
+
+        // пустой values - редактор закрыт
+        void load(const std::vector<ColumnInfo> &columns,
+                  const std::map<std::string, std::string> &values);
+        // новая запись: все столбцы пустые
+        void loadEmpty(const std::vector<ColumnInfo> &columns);
+        void clear();
+        bool empty() const;
+        std::vector<EditField> &fields();
+        // значения присутствующих полей для сохранения
+        std::map<std::string, std::string> values() const;
+
+        // редактор по объявленному типу столбца и текущему значению
+        static EditField::Kind kindOf(const ColumnInfo &column,
+                                      const std::string &value);
+        // пусто, число (unix-время, юлианский день) или
+        // ГГГГ-ММ-ДД[ ЧЧ:ММ[:СС[.ССС]]]
+        static bool validDate(const std::string &value);
+
+    private:
+        std::vector<EditField> list;
+};
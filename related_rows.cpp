@@ -0,0 +1,242 @@
+#include "related_rows.hpp"
+#include <algorithm>
+
+namespace {
+
+// ключ кэша: вид запроса, таблица, номер внешнего ключа и значения
+std::string cacheId(char kind, const std::string &table, size_t key,
+                    const std::vector<Value> &values) {
+    std::string id(1, kind);
+    id += table;
+    id += '\0';
+    id += std::to_string(key);
+    for (const auto &value : values) {
+        id += '\0';
+        id += (char)('0' + (int)value.type);
+        switch (value.type) {
+        case Value::Type::Null:
+            break;
+        case Value::Type::Integer:
+            id += std::to_string(value.integer);
+            break;
+        case Value::Type::Real:
+            id.append((const char *)&value.real, sizeof(value.real));
+            break;
+        case Value::Type::Text:
+        case Value::Type::Blob:
+            id += value.text;
+            break;
+        }
+    }
+    return id;
+}
+
+bool hasNull(const std::vector<Value> &values) {
+    for (const auto &value : values) {
+        if (value.type == Value::Type::Null)
+            return true;
+    }
+    return false;
+}
+
+std::string whereEqual(const std::vector<std::string> &columns) {
+    std::string where;
+    for (size_t i = 0; i < columns.size(); ++i) {
+        where += (i ? " AND " : " WHERE ") +
+                 Database::quoteIdentifier(columns[i]) + " = ?";
+    }
+    return where;
+}
+
+} // namespace
+
+void RelatedRows::open(QueryWorker &queryWorker) {
+    worker = &queryWorker;
+    clear();
+}
+
+void RelatedRows::setReadPool(ReadPool *pool) { readPool = pool; }
+
+void RelatedRows::clear() {
+    ++generation;
+    cache.clear();
+    pending.clear();
+}
+
+const RelatedRows::Link *
+RelatedRows::parent(const SchemaCatalog &catalog, const std::string &table,
+                    size_t key, const std::vector<Value> &values) {
+    const TableSchema *schema = catalog.find(table);
+    if (!schema || key >= schema->foreignKeys.size())
+        return nullptr;
+    const ForeignKeyInfo &foreign = schema->foreignKeys[key];
+    const TableSchema *target = catalog.find(foreign.table);
+    if (!target || values.size() != foreign.from.size())
+        return nullptr;
+
+    std::vector<std::string> keys;
+    if (target->withoutRowid)
+        keys = target->primaryKey;
+    else
+        keys.push_back("rowid");
+    std::vector<std::string> columns = targetColumns(*target, foreign);
+    return request(cacheId('p', table, key, values),
+                   [name = target->name, keys, columns,
+                    values](Database &db) {
+                       return findParent(db, name, keys, columns, values);
+                   });
+}
+
+const RelatedRows::Link *
+RelatedRows::children(const SchemaCatalog &catalog, const std::string &table,
+                      size_t key, const std::vector<Value> &values) {
+    const TableSchema *schema = catalog.find(table);
+    if (!schema || key >= schema->foreignKeys.size() ||
+        values.size() != schema->foreignKeys[key].from.size())
+        return nullptr;
+    return request(cacheId('c', table, key, values),
+                   [table, columns = schema->foreignKeys[key].from,
+                    values](Database &db) {
+                       return countChildren(db, table, columns, values);
+                   });
+}
+
+const RelatedRows::Link *
+RelatedRows::request(std::string id, std::function<Link(Database &)> work) {
+    auto found = cache.find(id);
+    if (found != cache.end())
+        return &found->second;
+    if (!worker || pending.count(id))
+        return nullptr;
+
+    uint64_t gen = generation;
+    pending[id] = gen;
+    auto done = [this, gen, id](Link link) {
+        if (gen != generation)
+            return;
+        pending.erase(id);
+        // отменённый запрос повторится при следующем обращении
+        if (!link.ready)
+            return;
+        if (cache.size() >= CacheEntries)
+            cache.clear();
+        cache[id] = std::move(link);
+    };
+    if (readPool)
+        readPool->submit(std::move(work), std::move(done));
+    else
+        worker->submit(std::move(work), std::move(done));
+    return nullptr;
+}
+
+std::vector<int>
+RelatedRows::columnKeys(const TableSchema &table,
+                        const std::vector<ColumnInfo> &columns) {
+    std::vector<int> keys(columns.size(), -1);
+    for (size_t key = 0; key < table.foreignKeys.size(); ++key) {
+        for (const auto &from : table.foreignKeys[key].from) {
+            for (size_t col = 0; col < columns.size(); ++col) {
+                if (columns[col].name == from && keys[col] < 0)
+                    keys[col] = (int)key;
+            }
+        }
+    }
+    return keys;
+}
+
+std::vector<RelatedRows::Reference>
+RelatedRows::references(const SchemaCatalog &catalog,
+                        const std::string &table) {
+    std::vector<Reference> result;
+    for (const auto &child : catalog.tables) {
+        for (size_t key = 0; key < child.foreignKeys.size(); ++key) {
+            if (child.foreignKeys[key].table == table)
+                result.push_back({child.name, key});
+        }
+    }
+    return result;
+}
+
+std::vector<std::string>
+RelatedRows::targetColumns(const TableSchema &parent,
+                           const ForeignKeyInfo &key) {
+    if (!key.to.empty())
+        return key.to;
+    // ссылка без списка столбцов - на первичный ключ; у таблицы без
+    // объявленного ключа это rowid
+    return parent.primaryKey.empty() ? std::vector<std::string>{"rowid"}
+                                     : parent.primaryKey;
+}
+
+bool RelatedRows::indexed(const TableSchema &table,
+                          const std::vector<std::string> &columns) {
+    for (const auto &index : table.indexes) {
+        if (index.partial || index.columns.size() < columns.size())
+            continue;
+        if (std::is_permutation(columns.begin(), columns.end(),
+                                index.columns.begin()))
+            return true;
+    }
+    return false;
+}
+
+RelatedRows::Link
+RelatedRows::findParent(Database &db, const std::string &table,
+                        const std::vector<std::string> &keys,
+                        const std::vector<std::string> &columns,
+                        const std::vector<Value> &values) {
+    Link link;
+    link.ready = true;
+    // NULL в ссылке не проверяется внешним ключом: родителя нет
+    if (hasNull(values))
+        return link;
+
+    std::string list;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        list += (keys[i] == "rowid" ? keys[i]
+                                    : Database::quoteIdentifier(keys[i])) +
+                ", ";
+    }
+    ResultSet row =
+        db.query("SELECT " + list + "* FROM " +
+                     Database::quoteIdentifier(table) + whereEqual(columns) +
+                     " LIMIT 1;",
+                 values, SummaryBytes);
+    // ошибка запроса - как отсутствующая строка, чтобы не повторять его
+    if (row.rowCount() == 0)
+        return link;
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+        link.key.push_back(row.getValue(0, i));
+    }
+    for (size_t col = keys.size();
+         col < row.columnCount() && link.summary.size() < SummaryBytes;
+         ++col) {
+        if (!link.summary.empty())
+            link.summary += ", ";
+        link.summary += row.columnName(col) + " = ";
+        link.summary += row.largeCell(0, col) ? "..." : row.getString(0, col);
+    }
+    if (link.summary.size() > SummaryBytes)
+        link.summary = link.summary.substr(0, SummaryBytes) + "...";
+    return link;
+}
+
+RelatedRows::Link
+RelatedRows::countChildren(Database &db, const std::string &table,
+                           const std::vector<std::string> &columns,
+                           const std::vector<Value> &values) {
+    Link link;
+    link.ready = true;
+    if (hasNull(values)) {
+        link.count = 0;
+        return link;
+    }
+    ResultSet count =
+        db.query("SELECT count(*) FROM " + Database::quoteIdentifier(table) +
+                     whereEqual(columns) + ";",
+                 values);
+    if (count.rowCount() == 1)
+        link.count = count.getValue(0, 0).integer;
+    return link;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "query_worker.hpp"
+#include "read_pool.hpp"
+#include "result_set.hpp"
+#include "schema_catalog.hpp"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Строки, связанные внешними ключами: родительская строка по ссылке и
+// число дочерних строк. Родитель ищется по своему ключу, который SQLite
+// требует уникальным, то есть индексированным; дочерние строки
+// считаются, только когда их число просят. Ответы кэшируются, поэтому
+// переход по ссылке, на которую уже навели курсор, мгновенный.
+class RelatedRows {
+    public:
+        static constexpr size_t CacheEntries = 512;
+        // подпись родительской строки в подсказке
+        static constexpr size_t SummaryBytes = 200;
+
+        struct Link {
+                bool ready = false;
+                // ключ родительской строки (rowid или первичный ключ, как у
+                // PagedTable); пуст, если строки нет
+                std::vector<Value> key;
+                std::string summary;
+                // число дочерних строк
+                int64_t count = -1;
+        };
+
+        // внешний ключ таблицы table на текущую: номер в её foreignKeys
+        struct Reference {
+                std::string table;
+                size_t key = 0;
+        };
+
+        void open(QueryWorker &queryWorker);
+        // nullptr - через QueryWorker, как у PagedTable::setReadPool
+        void setReadPool(ReadPool *pool);
+        // после правок и при смене базы: ответы прежних запросов
+        // отбрасываются
+        void clear();
+
+        // Строка родителя по внешнему ключу key таблицы table со
+        // значениями values столбцов key.from. Первое обращение ставит
+        // запрос в очередь; nullptr, пока ответа нет.
+        const Link *parent(const SchemaCatalog &catalog,
+                           const std::string &table, size_t key,
+                           const std::vector<Value> &values);
+        // число строк table, ссылающихся ключом key на values
+        const Link *children(const SchemaCatalog &catalog,
+                             const std::string &table, size_t key,
+                             const std::vector<Value> &values);
+
+        // номер внешнего ключа table для каждого столбца columns или -1
+        static std::vector<int>
+        columnKeys(const TableSchema &table,
+                   const std::vector<ColumnInfo> &columns);
+        // внешние ключи всех таблиц, ссылающиеся на table
+        static std::vector<Reference> references(const SchemaCatalog &catalog,
+                                                 const std::string &table);
+        // столбцы родителя, на которые указывает key
+        static std::vector<std::string>
+        targetColumns(const TableSchema &parent, const ForeignKeyInfo &key);
+        // есть индекс, начинающийся со столбцов columns
+        static bool indexed(const TableSchema &table,
+                            const std::vector<std::string> &columns);
+
+        static Link findParent(Database &db, const std::string &table,
+                               const std::vector<std::string> &keys,
+                               const std::vector<std::string> &columns,
+                               const std::vector<Value> &values);
+        static Link countChildren(Database &db, const std::string &table,
+                                  const std::vector<std::string> &columns,
+                                  const std::vector<Value> &values);
+
+    private:
+        const Link *request(std::string id,
+                            std::function<Link(Database &)> work);
+
+        QueryWorker *worker = nullptr;
+        ReadPool *readPool = nullptr;
+        std::unordered_map<std::string, Link> cache;
+        // запросы в очереди; ответ на снятый запрос отбрасывается
+        std::unordered_map<std::string, uint64_t> pending;
+        uint64_t generation = 0;
+};
@@ -0,0 +1,643 @@
+#include "result_set.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+size_t formatInt(int64_t value, ResultSet::NumberBuffer &buffer) {
+    int n = snprintf(buffer, sizeof(buffer), "%lld", (long long)value);
+    return n > 0 ? (size_t)n : 0;
+}
+
+// тот же формат, что у sqlite3_column_text
+size_t formatReal(double value, ResultSet::NumberBuffer &buffer) {
+    sqlite3_snprintf(sizeof(buffer), buffer, "%!.15g", value);
+    return strlen(buffer);
+}
+
+// длина начала текста для LargeCell: не больше PreviewBytes и по границе
+// символа UTF-8; size - сколько байт data доступно
+size_t previewLength(const char *data, size_t size) {
+    size_t preview = std::min(size, ResultSet::PreviewBytes);
+    while (preview > 0 && preview < size &&
+           ((unsigned char)data[preview] & 0xC0) == 0x80)
+        --preview;
+    return preview;
+}
+
+} // namespace
+
+Value Value::ofInteger(int64_t value) {
+    Value result;
+    result.type = Type::Integer;
+    result.integer = value;
+    return result;
+}
+
+Value Value::ofText(std::string value) {
+    Value result;
+    result.type = Type::Text;
+    result.text = std::move(value);
+    return result;
+}
+
+Value Value::fromColumn(sqlite3_stmt *stmt, int col) {
+    Value value;
+    switch (sqlite3_column_type(stmt, col)) {
+    case SQLITE_INTEGER:
+        value.type = Type::Integer;
+        value.integer = sqlite3_column_int64(stmt, col);
+        break;
+    case SQLITE_FLOAT:
+        value.type = Type::Real;
+        value.real = sqlite3_column_double(stmt, col);
+        break;
+    case SQLITE_TEXT:
+    case SQLITE_BLOB: {
+        value.type = sqlite3_column_type(stmt, col) == SQLITE_BLOB
+                         ? Type::Blob
+                         : Type::Text;
+        const char *data = (const char *)sqlite3_column_blob(stmt, col);
+        if (data)
+            value.text.assign(data, sqlite3_column_bytes(stmt, col));
+        break;
+    }
+    default:
+        break;
+    }
+    return value;
+}
+
+// Родство типа определяется по правилам SQLite (раздел 3.1 datatype3):
+// INTEGER и NUMERIC получают число, если текст целиком им является.
+Value Value::fromText(const std::string &text,
+                      const std::string &declaredType) {
+    std::string type;
+    for (char c : declaredType) {
+        type += (char)toupper((unsigned char)c);
+    }
+
+    bool textual = type.find("CHAR") != std::string::npos ||
+                   type.find("CLOB") != std::string::npos ||
+                   type.find("TEXT") != std::string::npos;
+    bool integer = type.find("INT") != std::string::npos;
+    bool blob = type.empty() || type.find("BLOB") != std::string::npos;
+
+    Value value;
+    value.type = Type::Text;
+    value.text = text;
+    if (text.empty() || (textual && !integer) || (blob && !integer))
+        return value;
+
+    const char *begin = text.c_str();
+    char *end = nullptr;
+    errno = 0;
+    long long asInt = strtoll(begin, &end, 10);
+    if (end && *end == '\0' && errno == 0 && !isspace((unsigned char)*begin)) {
+        value.type = Type::Integer;
+        value.integer = asInt;
+        value.text.clear();
+        return value;
+    }
+
+    double asReal = strtod(begin, &end);
+    if (end && *end == '\0' && !isspace((unsigned char)*begin)) {
+        value.type = Type::Real;
+        value.real = asReal;
+        value.text.clear();
+    }
+    return value;
+}
+
+int Value::bind(sqlite3_stmt *stmt, int index) const {
+    switch (type) {
+    case Type::Integer:
+        return sqlite3_bind_int64(stmt, index, integer);
+    case Type::Real:
+        return sqlite3_bind_double(stmt, index, real);
+    case Type::Text:
+        return sqlite3_bind_text(stmt, index, text.data(), (int)text.size(),
+                                 SQLITE_TRANSIENT);
+    case Type::Blob:
+        // пустой указатель sqlite3_bind_blob привязал бы NULL
+        if (text.empty())
+            return sqlite3_bind_zeroblob(stmt, index, 0);
+        return sqlite3_bind_blob(stmt, index, text.data(), (int)text.size(),
+                                 SQLITE_TRANSIENT);
+    default:
+        return sqlite3_bind_null(stmt, index);
+    }
+}
+
+int Value::compare(const Value &other) const {
+    auto rank = [](Type t) {
+        return t == Type::Null   ? 0
+               : t == Type::Text ? 2
+               : t == Type::Blob ? 3
+                                 : 1;
+    };
+    if (rank(type) != rank(other.type))
+        return rank(type) < rank(other.type) ? -1 : 1;
+
+    switch (type) {
+    case Type::Null:
+        return 0;
+    case Type::Text:
+    case Type::Blob: {
+        int order = text.compare(other.text);
+        return order < 0 ? -1 : order > 0;
+    }
+    default:
+        break;
+    }
+
+    if (type == Type::Integer && other.type == Type::Integer)
+        return integer < other.integer ? -1 : integer > other.integer;
+    double a = type == Type::Integer ? (double)integer : real;
+    double b = other.type == Type::Integer ? (double)other.integer : other.real;
+    return a < b ? -1 : a > b;
+}
+
+bool Value::operator==(const Value &other) const {
+    if (type != other.type)
+        return false;
+
+    switch (type) {
+    case Type::Integer:
+        return integer == other.integer;
+    case Type::Real:
+        return real == other.real;
+    case Type::Text:
+    case Type::Blob:
+        return text == other.text;
+    default:
+        return true;
+    }
+}
+
+bool Value::operator!=(const Value &other) const { return !(*this == other); }
+
+ResultSet::ResultSet(std::vector<std::string> columnNames) {
+    columns.resize(columnNames.size());
+    for (size_t i = 0; i < columnNames.size(); ++i) {
+        columns[i].name = std::move(columnNames[i]);
+    }
+}
+
+ResultSet::ResultSet(sqlite3_stmt *stmt,
+                     const std::vector<int> &sizeColumns) {
+    int count = sqlite3_column_count(stmt);
+    for (int i = 0; i < count; ++i) {
+        bool size = std::find(sizeColumns.begin(), sizeColumns.end(), i) !=
+                    sizeColumns.end();
+        if (size && !columns.empty()) {
+            sizes.back() = i;
+            continue;
+        }
+        const char *name = sqlite3_column_name(stmt, i);
+        columns.emplace_back();
+        columns.back().name = name ? name : "";
+        if (!sizeColumns.empty()) {
+            sources.push_back(i);
+            sizes.push_back(-1);
+        }
+    }
+}
+
+size_t ResultSet::rowCount() const { return rows; }
+
+size_t ResultSet::columnCount() const { return columns.size(); }
+
+bool ResultSet::empty() const { return rows == 0; }
+
+const std::string &ResultSet::columnName(size_t col) const {
+    return columns[col].name;
+}
+
+int ResultSet::columnIndex(const std::string &name) const {
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (columns[i].name == name)
+            return (int)i;
+    }
+    return -1;
+}
+
+ResultSet::ColumnType ResultSet::columnType(size_t col) const {
+    return columns[col].type;
+}
+
+bool ResultSet::isNull(size_t row, size_t col) const {
+    const auto &nulls = columns[col].nulls;
+    return (nulls[row / 64] >> (row % 64)) & 1;
+}
+
+int64_t ResultSet::getInt(size_t row, size_t col) const {
+    const Column &column = columns[col];
+    if (isNull(row, col))
+        return 0;
+
+    switch (column.type) {
+    case ColumnType::Integer:
+        return column.ints[row];
+    case ColumnType::Real:
+        return (int64_t)column.reals[row];
+    case ColumnType::Text:
+        return strtoll(arena.data() + column.offsets[row], nullptr, 10);
+    default:
+        return 0;
+    }
+}
+
+double ResultSet::getDouble(size_t row, size_t col) const {
+    const Column &column = columns[col];
+    if (isNull(row, col))
+        return 0.0;
+
+    switch (column.type) {
+    case ColumnType::Integer:
+        return (double)column.ints[row];
+    case ColumnType::Real:
+        return column.reals[row];
+    case ColumnType::Text:
+        return strtod(arena.data() + column.offsets[row], nullptr);
+    default:
+        return 0.0;
+    }
+}
+
+std::string_view ResultSet::getText(size_t row, size_t col,
+                                    NumberBuffer &buffer) const {
+    const Column &column = columns[col];
+    if (isNull(row, col))
+        return std::string_view("", 0);
+
+    switch (column.type) {
+    case ColumnType::Integer:
+        return std::string_view(buffer, formatInt(column.ints[row], buffer));
+    case ColumnType::Real:
+        return std::string_view(buffer, formatReal(column.reals[row], buffer));
+    case ColumnType::Text:
+        return std::string_view(arena.data() + column.offsets[row],
+                                column.lengths[row]);
+    default:
+        return std::string_view("", 0);
+    }
+}
+
+std::string ResultSet::getString(size_t row, size_t col) const {
+    NumberBuffer buffer;
+    return std::string(getText(row, col, buffer));
+}
+
+Value ResultSet::getValue(size_t row, size_t col) const {
+    const Column &column = columns[col];
+    Value value;
+    if (isNull(row, col))
+        return value;
+
+    switch (column.type) {
+    case ColumnType::Integer:
+        value.type = Value::Type::Integer;
+        value.integer = column.ints[row];
+        break;
+    case ColumnType::Real:
+        value.type = Value::Type::Real;
+        value.real = column.reals[row];
+        break;
+    case ColumnType::Text:
+        // число из смешанного столбца возвращается числом, чтобы ключи
+        // и якоря сравнивались так же, как в SQLite
+        if (!column.kinds.empty() &&
+            column.kinds[row] == (uint8_t)ColumnType::Integer) {
+            value.type = Value::Type::Integer;
+            value.integer = getInt(row, col);
+        } else if (!column.kinds.empty() &&
+                   column.kinds[row] == (uint8_t)ColumnType::Real) {
+            value.type = Value::Type::Real;
+            value.real = getDouble(row, col);
+        } else {
+            value.type = !column.kinds.empty() &&
+                                 column.kinds[row] == (uint8_t)ColumnType::Blob
+                             ? Value::Type::Blob
+                             : Value::Type::Text;
+            value.text.assign(arena.data() + column.offsets[row],
+                              column.lengths[row]);
+        }
+        break;
+    default:
+        break;
+    }
+    return value;
+}
+
+std::map<std::string, std::string> ResultSet::rowValues(size_t row) const {
+    std::map<std::string, std::string> values;
+    for (size_t col = 0; col < columns.size(); ++col) {
+        values[columns[col].name] = getString(row, col);
+    }
+    return values;
+}
+
+void ResultSet::setLargeCellLimit(size_t bytes) { largeLimit = bytes; }
+
+size_t ResultSet::largeCellLimit() const { return largeLimit; }
+
+const ResultSet::LargeCell *ResultSet::largeCell(size_t row,
+                                                 size_t col) const {
+    const auto &large = columns[col].large;
+    if (large.empty())
+        return nullptr;
+    auto found = large.find(row);
+    return found == large.end() ? nullptr : &found->second;
+}
+
+void ResultSet::appendRow(sqlite3_stmt *stmt) {
+    for (size_t c = 0; c < columns.size(); ++c) {
+        Column &column = columns[c];
+        int i = sources.empty() ? (int)c : sources[c];
+        if (column.nulls.size() * 64 <= rows)
+            column.nulls.push_back(0);
+
+        switch (sqlite3_column_type(stmt, i)) {
+        case SQLITE_INTEGER:
+            appendInt(column, sqlite3_column_int64(stmt, i));
+            break;
+        case SQLITE_FLOAT:
+            appendReal(column, sqlite3_column_double(stmt, i));
+            break;
+        case SQLITE_TEXT: {
+            const char *text = (const char *)sqlite3_column_text(stmt, i);
+            size_t size = sqlite3_column_bytes(stmt, i);
+            // пришло только начало, полный размер - в столбце размера
+            int bytes = sizes.empty() ? -1 : sizes[c];
+            if (bytes >= 0 && sqlite3_column_type(stmt, bytes) != SQLITE_NULL)
+                appendLarge(column, text, previewLength(text, size),
+                            {(uint64_t)sqlite3_column_int64(stmt, bytes),
+                             false});
+            else if (largeLimit && size > largeLimit)
+                appendLarge(column, text, previewLength(text, size),
+                            {size, false});
+            else
+                appendText(column, text, size);
+            break;
+        }
+        case SQLITE_BLOB: {
+            // размер известен без чтения: zeroblob() из запроса PagedTable
+            // не разворачивается, пока не вызван sqlite3_column_blob
+            size_t size = sqlite3_column_bytes(stmt, i);
+            if (largeLimit && size > largeLimit) {
+                appendLarge(column, nullptr, 0, {size, true});
+                break;
+            }
+            const char *blob = (const char *)sqlite3_column_blob(stmt, i);
+            appendBlob(column, blob, sqlite3_column_bytes(stmt, i));
+            break;
+        }
+        default:
+            appendNull(column);
+            break;
+        }
+    }
+    ++rows;
+}
+
+void ResultSet::appendRow(const ResultSet &source, size_t row) {
+    for (size_t i = 0; i < columns.size(); ++i) {
+        Column &column = columns[i];
+        const Column &from = source.columns[i];
+        if (column.nulls.size() * 64 <= rows)
+            column.nulls.push_back(0);
+
+        if (source.isNull(row, i)) {
+            appendNull(column);
+            continue;
+        }
+        if (const LargeCell *cell = source.largeCell(row, i)) {
+            appendLarge(column, source.arena.data() + from.offsets[row],
+                        from.lengths[row], *cell);
+            continue;
+        }
+        ColumnType type = from.type;
+        if (!from.kinds.empty())
+            type = (ColumnType)from.kinds[row];
+        bool blob = type == ColumnType::Blob;
+        if ((type == ColumnType::Text || blob) && largeLimit &&
+            from.lengths[row] > largeLimit) {
+            const char *data = source.arena.data() + from.offsets[row];
+            appendLarge(column, data,
+                        blob ? 0 : previewLength(data, from.lengths[row]),
+                        {from.lengths[row], blob});
+            continue;
+        }
+        switch (type) {
+        case ColumnType::Integer:
+            appendInt(column, source.getInt(row, i));
+            break;
+        case ColumnType::Real:
+            appendReal(column, source.getDouble(row, i));
+            break;
+        case ColumnType::Text:
+            appendText(column, source.arena.data() + from.offsets[row],
+                       from.lengths[row]);
+            break;
+        case ColumnType::Blob:
+            appendBlob(column, source.arena.data() + from.offsets[row],
+                       from.lengths[row]);
+            break;
+        default:
+            appendNull(column);
+            break;
+        }
+    }
+    ++rows;
+}
+
+void ResultSet::appendRow(const std::vector<Value> &values) {
+    for (size_t i = 0; i < columns.size(); ++i) {
+        Column &column = columns[i];
+        if (column.nulls.size() * 64 <= rows)
+            column.nulls.push_back(0);
+
+        const Value *value = i < values.size() ? &values[i] : nullptr;
+        switch (value ? value->type : Value::Type::Null) {
+        case Value::Type::Integer:
+            appendInt(column, value->integer);
+            break;
+        case Value::Type::Real:
+            appendReal(column, value->real);
+            break;
+        case Value::Type::Text:
+            appendText(column, value->text.data(), value->text.size());
+            break;
+        case Value::Type::Blob:
+            appendBlob(column, value->text.data(), value->text.size());
+            break;
+        default:
+            appendNull(column);
+            break;
+        }
+    }
+    ++rows;
+}
+
+void ResultSet::clear() {
+    for (auto &column : columns) {
+        std::string name = std::move(column.name);
+        column = Column();
+        column.name = std::move(name);
+    }
+    arena.clear();
+    rows = 0;
+}
+
+size_t ResultSet::memoryUsage() const {
+    size_t bytes = arena.capacity() + columns.capacity() * sizeof(Column);
+    for (const auto &column : columns) {
+        bytes += column.name.capacity();
+        bytes += column.ints.capacity() * sizeof(int64_t);
+        bytes += column.reals.capacity() * sizeof(double);
+        bytes += column.offsets.capacity() * sizeof(uint64_t);
+        bytes += column.lengths.capacity() * sizeof(uint32_t);
+        bytes += column.nulls.capacity() * sizeof(uint64_t);
+        bytes += column.kinds.capacity();
+        bytes += column.large.size() * (sizeof(size_t) + sizeof(LargeCell));
+    }
+    return bytes;
+}
+
+void ResultSet::appendNull(Column &column) {
+    column.nulls[rows / 64] |= uint64_t(1) << (rows % 64);
+
+    switch (column.type) {
+    case ColumnType::Integer:
+        column.ints.push_back(0);
+        break;
+    case ColumnType::Real:
+        column.reals.push_back(0.0);
+        break;
+    case ColumnType::Text:
+        column.offsets.push_back(0);
+        column.lengths.push_back(0);
+        markKind(column, ColumnType::Null);
+        break;
+    default:
+        break;
+    }
+}
+
+// Числовые массивы хранят только однородные столбцы; смешанные целые и
+// дробные значения переводят столбец в текст, чтобы "5" не стало "5.0".
+void ResultSet::appendInt(Column &column, int64_t value) {
+    if (column.type == ColumnType::Null)
+        promote(column, ColumnType::Integer);
+    else if (column.type == ColumnType::Real)
+        promote(column, ColumnType::Text);
+
+    if (column.type == ColumnType::Integer) {
+        column.ints.push_back(value);
+    } else {
+        NumberBuffer buffer;
+        storeText(column, buffer, formatInt(value, buffer));
+        markKind(column, ColumnType::Integer);
+    }
+}
+
+void ResultSet::appendReal(Column &column, double value) {
+    if (column.type == ColumnType::Null)
+        promote(column, ColumnType::Real);
+    else if (column.type == ColumnType::Integer)
+        promote(column, ColumnType::Text);
+
+    if (column.type == ColumnType::Real) {
+        column.reals.push_back(value);
+    } else {
+        NumberBuffer buffer;
+        storeText(column, buffer, formatReal(value, buffer));
+        markKind(column, ColumnType::Real);
+    }
+}
+
+void ResultSet::appendText(Column &column, const char *data, size_t size) {
+    if (column.type != ColumnType::Text)
+        promote(column, ColumnType::Text);
+    storeText(column, data, size);
+    markKind(column, ColumnType::Text);
+}
+
+void ResultSet::appendBlob(Column &column, const char *data, size_t size) {
+    if (column.type != ColumnType::Text)
+        promote(column, ColumnType::Text);
+    storeText(column, data, size);
+    markKind(column, ColumnType::Blob);
+}
+
+// Смена типа столбца при первом несовпадающем значении: все уже
+// сохранённые ячейки (их ровно rows) переносятся в новое хранилище.
+void ResultSet::promote(Column &column, ColumnType type) {
+    if (column.type == ColumnType::Null) {
+        switch (type) {
+        case ColumnType::Integer:
+            column.ints.assign(rows, 0);
+            break;
+        case ColumnType::Real:
+            column.reals.assign(rows, 0.0);
+            break;
+        case ColumnType::Text:
+            column.offsets.assign(rows, 0);
+            column.lengths.assign(rows, 0);
+            break;
+        default:
+            break;
+        }
+    } else if (type == ColumnType::Text) {
+        ColumnType previous = column.type;
+        column.type = ColumnType::Text;
+        for (size_t row = 0; row < rows; ++row) {
+            if ((column.nulls[row / 64] >> (row % 64)) & 1) {
+                column.offsets.push_back(0);
+                column.lengths.push_back(0);
+                continue;
+            }
+            NumberBuffer buffer;
+            size_t size = previous == ColumnType::Integer
+                              ? formatInt(column.ints[row], buffer)
+                              : formatReal(column.reals[row], buffer);
+            storeText(column, buffer, size);
+        }
+        std::vector<int64_t>().swap(column.ints);
+        std::vector<double>().swap(column.reals);
+        column.kinds.assign(rows, (uint8_t)previous);
+    }
+    column.type = type;
+}
+
+// тип запоминается только после первого числа или BLOB в столбце текста
+void ResultSet::markKind(Column &column, ColumnType type) {
+    if (column.kinds.empty()) {
+        if (type == ColumnType::Text || type == ColumnType::Null)
+            return;
+        column.kinds.assign(rows, (uint8_t)ColumnType::Text);
+    }
+    column.kinds.push_back((uint8_t)type);
+}
+
+void ResultSet::appendLarge(Column &column, const char *data, size_t size,
+                            LargeCell cell) {
+    if (cell.blob)
+        appendBlob(column, data, size);
+    else
+        appendText(column, data, size);
+    column.large[rows] = cell;
+}
+
+void ResultSet::storeText(Column &column, const char *data, size_t size) {
+    column.offsets.push_back(arena.size());
+    column.lengths.push_back((uint32_t)size);
+    if (size)
+        arena.append(data, size);
+    arena.push_back('\0');
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <sqlite3.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Отдельное значение ячейки: ключи строк, параметры запросов. Байты
+// BLOB хранятся в text, но тип остаётся Blob и привязывается как BLOB.
+struct Value {
+        enum class Type { Null, Integer, Real, Text, Blob };
+
+        Type type = Type::Null;
+        int64_t integer = 0;
+        double real = 0.0;
+        std::string text;
+
+        static Value ofInteger(int64_t value);
+        static Value ofText(std::string value);
+        static Value fromColumn(sqlite3_stmt *stmt, int col);
+        // значение из текста редактора с учётом объявленного типа столбца
+        static Value fromText(const std::string &text,
+                              const std::string &declaredType);
+        int bind(sqlite3_stmt *stmt, int index) const;
+        // порядок SQLite: NULL, числа, текст (побайтно, как BINARY), BLOB
+        int compare(const Value &other) const;
+        bool operator==(const Value &other) const;
+        bool operator!=(const Value &other) const;
+};
+
+// Результат запроса в колоночном виде: общий заголовок с именами столбцов,
+// числа хранятся в непрерывных массивах, строки - в одной общей арене.
+class ResultSet {
+    public:
+        // Blob бывает только в kinds: BLOB хранится в текстовом столбце
+        enum class ColumnType { Null, Integer, Real, Text, Blob };
+
+        // буфер для текстового представления числовых ячеек
+        using NumberBuffer = char[32];
+
+        // Ячейка больше предела хранится ссылкой: в арене только начало
+        // текста (у BLOB - ничего), здесь - полный размер. Значение
+        // целиком читается Database::readCell по ключу строки.
+        struct LargeCell {
+                uint64_t bytes = 0;
+                bool blob = false;
+        };
+        static constexpr size_t PreviewBytes = 256;
+
+        ResultSet() = default;
+        explicit ResultSet(std::vector<std::string> columnNames);
+        // sizeColumns - номера столбцов запроса, которые в результат не
+        // входят: это полный размер предыдущей ячейки, в которой пришло
+        // только начало текста. Такая ячейка хранится как LargeCell.
+        explicit ResultSet(sqlite3_stmt *stmt,
+                           const std::vector<int> &sizeColumns = {});
+
+        size_t rowCount() const;
+        size_t columnCount() const;
+        bool empty() const;
+
+        const std::string &columnName(size_t col) const;
+        int columnIndex(const std::string &name) const;
+        ColumnType columnType(size_t col) const;
+
+        bool isNull(size_t row, size_t col) const;
+        int64_t getInt(size_t row, size_t col) const;
+        double getDouble(size_t row, size_t col) const;
+        // возвращаемая строка всегда завершается нулём
+        std::string_view getText(size_t row, size_t col,
+                                 NumberBuffer &buffer) const;
+        std::string getString(size_t row, size_t col) const;
+        Value getValue(size_t row, size_t col) const;
+        std::map<std::string, std::string> rowValues(size_t row) const;
+
+        // предел размера ячейки для следующих строк; 0 - без предела
+        void setLargeCellLimit(size_t bytes);
+        size_t largeCellLimit() const;
+        // nullptr, если ячейка хранится целиком
+        const LargeCell *largeCell(size_t row, size_t col) const;
+
+        // добавляет текущую строку подготовленного запроса
+        void appendRow(sqlite3_stmt *stmt);
+        // копирует строку другого результата с тем же набором столбцов
+        void appendRow(const ResultSet &source, size_t row);
+        // строка из отдельных значений, по одному на столбец
+        void appendRow(const std::vector<Value> &values);
+        void clear();
+
+        size_t memoryUsage() const;
+
+    private:
+        struct Column {
+                std::string name;
+                ColumnType type = ColumnType::Null;
+                std::vector<int64_t> ints;
+                std::vector<double> reals;
+                std::vector<uint64_t> offsets;
+                std::vector<uint32_t> lengths;
+                std::vector<uint64_t> nulls;
+                // исходные типы ячеек смешанного столбца, хранимого
+                // текстом; пуст, пока в нём только строки (не BLOB)
+                std::vector<uint8_t> kinds;
+                // строка -> размер ячейки, сохранённой ссылкой
+                std::unordered_map<size_t, LargeCell> large;
+        };
+
+        void appendNull(Column &column);
+        void appendInt(Column &column, int64_t value);
+        void appendReal(Column &column, double value);
+        void appendText(Column &column, const char *data, size_t size);
+        void appendBlob(Column &column, const char *data, size_t size);
+        void promote(Column &column, ColumnType type);
+        void markKind(Column &column, ColumnType type);
+        void storeText(Column &column, const char *data, size_t size);
+        // data - уже обрезанное начало значения длиной size
+        void appendLarge(Column &column, const char *data, size_t size,
+                         LargeCell cell);
+
+        std::vector<Column> columns;
+        // номер столбца запроса для каждого столбца и столбца с его
+        // размером (-1 - нет); пусты, если размеров в запросе нет
+        std::vector<int> sources;
+        std::vector<int> sizes;
+        std::string arena;
+        size_t rows = 0;
+        size_t largeLimit = 0;
+};
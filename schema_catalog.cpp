@@ -0,0 +1,216 @@
+#include "schema_catalog.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+namespace {
+
+std::string columnText(sqlite3_stmt *stmt, int col) {
+    const char *text = (const char *)sqlite3_column_text(stmt, col);
+    return text ? text : "";
+}
+
+// запасной путь для SQLite без pragma_table_list (до 3.37)
+bool declaresWithoutRowid(std::string sql) {
+    for (auto &c : sql)
+        c = (char)toupper((unsigned char)c);
+    size_t without = sql.rfind("WITHOUT");
+    return without != std::string::npos &&
+           sql.find("ROWID", without) != std::string::npos;
+}
+
+} // namespace
+
+const ColumnInfo *TableSchema::column(const std::string &name) const {
+    for (const auto &col : columns) {
+        if (col.name == name)
+            return &col;
+    }
+    return nullptr;
+}
+
+std::shared_ptr<const SchemaCatalog> SchemaCatalog::load(Database &db,
+                                                         int version) {
+    auto catalog = std::make_shared<SchemaCatalog>();
+    catalog->version = version;
+
+    db.stream("SELECT name FROM sqlite_master WHERE type = 'table' "
+              "ORDER BY rowid;",
+              {}, [&](sqlite3_stmt *stmt) {
+                  TableSchema table;
+                  table.name = columnText(stmt, 0);
+                  catalog->byName[table.name] = catalog->tables.size();
+                  catalog->tables.push_back(std::move(table));
+                  return true;
+              });
+
+    catalog->loadColumns(db);
+    catalog->loadRowid(db);
+    catalog->loadIndexes(db);
+    catalog->loadForeignKeys(db);
+    catalog->loadRowEstimates(db);
+    return catalog;
+}
+
+const TableSchema *SchemaCatalog::find(const std::string &name) const {
+    auto it = byName.find(name);
+    return it == byName.end() ? nullptr : &tables[it->second];
+}
+
+TableSchema *SchemaCatalog::findMutable(const std::string &name) {
+    auto it = byName.find(name);
+    return it == byName.end() ? nullptr : &tables[it->second];
+}
+
+void SchemaCatalog::loadColumns(Database &db) {
+    // позиция столбца в первичном ключе -> имя
+    std::vector<std::pair<int, std::string>> key;
+    TableSchema *table = nullptr;
+    auto finishKey = [&]() {
+        if (!table)
+            return;
+        std::sort(key.begin(), key.end());
+        for (auto &pair : key)
+            table->primaryKey.push_back(std::move(pair.second));
+        key.clear();
+    };
+
+    db.stream("SELECT m.name, p.name, p.type, p.\"notnull\", p.pk "
+              "FROM sqlite_master AS m JOIN pragma_table_info(m.name) AS p "
+              "WHERE m.type = 'table' ORDER BY m.rowid, p.cid;",
+              {}, [&](sqlite3_stmt *stmt) {
+                  std::string name = columnText(stmt, 0);
+                  if (!table || table->name != name) {
+                      finishKey();
+                      table = findMutable(name);
+                      if (!table)
+                          return true;
+                  }
+
+                  ColumnInfo col;
+                  col.name = columnText(stmt, 1);
+                  col.type = columnText(stmt, 2);
+                  col.not_null = sqlite3_column_int(stmt, 3) == 1;
+                  int pk = sqlite3_column_int(stmt, 4);
+                  col.primary_key = pk > 0;
+                  if (pk > 0)
+                      key.emplace_back(pk, col.name);
+                  table->columns.push_back(std::move(col));
+                  return true;
+              });
+    finishKey();
+}
+
+void SchemaCatalog::loadRowid(Database &db) {
+    if (sqlite3_libversion_number() >= 3037000) {
+        db.stream("SELECT name, wr FROM pragma_table_list "
+                  "WHERE schema = 'main' AND type = 'table';",
+                  {}, [&](sqlite3_stmt *stmt) {
+                      if (TableSchema *table =
+                              findMutable(columnText(stmt, 0)))
+                          table->withoutRowid = sqlite3_column_int(stmt, 1);
+                      return true;
+                  });
+        return;
+    }
+
+    db.stream("SELECT name, sql FROM sqlite_master WHERE type = 'table';", {},
+              [&](sqlite3_stmt *stmt) {
+                  if (TableSchema *table = findMutable(columnText(stmt, 0)))
+                      table->withoutRowid =
+                          declaresWithoutRowid(columnText(stmt, 1));
+                  return true;
+              });
+}
+
+void SchemaCatalog::loadIndexes(Database &db) {
+    TableSchema *table = nullptr;
+    db.stream("SELECT m.name, l.name, l.\"unique\", l.origin, l.partial, "
+              "i.name FROM sqlite_master AS m "
+              "JOIN pragma_index_list(m.name) AS l "
+              "JOIN pragma_index_info(l.name) AS i "
+              "WHERE m.type = 'table' ORDER BY m.rowid, l.name, i.seqno;",
+              {}, [&](sqlite3_stmt *stmt) {
+                  std::string name = columnText(stmt, 0);
+                  if (!table || table->name != name)
+                      table = findMutable(name);
+                  if (!table)
+                      return true;
+
+                  std::string index = columnText(stmt, 1);
+                  if (table->indexes.empty() ||
+                      table->indexes.back().name != index) {
+                      IndexInfo info;
+                      info.name = index;
+                      info.unique = sqlite3_column_int(stmt, 2) != 0;
+                      info.origin = columnText(stmt, 3);
+                      info.partial = sqlite3_column_int(stmt, 4) != 0;
+                      table->indexes.push_back(std::move(info));
+                  }
+                  table->indexes.back().columns.push_back(
+                      columnText(stmt, 5));
+                  return true;
+              });
+}
+
+void SchemaCatalog::loadForeignKeys(Database &db) {
+    TableSchema *table = nullptr;
+    int id = -1;
+    db.stream("SELECT m.name, f.id, f.\"table\", f.\"from\", f.\"to\", "
+              "f.on_update, f.on_delete FROM sqlite_master AS m "
+              "JOIN pragma_foreign_key_list(m.name) AS f "
+              "WHERE m.type = 'table' ORDER BY m.rowid, f.id, f.seq;",
+              {}, [&](sqlite3_stmt *stmt) {
+                  std::string name = columnText(stmt, 0);
+                  if (!table || table->name != name) {
+                      table = findMutable(name);
+                      id = -1;
+                  }
+                  if (!table)
+                      return true;
+
+                  if (sqlite3_column_int(stmt, 1) != id) {
+                      id = sqlite3_column_int(stmt, 1);
+                      ForeignKeyInfo info;
+                      info.table = columnText(stmt, 2);
+                      info.onUpdate = columnText(stmt, 5);
+                      info.onDelete = columnText(stmt, 6);
+                      table->foreignKeys.push_back(std::move(info));
+                  }
+                  auto &key = table->foreignKeys.back();
+                  key.from.push_back(columnText(stmt, 3));
+                  if (sqlite3_column_type(stmt, 4) != SQLITE_NULL)
+                      key.to.push_back(columnText(stmt, 4));
+                  return true;
+              });
+}
+
+// Точный count(*) - полный проход по таблице, поэтому берётся оценка:
+// первое число из sqlite_stat1 после ANALYZE, иначе max(rowid), который
+// читается спуском по B-дереву.
+void SchemaCatalog::loadRowEstimates(Database &db) {
+    if (find("sqlite_stat1")) {
+        db.stream("SELECT tbl, stat FROM sqlite_stat1;", {},
+                  [&](sqlite3_stmt *stmt) {
+                      TableSchema *table = findMutable(columnText(stmt, 0));
+                      if (table) {
+                          int64_t rows =
+                              strtoll(columnText(stmt, 1).c_str(), nullptr, 10);
+                          table->rowEstimate =
+                              std::max(table->rowEstimate, rows);
+                      }
+                      return true;
+                  });
+    }
+
+    for (auto &table : tables) {
+        if (table.rowEstimate >= 0 || table.withoutRowid)
+            continue;
+        db.stream("SELECT max(rowid) FROM " +
+                      Database::quoteIdentifier(table.name) + ";",
+                  {}, [&](sqlite3_stmt *stmt) {
+                      table.rowEstimate = sqlite3_column_int64(stmt, 0);
+                      return false;
+                  });
+    }
+}
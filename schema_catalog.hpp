@@ -0,0 +1,66 @@
+#pragma once
+
+#include "database.hpp"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct IndexInfo {
+        std::string name;
+        // "c" - CREATE INDEX, "u" - UNIQUE, "pk" - PRIMARY KEY
+        std::string origin;
+        bool unique = false;
+        bool partial = false;
+        // пустое имя - выражение
+        std::vector<std::string> columns;
+};
+
+struct ForeignKeyInfo {
+        std::string table;
+        std::vector<std::string> from;
+        // пустой список - ссылка на первичный ключ родительской таблицы
+        std::vector<std::string> to;
+        std::string onUpdate;
+        std::string onDelete;
+};
+
+struct TableSchema {
+        std::string name;
+        bool withoutRowid = false;
+        std::vector<ColumnInfo> columns;
+        // столбцы первичного ключа в порядке объявления
+        std::vector<std::string> primaryKey;
+        std::vector<IndexInfo> indexes;
+        std::vector<ForeignKeyInfo> foreignKeys;
+        // по sqlite_stat1 или max(rowid); -1, если оценки нет
+        int64_t rowEstimate = -1;
+
+        const ColumnInfo *column(const std::string &name) const;
+};
+
+// Снимок схемы базы: таблицы, столбцы, индексы и внешние ключи читаются
+// несколькими запросами к табличным функциям pragma_* сразу для всех
+// таблиц. Снимок неизменяем, поэтому его можно отдать в поток интерфейса;
+// устаревание определяется по PRAGMA schema_version.
+class SchemaCatalog {
+    public:
+        static std::shared_ptr<const SchemaCatalog> load(Database &db,
+                                                         int version);
+
+        const TableSchema *find(const std::string &name) const;
+
+        int version = -1;
+        // в порядке sqlite_master
+        std::vector<TableSchema> tables;
+
+    private:
+        void loadColumns(Database &db);
+        void loadRowid(Database &db);
+        void loadIndexes(Database &db);
+        void loadForeignKeys(Database &db);
+        void loadRowEstimates(Database &db);
+        TableSchema *findMutable(const std::string &name);
+
+        std::unordered_map<std::string, size_t> byName;
+};
@@ -0,0 +1,149 @@
+#include "snapshot.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+std::atomic<unsigned> replicas{0};
+
+// транзакция чтения, открытая до конца копирования
+bool beginRead(sqlite3 *db) {
+    return sqlite3_exec(db,
+                        "BEGIN; SELECT count(*) FROM sqlite_master;",
+                        nullptr, nullptr, nullptr) == SQLITE_OK;
+}
+
+} // namespace
+
+Snapshot::Snapshot(std::string source, Target target)
+    : sourcePath(std::move(source)), kind(target) {
+    std::string file = "database_editor_snapshot_" +
+                       std::to_string(getpid()) + "_" +
+                       std::to_string(replicas.fetch_add(1)) + ".db";
+    // Память - файл в tmpfs: его, в отличие от memdb, читают и worker, и
+    // соединения пула, а заголовок правится обычной записью
+    std::error_code ec;
+    std::filesystem::path dir = "/dev/shm";
+    if (kind != Target::Memory || !std::filesystem::is_directory(dir, ec))
+        dir = std::filesystem::temp_directory_path(ec);
+    name = (dir / file).string();
+}
+
+Snapshot::~Snapshot() {
+    if (holder)
+        sqlite3_close(holder);
+    std::remove(name.c_str());
+    std::remove((name + "-journal").c_str());
+}
+
+bool Snapshot::copy(TaskProgress &progress) {
+    if (sqlite3_open_v2(name.c_str(), &holder,
+                        SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+                        nullptr) != SQLITE_OK) {
+        progress.setError(sqlite3_errmsg(holder));
+        return false;
+    }
+    // копия не переживает сбоя, журнал и fsync ей не нужны
+    sqlite3_exec(holder,
+                 "PRAGMA journal_mode = OFF; PRAGMA synchronous = OFF;",
+                 nullptr, nullptr, nullptr);
+
+    sqlite3 *source = nullptr;
+    if (sqlite3_open_v2(sourcePath.c_str(), &source, SQLITE_OPEN_READONLY,
+                        nullptr) != SQLITE_OK) {
+        progress.setError(sqlite3_errmsg(source));
+        sqlite3_close(source);
+        return false;
+    }
+    sqlite3_busy_timeout(source, BusyTimeoutMs);
+
+    // В WAL читатель не мешает писателю: копия идёт в одной транзакции
+    // чтения и видит согласованный снимок без перезапусков. В режиме
+    // журнала блокировка берётся на шаг; если писатель раз за разом
+    // сбрасывает копию, после MaxRestarts она доводится в одной
+    // транзакции, и писатель ждёт её конца.
+    bool wal = false;
+    sqlite3_stmt *mode = nullptr;
+    if (sqlite3_prepare_v2(source, "PRAGMA journal_mode;", -1, &mode,
+                           nullptr) == SQLITE_OK &&
+        sqlite3_step(mode) == SQLITE_ROW) {
+        const char *text = (const char *)sqlite3_column_text(mode, 0);
+        wal = text && std::string(text) == "wal";
+    }
+    sqlite3_finalize(mode);
+    bool reading = wal && beginRead(source);
+
+    sqlite3_backup *backup =
+        sqlite3_backup_init(holder, "main", source, "main");
+    if (!backup) {
+        progress.setError(sqlite3_errmsg(holder));
+        sqlite3_close(source);
+        return false;
+    }
+
+    int rc = SQLITE_OK;
+    int restarts = 0;
+    uint64_t copied = 0;
+    while (!progress.cancelled) {
+        auto start = std::chrono::steady_clock::now();
+        rc = sqlite3_backup_step(backup, StepPages);
+        int total = sqlite3_backup_pagecount(backup);
+        progress.total = (uint64_t)total;
+        progress.done = (uint64_t)(total - sqlite3_backup_remaining(backup));
+        progress.rows = progress.done.load();
+        if (rc != SQLITE_OK && rc != SQLITE_BUSY && rc != SQLITE_LOCKED)
+            break;
+        // шаг не продвинул копию - она начата заново: источник изменился
+        // между шагами
+        if (rc == SQLITE_OK && progress.done <= copied &&
+            ++restarts >= MaxRestarts && !reading)
+            reading = beginRead(source);
+        copied = progress.done;
+        auto pause = std::max<std::chrono::steady_clock::duration>(
+            std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(MinPauseMs));
+        std::this_thread::sleep_for(pause);
+    }
+    sqlite3_backup_finish(backup);
+    if (reading)
+        sqlite3_exec(source, "COMMIT;", nullptr, nullptr, nullptr);
+    if (rc != SQLITE_DONE && !progress.cancelled)
+        progress.setError(sqlite3_errstr(rc));
+    sqlite3_close(source);
+    if (rc != SQLITE_DONE)
+        return false;
+    if (!clearWal()) {
+        progress.setError("не удалось изменить заголовок копии");
+        return false;
+    }
+    return true;
+}
+
+// Байты 18-19 заголовка (версии записи и чтения) копия берёт у
+// источника. У копии WAL-базы там 2, и соединение только для чтения
+// не открыло бы её без -wal и -shm. Копия переводится в режим журнала
+// правкой этих байтов.
+bool Snapshot::clearWal() {
+    const unsigned char journal[2] = {1, 1};
+    FILE *file = fopen(name.c_str(), "r+b");
+    if (!file)
+        return false;
+    unsigned char version[2] = {0, 0};
+    bool ok = fseek(file, 18, SEEK_SET) == 0 &&
+              fread(version, 1, sizeof(version), file) == sizeof(version);
+    if (ok && version[0] == 2)
+        ok = fseek(file, 18, SEEK_SET) == 0 &&
+             fwrite(journal, 1, sizeof(journal), file) == sizeof(journal);
+    return fclose(file) == 0 && ok;
+}
+
+const std::string &Snapshot::source() const { return sourcePath; }
+
+const std::string &Snapshot::replica() const { return name; }
+
+Snapshot::Target Snapshot::target() const { return kind; }
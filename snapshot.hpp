@@ -0,0 +1,48 @@
+#pragma once
+
+#include "task_progress.hpp"
+#include <sqlite3.h>
+#include <string>
+
+// Копия базы, которую редактор просматривает вместо живого файла: чтения
+// не борются за блокировки с процессом, который в него пишет. Страницы
+// копируются sqlite3_backup_step по StepPages; блокировка чтения
+// источника держится только на время шага, после шага поток спит не
+// меньше, чем шаг длился, - писатель успевает зафиксировать транзакцию.
+class Snapshot {
+    public:
+        // Memory - файл в /dev/shm (tmpfs), если он есть
+        enum class Target { Memory, TempFile };
+
+        static constexpr int StepPages = 256;
+        static constexpr int MinPauseMs = 2;
+        // ожидание блокировки источника на шаге
+        static constexpr int BusyTimeoutMs = 1000;
+        static constexpr int MaxRestarts = 3;
+
+        Snapshot(std::string source, Target target);
+        // файл реплики удаляется; открытые с ним соединения читают его
+        // до закрытия
+        ~Snapshot();
+
+        Snapshot(const Snapshot &) = delete;
+        Snapshot &operator=(const Snapshot &) = delete;
+
+        // Копирует источник целиком; done/total - страницы. Вызывается в
+        // своём потоке, прерывается progress.cancelled.
+        bool copy(TaskProgress &progress);
+
+        const std::string &source() const;
+        // имя для Database::open(..., OpenProfile::Snapshot)
+        const std::string &replica() const;
+        Target target() const;
+
+    private:
+        bool clearWal();
+
+        std::string sourcePath;
+        std::string name;
+        Target kind;
+        // соединение-владелец реплики, в него же пишет backup
+        sqlite3 *holder = nullptr;
+};
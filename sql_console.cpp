@@ -0,0 +1,240 @@
+#include "sql_console.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+
+namespace {
+
+std::string escapeLine(const std::string &text) {
+    std::string line;
+    for (char c : text) {
+        if (c == '\\')
+            line += "\\\\";
+        else if (c == '\n')
+            line += "\\n";
+        else if (c == '\r')
+            line += "\\r";
+        else
+            line += c;
+    }
+    return line;
+}
+
+std::string unescapeLine(const std::string &line) {
+    std::string text;
+    for (size_t i = 0; i < line.size(); ++i) {
+        if (line[i] != '\\' || i + 1 == line.size()) {
+            text += line[i];
+            continue;
+        }
+        char c = line[++i];
+        text += c == 'n' ? '\n' : c == 'r' ? '\r' : c;
+    }
+    return text;
+}
+
+} // namespace
+
+SqlConsole::SqlConsole(std::string sqlText, bool onlyPlan,
+                       TaskProgress &taskProgress)
+    : sql(std::move(sqlText)), planOnly(onlyPlan), progress(taskProgress) {}
+
+bool SqlConsole::run(Database &db) {
+    const char *next = sql.c_str();
+    while (*next && !progress.cancelled) {
+        sqlite3_stmt *stmt = nullptr;
+        const char *tail = nullptr;
+        size_t index;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            index = done.size();
+            done.emplace_back();
+        }
+        StatementStats stats;
+        if (!db.prepare(next, &stmt, &tail)) {
+            stats.sql = next;
+            stats.error = db.errorMessage();
+        } else if (!stmt) {
+            // в хвосте только пробелы и комментарии
+            std::lock_guard<std::mutex> lock(mutex);
+            done.pop_back();
+            break;
+        } else {
+            next = tail;
+            stats.sql = sqlite3_sql(stmt);
+            stats.sql.erase(0, stats.sql.find_first_not_of(" \t\r\n"));
+            // у EXPLAIN своего плана нет
+            if (!sqlite3_stmt_isexplain(stmt))
+                stats.plan = explain(db, stats.sql);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                done[index].sql = stats.sql;
+                done[index].plan = stats.plan;
+            }
+            if (!planOnly)
+                runStatement(db, stmt, stats);
+            sqlite3_finalize(stmt);
+        }
+
+        stats.finished = true;
+        bool ok = stats.error.empty();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done[index] = std::move(stats);
+        }
+        progress.done++;
+        if (!ok)
+            return false;
+    }
+    return !progress.cancelled;
+}
+
+bool SqlConsole::runStatement(Database &db, sqlite3_stmt *stmt,
+                              StatementStats &stats) {
+    if (sqlite3_column_count(stmt) > 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        fresh = ResultSet(stmt);
+        fresh.setLargeCellLimit(LargeCellBytes);
+        ++result;
+        cut = false;
+    }
+    stats.writes = !sqlite3_stmt_readonly(stmt);
+
+    auto start = std::chrono::steady_clock::now();
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (progress.cancelled)
+            break;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stats.rows == MaxRows) {
+            cut = true;
+            rc = SQLITE_DONE;
+            break;
+        }
+        fresh.appendRow(stmt);
+        ++stats.rows;
+        ++progress.rows;
+    }
+    stats.seconds = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+    stats.fullscanSteps =
+        sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0);
+    stats.sorts = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 0);
+    stats.autoindexes =
+        sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 0);
+    stats.vmSteps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 0);
+
+    if (progress.cancelled) {
+        stats.error = "выполнение прервано";
+        return false;
+    }
+    if (rc != SQLITE_DONE) {
+        stats.error = db.errorMessage();
+        return false;
+    }
+    if (stats.writes)
+        stats.changes = db.changes();
+    return true;
+}
+
+void SqlConsole::take(ResultSet &rows) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (taken != result) {
+        // начался результат следующего оператора
+        std::vector<std::string> names;
+        for (size_t col = 0; col < fresh.columnCount(); ++col) {
+            names.push_back(fresh.columnName(col));
+        }
+        rows = std::move(fresh);
+        fresh = ResultSet(std::move(names));
+        fresh.setLargeCellLimit(LargeCellBytes);
+        taken = result;
+        return;
+    }
+    for (size_t row = 0; row < fresh.rowCount(); ++row) {
+        rows.appendRow(fresh, row);
+    }
+    fresh.clear();
+}
+
+std::vector<StatementStats> SqlConsole::statements() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return done;
+}
+
+bool SqlConsole::truncated() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return cut;
+}
+
+bool SqlConsole::wrote() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::any_of(done.begin(), done.end(),
+                       [](const StatementStats &stats) {
+                           return stats.writes;
+                       });
+}
+
+std::vector<PlanNode> SqlConsole::explain(Database &db,
+                                          const std::string &sql) {
+    std::vector<PlanNode> plan;
+    ResultSet rows = db.query("EXPLAIN QUERY PLAN " + sql);
+    // столбцы: id, parent, notused, detail
+    if (rows.columnCount() < 4)
+        return plan;
+    for (size_t row = 0; row < rows.rowCount(); ++row) {
+        PlanNode node;
+        node.id = (int)rows.getInt(row, 0);
+        node.parent = (int)rows.getInt(row, 1);
+        node.detail = rows.getString(row, 3);
+        plan.push_back(std::move(node));
+    }
+    return plan;
+}
+
+std::string SqlHistory::defaultPath() {
+    const char *home = getenv("HOME");
+    if (home && *home)
+        return std::string(home) + "/.database_editor_history";
+    return "database_editor_history.txt";
+}
+
+void SqlHistory::load(const std::string &file) {
+    path = file;
+    list.clear();
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty())
+            list.push_back(unescapeLine(line));
+    }
+    if (list.size() > MaxEntries)
+        list.erase(list.begin(), list.end() - MaxEntries);
+}
+
+void SqlHistory::add(const std::string &sql) {
+    size_t end = sql.find_last_not_of(" \t\r\n;");
+    if (end == std::string::npos)
+        return;
+    std::string entry = sql.substr(0, end + 1);
+
+    list.erase(std::remove(list.begin(), list.end(), entry), list.end());
+    list.push_back(std::move(entry));
+    if (list.size() > MaxEntries)
+        list.erase(list.begin());
+    save();
+}
+
+const std::vector<std::string> &SqlHistory::entries() const { return list; }
+
+bool SqlHistory::save() const {
+    if (path.empty())
+        return false;
+    std::ofstream out(path, std::ios::trunc);
+    for (const auto &entry : list) {
+        out << escapeLine(entry) << '\n';
+    }
+    return (bool)out;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "database.hpp"
+#include "result_set.hpp"
+#include "task_progress.hpp"
+#include <mutex>
+#include <string>
+#include <vector>
+
+// строка EXPLAIN QUERY PLAN: узел дерева и его родитель
+struct PlanNode {
+        int id = 0;
+        int parent = 0;
+        std::string detail;
+};
+
+// Итог одного оператора скрипта. Счётчики - sqlite3_stmt_status:
+// шаги полного просмотра, сортировки без индекса, автоиндексы.
+struct StatementStats {
+        std::string sql;
+        std::vector<PlanNode> plan;
+        double seconds = 0;
+        uint64_t rows = 0;
+        int changes = 0;
+        int fullscanSteps = 0;
+        int sorts = 0;
+        int autoindexes = 0;
+        int vmSteps = 0;
+        // изменил базу или схему
+        bool writes = false;
+        bool finished = false;
+        std::string error;
+};
+
+// Произвольный SQL из консоли. Скрипт выполняется в потоке базы
+// оператор за оператором; строки результата копятся в буфере, и
+// интерфейс забирает их take() каждый кадр, не дожидаясь конца запроса.
+// Перед каждым оператором снимается EXPLAIN QUERY PLAN.
+class SqlConsole {
+    public:
+        // больше строк не читается: результат обрезается
+        static constexpr size_t MaxRows = 1000000;
+        // ячейки больше этого хранятся ссылкой, как в PagedTable
+        static constexpr size_t LargeCellBytes = 4096;
+
+        // planOnly - только план, без выполнения
+        SqlConsole(std::string sql, bool planOnly, TaskProgress &progress);
+
+        // в потоке базы; false - ошибка или отмена, остальные операторы
+        // не выполняются
+        bool run(Database &db);
+
+        // Дописывает в rows строки, пришедшие после прошлого вызова.
+        // Если начался результат следующего оператора, rows заменяется.
+        void take(ResultSet &rows);
+        std::vector<StatementStats> statements() const;
+        bool truncated() const;
+        // изменил ли скрипт базу или схему
+        bool wrote() const;
+
+        static std::vector<PlanNode> explain(Database &db,
+                                             const std::string &sql);
+
+    private:
+        bool runStatement(Database &db, sqlite3_stmt *stmt,
+                          StatementStats &stats);
+
+        std::string sql;
+        bool planOnly;
+        TaskProgress &progress;
+
+        mutable std::mutex mutex;
+        std::vector<StatementStats> done;
+        // строки текущего результата, ещё не забранные take()
+        ResultSet fresh;
+        uint64_t result = 0;
+        uint64_t taken = 0;
+        bool cut = false;
+};
+
+// История запросов консоли в файле: по записи в строке, перевод строки
+// и обратная косая черта экранируются. Повтор поднимает запись наверх.
+class SqlHistory {
+    public:
+        static constexpr size_t MaxEntries = 200;
+
+        // ~/.database_editor_history или файл в текущем каталоге
+        static std::string defaultPath();
+
+        void load(const std::string &path);
+        void add(const std::string &sql);
+        // новые в конце
+        const std::vector<std::string> &entries() const;
+
+    private:
+        bool save() const;
+
+        std::string path;
+        std::vector<std::string> list;
+};
@@ -0,0 +1,266 @@
+#include "table_diff.hpp"
+#include "schema_catalog.hpp"
+#include <algorithm>
+
+namespace {
+
+// FNV-1a: хеш не криптографический, а лишь отличающий строки
+const uint64_t FnvOffset = 14695981039346656037ull;
+const uint64_t FnvPrime = 1099511628211ull;
+
+uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * FnvPrime;
+    }
+    return hash;
+}
+
+// тип входит в хеш: 1 и '1' - разные значения
+uint64_t hashColumn(uint64_t hash, sqlite3_stmt *stmt, int col) {
+    unsigned char type = (unsigned char)sqlite3_column_type(stmt, col);
+    hash = hashBytes(hash, &type, 1);
+    switch (type) {
+    case SQLITE_INTEGER: {
+        int64_t value = sqlite3_column_int64(stmt, col);
+        return hashBytes(hash, &value, sizeof(value));
+    }
+    case SQLITE_FLOAT: {
+        double value = sqlite3_column_double(stmt, col);
+        return hashBytes(hash, &value, sizeof(value));
+    }
+    case SQLITE_TEXT:
+    case SQLITE_BLOB: {
+        const void *data = type == SQLITE_TEXT
+                               ? (const void *)sqlite3_column_text(stmt, col)
+                               : sqlite3_column_blob(stmt, col);
+        uint64_t size = (uint64_t)sqlite3_column_bytes(stmt, col);
+        hash = hashBytes(hash, &size, sizeof(size));
+        return hashBytes(hash, data, (size_t)size);
+    }
+    default:
+        return hash;
+    }
+}
+
+// порядок ключей как в ORDER BY
+int compareKeys(const std::vector<Value> &a, const std::vector<Value> &b) {
+    for (size_t i = 0; i < a.size() && i < b.size(); ++i) {
+        int order = a[i].compare(b[i]);
+        if (order != 0)
+            return order;
+    }
+    return 0;
+}
+
+// В отличие от Database::rowKeyColumns первичный ключ важнее rowid:
+// rowid одной и той же строки в двух базах может различаться.
+std::vector<std::string> tableKeys(const TableSchema &table) {
+    if (!table.primaryKey.empty())
+        return table.primaryKey;
+    return table.withoutRowid ? std::vector<std::string>()
+                              : std::vector<std::string>{"rowid"};
+}
+
+} // namespace
+
+TableDiff::TableDiff(DiffOptions diffOptions, TaskProgress &taskProgress)
+    : options(std::move(diffOptions)), progress(taskProgress) {}
+
+bool TableDiff::run() {
+    if (!prepare())
+        return false;
+
+    Cursor a;
+    Cursor b;
+    bool ok = open(left, a) && open(right, b);
+    ok = ok && step(left, a) && step(right, b);
+    uint64_t count = 0;
+    while (ok && (a.row || b.row)) {
+        if ((++count & 1023) == 0 && progress.cancelled) {
+            ok = false;
+            break;
+        }
+
+        int order = !a.row   ? 1
+                    : !b.row ? -1
+                             : compareKeys(a.key, b.key);
+        if (order < 0) {
+            add(Kind::Removed, a.key);
+            ok = step(left, a);
+            ++progress.done;
+        } else if (order > 0) {
+            add(Kind::Added, b.key);
+            ok = step(right, b);
+        } else {
+            if (a.digest != b.digest) {
+                add(Kind::Changed, a.key);
+            } else {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++counts.same;
+            }
+            ok = step(left, a) && step(right, b);
+            ++progress.done;
+        }
+        ++progress.rows;
+    }
+    sqlite3_finalize(a.stmt);
+    sqlite3_finalize(b.stmt);
+    return ok;
+}
+
+// Ключ и столбцы: ключ - первичный ключ или rowid, одинаковый с обеих
+// сторон; сравниваются общие по имени столбцы.
+bool TableDiff::prepare() {
+    if (!left.open(options.leftPath, options.leftProfile) ||
+        !right.open(options.rightPath, OpenProfile::Reader)) {
+        progress.setError("Не удалось открыть базу");
+        return false;
+    }
+    auto leftCatalog = left.catalog();
+    auto rightCatalog = right.catalog();
+    const TableSchema *a = leftCatalog ? leftCatalog->find(options.table)
+                                       : nullptr;
+    const TableSchema *b = rightCatalog ? rightCatalog->find(options.table)
+                                        : nullptr;
+    if (!a || !b) {
+        progress.setError("Таблицы " + options.table + " нет в " +
+                          (a ? "другой базе" : "текущей базе"));
+        return false;
+    }
+    keys = tableKeys(*a);
+    if (keys.empty() || keys != tableKeys(*b)) {
+        progress.setError("У таблиц разные первичные ключи");
+        return false;
+    }
+
+    DiffSummary summary;
+    summary.keys = keys;
+    for (const auto &col : a->columns) {
+        if (std::find(keys.begin(), keys.end(), col.name) != keys.end())
+            continue;
+        if (b->column(col.name))
+            summary.columns.push_back(col.name);
+        else
+            summary.leftOnly.push_back(col.name);
+    }
+    for (const auto &col : b->columns) {
+        if (!a->column(col.name))
+            summary.rightOnly.push_back(col.name);
+    }
+    columns = summary.columns;
+
+    std::vector<std::string> names = {"__diff"};
+    names.insert(names.end(), keys.begin(), keys.end());
+    std::lock_guard<std::mutex> lock(mutex);
+    counts = std::move(summary);
+    fresh = ResultSet(names);
+    progress.total = (uint64_t)std::max<int64_t>(a->rowEstimate, 0);
+    return true;
+}
+
+// ORDER BY с BINARY: слияние сравнивает ключи побайтно (Value::compare),
+// а своя сортировка ключа (NOCASE и т.п.) развела бы стороны
+std::string TableDiff::select(const std::string &list) const {
+    std::string columns;
+    std::string order;
+    for (const auto &key : keys) {
+        columns += (columns.empty() ? "" : ", ") + Database::keyExpression(key);
+        order += (order.empty() ? "" : ", ") + Database::keyExpression(key) +
+                 " COLLATE BINARY";
+    }
+    return "SELECT " + columns + list + " FROM " +
+           Database::quoteIdentifier(options.table) + " ORDER BY " + order +
+           ";";
+}
+
+bool TableDiff::open(Database &db, Cursor &cursor) {
+    std::string list;
+    for (const auto &column : columns) {
+        list += ", " + Database::quoteIdentifier(column);
+    }
+    std::string sql = select(list);
+    if (!db.prepare(sql.c_str(), &cursor.stmt, nullptr) || !cursor.stmt) {
+        progress.setError(db.errorMessage());
+        return false;
+    }
+    return true;
+}
+
+// следующая строка: ключ в Value, остальное сразу в хеш
+bool TableDiff::step(Database &db, Cursor &cursor) {
+    int rc = sqlite3_step(cursor.stmt);
+    cursor.row = rc == SQLITE_ROW;
+    if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+        progress.setError(db.errorMessage());
+        return false;
+    }
+    if (!cursor.row)
+        return true;
+
+    cursor.key.resize(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        cursor.key[i] = Value::fromColumn(cursor.stmt, (int)i);
+    }
+    uint64_t hash = FnvOffset;
+    for (size_t i = 0; i < columns.size(); ++i) {
+        hash = hashColumn(hash, cursor.stmt, (int)(keys.size() + i));
+    }
+    cursor.digest = hash;
+    return true;
+}
+
+void TableDiff::add(Kind kind, const std::vector<Value> &key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    switch (kind) {
+    case Kind::Changed:
+        ++counts.changed;
+        break;
+    case Kind::Added:
+        ++counts.added;
+        break;
+    case Kind::Removed:
+        ++counts.removed;
+        break;
+    }
+    if (stored >= MaxRows) {
+        counts.truncated = true;
+        return;
+    }
+    std::vector<Value> row = {Value::ofInteger((int64_t)kind)};
+    row.insert(row.end(), key.begin(), key.end());
+    fresh.appendRow(row);
+    ++stored;
+}
+
+void TableDiff::take(ResultSet &rows) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (fresh.rowCount() == 0)
+        return;
+    if (rows.columnCount() == 0) {
+        rows = fresh;
+    } else {
+        for (size_t row = 0; row < fresh.rowCount(); ++row) {
+            rows.appendRow(fresh, row);
+        }
+    }
+    fresh.clear();
+}
+
+DiffSummary TableDiff::summary() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counts;
+}
+
+std::pair<ResultSet, ResultSet>
+TableDiff::rows(const std::vector<Value> &key) {
+    std::string where;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        where += (i ? " AND " : " WHERE ") +
+                 Database::keyExpression(keys[i]) + " IS ?";
+    }
+    std::string sql = "SELECT * FROM " +
+                      Database::quoteIdentifier(options.table) + where + ";";
+    return {left.query(sql, key, LargeCellBytes),
+            right.query(sql, key, LargeCellBytes)};
+}
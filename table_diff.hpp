@@ -0,0 +1,88 @@
+#pragma once
+
+#include "database.hpp"
+#include "result_set.hpp"
+#include "task_progress.hpp"
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct DiffOptions {
+        // левая база - открытая в редакторе (или её снимок), правая -
+        // другой файл
+        std::string leftPath;
+        OpenProfile leftProfile = OpenProfile::Reader;
+        std::string rightPath;
+        std::string table;
+};
+
+struct DiffSummary {
+        // rowid или первичный ключ, общий для обеих сторон
+        std::vector<std::string> keys;
+        // сравниваемые столбцы и те, что есть только с одной стороны
+        std::vector<std::string> columns;
+        std::vector<std::string> leftOnly;
+        std::vector<std::string> rightOnly;
+        uint64_t same = 0;
+        uint64_t changed = 0;
+        uint64_t added = 0;
+        uint64_t removed = 0;
+        bool truncated = false;
+};
+
+// Построчное сравнение таблицы в двух базах на своих соединениях. Обе
+// стороны читаются одним проходом в порядке ключа и сливаются, как при
+// сортировке слиянием; от строки в памяти остаются только ключ и 64-битный
+// хеш остальных столбцов, считанный прямо из sqlite3_column_*. Память
+// ограничена списком различий: после MaxRows он обрезается, счёт идёт
+// дальше. Интерфейс забирает различия take() каждый кадр.
+class TableDiff {
+    public:
+        enum class Kind { Changed, Added, Removed };
+        static constexpr size_t MaxRows = 1000000;
+        // ячейки больше этого в строках для просмотра хранятся ссылкой
+        static constexpr size_t LargeCellBytes = 4096;
+
+        TableDiff(DiffOptions options, TaskProgress &progress);
+
+        // в своём потоке; false - ошибка (в progress) или отмена
+        bool run();
+        // Дописывает в rows различия, найденные после прошлого вызова:
+        // столбец "__diff" (Kind), затем ключ.
+        void take(ResultSet &rows);
+        DiffSummary summary() const;
+
+        // Обе строки с ключом key целиком, для показа разницы по
+        // столбцам. После run(), не параллельно с ним; интерфейс
+        // вызывает его в потоке worker.
+        std::pair<ResultSet, ResultSet> rows(const std::vector<Value> &key);
+
+    private:
+        // сторона слияния: текущая строка запроса, её ключ и хеш
+        struct Cursor {
+                sqlite3_stmt *stmt = nullptr;
+                bool row = false;
+                std::vector<Value> key;
+                uint64_t digest = 0;
+        };
+
+        bool prepare();
+        bool open(Database &db, Cursor &cursor);
+        bool step(Database &db, Cursor &cursor);
+        void add(Kind kind, const std::vector<Value> &key);
+        std::string select(const std::string &columns) const;
+
+        DiffOptions options;
+        TaskProgress &progress;
+        Database left;
+        Database right;
+        std::vector<std::string> keys;
+        std::vector<std::string> columns;
+
+        mutable std::mutex mutex;
+        DiffSummary counts;
+        // различия, ещё не забранные take()
+        ResultSet fresh;
+        size_t stored = 0;
+};
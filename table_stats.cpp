@@ -0,0 +1,501 @@
+#include "table_stats.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// хэш значения ячейки; 1 и 1.0 для SQLite одно значение, хэш тоже один
+uint64_t hashCell(sqlite3_stmt *stmt, int col, int type) {
+    if (type == SQLITE_INTEGER)
+        return mix((uint64_t)sqlite3_column_int64(stmt, col));
+    if (type == SQLITE_FLOAT) {
+        double value = sqlite3_column_double(stmt, col);
+        if (value == (double)(int64_t)value)
+            return mix((uint64_t)(int64_t)value);
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return mix(bits ^ 0x9e3779b97f4a7c15ULL);
+    }
+
+    // FNV-1a по байтам текста или BLOB
+    const unsigned char *data =
+        type == SQLITE_BLOB
+            ? (const unsigned char *)sqlite3_column_blob(stmt, col)
+            : sqlite3_column_text(stmt, col);
+    int size = sqlite3_column_bytes(stmt, col);
+    uint64_t h = type == SQLITE_BLOB ? 0x84222325cbf29ce4ULL
+                                     : 0xcbf29ce484222325ULL;
+    for (int i = 0; i < size; ++i) {
+        h ^= data[i];
+        h *= 0x100000001b3ULL;
+    }
+    return mix(h);
+}
+
+// сравнение ячейки с уже найденным (не NULL) значением без копирования;
+// порядок классов как в SQLite: числа, текст, BLOB
+int compareCell(sqlite3_stmt *stmt, int col, int type, const Value &value) {
+    int cellRank = type == SQLITE_TEXT ? 1 : type == SQLITE_BLOB ? 2 : 0;
+    int valueRank = value.type == Value::Type::Text   ? 1
+                    : value.type == Value::Type::Blob ? 2
+                                                      : 0;
+    if (cellRank != valueRank)
+        return cellRank < valueRank ? -1 : 1;
+
+    if (cellRank) {
+        const void *data = type == SQLITE_BLOB
+                               ? sqlite3_column_blob(stmt, col)
+                               : sqlite3_column_text(stmt, col);
+        size_t size = (size_t)sqlite3_column_bytes(stmt, col);
+        int order = memcmp(data, value.text.data(),
+                           std::min(size, value.text.size()));
+        if (order)
+            return order < 0 ? -1 : 1;
+        return size < value.text.size() ? -1 : size > value.text.size();
+    }
+
+    if (type == SQLITE_INTEGER && value.type == Value::Type::Integer) {
+        int64_t cell = sqlite3_column_int64(stmt, col);
+        return cell < value.integer ? -1 : cell > value.integer;
+    }
+    double cell = sqlite3_column_double(stmt, col);
+    double other = value.type == Value::Type::Integer ? (double)value.integer
+                                                      : value.real;
+    return cell < other ? -1 : cell > other;
+}
+
+// значение для TopValues: текст и BLOB обрезаются до MaxText байт
+Value shortValue(sqlite3_stmt *stmt, int col, int type) {
+    if (type != SQLITE_TEXT && type != SQLITE_BLOB)
+        return Value::fromColumn(stmt, col);
+    Value value;
+    value.type = type == SQLITE_BLOB ? Value::Type::Blob : Value::Type::Text;
+    const char *data = (const char *)sqlite3_column_blob(stmt, col);
+    size_t size = (size_t)sqlite3_column_bytes(stmt, col);
+    if (data)
+        value.text.assign(data, std::min(size, TopValues::MaxText));
+    return value;
+}
+
+} // namespace
+
+HyperLogLog::HyperLogLog() : registers(size_t(1) << Precision, 0) {}
+
+void HyperLogLog::add(uint64_t hash) {
+    size_t index = (size_t)(hash >> (64 - Precision));
+    // ранг - позиция первой единицы в оставшихся битах; граничный бит
+    // не даёт clz получить ноль
+    uint64_t rest = (hash << Precision) | (uint64_t(1) << (Precision - 1));
+    uint8_t rank = (uint8_t)(__builtin_clzll(rest) + 1);
+    if (rank > registers[index])
+        registers[index] = rank;
+}
+
+void HyperLogLog::merge(const HyperLogLog &other) {
+    for (size_t i = 0; i < registers.size(); ++i) {
+        registers[i] = std::max(registers[i], other.registers[i]);
+    }
+}
+
+uint64_t HyperLogLog::estimate() const {
+    double m = (double)registers.size();
+    double sum = 0;
+    size_t zeros = 0;
+    for (uint8_t rank : registers) {
+        sum += std::ldexp(1.0, -rank);
+        zeros += rank == 0;
+    }
+    double estimate = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+    // на малых числах точнее linear counting по пустым регистрам
+    if (estimate <= 2.5 * m && zeros)
+        estimate = m * std::log(m / (double)zeros);
+    return (uint64_t)std::llround(estimate);
+}
+
+void StreamingHistogram::add(double value) {
+    if (!std::isfinite(value))
+        return;
+    if (bins.empty() && pending.empty())
+        low = high = value;
+    low = std::min(low, value);
+    high = std::max(high, value);
+    pending.push_back(value);
+    if (pending.size() >= Batch)
+        flush();
+}
+
+// пачка сортируется и сразу сводится к MaxBins центрам по равному числу
+// значений, так что compress() сливает не больше 2 * MaxBins центров
+void StreamingHistogram::flush() {
+    if (pending.empty())
+        return;
+
+    std::sort(pending.begin(), pending.end());
+    size_t count = pending.size();
+    size_t groups = std::min(MaxBins, count);
+    for (size_t group = 0; group < groups; ++group) {
+        size_t from = group * count / groups;
+        size_t to = (group + 1) * count / groups;
+        double sum = 0;
+        for (size_t i = from; i < to; ++i) {
+            sum += pending[i];
+        }
+        bins.push_back({sum / (double)(to - from), to - from});
+    }
+    pending.clear();
+    compress();
+}
+
+void StreamingHistogram::compress() {
+    std::sort(bins.begin(), bins.end(), [](const Bin &a, const Bin &b) {
+        return a.center < b.center;
+    });
+    while (bins.size() > MaxBins) {
+        size_t nearest = 0;
+        for (size_t i = 1; i + 1 < bins.size(); ++i) {
+            if (bins[i + 1].center - bins[i].center <
+                bins[nearest + 1].center - bins[nearest].center)
+                nearest = i;
+        }
+        Bin &a = bins[nearest];
+        const Bin &b = bins[nearest + 1];
+        uint64_t count = a.count + b.count;
+        a.center = (a.center * (double)a.count + b.center * (double)b.count) /
+                   (double)count;
+        a.count = count;
+        bins.erase(bins.begin() + (long)nearest + 1);
+    }
+}
+
+void StreamingHistogram::merge(StreamingHistogram &other) {
+    flush();
+    other.flush();
+    if (other.bins.empty())
+        return;
+    if (bins.empty()) {
+        low = other.low;
+        high = other.high;
+    }
+    low = std::min(low, other.low);
+    high = std::max(high, other.high);
+    bins.insert(bins.end(), other.bins.begin(), other.bins.end());
+    compress();
+}
+
+std::vector<float> StreamingHistogram::uniform(size_t buckets, double &min,
+                                               double &max) const {
+    min = low;
+    max = high;
+    if (bins.empty() || buckets == 0)
+        return {};
+
+    std::vector<float> counts(buckets, 0.0f);
+    double width = (high - low) / (double)buckets;
+    for (const auto &bin : bins) {
+        size_t index = width > 0 ? (size_t)((bin.center - low) / width) : 0;
+        counts[std::min(index, buckets - 1)] += (float)bin.count;
+    }
+    return counts;
+}
+
+TopValues::TopValues() : filter(FilterSize, 0) {}
+
+void TopValues::add(uint64_t hash, sqlite3_stmt *stmt, int col) {
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        if (hashes[i] == hash) {
+            ++entries[i].count;
+            if (i == rare)
+                findRare();
+            return;
+        }
+    }
+
+    int type = sqlite3_column_type(stmt, col);
+    if (entries.size() < Capacity) {
+        hashes.push_back(hash);
+        entries.push_back({shortValue(stmt, col, type), 1, 0});
+        findRare();
+        return;
+    }
+
+    uint64_t &seen = filter[hash % FilterSize];
+    if (seen + 1 <= entries[rare].count) {
+        ++seen;
+        return;
+    }
+    // вытесненное значение оставляет свой счёт в фильтре
+    filter[hashes[rare] % FilterSize] = entries[rare].count;
+    hashes[rare] = hash;
+    entries[rare] = {shortValue(stmt, col, type), seen + 1, seen};
+    findRare();
+}
+
+void TopValues::findRare() {
+    rare = 0;
+    for (size_t i = 1; i < entries.size(); ++i) {
+        if (entries[i].count < entries[rare].count)
+            rare = i;
+    }
+}
+
+// счётчики одинаковых значений складываются, лишние редкие отбрасываются
+void TopValues::merge(const TopValues &other) {
+    for (size_t i = 0; i < FilterSize; ++i) {
+        filter[i] += other.filter[i];
+    }
+    for (size_t i = 0; i < other.hashes.size(); ++i) {
+        auto same = std::find(hashes.begin(), hashes.end(), other.hashes[i]);
+        if (same == hashes.end()) {
+            hashes.push_back(other.hashes[i]);
+            entries.push_back(other.entries[i]);
+        } else {
+            Entry &entry = entries[(size_t)(same - hashes.begin())];
+            entry.count += other.entries[i].count;
+            entry.error += other.entries[i].error;
+        }
+    }
+
+    if (entries.size() > Capacity) {
+        std::vector<size_t> order(entries.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return entries[a].count > entries[b].count;
+        });
+        order.resize(Capacity);
+        std::vector<uint64_t> keptHashes;
+        std::vector<Entry> kept;
+        for (size_t i : order) {
+            keptHashes.push_back(hashes[i]);
+            kept.push_back(std::move(entries[i]));
+        }
+        hashes.swap(keptHashes);
+        entries.swap(kept);
+    }
+    findRare();
+}
+
+std::vector<TopValues::Entry> TopValues::top(size_t n) const {
+    std::vector<Entry> sorted = entries;
+    std::sort(sorted.begin(), sorted.end(),
+              [](const Entry &a, const Entry &b) { return a.count > b.count; });
+    if (sorted.size() > n)
+        sorted.resize(n);
+    return sorted;
+}
+
+struct TableStatsCollector::Partial {
+        uint64_t rows = 0;
+        std::vector<uint64_t> nulls;
+        std::vector<HyperLogLog> distinct;
+        std::vector<StreamingHistogram> histograms;
+        std::vector<TopValues> top;
+        std::vector<Value> min;
+        std::vector<Value> max;
+};
+
+TableStatsCollector::TableStatsCollector(std::string table,
+                                         TaskProgress &progress)
+    : table(std::move(table)),
+      progress(progress) {}
+
+TableStatsCollector::~TableStatsCollector() = default;
+
+TableStatsCollector::Partial TableStatsCollector::makePartial() const {
+    Partial partial;
+    size_t count = names.size();
+    partial.nulls.assign(count, 0);
+    partial.distinct.assign(count, HyperLogLog());
+    partial.histograms.assign(count, StreamingHistogram());
+    partial.top.assign(count, TopValues());
+    partial.min.assign(count, Value());
+    partial.max.assign(count, Value());
+    return partial;
+}
+
+TableStats TableStatsCollector::run(Database &db, ReadPool *pool) {
+    std::vector<std::string> columns = db.getTableColumns(table);
+    std::string list;
+    for (const auto &name : columns) {
+        list += (list.empty() ? "" : ", ") + Database::quoteIdentifier(name);
+    }
+    int64_t first = 0, last = -1;
+    bool ranged = db.rowidRange(table, first, last);
+    bool parallel = ranged && pool && pool->isOpen();
+    // частей больше, чем потоков: неровные диапазоны добираются кражей
+    auto ranges =
+        ReadPool::splitRange(first, last, parallel ? pool->size() * 4 : 1);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        names = std::move(columns);
+        select = std::move(list);
+        total = std::make_unique<Partial>(makePartial());
+        parts = parallel ? ranges.size() : 1;
+        partsDone = 0;
+        complete = finished = false;
+        start = std::chrono::steady_clock::now();
+    }
+    if (ranged)
+        progress.total = (uint64_t)(last - first + 1);
+
+    bool ok = true;
+    if (names.empty()) {
+        // таблицы нет - нечего считать
+    } else if (parallel) {
+        ok = pool->parallelFor(ranges.size(), [&](Database &reader,
+                                                  size_t part) {
+            scan(reader, "rowid BETWEEN ? AND ?",
+                 {Value::ofInteger(ranges[part].first),
+                  Value::ofInteger(ranges[part].second)});
+        });
+    } else {
+        scan(db, "", {});
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        complete = ok && !progress.cancelled;
+        finished = true;
+        end = std::chrono::steady_clock::now();
+    }
+    ++published;
+    return snapshot();
+}
+
+void TableStatsCollector::scan(Database &db, const std::string &where,
+                               const std::vector<Value> &params) {
+    size_t count = names.size();
+    std::string sql = "SELECT " + select + " FROM " +
+                      Database::quoteIdentifier(table);
+    if (!where.empty())
+        sql += " WHERE " + where;
+
+    Partial partial = makePartial();
+    uint64_t rows = 0;
+    db.stream(sql + ";", params, [&](sqlite3_stmt *stmt) {
+        for (size_t col = 0; col < count; ++col) {
+            int type = sqlite3_column_type(stmt, (int)col);
+            if (type == SQLITE_NULL) {
+                ++partial.nulls[col];
+                continue;
+            }
+
+            uint64_t hash = hashCell(stmt, (int)col, type);
+            partial.distinct[col].add(hash);
+            partial.top[col].add(hash, stmt, (int)col);
+            if (type == SQLITE_INTEGER || type == SQLITE_FLOAT)
+                partial.histograms[col].add(
+                    sqlite3_column_double(stmt, (int)col));
+
+            Value &min = partial.min[col];
+            Value &max = partial.max[col];
+            if (min.type == Value::Type::Null ||
+                compareCell(stmt, (int)col, type, min) < 0)
+                min = Value::fromColumn(stmt, (int)col);
+            if (max.type == Value::Type::Null ||
+                compareCell(stmt, (int)col, type, max) > 0)
+                max = Value::fromColumn(stmt, (int)col);
+        }
+
+        ++partial.rows;
+        if (++rows % 4096 == 0) {
+            progress.rows += 4096;
+            progress.done += 4096;
+            if (progress.cancelled)
+                return false;
+        }
+        if (partial.rows == PublishRows)
+            publish(partial);
+        return true;
+    });
+    progress.rows += rows % 4096;
+    progress.done += rows % 4096;
+    publish(partial);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ++partsDone;
+}
+
+// эскизы потока сливаются в общий итог и начинаются заново
+void TableStatsCollector::publish(Partial &partial) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Partial &into = *total;
+        into.rows += partial.rows;
+        for (size_t col = 0; col < names.size(); ++col) {
+            into.nulls[col] += partial.nulls[col];
+            into.distinct[col].merge(partial.distinct[col]);
+            into.histograms[col].merge(partial.histograms[col]);
+            into.top[col].merge(partial.top[col]);
+
+            const Value &min = partial.min[col];
+            const Value &max = partial.max[col];
+            if (min.type != Value::Type::Null &&
+                (into.min[col].type == Value::Type::Null ||
+                 min.compare(into.min[col]) < 0))
+                into.min[col] = min;
+            if (max.type != Value::Type::Null &&
+                (into.max[col].type == Value::Type::Null ||
+                 max.compare(into.max[col]) > 0))
+                into.max[col] = max;
+        }
+    }
+    partial = makePartial();
+    ++published;
+}
+
+TableStats TableStatsCollector::snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!total) {
+        TableStats stats;
+        stats.table = table;
+        return stats;
+    }
+
+    TableStats stats = build(*total);
+    stats.parts = parts;
+    stats.partsDone = partsDone;
+    stats.complete = complete;
+    stats.seconds =
+        std::chrono::duration<double>(
+            (finished ? end : std::chrono::steady_clock::now()) - start)
+            .count();
+    return stats;
+}
+
+uint64_t TableStatsCollector::version() const { return published.load(); }
+
+TableStats TableStatsCollector::build(const Partial &partial) const {
+    TableStats stats;
+    stats.table = table;
+    stats.rows = partial.rows;
+    for (size_t col = 0; col < names.size(); ++col) {
+        ColumnStats column;
+        column.name = names[col];
+        column.nulls = partial.nulls[col];
+        column.distinct = partial.distinct[col].estimate();
+        column.min = partial.min[col];
+        column.max = partial.max[col];
+        column.histogram = partial.histograms[col].uniform(
+            HistogramBuckets, column.histogramMin, column.histogramMax);
+        // значения, которые наверняка встречались один раз, - шум
+        // вытеснения, а не частые
+        for (auto &entry : partial.top[col].top(TopCount)) {
+            if (entry.count - entry.error >= 2)
+                column.top.emplace_back(std::move(entry.value), entry.count);
+        }
+        stats.columns.push_back(std::move(column));
+    }
+    return stats;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "read_pool.hpp"
+#include "result_set.hpp"
+#include "task_progress.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Оценка числа различных значений: HyperLogLog на 2^12 однобайтных
+// регистрах, погрешность около 1.6%. Слияние - поэлементный максимум.
+class HyperLogLog {
+    public:
+        static constexpr int Precision = 12;
+
+        HyperLogLog();
+
+        void add(uint64_t hash);
+        void merge(const HyperLogLog &other);
+        uint64_t estimate() const;
+
+    private:
+        std::vector<uint8_t> registers;
+};
+
+// Потоковая гистограмма (Ben-Haim, Tom-Tov): не больше MaxBins центров с
+// весами, при переполнении сливаются два ближайших. Значения копятся
+// пачкой, чтобы сжатие шло раз на Batch значений.
+class StreamingHistogram {
+    public:
+        static constexpr size_t MaxBins = 64;
+        static constexpr size_t Batch = 1024;
+
+        struct Bin {
+                double center;
+                uint64_t count;
+        };
+
+        void add(double value);
+        // сбрасывает пачки обеих гистограмм, поэтому other меняется
+        void merge(StreamingHistogram &other);
+        // Число значений в buckets равных интервалах [min, max]. Учитывает
+        // только сброшенные пачки: итог после merge() полон.
+        std::vector<float> uniform(size_t buckets, double &min,
+                                   double &max) const;
+
+    private:
+        void flush();
+        void compress();
+
+        std::vector<Bin> bins;
+        std::vector<double> pending;
+        double low = 0;
+        double high = 0;
+};
+
+// Частые значения (Filtered Space-Saving): Capacity счётчиков и фильтр
+// из FilterSize счётчиков по хэшу. Новое значение вытесняет самое редкое,
+// только когда его счётчик в фильтре догнал минимум, поэтому столбец из
+// уникальных значений не пересоздаёт записи на каждой строке.
+class TopValues {
+    public:
+        static constexpr size_t Capacity = 32;
+        static constexpr size_t FilterSize = 1024;
+        // длина хранимого текста, ключ сравнения - хэш полного значения
+        static constexpr size_t MaxText = 64;
+
+        struct Entry {
+                Value value;
+                // завышен не больше чем на error
+                uint64_t count;
+                uint64_t error;
+        };
+
+        TopValues();
+
+        void add(uint64_t hash, sqlite3_stmt *stmt, int col);
+        void merge(const TopValues &other);
+        // n самых частых по убыванию
+        std::vector<Entry> top(size_t n) const;
+
+    private:
+        void findRare();
+
+        // хэши отдельно от записей: поиск идёт по плотному массиву
+        std::vector<uint64_t> hashes;
+        std::vector<Entry> entries;
+        std::vector<uint64_t> filter;
+        size_t rare = 0;
+};
+
+struct ColumnStats {
+        std::string name;
+        uint64_t nulls = 0;
+        // оценка HyperLogLog
+        uint64_t distinct = 0;
+        // NULL, если в столбце нет значений
+        Value min;
+        Value max;
+        // числовые значения по равным интервалам [histogramMin, histogramMax]
+        std::vector<float> histogram;
+        double histogramMin = 0;
+        double histogramMax = 0;
+        std::vector<std::pair<Value, uint64_t>> top;
+};
+
+struct TableStats {
+        std::string table;
+        uint64_t rows = 0;
+        std::vector<ColumnStats> columns;
+        // на сколько диапазонов rowid разбит проход и сколько пройдено
+        size_t parts = 0;
+        size_t partsDone = 0;
+        double seconds = 0;
+        bool complete = false;
+};
+
+// Профиль столбцов за один проход по таблице. Таблица с rowid делится на
+// диапазоны, которые читаются параллельно соединениями ReadPool; без пула
+// или без rowid проход идёт на db. Каждый поток держит только свои
+// эскизы и каждые PublishRows строк сливает их в общий итог, поэтому
+// память не зависит от размера таблицы, а snapshot() виден по ходу.
+class TableStatsCollector {
+    public:
+        static constexpr uint64_t PublishRows = 65536;
+        static constexpr size_t HistogramBuckets = 32;
+        static constexpr size_t TopCount = 10;
+
+        TableStatsCollector(std::string table, TaskProgress &progress);
+        ~TableStatsCollector();
+
+        TableStats run(Database &db, ReadPool *pool);
+        // промежуточный итог из любого потока
+        TableStats snapshot() const;
+        // растёт при каждом слиянии; по нему интерфейс решает, обновлять ли
+        uint64_t version() const;
+
+    private:
+        struct Partial;
+
+        void scan(Database &db, const std::string &where,
+                  const std::vector<Value> &params);
+        void publish(Partial &partial);
+        TableStats build(const Partial &partial) const;
+        Partial makePartial() const;
+
+        std::string table;
+        TaskProgress &progress;
+        std::vector<std::string> names;
+        std::string select;
+
+        mutable std::mutex mutex;
+        std::unique_ptr<Partial> total;
+        size_t parts = 0;
+        size_t partsDone = 0;
+        bool complete = false;
+        bool finished = false;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point end;
+        std::atomic<uint64_t> published{0};
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// Ход длительной фоновой операции (импорт, экспорт). Счётчики читаются
+// потоком интерфейса каждый кадр без блокировок.
+class TaskProgress {
+    public:
+        std::atomic<uint64_t> done{0};
+        std::atomic<uint64_t> total{0};
+        std::atomic<uint64_t> rows{0};
+        std::atomic<bool> running{false};
+        std::atomic<bool> cancelled{false};
+
+        void start(uint64_t totalUnits) {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = 0;
+            total = totalUnits;
+            rows = 0;
+            cancelled = false;
+            error.clear();
+            startedAt = finishedAt = std::chrono::steady_clock::now();
+            running = true;
+        }
+
+        void finish() {
+            std::lock_guard<std::mutex> lock(mutex);
+            finishedAt = std::chrono::steady_clock::now();
+            running = false;
+        }
+
+        float fraction() const {
+            uint64_t t = total.load();
+            return t ? (float)((double)done.load() / (double)t) : 0.0f;
+        }
+
+        double seconds() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto end =
+                running ? std::chrono::steady_clock::now() : finishedAt;
+            return std::chrono::duration<double>(end - startedAt).count();
+        }
+
+        double rowsPerSecond() const {
+            double s = seconds();
+            return s > 0.0 ? (double)rows.load() / s : 0.0;
+        }
+
+        void setError(const std::string &message) {
+            std::lock_guard<std::mutex> lock(mutex);
+            error = message;
+        }
+
+        std::string getError() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return error;
+        }
+
+    private:
+        mutable std::mutex mutex;
+        std::chrono::steady_clock::time_point startedAt;
+        std::chrono::steady_clock::time_point finishedAt;
+        std::string error;
+};